@@ -343,6 +343,7 @@ void Config::addPack(const std::string& name,
     RecursiveLock wlock(config_schedule_mutex_);
     try {
       schedule_->add(std::make_unique<Pack>(pack_name, source, pack_obj));
+      schedule_generation_++;
       if (schedule_->last()->shouldPackExecute()) {
         applyParsers(source + FLAGS_pack_delimiter + pack_name, pack_obj, true);
       }
@@ -373,6 +374,7 @@ void Config::setStartTime(size_t st) {
 
 void Config::removePack(const std::string& pack) {
   RecursiveLock wlock(config_schedule_mutex_);
+  schedule_generation_++;
   return schedule_->remove(pack);
 }
 
@@ -414,6 +416,23 @@ static inline bool blacklistExpired(size_t blt, const ScheduledQuery& query) {
   return false;
 }
 
+bool Config::isQueryBlacklisted(const std::string& name,
+                                const ScheduledQuery& query) const {
+  RecursiveLock lock(config_schedule_mutex_);
+  auto blacklisted_query = schedule_->blacklist_.find(name);
+  if (blacklisted_query == schedule_->blacklist_.end()) {
+    return false;
+  }
+
+  if (blacklistExpired(blacklisted_query->second, query)) {
+    // The blacklisted query passed the expiration time (remove).
+    schedule_->blacklist_.erase(blacklisted_query);
+    saveScheduleBlacklist(schedule_->blacklist_);
+    return false;
+  }
+  return true;
+}
+
 void Config::scheduledQueries(
     std::function<void(std::string name, const ScheduledQuery& query)>
         predicate,
@@ -429,21 +448,10 @@ void Config::scheduledQueries(
       }
 
       // They query may have failed and been added to the schedule's blacklist.
-      auto blacklisted_query = schedule_->blacklist_.find(name);
-      if (blacklisted_query != schedule_->blacklist_.end()) {
-        if (blacklistExpired(blacklisted_query->second, it.second)) {
-          // The blacklisted query passed the expiration time (remove).
-          schedule_->blacklist_.erase(blacklisted_query);
-          saveScheduleBlacklist(schedule_->blacklist_);
-          it.second.blacklisted = false;
-        } else {
-          // The query is still blacklisted.
-          it.second.blacklisted = true;
-          if (!blacklisted) {
-            // The caller does not want blacklisted queries.
-            continue;
-          }
-        }
+      it.second.blacklisted = isQueryBlacklisted(name, it.second);
+      if (it.second.blacklisted && !blacklisted) {
+        // The caller does not want blacklisted queries.
+        continue;
       }
 
       // Call the predicate.
@@ -618,6 +626,7 @@ Status Config::updateSource(const std::string& source,
     RecursiveLock lock(config_schedule_mutex_);
     // Remove all packs from this source.
     schedule_->removeAll(source);
+    schedule_generation_++;
     // Remove all files from this source.
     removeFiles(source);
   }
@@ -875,6 +884,7 @@ void Config::reset() {
   setStartTime(getUnixTime());
 
   schedule_ = std::make_unique<Schedule>();
+  schedule_generation_++;
   std::map<std::string, QueryPerformance>().swap(performance_);
   std::map<std::string, FileCategories>().swap(files_);
   std::map<std::string, std::string>().swap(hash_);
@@ -967,6 +977,16 @@ void Config::recordQueryStart(const std::string& name) {
       kPersistentSettings, "timestamp." + name, std::to_string(getUnixTime()));
 }
 
+void Config::recordQueryPlacement(const std::string& name, size_t offset) {
+  RecursiveLock lock(config_performance_mutex_);
+  performance_[name].placement = offset;
+}
+
+void Config::recordQueryDeferral(const std::string& name) {
+  RecursiveLock lock(config_performance_mutex_);
+  performance_[name].deferrals += 1;
+}
+
 void Config::getPerformanceStats(
     const std::string& name,
     std::function<void(const QueryPerformance& query)> predicate) const {
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <map>
 #include <memory>
@@ -107,6 +108,21 @@ class Config : private boost::noncopyable {
    */
   void recordQueryStart(const std::string& name);
 
+  /**
+   * @brief Record the scheduler's placement of a query within its interval.
+   *
+   * @param name The unique name of the scheduled item
+   * @param offset Seconds the query executions are offset within the interval
+   */
+  void recordQueryPlacement(const std::string& name, size_t offset);
+
+  /**
+   * @brief Record that the scheduler deferred a due query.
+   *
+   * @param name The unique name of the scheduled item
+   */
+  void recordQueryDeferral(const std::string& name);
+
   /**
    * @brief Calculate the hash of the osquery config
    *
@@ -190,6 +206,26 @@ class Config : private boost::noncopyable {
           predicate,
       bool blacklisted = false) const;
 
+  /**
+   * @brief Check, and possibly expire, a scheduled query's blacklist entry.
+   *
+   * @param name The unique (synthetic) name of the scheduled query.
+   * @param query The scheduled query and its options.
+   * @return true if the query is still blacklisted and should not execute.
+   */
+  bool isQueryBlacklisted(const std::string& name,
+                          const ScheduledQuery& query) const;
+
+  /**
+   * @brief A counter that changes whenever the set of scheduled queries does.
+   *
+   * Consumers that precompute state from Config::scheduledQueries, such as
+   * the scheduler's queue, compare this value to know when to rebuild.
+   */
+  size_t getScheduleGeneration() const {
+    return schedule_generation_;
+  }
+
   /**
    * @brief Map a function across the set of configured files
    *
@@ -327,6 +363,9 @@ class Config : private boost::noncopyable {
   /// Schedule of packs and their queries.
   std::unique_ptr<Schedule> schedule_;
 
+  /// Incremented each time packs are added, removed, or the schedule reset.
+  std::atomic<size_t> schedule_generation_{0};
+
   /// A set of performance stats for each query in the schedule.
   std::map<std::string, QueryPerformance> performance_;
 
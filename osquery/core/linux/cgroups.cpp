@@ -0,0 +1,246 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <osquery/core/linux/cgroups.h>
+#include <osquery/logger.h>
+#include <osquery/utils/conversions/split.h>
+#include <osquery/utils/conversions/tryto.h>
+
+namespace osquery {
+
+/// Mount point of the unified cgroup v2 hierarchy.
+const std::string kCgroupMount{"/sys/fs/cgroup"};
+
+/// Leaf holding the watcher, so its parent may enable controllers.
+const std::string kWatcherLeaf{"watcher"};
+
+/// Control files are small, a single read returns all of them.
+/// The trailing newline is removed.
+static Status readControlFile(const std::string& path, std::string& content) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return Status::failure("Cannot open " + path + ": " + strerror(errno));
+  }
+
+  char buffer[4096];
+  auto bytes = ::read(fd, buffer, sizeof(buffer));
+  ::close(fd);
+  if (bytes < 0) {
+    return Status::failure("Cannot read " + path + ": " + strerror(errno));
+  }
+  content.assign(buffer, static_cast<size_t>(bytes));
+  while (!content.empty() && content.back() == '\n') {
+    content.pop_back();
+  }
+  return Status::success();
+}
+
+/// The kernel parses each write to a control file separately.
+static Status writeControlFile(const std::string& path,
+                               const std::string& content) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return Status::failure("Cannot open " + path + ": " + strerror(errno));
+  }
+
+  auto bytes = ::write(fd, content.data(), content.size());
+  auto error = errno;
+  ::close(fd);
+  if (bytes != static_cast<ssize_t>(content.size())) {
+    return Status::failure("Cannot write " + path + ": " + strerror(error));
+  }
+  return Status::success();
+}
+
+/// Format a limit, using "max" when unlimited.
+static std::string formatLimit(int64_t value) {
+  return (value < 0) ? "max" : std::to_string(value);
+}
+
+/// Parse a limit, "max" is unlimited.
+static int64_t parseLimit(const std::string& value) {
+  if (value.empty() || value.compare(0, 3, "max") == 0) {
+    return kCgroupUnlimited;
+  }
+  return tryTo<int64_t>(value).takeOr(kCgroupUnlimited);
+}
+
+std::map<std::string, uint64_t> parseCgroupKeyValues(
+    const std::string& content) {
+  std::map<std::string, uint64_t> values;
+  for (const auto& line : split(content, "\n")) {
+    auto fields = split(line, " ");
+    if (fields.size() == 2) {
+      values[fields[0]] = tryTo<uint64_t>(fields[1]).takeOr(uint64_t{0});
+    }
+  }
+  return values;
+}
+
+Status readCgroupLimits(const std::string& path, CgroupLimits& limits) {
+  std::string content;
+  auto s = readControlFile(path + "/cpu.max", content);
+  if (s.ok()) {
+    auto fields = split(content, " ");
+    if (fields.size() == 2) {
+      limits.cpu_quota = parseLimit(fields[0]);
+      limits.cpu_period = parseLimit(fields[1]);
+    }
+  }
+
+  if (readControlFile(path + "/memory.high", content).ok()) {
+    limits.memory_high = parseLimit(content);
+  }
+  if (readControlFile(path + "/memory.max", content).ok()) {
+    limits.memory_max = parseLimit(content);
+  }
+  return s;
+}
+
+Status readCgroupStats(const std::string& path, CgroupStats& stats) {
+  std::string content;
+  if (readControlFile(path + "/memory.current", content).ok()) {
+    stats.memory_current = tryTo<uint64_t>(content).takeOr(uint64_t{0});
+  }
+
+  if (readControlFile(path + "/memory.events", content).ok()) {
+    auto events = parseCgroupKeyValues(content);
+    stats.memory_high_events = events["high"];
+    stats.memory_max_events = events["max"];
+    stats.oom_kills = events["oom_kill"];
+  }
+
+  auto s = readControlFile(path + "/cpu.stat", content);
+  if (s.ok()) {
+    auto cpu = parseCgroupKeyValues(content);
+    stats.cpu_usage = cpu["usage_usec"];
+    stats.throttled_periods = cpu["nr_throttled"];
+    stats.throttled_time = cpu["throttled_usec"];
+  }
+  return s;
+}
+
+Status getProcessCgroup(pid_t pid, std::string& path) {
+  std::string content;
+  auto s = readControlFile("/proc/" + std::to_string(pid) + "/cgroup", content);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // The unified hierarchy is the entry with hierarchy ID 0 and no controllers.
+  for (const auto& line : split(content, "\n")) {
+    if (boost::starts_with(line, "0::")) {
+      path = kCgroupMount + line.substr(3);
+      return Status::success();
+    }
+  }
+  return Status::failure("Process is not in a cgroup v2 hierarchy");
+}
+
+Status WatcherCgroups::setUp(const std::string& root) {
+  std::string delegated = root;
+  if (delegated.empty()) {
+    auto s = getProcessCgroup(::getpid(), delegated);
+    if (!s.ok()) {
+      return s;
+    }
+
+    // A restarted watcher may already be in its leaf.
+    auto leaf = "/" + kWatcherLeaf;
+    if (boost::ends_with(delegated, leaf)) {
+      delegated.resize(delegated.size() - leaf.size());
+    }
+  }
+
+  std::string controllers;
+  auto s = readControlFile(delegated + "/cgroup.controllers", controllers);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Controllers are listed by name, "cpu" is not "cpuset".
+  auto names = split(controllers, " \t\n");
+  auto has = [&names](const std::string& name) {
+    return std::find(names.begin(), names.end(), name) != names.end();
+  };
+  if (!has("cpu") || !has("memory")) {
+    return Status::failure("The cpu and memory controllers are not delegated");
+  }
+
+  root_ = delegated;
+  s = attach(kWatcherLeaf, ::getpid());
+  if (s.ok()) {
+    s = writeControlFile(delegated + "/cgroup.subtree_control",
+                         "+cpu +memory");
+  }
+
+  if (!s.ok()) {
+    root_.clear();
+    return s;
+  }
+  return Status::success();
+}
+
+std::string WatcherCgroups::path(const std::string& name) const {
+  return root_ + "/" + name;
+}
+
+Status WatcherCgroups::attach(const std::string& name, pid_t pid) {
+  if (!active()) {
+    return Status::failure("Watcher cgroups are not set up");
+  }
+
+  auto leaf = path(name);
+  if (::mkdir(leaf.c_str(), 0755) != 0 && errno != EEXIST) {
+    return Status::failure("Cannot create " + leaf + ": " + strerror(errno));
+  }
+  return writeControlFile(leaf + "/cgroup.procs", std::to_string(pid));
+}
+
+Status WatcherCgroups::limit(const std::string& name,
+                             const CgroupLimits& limits) {
+  if (!active()) {
+    return Status::failure("Watcher cgroups are not set up");
+  }
+
+  auto leaf = path(name);
+  auto s = writeControlFile(leaf + "/cpu.max",
+                            formatLimit(limits.cpu_quota) + " " +
+                                std::to_string(limits.cpu_period));
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Usage above memory.high is throttled, only memory.max invokes the OOM
+  // killer.
+  s = writeControlFile(leaf + "/memory.high", formatLimit(limits.memory_high));
+  if (!s.ok()) {
+    return s;
+  }
+  return writeControlFile(leaf + "/memory.max", formatLimit(limits.memory_max));
+}
+
+Status WatcherCgroups::stats(const std::string& name,
+                             CgroupStats& stats) const {
+  if (!active()) {
+    return Status::failure("Watcher cgroups are not set up");
+  }
+  return readCgroupStats(path(name), stats);
+}
+
+} // namespace osquery
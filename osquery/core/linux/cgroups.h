@@ -0,0 +1,118 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <sys/types.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <osquery/utils/status/status.h>
+
+namespace osquery {
+
+/// Value used for cgroup limits that are set to "max".
+const int64_t kCgroupUnlimited = -1;
+
+/// Limits applied to a single cgroup v2 directory.
+struct CgroupLimits {
+  /// memory.high in bytes, allocations above it are throttled and reclaimed.
+  int64_t memory_high{kCgroupUnlimited};
+
+  /// memory.max in bytes, allocations above it invoke the OOM killer.
+  int64_t memory_max{kCgroupUnlimited};
+
+  /// cpu.max quota in microseconds per period.
+  int64_t cpu_quota{kCgroupUnlimited};
+
+  /// cpu.max period in microseconds.
+  int64_t cpu_period{100000};
+};
+
+/// Pressure counters read from a single cgroup v2 directory.
+struct CgroupStats {
+  /// memory.current in bytes.
+  uint64_t memory_current{0};
+
+  /// memory.events: times memory.high was exceeded and the group throttled.
+  uint64_t memory_high_events{0};
+
+  /// memory.events: times memory.max was reached.
+  uint64_t memory_max_events{0};
+
+  /// memory.events: processes killed by the OOM killer.
+  uint64_t oom_kills{0};
+
+  /// cpu.stat: total CPU time in microseconds.
+  uint64_t cpu_usage{0};
+
+  /// cpu.stat: periods in which the group was throttled.
+  uint64_t throttled_periods{0};
+
+  /// cpu.stat: total time throttled in microseconds.
+  uint64_t throttled_time{0};
+};
+
+/// Parse the "key value" lines of files such as memory.events and cpu.stat.
+std::map<std::string, uint64_t> parseCgroupKeyValues(
+    const std::string& content);
+
+/// Read the cpu.max, memory.high and memory.max limits of a cgroup.
+Status readCgroupLimits(const std::string& path, CgroupLimits& limits);
+
+/// Read the memory.current, memory.events and cpu.stat counters of a cgroup.
+Status readCgroupStats(const std::string& path, CgroupStats& stats);
+
+/// Get the cgroup v2 directory of a process, from /proc/<pid>/cgroup.
+Status getProcessCgroup(pid_t pid, std::string& path);
+
+/**
+ * @brief A delegated cgroup v2 subtree used by the watcher.
+ *
+ * The watcher's own cgroup, for example the one systemd creates for a service
+ * with Delegate=yes, becomes the root of the subtree. cgroup v2 only allows
+ * controllers to be enabled for children of a group that has no processes,
+ * so the watcher first moves itself into a "watcher" leaf. The worker and
+ * each extension are then moved into their own leaves, where limits apply.
+ */
+class WatcherCgroups : private boost::noncopyable {
+ public:
+  /**
+   * @brief Prepare the subtree and enable the cpu and memory controllers.
+   *
+   * @param root the delegated directory, empty to use the watcher's cgroup.
+   */
+  Status setUp(const std::string& root);
+
+  /// True once the subtree was set up.
+  bool active() const {
+    return !root_.empty();
+  }
+
+  /// Move a process into the leaf called name, creating it if needed.
+  Status attach(const std::string& name, pid_t pid);
+
+  /// Apply limits to the leaf called name.
+  Status limit(const std::string& name, const CgroupLimits& limits);
+
+  /// Read the pressure counters of the leaf called name.
+  Status stats(const std::string& name, CgroupStats& stats) const;
+
+  /// Path to the leaf called name.
+  std::string path(const std::string& name) const;
+
+ private:
+  /// The delegated directory, empty until set up.
+  std::string root_;
+};
+
+} // namespace osquery
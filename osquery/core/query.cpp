@@ -15,6 +15,7 @@
 #include <osquery/logger.h>
 #include <osquery/query.h>
 
+#include <osquery/utils/conversions/castvariant.h>
 #include <osquery/utils/json/json.h>
 
 namespace rj = rapidjson;
@@ -319,20 +320,134 @@ Status serializeQueryLogItemJSON(const QueryLogItem& item, std::string& json) {
   return doc.toString(json);
 }
 
+/// Writes column values as serializeRow adds them to a document.
+class ColumnWriterVisitor : public boost::static_visitor<> {
+ public:
+  ColumnWriterVisitor(rj::Writer<rj::StringBuffer>& writer, bool as_numeric)
+      : writer_(writer), as_numeric_(as_numeric) {}
+
+  void operator()(const long long& i) const {
+    if (as_numeric_) {
+      writer_.Int64(i);
+    } else {
+      writeString(castVariant(i));
+    }
+  }
+
+  void operator()(const double& d) const {
+    if (as_numeric_) {
+      writer_.Double(d);
+    } else {
+      writeString(castVariant(d));
+    }
+  }
+
+  void operator()(const std::string& str) const {
+    writeString(str);
+  }
+
+ private:
+  void writeString(const std::string& str) const {
+    writer_.String(str.c_str(), static_cast<rj::SizeType>(str.size()));
+  }
+
+ private:
+  rj::Writer<rj::StringBuffer>& writer_;
+  bool as_numeric_;
+};
+
+/**
+ * @brief Render the fields shared by each event of a log item.
+ *
+ * The prefix is the legacy fields and decorations followed by the "columns"
+ * key, a row's columns and the action suffix complete an event.
+ */
+static Status getEventPrefix(const QueryLogItem& item, std::string& prefix) {
+  auto doc = JSON::newObject();
+  addLegacyFieldsAndDecorations(item, doc, doc.doc());
+  auto status = doc.toString(prefix);
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Reopen the object.
+  if (prefix.empty() || prefix.back() != '}') {
+    return Status(1, "Cannot render the event fields");
+  }
+  prefix.pop_back();
+  prefix += ",\"columns\":";
+  return Status::success();
+}
+
+/// Append an event for each row, writing columns into a reused buffer.
+static void appendEvents(const QueryDataTyped& rows,
+                         const std::string& prefix,
+                         const std::string& action,
+                         std::vector<std::string>& items) {
+  auto suffix = ",\"action\":\"" + action + "\"}";
+  rj::StringBuffer sb;
+  rj::Writer<rj::StringBuffer> writer(sb);
+  ColumnWriterVisitor visitor(writer, FLAGS_log_numerics_as_numbers);
+
+  items.reserve(items.size() + rows.size());
+  for (const auto& row : rows) {
+    sb.Clear();
+    writer.Reset(sb);
+    writer.StartObject();
+    for (const auto& column : row) {
+      writer.Key(column.first.c_str(),
+                 static_cast<rj::SizeType>(column.first.size()));
+      boost::apply_visitor(visitor, column.second);
+    }
+    writer.EndObject();
+
+    std::string event;
+    event.reserve(prefix.size() + sb.GetSize() + suffix.size());
+    event.append(prefix);
+    event.append(sb.GetString(), sb.GetSize());
+    event.append(suffix);
+    items.push_back(std::move(event));
+  }
+}
+
 Status serializeQueryLogItemAsEventsJSON(const QueryLogItem& item,
                                          std::vector<std::string>& items) {
-  auto doc = JSON::newArray();
-  auto status = serializeQueryLogItemAsEvents(item, doc);
+  bool has_diff = !item.results.added.empty() || !item.results.removed.empty();
+  if (!has_diff && item.snapshot_results.empty()) {
+    // This error case may also be represented in serializeQueryLogItem.
+    return Status(1, "No differential or snapshot results");
+  }
+
+  // Top-level decorations named like the event fields replace them.
+  if (FLAGS_decorations_top_level && (item.decorations.count("columns") > 0 ||
+                                      item.decorations.count("action") > 0)) {
+    auto doc = JSON::newArray();
+    auto status = serializeQueryLogItemAsEvents(item, doc);
+    if (!status.ok()) {
+      return status;
+    }
+
+    for (auto& event : doc.doc().GetArray()) {
+      rj::StringBuffer sb;
+      rj::Writer<rj::StringBuffer> writer(sb);
+      event.Accept(writer);
+      items.push_back(sb.GetString());
+    }
+    return Status::success();
+  }
+
+  // The fields and decorations are rendered once for all events.
+  std::string prefix;
+  auto status = getEventPrefix(item, prefix);
   if (!status.ok()) {
     return status;
   }
 
-  // return doc.toString()
-  for (auto& event : doc.doc().GetArray()) {
-    rj::StringBuffer sb;
-    rj::Writer<rj::StringBuffer> writer(sb);
-    event.Accept(writer);
-    items.push_back(sb.GetString());
+  if (has_diff) {
+    appendEvents(item.results.removed, prefix, "removed", items);
+    appendEvents(item.results.added, prefix, "added", items);
+  } else {
+    appendEvents(item.snapshot_results, prefix, "snapshot", items);
   }
   return Status::success();
 }
@@ -33,6 +33,12 @@ struct QueryPerformance {
 
   /// Average memory differentials. This should be near 0.
   unsigned long long int average_memory{0};
+
+  /// Seconds the scheduler offsets the query within its interval.
+  size_t placement{0};
+
+  /// Number of times the scheduler deferred the query due to cost or load.
+  size_t deferrals{0};
 };
 
 } // namespace osquery
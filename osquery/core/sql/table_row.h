@@ -39,12 +39,19 @@ class TableRow {
    */
   virtual int get_column(sqlite3_context* ctx,
                          sqlite3_vtab* pVtab,
-                         int col) = 0;
+                         int col) const = 0;
   /**
    * Serialize this row as key,value pairs into the given JSON object.
    */
   virtual Status serialize(JSON& doc, rapidjson::Value& obj) const = 0;
 
+  /**
+   * Approximate the bytes of memory used by this row.
+   */
+  virtual size_t memory_size() const {
+    return sizeof(*this);
+  }
+
   /**
    * Clone this row.
    */
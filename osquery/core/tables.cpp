@@ -6,6 +6,10 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
 #include <osquery/utils/json/json.h>
 
 #include <osquery/database.h>
@@ -403,18 +407,62 @@ bool ConstraintList::matches(const std::string& expr) const {
   return false;
 }
 
+/// The literal content of a LIKE or GLOB pattern before its first wildcard.
+static std::string patternPrefix(unsigned char op, const std::string& pattern) {
+  auto wildcards = (op == LIKE) ? "%_" : "*?[";
+  return pattern.substr(0, pattern.find_first_of(wildcards));
+}
+
+/// Check if an expression starts with a pattern's literal prefix.
+static bool prefixMatches(unsigned char op,
+                          const std::string& pattern,
+                          const std::string& expr) {
+  auto prefix = patternPrefix(op, pattern);
+  if (expr.size() < prefix.size()) {
+    return false;
+  }
+
+  if (op == GLOB) {
+    return expr.compare(0, prefix.size(), prefix) == 0;
+  }
+  // SQLite's LIKE is case-insensitive for ASCII characters.
+  return std::equal(
+      prefix.begin(), prefix.end(), expr.begin(), [](char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) ==
+               std::tolower(static_cast<unsigned char>(b));
+      });
+}
+
 template <typename T>
 bool ConstraintList::literal_matches(const T& base_expr) const {
   bool aggregate = true;
+  // Equalities are the members of an IN list, any one of them may match.
+  bool has_equals = false;
+  bool equals_match = false;
   for (size_t i = 0; i < constraints_.size(); ++i) {
+    if (constraints_[i].op == LIKE || constraints_[i].op == GLOB) {
+      // Patterns are checked by their literal prefix, SQLite will complete
+      // the match on the generated rows.
+      if (!prefixMatches(
+              constraints_[i].op, constraints_[i].expr, SQL_TEXT(base_expr))) {
+        return false;
+      }
+      continue;
+    }
+
     auto constraint_expr = tryTo<T>(constraints_[i].expr);
+    if (constraints_[i].op == EQUALS) {
+      has_equals = true;
+      if (constraint_expr && base_expr == constraint_expr.take()) {
+        equals_match = true;
+      }
+      continue;
+    }
     if (!constraint_expr) {
       // Cannot cast input constraint to column type.
       return false;
     }
-    if (constraints_[i].op == EQUALS) {
-      aggregate = aggregate && (base_expr == constraint_expr.take());
-    } else if (constraints_[i].op == GREATER_THAN) {
+    if (constraints_[i].op == GREATER_THAN) {
       aggregate = aggregate && (base_expr > constraint_expr.take());
     } else if (constraints_[i].op == LESS_THAN) {
       aggregate = aggregate && (base_expr < constraint_expr.take());
@@ -424,14 +472,14 @@ bool ConstraintList::literal_matches(const T& base_expr) const {
       aggregate = aggregate && (base_expr <= constraint_expr.take());
     } else {
       // Unsupported constraint. Should match every thing.
-      return true;
+      continue;
     }
     if (!aggregate) {
       // Speed up comparison.
       return false;
     }
   }
-  return true;
+  return !has_equals || equals_match;
 }
 
 std::set<std::string> ConstraintList::getAll(ConstraintOperator op) const {
@@ -446,9 +494,12 @@ std::set<std::string> ConstraintList::getAll(ConstraintOperator op) const {
 }
 
 template <typename T>
-std::set<T> ConstraintList::getAll(ConstraintOperator /* op */) const {
+std::set<T> ConstraintList::getAll(ConstraintOperator op) const {
   std::set<T> cs;
   for (const auto& item : constraints_) {
+    if (item.op != op) {
+      continue;
+    }
     auto exp = tryTo<T>(item.expr);
     if (exp) {
       cs.insert(exp.take());
@@ -474,6 +525,71 @@ template std::set<long long> ConstraintList::getAll<long long>(
 template std::set<unsigned long long>
     ConstraintList::getAll<unsigned long long>(ConstraintOperator) const;
 
+template <typename T>
+bool ConstraintList::getRange(T& lower, T& upper) const {
+  bool equals = false;
+  T equals_lower = std::numeric_limits<T>::max();
+  T equals_upper = std::numeric_limits<T>::min();
+  for (const auto& constraint : constraints_) {
+    // Only integral expressions narrow the range, a REAL comparison like
+    // 'x < 1.5' would be truncated by the conversion.
+    const auto& expr = constraint.expr;
+    if (expr.empty() ||
+        expr.find_first_not_of("0123456789", (expr[0] == '-') ? 1 : 0) !=
+            std::string::npos) {
+      continue;
+    }
+
+    auto value_exp = tryTo<T>(expr);
+    if (!value_exp) {
+      continue;
+    }
+
+    auto value = value_exp.take();
+    if (constraint.op == EQUALS) {
+      equals = true;
+      equals_lower = std::min(equals_lower, value);
+      equals_upper = std::max(equals_upper, value);
+    } else if (constraint.op == GREATER_THAN) {
+      if (value == std::numeric_limits<T>::max()) {
+        return false;
+      }
+      lower = std::max(lower, static_cast<T>(value + 1));
+    } else if (constraint.op == GREATER_THAN_OR_EQUALS) {
+      lower = std::max(lower, value);
+    } else if (constraint.op == LESS_THAN) {
+      if (value == std::numeric_limits<T>::min()) {
+        return false;
+      }
+      upper = std::min(upper, static_cast<T>(value - 1));
+    } else if (constraint.op == LESS_THAN_OR_EQUALS) {
+      upper = std::min(upper, value);
+    }
+  }
+
+  if (equals) {
+    lower = std::max(lower, equals_lower);
+    upper = std::min(upper, equals_upper);
+  }
+  return lower <= upper;
+}
+
+/// Explicit getRange for INTEGER.
+template bool ConstraintList::getRange<int>(int&, int&) const;
+
+/// Explicit getRange for BIGINT.
+template bool ConstraintList::getRange<long long>(long long&, long long&) const;
+
+std::set<std::string> ConstraintList::getPrefixes(ConstraintOperator op) const {
+  std::set<std::string> prefixes;
+  for (const auto& constraint : constraints_) {
+    if (constraint.op == op && (op == LIKE || op == GLOB)) {
+      prefixes.insert(patternPrefix(op, constraint.expr));
+    }
+  }
+  return prefixes;
+}
+
 void ConstraintList::serialize(JSON& doc, rapidjson::Value& obj) const {
   auto expressions = doc.getArray();
   for (const auto& constraint : constraints_) {
@@ -23,6 +23,8 @@ namespace osquery {
 
 DECLARE_bool(disable_database);
 DECLARE_bool(log_numerics_as_numbers);
+DECLARE_bool(decorations_top_level);
+
 class QueryTests : public testing::Test {
  public:
   QueryTests() {
@@ -155,4 +157,70 @@ TEST_F(QueryTests, test_get_stored_query_names) {
   auto in_vector = std::find(names.begin(), names.end(), "foobar");
   EXPECT_NE(in_vector, names.end());
 }
+
+/// Serialize events through the JSON document, as they were before.
+static std::vector<std::string> getDocumentEvents(const QueryLogItem& item) {
+  auto doc = JSON::newArray();
+  EXPECT_TRUE(serializeQueryLogItemAsEvents(item, doc).ok());
+
+  std::vector<std::string> events;
+  for (auto& event : doc.doc().GetArray()) {
+    rapidjson::StringBuffer sb;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+    event.Accept(writer);
+    events.push_back(sb.GetString());
+  }
+  return events;
+}
+
+TEST_F(QueryTests, test_serialize_events) {
+  QueryLogItem item;
+  item.name = "foobar";
+  item.identifier = "host\"name";
+  item.calendar_time = "Mon Jan  1 00:00:00 2018 UTC";
+  item.time = 1514764800;
+  item.epoch = 2;
+  item.counter = 3;
+  item.decorations["version"] = "4.0.0";
+  item.results.added = {
+      {{"int", 1LL}, {"double", 2.0}, {"text", std::string("a\nb")}},
+      {{"text", std::string("second")}}};
+  item.results.removed = {{{"int", -1LL}}};
+
+  auto numerics = FLAGS_log_numerics_as_numbers;
+  auto top_level = FLAGS_decorations_top_level;
+  for (auto as_numbers : {false, true}) {
+    for (auto decorations_top_level : {false, true}) {
+      FLAGS_log_numerics_as_numbers = as_numbers;
+      FLAGS_decorations_top_level = decorations_top_level;
+
+      std::vector<std::string> events;
+      ASSERT_TRUE(serializeQueryLogItemAsEventsJSON(item, events).ok());
+      EXPECT_EQ(getDocumentEvents(item), events);
+      ASSERT_EQ(3U, events.size());
+      EXPECT_NE(std::string::npos, events[0].find("\"action\":\"removed\""));
+    }
+  }
+
+  // Snapshots use the "snapshot" action.
+  QueryLogItem snapshot = item;
+  snapshot.results = DiffResults();
+  snapshot.snapshot_results = item.results.added;
+  std::vector<std::string> events;
+  ASSERT_TRUE(serializeQueryLogItemAsEventsJSON(snapshot, events).ok());
+  EXPECT_EQ(getDocumentEvents(snapshot), events);
+
+  // A top-level decoration may replace an event field.
+  FLAGS_decorations_top_level = true;
+  snapshot.decorations["action"] = "decorated";
+  events.clear();
+  ASSERT_TRUE(serializeQueryLogItemAsEventsJSON(snapshot, events).ok());
+  EXPECT_EQ(getDocumentEvents(snapshot), events);
+
+  events.clear();
+  EXPECT_FALSE(serializeQueryLogItemAsEventsJSON(QueryLogItem(), events).ok());
+
+  FLAGS_log_numerics_as_numbers = numerics;
+  FLAGS_decorations_top_level = top_level;
+}
 }
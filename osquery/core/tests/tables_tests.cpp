@@ -117,6 +117,88 @@ TEST_F(TablesTests, test_constraint_matching) {
 
   EXPECT_FALSE(cl3.matches(0));
   EXPECT_TRUE(cl3.matches(1));
+
+  // The members of an IN list match any one of them, within other bounds.
+  struct ConstraintList cl4;
+  cl4.affinity = INTEGER_TYPE;
+  cl4.add(Constraint(EQUALS, "2"));
+  cl4.add(Constraint(EQUALS, "5"));
+  cl4.add(Constraint(EQUALS, "8"));
+  cl4.add(Constraint(LESS_THAN, "6"));
+  EXPECT_TRUE(cl4.matches(2));
+  EXPECT_TRUE(cl4.matches(5));
+  EXPECT_FALSE(cl4.matches(3));
+  EXPECT_FALSE(cl4.matches(8));
+}
+
+TEST_F(TablesTests, test_constraint_range) {
+  struct ConstraintList cl;
+  cl.affinity = BIGINT_TYPE;
+
+  // Without constraints the range is unchanged.
+  long long lower = 0;
+  long long upper = 100;
+  EXPECT_TRUE(cl.getRange(lower, upper));
+  EXPECT_EQ(0, lower);
+  EXPECT_EQ(100, upper);
+
+  // Exclusive bounds are made inclusive, and the narrowest bound is kept.
+  cl.add(Constraint(GREATER_THAN, "10"));
+  cl.add(Constraint(GREATER_THAN_OR_EQUALS, "5"));
+  cl.add(Constraint(LESS_THAN, "50"));
+  EXPECT_TRUE(cl.getRange(lower, upper));
+  EXPECT_EQ(11, lower);
+  EXPECT_EQ(49, upper);
+
+  // Comparisons only return the EQUALS expressions when asked.
+  EXPECT_TRUE(cl.getAll<long long>(EQUALS).empty());
+  EXPECT_EQ(1U, cl.getAll<long long>(LESS_THAN).size());
+
+  // IN list members are EQUALS constraints, the range spans them.
+  cl.add(Constraint(EQUALS, "20"));
+  cl.add(Constraint(EQUALS, "30"));
+  EXPECT_TRUE(cl.getRange(lower, upper));
+  EXPECT_EQ(20, lower);
+  EXPECT_EQ(30, upper);
+
+  // REAL expressions are not truncated into the range.
+  struct ConstraintList real;
+  real.add(Constraint(LESS_THAN, "1.5"));
+  lower = 0;
+  upper = 100;
+  EXPECT_TRUE(real.getRange(lower, upper));
+  EXPECT_EQ(100, upper);
+
+  // Disjoint constraints cannot match anything.
+  struct ConstraintList disjoint;
+  disjoint.add(Constraint(GREATER_THAN, "10"));
+  disjoint.add(Constraint(LESS_THAN_OR_EQUALS, "10"));
+  int int_lower = 0;
+  int int_upper = 100;
+  EXPECT_FALSE(disjoint.getRange(int_lower, int_upper));
+}
+
+TEST_F(TablesTests, test_constraint_prefixes) {
+  struct ConstraintList cl;
+  cl.add(Constraint(LIKE, "/usr/%/bin"));
+  cl.add(Constraint(GLOB, "/usr/lib*"));
+
+  auto prefixes = cl.getPrefixes(LIKE);
+  ASSERT_EQ(1U, prefixes.size());
+  EXPECT_EQ("/usr/", *prefixes.begin());
+  prefixes = cl.getPrefixes(GLOB);
+  ASSERT_EQ(1U, prefixes.size());
+  EXPECT_EQ("/usr/lib", *prefixes.begin());
+
+  // Matching compares the literal prefixes, LIKE ignores ASCII case.
+  EXPECT_TRUE(cl.matches("/usr/lib/bin"));
+  EXPECT_FALSE(cl.matches("/usr/local/bin"));
+  EXPECT_FALSE(cl.matches("/opt/lib"));
+
+  struct ConstraintList like;
+  like.add(Constraint(LIKE, "Ab_c%"));
+  EXPECT_TRUE(like.matches("aBxc"));
+  EXPECT_FALSE(like.matches("ac"));
 }
 
 TEST_F(TablesTests, test_constraint_map) {
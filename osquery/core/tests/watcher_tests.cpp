@@ -6,11 +6,18 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <chrono>
+#include <thread>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
 #include <osquery/config/config.h>
 #include <osquery/core.h>
+#include <osquery/filesystem/filesystem.h>
 #include <osquery/registry.h>
 #include <osquery/system.h>
 #include <osquery/tables.h>
@@ -20,6 +27,8 @@
 
 using namespace testing;
 
+namespace fs = boost::filesystem;
+
 namespace osquery {
 
 DECLARE_uint64(watchdog_delay);
@@ -209,15 +218,16 @@ class FakeWatcherRunner : public WatcherRunner {
   /**
    * @brief What the runner's internals will use as process state.
    *
-   * Internal calls to getProcessRow will return this structure.
+   * Internal calls to getProcessSample will return this structure.
    */
-  void setProcessRow(QueryData qd) {
-    qd_ = std::move(qd);
+  void setProcessSample(const ProcessSample& sample) {
+    sample_ = sample;
   }
 
-  /// The tests do not have access to the processes table.
-  QueryData getProcessRow(pid_t pid) const {
-    return qd_;
+  /// The tests control the sampled process state.
+  bool getProcessSample(pid_t pid, ProcessSample& sample) const {
+    sample = sample_;
+    return true;
   }
 
  private:
@@ -225,20 +235,20 @@ class FakeWatcherRunner : public WatcherRunner {
   void stopChild(const PlatformProcess& child) const {}
 
  private:
-  QueryData qd_;
+  ProcessSample sample_;
 };
 
 TEST_F(WatcherTests, test_watcherrunner_watcherhealth) {
   FakeWatcherRunner runner(0, nullptr, true);
 
-  // Construct a process state, assume this would have been returned from the
-  // processes table, which the WorkerRunner normally uses internally.
-  Row r;
-  r["parent"] = INTEGER(1);
-  r["user_time"] = INTEGER(100);
-  r["system_time"] = INTEGER(100);
-  r["resident_size"] = INTEGER(100);
-  runner.setProcessRow({r});
+  // Construct a process state, assume this would have been sampled from the
+  // process, which the WorkerRunner normally does internally.
+  ProcessSample r;
+  r.parent = 1;
+  r.user_time = 100;
+  r.system_time = 100;
+  r.resident_size = 100;
+  runner.setProcessSample(r);
 
   // Hold the process and process state externally.
   // Normally the WatcherRunner's entry point will persist these and use them
@@ -260,22 +270,22 @@ TEST_F(WatcherTests, test_watcherrunner_watcherhealth) {
 
   // Now we can alter the performance.
   // Let us emulate the watcher having just allocated 1G of memory.
-  r["resident_size"] = INTEGER(1024 * 1024 * 1024);
-  runner.setProcessRow({r});
+  r.resident_size = 1024 * 1024 * 1024;
+  runner.setProcessSample(r);
 
   auto status = runner.isWatcherHealthy(*test_process, state);
   EXPECT_FALSE(status.ok());
   EXPECT_EQ(status.getMessage(), "Memory limits exceeded");
 
   // Now emulate a rapid increase in CPU requirements.
-  r["user_time"] = INTEGER(1024 * 1024 * 1024);
-  runner.setProcessRow({r});
+  r.user_time = 1024 * 1024 * 1024;
+  runner.setProcessSample(r);
   runner.isWatcherHealthy(*test_process, state);
   EXPECT_EQ(1U, state.sustained_latency);
 
   // And again, the CPU continues to increase from the system perspective.
-  r["system_time"] = INTEGER(1024 * 1024 * 1024);
-  runner.setProcessRow({r});
+  r.system_time = 1024 * 1024 * 1024;
+  runner.setProcessSample(r);
   runner.isWatcherHealthy(*test_process, state);
   EXPECT_EQ(2U, state.sustained_latency);
 }
@@ -288,19 +298,19 @@ TEST_F(WatcherTests, test_watcherrunner_unhealthy_delay) {
   fake_test_process.setStatus(PROCESS_STILL_ALIVE, 0);
 
   // Set up a fake test process and place it into an healthy state.
-  Row r;
-  r["parent"] = INTEGER(test_process->pid());
-  r["user_time"] = INTEGER(100);
-  r["system_time"] = INTEGER(100);
-  r["resident_size"] = INTEGER(100);
-  runner.setProcessRow({r});
+  ProcessSample r;
+  r.parent = test_process->pid();
+  r.user_time = 100;
+  r.system_time = 100;
+  r.resident_size = 100;
+  runner.setProcessSample(r);
 
   // Check the fake process sanity, which records the state at t=0.
   EXPECT_TRUE(runner.isChildSane(fake_test_process));
 
   // Update the fake process resident memory, make it unhealthy.
-  r["resident_size"] = INTEGER(1024 * 1024 * 1024);
-  runner.setProcessRow({r});
+  r.resident_size = 1024 * 1024 * 1024;
+  runner.setProcessSample(r);
 
   // Set the watchdog to delay 1000s.
   auto delay = FLAGS_watchdog_delay;
@@ -316,4 +326,126 @@ TEST_F(WatcherTests, test_watcherrunner_unhealthy_delay) {
 
   FLAGS_watchdog_delay = delay;
 }
+
+TEST_F(WatcherTests, test_watcherrunner_smoothed_utilization) {
+  FakeWatcherRunner runner(0, nullptr, true);
+  auto test_process = PlatformProcess::getCurrentProcess();
+
+  auto interval = FLAGS_watchdog_sample_interval;
+  FLAGS_watchdog_sample_interval = 20;
+  auto cpus = boost::thread::physical_concurrency();
+
+  ProcessSample r;
+  r.parent = 1;
+  r.resident_size = 100;
+  runner.setProcessSample(r);
+
+  PerformanceState state;
+  EXPECT_TRUE(runner.isWatcherHealthy(*test_process, state));
+  EXPECT_EQ(0U, state.sustained_latency);
+
+  // A single sample at full utilization is smoothed below the limit.
+  auto last = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  auto now = std::chrono::steady_clock::now();
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::milliseconds>(now - last);
+  r.user_time += elapsed.count() * cpus;
+  runner.setProcessSample(r);
+  runner.isWatcherHealthy(*test_process, state);
+  EXPECT_EQ(0U, state.sustained_latency);
+  EXPECT_GT(state.utilization, 0.0);
+
+  // Sustained full utilization crosses the limit within an interval.
+  last = now;
+  for (size_t i = 0; i < 100 && state.sustained_latency == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    now = std::chrono::steady_clock::now();
+    elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last);
+    r.user_time += elapsed.count() * cpus;
+    last = now;
+    runner.setProcessSample(r);
+    runner.isWatcherHealthy(*test_process, state);
+  }
+  EXPECT_GT(state.sustained_latency, 0U);
+  EXPECT_GT(state.latency_ms, 0U);
+
+  FLAGS_watchdog_sample_interval = interval;
+}
+
+#ifdef __linux__
+TEST_F(WatcherTests, test_process_sampler) {
+  ProcessSampler sampler(PlatformProcess::getCurrentPid());
+
+  ProcessSample first;
+  ASSERT_TRUE(sampler.sample(first));
+  EXPECT_EQ(first.parent, ::getppid());
+  EXPECT_GT(first.resident_size, 0U);
+
+  // Burn some CPU, the same descriptors are re-read.
+  auto start = std::chrono::steady_clock::now();
+  volatile size_t spin = 0;
+  while (std::chrono::steady_clock::now() - start <
+         std::chrono::milliseconds(100)) {
+    spin++;
+  }
+
+  ProcessSample second;
+  ASSERT_TRUE(sampler.sample(second));
+  EXPECT_GT(second.user_time + second.system_time,
+            first.user_time + first.system_time);
+
+  ProcessSampler missing(-1);
+  EXPECT_FALSE(missing.sample(second));
+}
+
+TEST_F(WatcherTests, test_cgroup_files) {
+  auto events = parseCgroupKeyValues(
+      "low 0\nhigh 12\nmax 3\noom 1\noom_kill 1\noom_group_kill 0\n");
+  EXPECT_EQ(events["high"], 12U);
+  EXPECT_EQ(events["oom_kill"], 1U);
+
+  // Lay out the files of a cgroup v2 leaf.
+  auto leaf = fs::temp_directory_path() /
+              fs::unique_path("osquery.tests.cgroup.%%%%.%%%%");
+  fs::create_directories(leaf);
+  writeTextFile((leaf / "cpu.max").string(), "25000 100000\n");
+  writeTextFile((leaf / "memory.high").string(), "209715200\n");
+  writeTextFile((leaf / "memory.max").string(), "max\n");
+  writeTextFile((leaf / "memory.current").string(), "1048576\n");
+  writeTextFile((leaf / "memory.events").string(),
+                "low 0\nhigh 4\nmax 0\noom 0\noom_kill 0\n");
+  writeTextFile((leaf / "cpu.stat").string(),
+                "usage_usec 5000\nuser_usec 4000\nsystem_usec 1000\n"
+                "nr_periods 10\nnr_throttled 2\nthrottled_usec 700\n");
+
+  CgroupLimits limits;
+  ASSERT_TRUE(readCgroupLimits(leaf.string(), limits).ok());
+  EXPECT_EQ(limits.cpu_quota, 25000);
+  EXPECT_EQ(limits.cpu_period, 100000);
+  EXPECT_EQ(limits.memory_high, 209715200);
+  EXPECT_EQ(limits.memory_max, kCgroupUnlimited);
+
+  CgroupStats stats;
+  ASSERT_TRUE(readCgroupStats(leaf.string(), stats).ok());
+  EXPECT_EQ(stats.memory_current, 1048576U);
+  EXPECT_EQ(stats.memory_high_events, 4U);
+  EXPECT_EQ(stats.cpu_usage, 5000U);
+  EXPECT_EQ(stats.throttled_periods, 2U);
+  EXPECT_EQ(stats.throttled_time, 700U);
+
+  // The watcher refuses a directory without delegated controllers.
+  WatcherCgroups cgroups;
+  EXPECT_FALSE(cgroups.setUp(leaf.string()).ok());
+  EXPECT_FALSE(cgroups.active());
+
+  // Only the exact controller names count.
+  writeTextFile((leaf / "cgroup.controllers").string(), "cpuset io memory\n");
+  EXPECT_FALSE(cgroups.setUp(leaf.string()).ok());
+  EXPECT_FALSE(cgroups.active());
+  EXPECT_FALSE(fs::exists(leaf / "watcher"));
+
+  fs::remove_all(leaf);
+}
+#endif
 } // namespace osquery
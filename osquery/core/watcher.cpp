@@ -6,7 +6,10 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <cstdio>
 #include <cstring>
 
 #include <math.h>
@@ -16,6 +19,11 @@
 #include <sys/wait.h>
 #endif
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -46,6 +54,7 @@ struct LimitDefinition {
 
 struct PerformanceChange {
   size_t sustained_latency;
+  size_t latency_ms;
   size_t footprint;
   size_t iv;
   pid_t parent;
@@ -94,6 +103,12 @@ HIDDEN_FLAG(uint64,
             60 * 10,
             "Max delay in seconds between worker respawns");
 
+CLI_FLAG(uint64,
+         watchdog_sample_interval,
+         0,
+         "Milliseconds between watchdog samples, CPU utilization is smoothed "
+         "over the profile interval (default 0, sample once per interval)");
+
 CLI_FLAG(bool,
          enable_extensions_watchdog,
          false,
@@ -101,12 +116,37 @@ CLI_FLAG(bool,
 
 CLI_FLAG(bool, disable_watchdog, false, "Disable userland watchdog process");
 
+#ifdef __linux__
+CLI_FLAG(bool,
+         watchdog_cgroups,
+         false,
+         "Enforce watchdog limits by throttling children in a delegated "
+         "cgroup v2 subtree");
+
+HIDDEN_FLAG(string,
+            watchdog_cgroup_root,
+            "",
+            "Delegated cgroup v2 directory (default is the watcher's cgroup)");
+
+HIDDEN_FLAG(uint64,
+            watchdog_cgroup_memory_headroom,
+            50,
+            "Percent above the memory limit a cgroup may use before the "
+            "kernel OOM killer runs (default 50)");
+
+/// The cpu.max period, in microseconds.
+const int64_t kCgroupCPUPeriod{100000};
+#endif
+
 void Watcher::resetWorkerCounters(size_t respawn_time) {
   // Reset the monitoring counters for the watcher.
   state_.sustained_latency = 0;
   state_.user_time = 0;
   state_.system_time = 0;
   state_.last_respawn_time = respawn_time;
+  state_.latency_ms = 0;
+  state_.utilization = 0;
+  state_.last_sample_ms = 0;
 }
 
 void Watcher::resetExtensionCounters(const std::string& extension,
@@ -117,6 +157,9 @@ void Watcher::resetExtensionCounters(const std::string& extension,
   state.user_time = 0;
   state.system_time = 0;
   state.last_respawn_time = respawn_time;
+  state.latency_ms = 0;
+  state.utilization = 0;
+  state.last_sample_ms = 0;
 }
 
 std::string Watcher::getExtensionPath(const PlatformProcess& child) {
@@ -205,6 +248,16 @@ void WatcherRunner::start() {
   watcher.resetWorkerCounters(0);
   PerformanceState watcher_state;
 
+#ifdef __linux__
+  if (FLAGS_watchdog_cgroups) {
+    auto status = cgroups_.setUp(FLAGS_watchdog_cgroup_root);
+    if (!status.ok()) {
+      LOG(WARNING) << "Cannot enforce watchdog limits with cgroups: "
+                   << status.getMessage();
+    }
+  }
+#endif
+
   // Enter the watch loop.
   do {
     if (use_worker_ && !watch(watcher.getWorker())) {
@@ -248,7 +301,12 @@ void WatcherRunner::start() {
       // A test harness can end the thread immediately.
       break;
     }
-    pause(std::chrono::seconds(getWorkerLimit(WatchdogLimitType::INTERVAL)));
+    if (FLAGS_watchdog_sample_interval > 0) {
+      pause(std::chrono::milliseconds(FLAGS_watchdog_sample_interval));
+    } else {
+      pause(
+          std::chrono::seconds(getWorkerLimit(WatchdogLimitType::INTERVAL)));
+    }
   } while (!interrupted() && ok());
 }
 
@@ -363,45 +421,74 @@ void WatcherRunner::stopChild(const PlatformProcess& child) const {
   }
 }
 
-PerformanceChange getChange(const Row& r, PerformanceState& state) {
+/// Milliseconds on a monotonic clock, used to time sub-interval samples.
+static uint64_t getMonotonicMilliseconds() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+PerformanceChange getChange(const ProcessSample& sample,
+                            PerformanceState& state) {
   PerformanceChange change;
 
   // IV is the check interval in seconds, and utilization is set per-second.
   change.iv = std::max(getWorkerLimit(WatchdogLimitType::INTERVAL), 1_sz);
-  long long user_time = 0, system_time = 0;
-  try {
-    change.parent =
-        static_cast<pid_t>(tryTo<long long>(r.at("parent")).takeOr(0LL));
-    user_time = tryTo<long long>(r.at("user_time")).takeOr(0LL);
-    system_time = tryTo<long long>(r.at("system_time")).takeOr(0LL);
-    change.footprint = tryTo<long long>(r.at("resident_size")).takeOr(0LL);
-  } catch (const std::exception& /* e */) {
-    state.sustained_latency = 0;
-  }
+  change.parent = sample.parent;
+  change.footprint = static_cast<size_t>(sample.resident_size);
 
   // Check the difference of CPU time used since last check.
   auto percent_ul = getWorkerLimit(WatchdogLimitType::UTILIZATION_LIMIT);
   percent_ul = (percent_ul > 100) ? 100 : percent_ul;
 
-  UNSIGNED_BIGINT_LITERAL iv_milliseconds = change.iv * 1000;
-  UNSIGNED_BIGINT_LITERAL cpu_ul =
-      (percent_ul * iv_milliseconds * kNumOfCPUs) / 100;
-
-  auto user_time_diff = user_time - state.user_time;
-  auto sys_time_diff = system_time - state.system_time;
-  auto cpu_utilization_time = user_time_diff + sys_time_diff;
+  auto user_time = static_cast<long long>(sample.user_time);
+  auto system_time = static_cast<long long>(sample.system_time);
+  auto user_time_diff = user_time - static_cast<long long>(state.user_time);
+  auto sys_time_diff = system_time - static_cast<long long>(state.system_time);
+  auto cpu_utilization_time = std::max(user_time_diff + sys_time_diff, 0LL);
+
+  bool exceeded = false;
+  size_t elapsed_ms = 0;
+  if (FLAGS_watchdog_sample_interval == 0) {
+    UNSIGNED_BIGINT_LITERAL iv_milliseconds = change.iv * 1000;
+    UNSIGNED_BIGINT_LITERAL cpu_ul =
+        (percent_ul * iv_milliseconds * kNumOfCPUs) / 100;
+
+    elapsed_ms = iv_milliseconds;
+    exceeded = static_cast<UNSIGNED_BIGINT_LITERAL>(cpu_utilization_time) >
+               cpu_ul;
+  } else {
+    // Samples are taken more often than the interval, a short burst should
+    // not count against the process. The utilization is smoothed with a time
+    // constant of one interval.
+    auto now = getMonotonicMilliseconds();
+    if (state.last_sample_ms != 0 && now > state.last_sample_ms) {
+      elapsed_ms = static_cast<size_t>(now - state.last_sample_ms);
+      auto utilization = (100.0 * cpu_utilization_time) /
+                         (static_cast<double>(elapsed_ms) * kNumOfCPUs);
+      auto alpha = 1.0 - exp(-static_cast<double>(elapsed_ms) /
+                             (change.iv * 1000.0));
+      state.utilization += alpha * (utilization - state.utilization);
+      exceeded = state.utilization > percent_ul;
+    }
+    state.last_sample_ms = now;
+  }
 
-  if (cpu_utilization_time > cpu_ul) {
+  if (exceeded) {
     state.sustained_latency++;
-  } else {
+    state.latency_ms += elapsed_ms;
+  } else if (elapsed_ms > 0) {
     state.sustained_latency = 0;
+    state.latency_ms = 0;
   }
   // Update the current CPU time.
-  state.user_time = user_time;
-  state.system_time = system_time;
+  state.user_time = static_cast<size_t>(user_time);
+  state.system_time = static_cast<size_t>(system_time);
 
   // Check if the sustained difference exceeded the acceptable latency limit.
   change.sustained_latency = state.sustained_latency;
+  change.latency_ms = state.latency_ms;
 
   // Set the memory footprint as the amount of resident bytes allocated
   // since the process image was created (estimate).
@@ -434,19 +521,19 @@ static bool exceededCyclesLimit(const PerformanceChange& change) {
     return false;
   }
 
-  auto latency = change.sustained_latency * change.iv;
-  return (latency >= getWorkerLimit(WatchdogLimitType::LATENCY_LIMIT));
+  return (change.latency_ms >=
+          getWorkerLimit(WatchdogLimitType::LATENCY_LIMIT) * 1000);
 }
 
 Status WatcherRunner::isWatcherHealthy(const PlatformProcess& watcher,
                                        PerformanceState& watcher_state) const {
-  auto rows = getProcessRow(watcher.pid());
-  if (rows.size() == 0) {
+  ProcessSample sample;
+  if (!getProcessSample(watcher.pid(), sample)) {
     // Could not find worker process?
     return Status(1, "Cannot find watcher process");
   }
 
-  auto change = getChange(rows[0], watcher_state);
+  auto change = getChange(sample, watcher_state);
   if (exceededMemoryLimit(change)) {
     return Status(1, "Memory limits exceeded");
   }
@@ -454,27 +541,129 @@ Status WatcherRunner::isWatcherHealthy(const PlatformProcess& watcher,
   return Status(0);
 }
 
-QueryData WatcherRunner::getProcessRow(pid_t pid) const {
+#ifdef __linux__
+/// Read a small /proc file from the start into a terminated buffer.
+static bool preadProcFile(int fd, char* buffer, size_t size) {
+  auto bytes = ::pread(fd, buffer, size - 1, 0);
+  if (bytes <= 0) {
+    return false;
+  }
+  buffer[bytes] = '\0';
+  return true;
+}
+
+ProcessSampler::ProcessSampler(pid_t pid) : pid_(pid) {
+  auto base = "/proc/" + std::to_string(pid_);
+  stat_fd_ = ::open((base + "/stat").c_str(), O_RDONLY | O_CLOEXEC);
+  statm_fd_ = ::open((base + "/statm").c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+ProcessSampler::~ProcessSampler() {
+  if (stat_fd_ >= 0) {
+    ::close(stat_fd_);
+  }
+  if (statm_fd_ >= 0) {
+    ::close(statm_fd_);
+  }
+}
+
+bool ProcessSampler::sample(ProcessSample& sample) {
+  static const auto kClockTicks = ::sysconf(_SC_CLK_TCK);
+  static const auto kPageSize = ::sysconf(_SC_PAGESIZE);
+  if (stat_fd_ < 0 || statm_fd_ < 0 || kClockTicks <= 0) {
+    return false;
+  }
+
+  char buffer[1024];
+  if (!preadProcFile(stat_fd_, buffer, sizeof(buffer))) {
+    return false;
+  }
+
+  // The command name may contain spaces or parentheses, skip past it.
+  auto fields = std::strrchr(buffer, ')');
+  if (fields == nullptr || fields[1] == '\0') {
+    return false;
+  }
+
+  // Fields 3 (state) through 15 (stime), see proc(5).
+  long long parent = 0;
+  unsigned long long user_ticks = 0;
+  unsigned long long system_ticks = 0;
+  if (std::sscanf(fields + 2,
+                  "%*c %lld %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                  &parent,
+                  &user_ticks,
+                  &system_ticks) != 3) {
+    return false;
+  }
+
+  if (!preadProcFile(statm_fd_, buffer, sizeof(buffer))) {
+    return false;
+  }
+
+  unsigned long long resident_pages = 0;
+  if (std::sscanf(buffer, "%*u %llu", &resident_pages) != 1) {
+    return false;
+  }
+
+  sample.parent = static_cast<pid_t>(parent);
+  sample.user_time = user_ticks * 1000 / kClockTicks;
+  sample.system_time = system_ticks * 1000 / kClockTicks;
+  sample.resident_size = resident_pages * kPageSize;
+  return true;
+}
+#else
+ProcessSampler::ProcessSampler(pid_t pid) : pid_(pid) {}
+
+ProcessSampler::~ProcessSampler() {}
+
+bool ProcessSampler::sample(ProcessSample& sample) {
   // On Windows, pid_t = DWORD, which is unsigned. However invalidity
   // of processes is denoted by a pid_t of -1. We check for this
   // by comparing the max value of DWORD, or ULONG_MAX, and then casting
   // our query back to an int value, as ULONG_MAX causes boost exceptions
   // as it's out of the range of an int.
-  int p = pid;
+  int p = pid_;
 #ifdef WIN32
-  p = (pid == ULONG_MAX) ? -1 : pid;
+  p = (pid_ == ULONG_MAX) ? -1 : pid_;
 #endif
-  return SQL::selectFrom(
+  auto rows = SQL::selectFrom(
       {"parent", "user_time", "system_time", "resident_size"},
       "processes",
       "pid",
       EQUALS,
       INTEGER(p));
+  if (rows.empty()) {
+    return false;
+  }
+
+  const auto& r = rows[0];
+  try {
+    sample.parent =
+        static_cast<pid_t>(tryTo<long long>(r.at("parent")).takeOr(0LL));
+    sample.user_time = tryTo<long long>(r.at("user_time")).takeOr(0LL);
+    sample.system_time = tryTo<long long>(r.at("system_time")).takeOr(0LL);
+    sample.resident_size = tryTo<long long>(r.at("resident_size")).takeOr(0LL);
+  } catch (const std::exception& /* e */) {
+    return false;
+  }
+  return true;
+}
+#endif
+
+bool WatcherRunner::getProcessSample(pid_t pid, ProcessSample& sample) const {
+  // A failing sampler is kept: the process exited, or its pid now belongs to
+  // a different process. It is only replaced when the child is respawned.
+  auto& sampler = samplers_[pid];
+  if (sampler == nullptr) {
+    sampler = std::make_unique<ProcessSampler>(pid);
+  }
+  return sampler->sample(sample);
 }
 
 Status WatcherRunner::isChildSane(const PlatformProcess& child) const {
-  auto rows = getProcessRow(child.pid());
-  if (rows.size() == 0) {
+  ProcessSample sample;
+  if (!getProcessSample(child.pid(), sample)) {
     // Could not find worker process?
     return Status(1, "Cannot find process");
   }
@@ -483,7 +672,7 @@ Status WatcherRunner::isChildSane(const PlatformProcess& child) const {
   {
     WatcherExtensionsLocker locker;
     auto& state = Watcher::get().getState(child);
-    change = getChange(rows[0], state);
+    change = getChange(sample, state);
   }
 
   // Only make a decision about the child sanity if it is still the watcher's
@@ -495,10 +684,21 @@ Status WatcherRunner::isChildSane(const PlatformProcess& child) const {
     return Status(0);
   }
 
+#ifdef __linux__
+  if (checkCgroup(child)) {
+    // The kernel throttles the child, and stops it only if it runs out of
+    // memory.
+    if (use_worker_ && child.pid() == Watcher::get().getWorker().pid()) {
+      relayStatusLogs();
+    }
+    return Status(0);
+  }
+#endif
+
   if (exceededCyclesLimit(change)) {
     return Status(1,
                   "Maximum sustainable CPU utilization limit exceeded: " +
-                      std::to_string(change.sustained_latency * change.iv));
+                      std::to_string(change.latency_ms / 1000));
   }
 
   // Check if the private memory exceeds a memory limit.
@@ -516,6 +716,92 @@ Status WatcherRunner::isChildSane(const PlatformProcess& child) const {
   return Status(0);
 }
 
+#ifdef __linux__
+/// Translate the watchdog profile into cgroup limits.
+static CgroupLimits getCgroupLimits() {
+  CgroupLimits limits;
+  auto memory = static_cast<int64_t>(
+      getWorkerLimit(WatchdogLimitType::MEMORY_LIMIT) * 1024 * 1024);
+  limits.memory_high = memory;
+  limits.memory_max =
+      memory + memory * FLAGS_watchdog_cgroup_memory_headroom / 100;
+
+  // The utilization limit is a percent of all CPUs, as in getChange.
+  auto percent = getWorkerLimit(WatchdogLimitType::UTILIZATION_LIMIT);
+  limits.cpu_period = kCgroupCPUPeriod;
+  if (percent < 100) {
+    limits.cpu_quota = std::max<int64_t>(
+        kCgroupCPUPeriod * percent * kNumOfCPUs / 100, 1000);
+  }
+  return limits;
+}
+
+void WatcherRunner::attachCgroup(const std::string& name, pid_t pid) {
+  if (!cgroups_.active()) {
+    return;
+  }
+
+  // Forget the previous process placed in this leaf.
+  for (auto it = cgroup_children_.begin(); it != cgroup_children_.end();) {
+    it = (it->second.name == name) ? cgroup_children_.erase(it) : ++it;
+  }
+
+  // The leaf keeps the limits of a previous child, lift them during the
+  // watchdog delay.
+  CgroupChild leaf;
+  leaf.name = name;
+  auto status = cgroups_.attach(name, pid);
+  if (status.ok() && getUnixTime() < delayedTime()) {
+    status = cgroups_.limit(name, CgroupLimits());
+  }
+
+  if (!status.ok()) {
+    LOG(WARNING) << "Cannot place " << name << " (" << pid
+                 << ") in a cgroup: " << status.getMessage();
+    return;
+  }
+  cgroups_.stats(name, leaf.stats);
+  cgroup_children_[pid] = std::move(leaf);
+}
+
+bool WatcherRunner::checkCgroup(const PlatformProcess& child) const {
+  auto it = cgroup_children_.find(child.pid());
+  if (it == cgroup_children_.end()) {
+    return false;
+  }
+
+  auto& leaf = it->second;
+  if (!leaf.limited && getUnixTime() >= delayedTime()) {
+    auto status = cgroups_.limit(leaf.name, getCgroupLimits());
+    if (!status.ok()) {
+      LOG(WARNING) << "Cannot apply cgroup limits to " << leaf.name << ": "
+                   << status.getMessage();
+      cgroup_children_.erase(it);
+      return false;
+    }
+    leaf.limited = true;
+  }
+
+  CgroupStats stats;
+  if (cgroups_.stats(leaf.name, stats).ok()) {
+    if (stats.oom_kills > leaf.stats.oom_kills) {
+      LOG(WARNING) << "osquery " << leaf.name
+                   << " exceeded its cgroup memory limit and was killed";
+    }
+    if (stats.memory_high_events > leaf.stats.memory_high_events ||
+        stats.throttled_periods > leaf.stats.throttled_periods) {
+      VLOG(1) << "osquery " << leaf.name << " is being throttled ("
+              << stats.throttled_periods - leaf.stats.throttled_periods
+              << " CPU periods, "
+              << stats.memory_high_events - leaf.stats.memory_high_events
+              << " memory events)";
+    }
+    leaf.stats = stats;
+  }
+  return true;
+}
+#endif
+
 void WatcherRunner::createWorker() {
   auto& watcher = Watcher::get();
 
@@ -578,8 +864,14 @@ void WatcherRunner::createWorker() {
     return;
   }
 
+  // A reused pid must not keep the sampler of the process that had it.
+  samplers_.erase(watcher.getWorker().pid());
+  samplers_.erase(worker->pid());
   watcher.setWorker(worker);
   watcher.resetWorkerCounters(getUnixTime());
+#ifdef __linux__
+  attachCgroup("worker", worker->pid());
+#endif
   VLOG(1) << "osqueryd watcher (" << PlatformProcess::getCurrentPid()
           << ") executing worker (" << worker->pid() << ")";
   watcher.worker_status_ = -1;
@@ -624,8 +916,26 @@ void WatcherRunner::createExtension(const std::string& extension) {
     Initializer::shutdown(EXIT_FAILURE);
   }
 
+  {
+    WatcherExtensionsLocker locker;
+    auto previous = watcher.extensions().find(extension);
+    if (previous != watcher.extensions().end()) {
+      samplers_.erase(previous->second->pid());
+    }
+  }
+  samplers_.erase(ext_process->pid());
   watcher.setExtension(extension, ext_process);
   watcher.resetExtensionCounters(extension, getUnixTime());
+#ifdef __linux__
+  if (FLAGS_enable_extensions_watchdog) {
+    auto name = fs::path(extension).filename().string();
+    std::replace_if(name.begin(),
+                    name.end(),
+                    [](char c) { return !std::isalnum(c) && c != '.'; },
+                    '_');
+    attachCgroup("extension-" + name, ext_process->pid());
+  }
+#endif
   VLOG(1) << "Created and monitoring extension child (" << ext_process->pid()
           << "): " << extension;
 }
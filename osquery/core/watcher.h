@@ -9,6 +9,9 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
 #include <string>
 
 #ifndef WIN32
@@ -23,12 +26,17 @@
 #include <osquery/flags.h>
 #include <osquery/process/process.h>
 
+#ifdef __linux__
+#include <osquery/core/linux/cgroups.h>
+#endif
+
 namespace osquery {
 
 using ExtensionMap = std::map<std::string, std::shared_ptr<PlatformProcess>>;
 
 DECLARE_bool(disable_watchdog);
 DECLARE_int32(watchdog_level);
+DECLARE_uint64(watchdog_sample_interval);
 
 class WatcherRunner;
 
@@ -68,15 +76,65 @@ struct PerformanceState {
   /// The initial (or as close as possible) process image footprint.
   size_t initial_footprint;
 
+  /// Milliseconds the process has continuously exceeded the CPU limit.
+  size_t latency_ms;
+  /// Smoothed CPU utilization in percent, used with sub-interval sampling.
+  double utilization;
+  /// Monotonic time in milliseconds of the last sub-interval sample.
+  uint64_t last_sample_ms;
+
   PerformanceState() {
     sustained_latency = 0;
     user_time = 0;
     system_time = 0;
     last_respawn_time = 0;
     initial_footprint = 0;
+    latency_ms = 0;
+    utilization = 0;
+    last_sample_ms = 0;
   }
 };
 
+/// A single resource usage sample of a watched process.
+struct ProcessSample {
+  /// Parent process ID.
+  pid_t parent{0};
+  /// User CPU time in milliseconds.
+  uint64_t user_time{0};
+  /// System CPU time in milliseconds.
+  uint64_t system_time{0};
+  /// Resident memory in bytes.
+  uint64_t resident_size{0};
+};
+
+/**
+ * @brief Reads the resource usage of a single process.
+ *
+ * On Linux the process's stat and statm files are opened once and re-read
+ * with pread on every sample, without going through SQL or the processes
+ * table. The descriptors refer to the process that existed when they were
+ * opened, if it exits and the pid is reused sampling fails rather than
+ * reporting on the new process.
+ *
+ * Other platforms select the same values from the processes table.
+ */
+class ProcessSampler : private boost::noncopyable {
+ public:
+  explicit ProcessSampler(pid_t pid);
+
+  ~ProcessSampler();
+
+  /// Take a sample, returns false if the process no longer exists.
+  bool sample(ProcessSample& sample);
+
+ private:
+  pid_t pid_{0};
+
+  /// Descriptors for /proc/<pid>/stat and /proc/<pid>/statm.
+  int stat_fd_{-1};
+  int statm_fd_{-1};
+};
+
 /**
  * @brief Thread-safe watched child process state manager.
  *
@@ -310,8 +368,8 @@ class WatcherRunner : public InternalRunnable {
   virtual Status isWatcherHealthy(const PlatformProcess& watcher,
                                   PerformanceState& watcher_state) const;
 
-  /// Get row data from the processes table for a given pid.
-  virtual QueryData getProcessRow(pid_t pid) const;
+  /// Sample the CPU and memory use of a given pid.
+  virtual bool getProcessSample(pid_t pid, ProcessSample& sample) const;
 
  private:
   /// Fork and execute a worker process.
@@ -326,6 +384,21 @@ class WatcherRunner : public InternalRunnable {
   /// Return the time the watchdog is delayed until (from start of watcher).
   size_t delayedTime() const;
 
+#ifdef __linux__
+  /// Move a new child into its own cgroup leaf, if cgroups are in use.
+  void attachCgroup(const std::string& name, pid_t pid);
+
+  /**
+   * @brief Apply limits and check pressure for a child placed in a cgroup.
+   *
+   * The kernel throttles CPU and memory for these children, so the sampled
+   * limits are not used to stop them.
+   *
+   * @return false if the child is not in a cgroup leaf.
+   */
+  bool checkCgroup(const PlatformProcess& child) const;
+#endif
+
  private:
   /// For testing only, ask the WatcherRunner to run a start loop once.
   void runOnce() {
@@ -348,6 +421,27 @@ class WatcherRunner : public InternalRunnable {
   /// Similarly to the uncontrolled worker restarted, count each extension.
   std::map<std::string, size_t> extension_restarts_;
 
+  /// Samplers are kept open for each watched pid, until it is respawned.
+  mutable std::map<pid_t, std::unique_ptr<ProcessSampler>> samplers_;
+
+#ifdef __linux__
+  /// A child placed in a cgroup leaf.
+  struct CgroupChild {
+    /// Name of the leaf.
+    std::string name;
+    /// Set once the limits were applied, after the watchdog delay.
+    bool limited{false};
+    /// The last counters read, used to report changes.
+    CgroupStats stats;
+  };
+
+  /// The delegated subtree, active when --watchdog_cgroups is set.
+  mutable WatcherCgroups cgroups_;
+
+  /// Children placed in a cgroup leaf, by pid.
+  mutable std::map<pid_t, CgroupChild> cgroup_children_;
+#endif
+
  private:
   FRIEND_TEST(WatcherTests, test_watcherrunner_watch);
   FRIEND_TEST(WatcherTests, test_watcherrunner_stop);
@@ -356,6 +450,7 @@ class WatcherRunner : public InternalRunnable {
   FRIEND_TEST(WatcherTests, test_watcherrunner_loop_disabled);
   FRIEND_TEST(WatcherTests, test_watcherrunner_watcherhealth);
   FRIEND_TEST(WatcherTests, test_watcherrunner_unhealthy_delay);
+  FRIEND_TEST(WatcherTests, test_watcherrunner_smoothed_utilization);
 };
 
 /// The WatcherWatcher is spawned within the worker and watches the watcher.
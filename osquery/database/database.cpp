@@ -43,14 +43,21 @@ const std::string kQueries = "queries";
 const std::string kEvents = "events";
 const std::string kCarves = "carves";
 const std::string kLogs = "logs";
+const std::string kDistributedQueue = "distributed";
+const std::string kPackages = "packages";
 
 const std::string kDbEpochSuffix = "epoch";
 const std::string kDbCounterSuffix = "counter";
 
 const std::string kDbVersionKey = "results_version";
 
-const std::vector<std::string> kDomains = {
-    kPersistentSettings, kQueries, kEvents, kLogs, kCarves};
+const std::vector<std::string> kDomains = {kPersistentSettings,
+                                           kQueries,
+                                           kEvents,
+                                           kLogs,
+                                           kCarves,
+                                           kDistributedQueue,
+                                           kPackages};
 
 std::atomic<bool> DatabasePlugin::kDBAllowOpen(false);
 std::atomic<bool> DatabasePlugin::kDBRequireWrite(false);
@@ -65,6 +72,9 @@ std::atomic<bool> DatabasePlugin::kDBChecking(false);
  */
 Mutex kDatabaseReset;
 
+/// Bytes of keys and values put into the active database plugin.
+static std::atomic<size_t> kDatabaseBytesWritten{0};
+
 Status DatabasePlugin::initPlugin() {
   // Initialize the database plugin using the flag.
   auto plugin = (FLAGS_disable_database) ? "ephemeral" : kInternalDatabase;
@@ -346,6 +356,12 @@ Status setDatabaseBatch(const std::string& domain,
     throw std::runtime_error("Cannot set database values");
   }
 
+  size_t bytes = 0;
+  for (const auto& item : data) {
+    bytes += item.first.size() + item.second.size();
+  }
+  kDatabaseBytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+
   auto plugin = getDatabasePlugin();
   return plugin->putBatch(domain, data);
 }
@@ -356,6 +372,10 @@ Status setDatabaseValue(const std::string& domain,
   return setDatabaseBatch(domain, {std::make_pair(key, std::to_string(value))});
 }
 
+size_t getDatabaseBytesWritten() {
+  return kDatabaseBytesWritten.load(std::memory_order_relaxed);
+}
+
 Status deleteDatabaseValue(const std::string& domain, const std::string& key) {
   if (domain.empty()) {
     return Status(1, "Missing domain");
@@ -0,0 +1,84 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <osquery/logger/result_spool.h>
+
+namespace osquery {
+namespace {
+
+const std::string kUsage =
+    "Usage: osqueryspool [--index] [--name <query>] <spool>...\n"
+    "\n"
+    "Convert result spools written by the filesystem logger back to JSON\n"
+    "result lines, or list their blocks with --index.\n";
+
+int printIndex(const std::string& path) {
+  std::vector<ResultSpoolBlock> blocks;
+  auto status = readResultSpoolIndex(path, blocks);
+  for (const auto& block : blocks) {
+    std::cout << path << "\t" << block.name << "\t" << block.offset << "\t"
+              << block.rows << "\n";
+  }
+  if (!status.ok()) {
+    std::cerr << path << ": " << status.getMessage() << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+int printLines(const std::string& path, const std::string& name) {
+  auto status = readResultSpool(
+      path, name, [](const std::string& line) { std::cout << line << "\n"; });
+  if (!status.ok()) {
+    std::cerr << path << ": " << status.getMessage() << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+} // namespace
+} // namespace osquery
+
+int main(int argc, char* argv[]) {
+  bool index = false;
+  std::string name;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--index") {
+      index = true;
+    } else if (arg == "--name" && i + 1 < argc) {
+      name = argv[++i];
+    } else if (arg == "--help" || arg == "-h" || arg.compare(0, 2, "--") == 0) {
+      std::cerr << osquery::kUsage;
+      return (arg == "--help" || arg == "-h") ? 0 : 1;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+
+  if (paths.empty()) {
+    std::cerr << osquery::kUsage;
+    return 1;
+  }
+
+  // Convert every spool, a broken one does not stop the others.
+  int result = 0;
+  for (const auto& path : paths) {
+    if (index) {
+      result |= osquery::printIndex(path);
+    } else {
+      result |= osquery::printLines(path, name);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,77 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <osquery/config/config.h>
+#include <osquery/dispatcher/scheduler.h>
+#include <osquery/registry_factory.h>
+
+#include "osquery/tests/test_util.h"
+
+namespace osquery {
+
+/// Build a config with a number of packs each with a number of queries.
+static std::string getSchedulerConfig(size_t packs, size_t queries) {
+  std::string config = "{\"packs\": {";
+  for (size_t p = 0; p < packs; p++) {
+    config += (p > 0) ? "," : "";
+    config += "\"pack" + std::to_string(p) + "\": {\"queries\": {";
+    for (size_t q = 0; q < queries; q++) {
+      config += (q > 0) ? "," : "";
+      config += "\"query" + std::to_string(q) +
+                "\": {\"query\": \"select 1\", \"interval\": " +
+                std::to_string(60 * (1 + (q % 60))) + "}";
+    }
+    config += "}}";
+  }
+  return config + "}}";
+}
+
+static void SCHEDULER_scan_queries(benchmark::State& state) {
+  RegistryFactory::get().setActive("database", "ephemeral");
+  Config::get().update(
+      {{"data", getSchedulerConfig(100, static_cast<size_t>(state.range(0)))}});
+
+  size_t step = 3600;
+  size_t due = 0;
+  while (state.KeepRunning()) {
+    Config::get().scheduledQueries(
+        ([&due, step](const std::string& name, const ScheduledQuery& query) {
+          if (query.splayed_interval > 0 && step % query.splayed_interval == 0) {
+            due++;
+          }
+        }));
+    step++;
+  }
+  benchmark::DoNotOptimize(due);
+}
+
+BENCHMARK(SCHEDULER_scan_queries)->Arg(10)->Arg(100);
+
+static void SCHEDULER_queue_queries(benchmark::State& state) {
+  RegistryFactory::get().setActive("database", "ephemeral");
+  Config::get().update(
+      {{"data", getSchedulerConfig(100, static_cast<size_t>(state.range(0)))}});
+
+  size_t step = 3600;
+  size_t due = 0;
+  ScheduleQueue queue;
+  queue.refresh(step);
+  while (state.KeepRunning()) {
+    queue.refresh(step);
+    queue.runDue(step,
+                 ([&due](const std::string& name,
+                         const ScheduledQuery& query) { due++; }));
+    step++;
+  }
+  benchmark::DoNotOptimize(due);
+}
+
+BENCHMARK(SCHEDULER_queue_queries)->Arg(10)->Arg(100);
+} // namespace osquery
@@ -7,7 +7,15 @@
  */
 
 #include <algorithm>
+#include <cstdlib>
 #include <ctime>
+#include <map>
+#include <memory>
+#include <thread>
+
+#ifdef __linux__
+#include <malloc.h>
+#endif
 
 #include <boost/format.hpp>
 #include <boost/io/detail/quoted_manip.hpp>
@@ -22,10 +30,12 @@
 #include <osquery/process/process.h>
 #include <osquery/profiler/code_profiler.h>
 #include <osquery/query.h>
+#include <osquery/utils/json/json.h>
 #include <osquery/utils/system/time.h>
 
 #include "osquery/dispatcher/scheduler.h"
 #include "osquery/sql/sqlite_util.h"
+#include "osquery/sql/table_snapshot_cache.h"
 #include "plugins/config/parsers/decorators.h"
 
 namespace osquery {
@@ -49,6 +59,12 @@ FLAG(uint64,
 
 FLAG(uint64, schedule_epoch, 0, "Epoch for scheduled queries");
 
+FLAG(uint64,
+     schedule_benchmark,
+     0,
+     "Run the schedule for this many simulated seconds without waiting "
+     "between steps, print the resources used by each query, and exit");
+
 HIDDEN_FLAG(bool,
             schedule_reload_sql,
             false,
@@ -58,9 +74,269 @@ HIDDEN_FLAG(bool,
 DECLARE_bool(events_optimize);
 DECLARE_bool(enable_numeric_monitoring);
 
+FLAG(uint64,
+     schedule_cost_budget,
+     0,
+     "Expected CPU milliseconds per second scheduled queries may use. Costly "
+     "queries are spread across their intervals and deferred when a second "
+     "exceeds the budget. Set to zero to disable");
+
+FLAG(double,
+     schedule_max_load,
+     0,
+     "Defer costly scheduled queries while the 1-minute load average per CPU "
+     "exceeds this value. Set to zero to disable");
+
+FLAG(uint64,
+     schedule_max_deferral,
+     60,
+     "Max seconds a due query is deferred because of cost or load");
+
+/// Pack discovery may change the set of executing packs on this interval.
+DECLARE_uint64(pack_refresh_interval);
+
+/// Number of seconds considered when spreading query costs.
+const size_t kPlacementHorizon{3600};
+
+/// Max number of candidate offsets considered for each query.
+const size_t kPlacementCandidates{60};
+
+/// The smallest step, not less than step, that is offset within interval.
+static inline size_t alignedStep(size_t step, size_t interval, size_t offset) {
+  return step + (offset + interval - (step % interval)) % interval;
+}
+
+/// The smallest multiple of interval that is greater than step.
+static inline size_t nextMultiple(size_t step, size_t interval) {
+  return alignedStep(step + 1, interval, 0);
+}
+
+/// Bytes of heap in use, 0 if the allocator does not report it.
+static int64_t getHeapBytes() {
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 33)
+  auto info = mallinfo2();
+#else
+  auto info = mallinfo();
+#endif
+  return static_cast<int64_t>(info.uordblks) +
+         static_cast<int64_t>(info.hblkhd);
+#else
+  return 0;
+#endif
+}
+
+/// The 1-minute load average divided by the number of CPUs, 0 if unknown.
+static double getLoadPerCPU() {
+#ifndef WIN32
+  double load = 0;
+  auto cpus = std::thread::hardware_concurrency();
+  if (cpus > 0 && getloadavg(&load, 1) == 1) {
+    return load / cpus;
+  }
+#endif
+  return 0;
+}
+
+bool ScheduleQueue::refresh(size_t step) {
+  if (built_ > 0 && generation_ == Config::get().getScheduleGeneration() &&
+      step < built_ + FLAGS_pack_refresh_interval) {
+    return false;
+  }
+
+  rebuild(step);
+  return true;
+}
+
+void ScheduleQueue::rebuild(size_t step) {
+  // Placed queries keep their offset while their interval is unchanged, so a
+  // periodic rebuild does not move them around.
+  Placements placements;
+  for (const auto& entry : entries_) {
+    if (entry.placed) {
+      placements[entry.name] =
+          std::make_pair(entry.query.splayed_interval, entry.offset);
+    }
+  }
+
+  std::vector<Entry>().swap(entries_);
+  decltype(queue_)().swap(queue_);
+
+  // Read the generation first, a concurrent update will cause another rebuild.
+  generation_ = Config::get().getScheduleGeneration();
+  built_ = step;
+  Config::get().scheduledQueries(
+      ([this](const std::string& name, const ScheduledQuery& query) {
+        if (query.splayed_interval == 0) {
+          return;
+        }
+
+        Entry entry;
+        entry.name = name;
+        entry.blacklisted = query.blacklisted;
+        entry.query.pack_name = query.pack_name;
+        entry.query.name = query.name;
+        entry.query.query = query.query;
+        entry.query.oncall = query.oncall;
+        entry.query.interval = query.interval;
+        entry.query.splayed_interval = query.splayed_interval;
+        entry.query.options = query.options;
+        entries_.push_back(std::move(entry));
+      }),
+      true);
+
+  // The expected cost is the average CPU time of previous executions.
+  for (auto& entry : entries_) {
+    Config::get().getPerformanceStats(
+        entry.name, ([&entry](const QueryPerformance& perf) {
+          if (perf.executions > 0) {
+            entry.cost = static_cast<size_t>(
+                (perf.user_time + perf.system_time) / perf.executions);
+          }
+        }));
+  }
+
+  if (FLAGS_schedule_cost_budget > 0) {
+    place(placements);
+  }
+
+  for (size_t index = 0; index < entries_.size(); ++index) {
+    const auto& entry = entries_[index];
+    auto next =
+        alignedStep(step, entry.query.splayed_interval, entry.offset);
+    queue_.push(std::make_tuple(next, next, index));
+  }
+}
+
+void ScheduleQueue::place(const Placements& placements) {
+  // Intervals that do not divide the horizon wrap around it, so the expected
+  // cost per second is an approximation.
+  std::vector<size_t> load(kPlacementHorizon, 0);
+  auto add_load = [&load](const Entry& entry) {
+    auto interval = entry.query.splayed_interval;
+    auto fires = std::max<size_t>(1, kPlacementHorizon / interval);
+    for (size_t f = 0; f < fires; ++f) {
+      load[(entry.offset + f * interval) % kPlacementHorizon] += entry.cost;
+    }
+  };
+
+  // Queries placed by a previous build stay where they are.
+  std::vector<size_t> order;
+  for (size_t index = 0; index < entries_.size(); ++index) {
+    auto& entry = entries_[index];
+    if (entry.cost == 0) {
+      continue;
+    }
+
+    auto previous = placements.find(entry.name);
+    if (previous != placements.end() &&
+        previous->second.first == entry.query.splayed_interval) {
+      entry.offset = previous->second.second;
+      entry.placed = true;
+      add_load(entry);
+      Config::get().recordQueryPlacement(entry.name, entry.offset);
+    } else {
+      order.push_back(index);
+    }
+  }
+
+  // Place the other most costly queries first, each at the candidate offset
+  // with the lowest peak expected cost.
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return entries_[a].cost > entries_[b].cost;
+  });
+
+  for (const auto index : order) {
+    auto& entry = entries_[index];
+    auto interval = entry.query.splayed_interval;
+    auto fires = std::max<size_t>(1, kPlacementHorizon / interval);
+    auto candidates = std::min(interval, kPlacementCandidates);
+
+    size_t best_peak = 0;
+    for (size_t c = 0; c < candidates; ++c) {
+      auto offset = (c * interval) / candidates;
+      size_t peak = 0;
+      for (size_t f = 0; f < fires; ++f) {
+        peak =
+            std::max(peak, load[(offset + f * interval) % kPlacementHorizon]);
+      }
+      if (c == 0 || peak < best_peak) {
+        best_peak = peak;
+        entry.offset = offset;
+      }
+    }
+
+    entry.placed = true;
+    add_load(entry);
+    Config::get().recordQueryPlacement(entry.name, entry.offset);
+  }
+}
+
+void ScheduleQueue::runDue(size_t step, const Predicate& predicate) {
+  // The expected cost of the queries called during this step.
+  size_t spent = 0;
+  bool checked_load = false;
+  bool high_load = false;
+
+  while (!queue_.empty() && std::get<0>(queue_.top()) <= step) {
+    auto due = std::get<1>(queue_.top());
+    auto index = std::get<2>(queue_.top());
+    queue_.pop();
+
+    auto& entry = entries_[index];
+    if (entry.cost > 0 && step < due + FLAGS_schedule_max_deferral) {
+      if (!checked_load && FLAGS_schedule_max_load > 0) {
+        checked_load = true;
+        high_load = getLoadPerCPU() > FLAGS_schedule_max_load;
+      }
+
+      // Always allow one query per step so a single costly query can run.
+      bool over_budget = FLAGS_schedule_cost_budget > 0 && spent > 0 &&
+                         spent + entry.cost > FLAGS_schedule_cost_budget;
+      if (over_budget || high_load) {
+        queue_.push(std::make_tuple(step + 1, due, index));
+        Config::get().recordQueryDeferral(entry.name);
+        continue;
+      }
+    }
+
+    auto next =
+        alignedStep(step + 1, entry.query.splayed_interval, entry.offset);
+    queue_.push(std::make_tuple(next, next, index));
+    if (entry.blacklisted) {
+      // Blacklist entries are only added when the schedule is created, so
+      // only queries blacklisted at build time need to be checked again.
+      entry.blacklisted =
+          Config::get().isQueryBlacklisted(entry.name, entry.query);
+      if (entry.blacklisted) {
+        continue;
+      }
+    }
+    spent += entry.cost;
+    predicate(entry.name, entry.query);
+  }
+}
+
+size_t ScheduleQueue::nextDue() const {
+  return (queue_.empty()) ? 0 : std::get<0>(queue_.top());
+}
+
 SQLInternal monitor(const std::string& name, const ScheduledQuery& query) {
+  // Snapshot the performance and times for the worker before running.
+  auto pid = std::to_string(PlatformProcess::getCurrentPid());
+  auto r0 = SQL::selectFrom({"resident_size", "user_time", "system_time"},
+                            "processes",
+                            "pid",
+                            EQUALS,
+                            pid);
+  auto t0 = getUnixTime();
+  Config::get().recordQueryStart(name);
+
+  // The profiler only measures the query, the recorded performance is also
+  // the expected cost used by the cost budget.
+  std::unique_ptr<CodeProfiler> profiler;
   if (FLAGS_enable_numeric_monitoring) {
-    CodeProfiler profiler(
+    profiler.reset(new CodeProfiler(
         {(boost::format("scheduler.pack.%s") % query.pack_name).str(),
          (boost::format("scheduler.global.query.%s.%s") % query.pack_name %
           query.name)
@@ -72,38 +348,29 @@ SQLInternal monitor(const std::string& name, const ScheduledQuery& query) {
          (boost::format("scheduler.query.%s.%s.%s") %
           monitoring::hostIdentifierKeys().scheme % query.pack_name %
           query.name)
-             .str()});
-    return SQLInternal(query.query, true);
-  } else {
-    // Snapshot the performance and times for the worker before running.
-    auto pid = std::to_string(PlatformProcess::getCurrentPid());
-    auto r0 = SQL::selectFrom({"resident_size", "user_time", "system_time"},
-                              "processes",
-                              "pid",
-                              EQUALS,
-                              pid);
-    auto t0 = getUnixTime();
-    Config::get().recordQueryStart(name);
-    SQLInternal sql(query.query, true);
-    // Snapshot the performance after, and compare.
-    auto t1 = getUnixTime();
-    auto r1 = SQL::selectFrom({"resident_size", "user_time", "system_time"},
-                              "processes",
-                              "pid",
-                              EQUALS,
-                              pid);
-    if (r0.size() > 0 && r1.size() > 0) {
-      // Always called while processes table is working.
-      Config::get().recordQueryPerformance(name, t1 - t0, r0[0], r1[0]);
-    }
-    return sql;
+             .str()}));
+  }
+  SQLInternal sql(query.query, true);
+  profiler.reset();
+
+  // Snapshot the performance after, and compare.
+  auto t1 = getUnixTime();
+  auto r1 = SQL::selectFrom({"resident_size", "user_time", "system_time"},
+                            "processes",
+                            "pid",
+                            EQUALS,
+                            pid);
+  if (r0.size() > 0 && r1.size() > 0) {
+    // Always called while processes table is working.
+    Config::get().recordQueryPerformance(name, t1 - t0, r0[0], r1[0]);
   }
+  return sql;
 }
 
 Status launchQuery(const std::string& name, const ScheduledQuery& query) {
   // Execute the scheduled query and create a named query object.
   LOG(INFO) << "Executing scheduled query " << name << ": " << query.query;
-  runDecorators(DECORATE_ALWAYS);
+  runDecorators(DECORATE_ALWAYS, TablePlugin::kCacheStep);
 
   auto sql = monitor(name, query);
   if (!sql.getStatus().ok()) {
@@ -178,27 +445,103 @@ Status launchQuery(const std::string& name, const ScheduledQuery& query) {
   return status;
 }
 
+ScheduleBenchmark::Usage& ScheduleBenchmark::Usage::operator+=(
+    const Usage& other) {
+  executions += other.executions;
+  cpu_us += other.cpu_us;
+  wall_us += other.wall_us;
+  process_heap_bytes += other.process_heap_bytes;
+  process_db_bytes += other.process_db_bytes;
+  process_log_bytes += other.process_log_bytes;
+  return *this;
+}
+
+Status ScheduleBenchmark::launch(const std::string& name,
+                                 const ScheduledQuery& query) {
+  auto db_bytes = getDatabaseBytesWritten();
+  auto log_bytes = getResultLogBytes();
+  auto heap_bytes = getHeapBytes();
+  auto cpu_us = getThreadCPUTime();
+  auto wall = std::chrono::steady_clock::now();
+
+  auto status = launchQuery(name, query);
+
+  auto& usage = queries_[name];
+  usage.wall_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - wall)
+                       .count();
+  usage.cpu_us += getThreadCPUTime() - cpu_us;
+  usage.process_heap_bytes += getHeapBytes() - heap_bytes;
+  usage.process_log_bytes += getResultLogBytes() - log_bytes;
+  usage.process_db_bytes += getDatabaseBytesWritten() - db_bytes;
+  usage.executions++;
+  return status;
+}
+
+ScheduleBenchmark::Usage ScheduleBenchmark::total() const {
+  Usage total;
+  for (const auto& query : queries_) {
+    total += query.second;
+  }
+  return total;
+}
+
+static void addUsage(JSON& doc,
+                     const ScheduleBenchmark::Usage& usage,
+                     rapidjson::Value& obj) {
+  doc.add("executions", usage.executions, obj);
+  doc.add("cpu_us", usage.cpu_us, obj);
+  doc.add("wall_us", usage.wall_us, obj);
+  doc.add("process_heap_bytes", usage.process_heap_bytes, obj);
+  doc.add("process_db_bytes", usage.process_db_bytes, obj);
+  doc.add("process_log_bytes", usage.process_log_bytes, obj);
+}
+
+Status ScheduleBenchmark::report(size_t steps, std::string& json) const {
+  auto doc = JSON::newObject();
+  doc.add("steps", steps);
+
+  auto queries = doc.getObject();
+  for (const auto& query : queries_) {
+    auto obj = doc.getObject();
+    addUsage(doc, query.second, obj);
+    doc.add(query.first, obj, queries);
+  }
+  doc.add("queries", queries);
+
+  auto total = doc.getObject();
+  addUsage(doc, this->total(), total);
+  doc.add("total", total);
+  return doc.toString(json);
+}
+
 void SchedulerRunner::start() {
   // Start the counter at the second.
   auto i = osquery::getUnixTime();
-  for (; (timeout_ == 0) || (i <= timeout_); ++i) {
+  // The first step not yet considered by the queue, in case it is rebuilt.
+  auto from = i;
+  ScheduleQueue queue;
+  while ((timeout_ == 0) || (i <= timeout_)) {
     auto start_time_point = std::chrono::steady_clock::now();
-    Config::get().scheduledQueries(
-        ([&i](const std::string& name, const ScheduledQuery& query) {
-          if (query.splayed_interval > 0 && i % query.splayed_interval == 0) {
-            TablePlugin::kCacheInterval = query.splayed_interval;
-            TablePlugin::kCacheStep = i;
-            const auto status = launchQuery(name, query);
-            monitoring::record(
-                (boost::format("scheduler.query.%s.%s.status.%s") %
-                 query.pack_name % query.name %
-                 (status.ok() ? "success" : "failure"))
-                    .str(),
-                1,
-                monitoring::PreAggregationType::Sum,
-                true);
-          }
-        }));
+    // A config update may have changed the schedule since the last step.
+    queue.refresh(from);
+    queue.runDue(i, ([this, &i](const std::string& name,
+                                const ScheduledQuery& query) {
+      TablePlugin::kCacheInterval = query.splayed_interval;
+      TablePlugin::kCacheStep = i;
+      const auto status = (benchmark_ != nullptr)
+                              ? benchmark_->launch(name, query)
+                              : launchQuery(name, query);
+      monitoring::record((boost::format("scheduler.query.%s.%s.status.%s") %
+                          query.pack_name % query.name %
+                          (status.ok() ? "success" : "failure"))
+                             .str(),
+                         1,
+                         monitoring::PreAggregationType::Sum,
+                         true);
+    }));
+    // Table rows shared by this step's queries are no longer fresh.
+    TableSnapshotCache::get().clear();
     // Configuration decorators run on 60 second intervals only.
     if ((i % 60) == 0) {
       runDecorators(DECORATE_INTERVAL, i);
@@ -214,23 +557,43 @@ void SchedulerRunner::start() {
     if ((i % 3) == 0) {
       relayStatusLogs(true);
     }
-    auto loop_step_duration =
-        std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - start_time_point);
-    if (loop_step_duration + time_drift_ < interval_) {
-      pause(std::chrono::milliseconds(interval_ - loop_step_duration -
-                                      time_drift_));
-      time_drift_ = std::chrono::milliseconds::zero();
-    } else {
-      time_drift_ += loop_step_duration - interval_;
-      if (time_drift_ > max_time_drift_) {
-        // giving up
+
+    // Skip ahead to the next step with work: a due query or periodic upkeep.
+    auto next = nextMultiple(i, 3);
+    if (FLAGS_schedule_reload > 0) {
+      next = std::min(next, nextMultiple(i, FLAGS_schedule_reload));
+    }
+    if (timeout_ > 0) {
+      next = std::min(next, static_cast<size_t>(timeout_) + 1);
+    }
+    if (queue.nextDue() > 0) {
+      next = std::min(next, queue.nextDue());
+    }
+
+    // A benchmark's simulated clock moves to the next step without waiting.
+    if (benchmark_ == nullptr) {
+      auto step_interval =
+          interval_ * static_cast<std::chrono::milliseconds::rep>(next - i);
+      auto loop_step_duration =
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now() - start_time_point);
+      if (loop_step_duration + time_drift_ < step_interval) {
+        pause(std::chrono::milliseconds(step_interval - loop_step_duration -
+                                        time_drift_));
         time_drift_ = std::chrono::milliseconds::zero();
+      } else {
+        time_drift_ += loop_step_duration - step_interval;
+        if (time_drift_ > max_time_drift_) {
+          // giving up
+          time_drift_ = std::chrono::milliseconds::zero();
+        }
       }
     }
     if (interrupted()) {
       break;
     }
+    from = i + 1;
+    i = next;
   }
 }
 
@@ -247,4 +610,19 @@ void startScheduler(unsigned long int timeout, size_t interval) {
   Dispatcher::addService(std::make_shared<SchedulerRunner>(
       timeout, interval, std::chrono::seconds{FLAGS_schedule_max_drift}));
 }
+
+Status runScheduleBenchmark(size_t seconds, std::string& report) {
+  if (seconds == 0) {
+    return Status::failure("A schedule benchmark needs at least one second");
+  }
+
+  ScheduleBenchmark benchmark;
+  auto timeout = getUnixTime() + seconds - 1;
+  SchedulerRunner runner(static_cast<unsigned long int>(timeout),
+                         1,
+                         std::chrono::milliseconds::zero(),
+                         &benchmark);
+  runner.start();
+  return benchmark.report(seconds, report);
+}
 } // namespace osquery
@@ -9,7 +9,13 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <vector>
 
 #include <osquery/dispatcher.h>
 
@@ -17,18 +23,161 @@
 
 namespace osquery {
 
+/**
+ * @brief A queue of scheduled queries ordered by their next execution step.
+ *
+ * The scheduler used to map across every scheduled query each second, which
+ * rebuilds each synthetic query name and checks the blacklist even when no
+ * query is due. The queue is built once from Config::scheduledQueries with
+ * the names precomputed, and is rebuilt when the config's schedule generation
+ * changes or after the pack discovery refresh interval.
+ *
+ * A query is due on each step that is a multiple of its splayed interval.
+ *
+ * When a CPU cost budget is configured the queue also uses each query's
+ * recorded performance to offset costly queries within their intervals, and
+ * defers due queries while a step's expected cost exceeds the budget or the
+ * system load is high.
+ */
+class ScheduleQueue {
+ public:
+  using Predicate =
+      std::function<void(const std::string& name, const ScheduledQuery& query)>;
+
+ public:
+  /**
+   * @brief Rebuild the queue if the config's schedule has changed.
+   *
+   * @param step The first step the rebuilt queue should consider due.
+   * @return true if the queue was rebuilt.
+   */
+  bool refresh(size_t step);
+
+  /// Unconditionally rebuild the queue from the config's schedule.
+  void rebuild(size_t step);
+
+  /**
+   * @brief Call the predicate for each query due at or before the step.
+   *
+   * Each query that is called is rescheduled for its next interval. A query
+   * may be deferred to the next step instead, up to a maximum deferral.
+   */
+  void runDue(size_t step, const Predicate& predicate);
+
+  /// The next step with a due query, or 0 if the queue is empty.
+  size_t nextDue() const;
+
+  /// The number of scheduled queries in the queue.
+  size_t size() const {
+    return entries_.size();
+  }
+
+ private:
+  struct Entry {
+    /// The precomputed, possibly synthetic, query name.
+    std::string name;
+
+    /// A copy of the scheduled query taken when the queue was built.
+    ScheduledQuery query;
+
+    /// The query was blacklisted when the queue was built.
+    bool blacklisted{false};
+
+    /// The expected CPU milliseconds for each execution.
+    size_t cost{0};
+
+    /// Offset in seconds of the due steps within the interval.
+    size_t offset{0};
+
+    /// The offset was chosen by place.
+    bool placed{false};
+  };
+
+  /// The splayed interval and offset of each placed query, by name.
+  using Placements = std::map<std::string, std::pair<size_t, size_t>>;
+
+  /**
+   * @brief A step, the step the query was originally due, and an index.
+   *
+   * Items are ordered by step, then deferred queries first, then config order.
+   */
+  using Item = std::tuple<size_t, size_t, size_t>;
+
+ private:
+  /// Spread costly queries across their intervals, keeping placements.
+  void place(const Placements& placements);
+
+ private:
+  std::vector<Entry> entries_;
+
+  std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue_;
+
+  /// The config schedule generation used to build the queue.
+  size_t generation_{0};
+
+  /// The step when the queue was last built, zero if never built.
+  size_t built_{0};
+};
+
+/**
+ * @brief The resources used by scheduled queries during a benchmark.
+ *
+ * Each launch is measured by the calling thread's CPU time, the wall time,
+ * the change in heap bytes in use, and the bytes put into the database and
+ * serialized for loggers while the query ran.
+ *
+ * The byte counters are process-wide, so the process_ deltas also include
+ * the work of other threads, such as event publishers, during the launch.
+ */
+class ScheduleBenchmark {
+ public:
+  struct Usage {
+    size_t executions{0};
+    uint64_t cpu_us{0};
+    uint64_t wall_us{0};
+
+    /// Change in heap bytes in use, 0 where the allocator does not report it.
+    int64_t process_heap_bytes{0};
+
+    uint64_t process_db_bytes{0};
+    uint64_t process_log_bytes{0};
+
+    Usage& operator+=(const Usage& other);
+  };
+
+ public:
+  /// Launch and measure a scheduled query.
+  Status launch(const std::string& name, const ScheduledQuery& query);
+
+  /// Usage by query name.
+  const std::map<std::string, Usage>& queries() const {
+    return queries_;
+  }
+
+  /// Usage summed across queries.
+  Usage total() const;
+
+  /// A JSON report of each query's and the total usage.
+  Status report(size_t steps, std::string& json) const;
+
+ private:
+  std::map<std::string, Usage> queries_;
+};
+
 /// A Dispatcher service thread that watches an ExtensionManagerHandler.
 class SchedulerRunner : public InternalRunnable {
  public:
   SchedulerRunner(
       unsigned long int timeout,
       size_t interval,
-      std::chrono::milliseconds max_time_drift = std::chrono::seconds::zero())
+      std::chrono::milliseconds max_time_drift = std::chrono::seconds::zero(),
+      ScheduleBenchmark* benchmark = nullptr)
       : InternalRunnable("SchedulerRunner"),
         interval_{std::chrono::seconds{interval}},
         timeout_(timeout),
         time_drift_{std::chrono::milliseconds::zero()},
-        max_time_drift_{max_time_drift} {}
+        max_time_drift_{max_time_drift},
+        benchmark_(benchmark) {}
 
  public:
   /// The Dispatcher thread entry point.
@@ -53,6 +202,9 @@ class SchedulerRunner : public InternalRunnable {
   std::chrono::milliseconds time_drift_;
 
   const std::chrono::milliseconds max_time_drift_;
+
+  /// When set, steps are not paused and each launch is measured.
+  ScheduleBenchmark* const benchmark_;
 };
 
 SQLInternal monitor(const std::string& name, const ScheduledQuery& query);
@@ -62,4 +214,12 @@ void startScheduler();
 
 /// Helper scheduler start with variable settings for testing.
 void startScheduler(unsigned long int timeout, size_t interval);
+
+/**
+ * @brief Run the config's schedule for a number of simulated seconds.
+ *
+ * Steps are run back to back on the calling thread, and the JSON report of
+ * ScheduleBenchmark is returned.
+ */
+Status runScheduleBenchmark(size_t seconds, std::string& report);
 }
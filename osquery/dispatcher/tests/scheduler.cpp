@@ -16,13 +16,16 @@
 #include <osquery/config/config.h>
 #include <osquery/dispatcher/scheduler.h>
 #include <osquery/sql/sqlite_util.h>
+#include <osquery/utils/json/json.h>
 #include <osquery/utils/system/time.h>
 
 namespace osquery {
 
 DECLARE_bool(disable_database);
 DECLARE_bool(disable_logging);
+DECLARE_bool(enable_numeric_monitoring);
 DECLARE_uint64(schedule_reload);
+DECLARE_uint64(schedule_cost_budget);
 
 class SchedulerTests : public testing::Test {
   void SetUp() override {
@@ -81,6 +84,16 @@ TEST_F(SchedulerTests, test_monitor) {
   // We are not concerned with the APPROX value, only that it was recorded.
   getDatabaseValue(kPersistentSettings, "timestamp." + name, timestamp);
   EXPECT_FALSE(timestamp.empty());
+
+  // Numeric monitoring does not replace the recorded performance.
+  auto backup_monitoring = FLAGS_enable_numeric_monitoring;
+  FLAGS_enable_numeric_monitoring = true;
+  results = monitor(name, query);
+  FLAGS_enable_numeric_monitoring = backup_monitoring;
+  EXPECT_EQ(results.rowsTyped().size(), 1U);
+  Config::get().getPerformanceStats(
+      name, ([&perf](const QueryPerformance& r) { perf = r; }));
+  EXPECT_EQ(perf.executions, 2U);
 }
 
 TEST_F(SchedulerTests, test_config_results_purge) {
@@ -254,6 +267,156 @@ TEST_F(SchedulerTests, test_scheduler_drift_accumulation) {
   TablePlugin::kCacheInterval = backup_interval;
 }
 
+TEST_F(SchedulerTests, test_schedule_queue) {
+  std::string config = R"config(
+  {
+    "packs": {
+      "queue": {
+        "queries": {
+          "1": {"query": "select 1 as number", "interval": 1},
+          "2": {"query": "select 2 as number", "interval": 2},
+          "3": {"query": "select 3 as number", "interval": 3}
+        }
+      }
+    }
+  })config";
+  Config::get().update({{"data", config}});
+
+  std::vector<std::string> executed;
+  auto predicate = ([&executed](const std::string& name,
+                                const ScheduledQuery& query) {
+    executed.push_back(name);
+  });
+
+  // The queue is built on the first refresh and holds precomputed names.
+  ScheduleQueue queue;
+  EXPECT_TRUE(queue.refresh(600));
+  EXPECT_EQ(queue.size(), 3U);
+  EXPECT_FALSE(queue.refresh(601));
+
+  // Step 600 is a multiple of every interval.
+  queue.runDue(600, predicate);
+  std::vector<std::string> expected = {
+      "pack_queue_1", "pack_queue_2", "pack_queue_3"};
+  EXPECT_EQ(executed, expected);
+  EXPECT_EQ(queue.nextDue(), 601U);
+
+  executed.clear();
+  queue.runDue(601, predicate);
+  expected = {"pack_queue_1"};
+  EXPECT_EQ(executed, expected);
+
+  // A skipped step runs each overdue query once, in config order.
+  executed.clear();
+  queue.runDue(603, predicate);
+  expected = {"pack_queue_1", "pack_queue_2", "pack_queue_3"};
+  EXPECT_EQ(executed, expected);
+  EXPECT_EQ(queue.nextDue(), 604U);
+
+  // Changing the config's schedule invalidates the queue.
+  config = R"config(
+  {
+    "packs": {
+      "queue": {
+        "queries": {
+          "1": {"query": "select 1 as number", "interval": 1}
+        }
+      }
+    }
+  })config";
+  Config::get().update({{"data", config}});
+  EXPECT_TRUE(queue.refresh(604));
+  EXPECT_EQ(queue.size(), 1U);
+}
+
+TEST_F(SchedulerTests, test_schedule_queue_placement) {
+  std::string config = R"config(
+  {
+    "packs": {
+      "placement": {
+        "queries": {
+          "1": {"query": "select 1 as number", "interval": 2},
+          "2": {"query": "select 2 as number", "interval": 2},
+          "3": {"query": "select 3 as number", "interval": 1},
+          "4": {"query": "select 4 as number", "interval": 1}
+        }
+      }
+    }
+  })config";
+  Config::get().update({{"data", config}});
+
+  // Give every query a recorded cost of 100ms of CPU time.
+  Row r0 = {{"user_time", "0"}, {"system_time", "0"}, {"resident_size", ""}};
+  Row r1 = {{"user_time", "60"}, {"system_time", "40"}, {"resident_size", ""}};
+  for (const auto& name : {"pack_placement_1",
+                           "pack_placement_2",
+                           "pack_placement_3",
+                           "pack_placement_4"}) {
+    Config::get().recordQueryPerformance(name, 1, r0, r1);
+  }
+
+  auto backup_budget = FLAGS_schedule_cost_budget;
+  FLAGS_schedule_cost_budget = 300;
+
+  std::vector<std::string> executed;
+  auto predicate = ([&executed](const std::string& name,
+                                const ScheduledQuery& query) {
+    executed.push_back(name);
+  });
+
+  // The two costly queries sharing an interval are offset from each other.
+  ScheduleQueue queue;
+  queue.rebuild(600);
+  queue.runDue(600, predicate);
+  std::vector<std::string> expected = {
+      "pack_placement_1", "pack_placement_3", "pack_placement_4"};
+  EXPECT_EQ(executed, expected);
+
+  executed.clear();
+  queue.runDue(601, predicate);
+  expected = {"pack_placement_2", "pack_placement_3", "pack_placement_4"};
+  EXPECT_EQ(executed, expected);
+
+  QueryPerformance perf;
+  Config::get().getPerformanceStats(
+      "pack_placement_2", ([&perf](const QueryPerformance& r) { perf = r; }));
+  EXPECT_EQ(perf.placement, 1U);
+
+  // A tighter budget defers queries to the following step, oldest first.
+  FLAGS_schedule_cost_budget = 150;
+  executed.clear();
+  queue.runDue(602, predicate);
+  expected = {"pack_placement_1"};
+  EXPECT_EQ(executed, expected);
+
+  executed.clear();
+  queue.runDue(603, predicate);
+  expected = {"pack_placement_3"};
+  EXPECT_EQ(executed, expected);
+
+  Config::get().getPerformanceStats(
+      "pack_placement_4", ([&perf](const QueryPerformance& r) { perf = r; }));
+  EXPECT_EQ(perf.deferrals, 2U);
+
+  // A rebuild keeps the offsets of placed queries, even when their costs
+  // would now place them differently.
+  Row r2 = {
+      {"user_time", "300"}, {"system_time", "200"}, {"resident_size", ""}};
+  Config::get().recordQueryPerformance("pack_placement_2", 1, r0, r2);
+  FLAGS_schedule_cost_budget = 300;
+  queue.rebuild(604);
+  executed.clear();
+  queue.runDue(604, predicate);
+  expected = {"pack_placement_1", "pack_placement_3", "pack_placement_4"};
+  EXPECT_EQ(executed, expected);
+
+  Config::get().getPerformanceStats(
+      "pack_placement_2", ([&perf](const QueryPerformance& r) { perf = r; }));
+  EXPECT_EQ(perf.placement, 1U);
+
+  FLAGS_schedule_cost_budget = backup_budget;
+}
+
 TEST_F(SchedulerTests, test_scheduler_reload) {
   std::string config =
       "{\"schedule\":{\"1\":{"
@@ -266,4 +429,55 @@ TEST_F(SchedulerTests, test_scheduler_reload) {
   SchedulerRunner runner(expire, 1);
   FLAGS_schedule_reload = backup_reload;
 }
+
+TEST_F(SchedulerTests, test_schedule_benchmark) {
+  const auto backup_step = TablePlugin::kCacheStep;
+  const auto backup_interval = TablePlugin::kCacheInterval;
+
+  std::string config = R"config(
+  {
+    "packs": {
+      "benchmark": {
+        "queries": {
+          "1": {"query": "select 1 as number", "interval": 1},
+          "2": {"query": "select 2 as number", "interval": 2}
+        }
+      }
+    }
+  })config";
+  Config::get().update({{"data", config}});
+
+  // A minute of steps does not wait a minute.
+  auto start = std::chrono::steady_clock::now();
+  ScheduleBenchmark benchmark;
+  SchedulerRunner runner(static_cast<unsigned long int>(getUnixTime() + 59),
+                         1,
+                         std::chrono::milliseconds::zero(),
+                         &benchmark);
+  runner.start();
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::seconds(30));
+
+  const auto& queries = benchmark.queries();
+  ASSERT_EQ(queries.size(), 2U);
+  EXPECT_EQ(queries.at("pack_benchmark_1").executions, 60U);
+  EXPECT_EQ(queries.at("pack_benchmark_2").executions, 30U);
+
+  // The first execution of each query stores its results.
+  auto total = benchmark.total();
+  EXPECT_EQ(total.executions, 90U);
+  EXPECT_GT(total.process_db_bytes, 0U);
+  EXPECT_GE(total.wall_us, total.executions);
+
+  std::string json;
+  ASSERT_TRUE(benchmark.report(60, json).ok());
+  auto doc = JSON::newObject();
+  ASSERT_TRUE(doc.fromString(json).ok());
+  EXPECT_EQ(doc.doc()["steps"].GetUint64(), 60U);
+  EXPECT_EQ(doc.doc()["total"]["executions"].GetUint64(), 90U);
+  EXPECT_TRUE(doc.doc()["queries"].HasMember("pack_benchmark_2"));
+
+  TablePlugin::kCacheStep = backup_step;
+  TablePlugin::kCacheInterval = backup_interval;
+}
 }
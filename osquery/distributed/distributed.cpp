@@ -6,8 +6,14 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include <osquery/database.h>
 #include <osquery/distributed.h>
@@ -16,7 +22,9 @@
 #include <osquery/registry_factory.h>
 #include <osquery/sql.h>
 #include <osquery/system.h>
+#include <osquery/utils/conversions/tryto.h>
 #include <osquery/utils/json/json.h>
+#include <osquery/utils/scope_guard.h>
 #include <osquery/utils/system/time.h>
 
 namespace rj = rapidjson;
@@ -32,9 +40,45 @@ FLAG(bool,
      true,
      "Disable distributed queries (default true)");
 
+FLAG(uint64,
+     distributed_workers,
+     0,
+     "Run distributed queries concurrently on this many threads and write "
+     "each result as it completes (default 0, run serially)");
+
+FLAG(uint64,
+     distributed_query_timeout,
+     0,
+     "Seconds a distributed query may run before it is interrupted "
+     "(default 0, no limit)");
+
+FLAG(uint64,
+     distributed_write_chunk_rows,
+     0,
+     "Split each concurrently written result into writes of at most this "
+     "many rows (default 0, no limit)");
+
+HIDDEN_FLAG(uint64,
+            distributed_max_attempts,
+            1,
+            "Times a distributed query may be started before it is reported "
+            "as failed instead (default 1)");
+
+/// Prefix of requests queued in the kQueries domain by earlier versions.
 const std::string kDistributedQueryPrefix{"distributed."};
 
-std::string Distributed::currentRequestId_{""};
+/// Queue keys, request positions are zero-padded so keys sort in order.
+const std::string kQueueHeadKey{"head"};
+const std::string kQueueTailKey{"tail"};
+const std::string kQueueRequestPrefix{"request."};
+const std::string kQueueAttemptsPrefix{"attempts."};
+
+static std::string queueKey(const std::string& prefix, uint64_t index) {
+  auto position = std::to_string(index);
+  return prefix + std::string(20 - position.size(), '0') + position;
+}
+
+thread_local std::string Distributed::currentRequestId_{""};
 
 Status DistributedPlugin::call(const PluginRequest& request,
                                PluginResponse& response) {
@@ -78,10 +122,159 @@ Status Distributed::pullUpdates() {
   return Status::success();
 }
 
+void DistributedQueue::load() {
+  if (loaded_) {
+    return;
+  }
+  loaded_ = true;
+
+  std::string value;
+  if (getDatabaseValue(kDistributedQueue, kQueueHeadKey, value).ok()) {
+    head_ = tryTo<uint64_t>(value).takeOr(uint64_t{0});
+  }
+  if (getDatabaseValue(kDistributedQueue, kQueueTailKey, value).ok()) {
+    tail_ = tryTo<uint64_t>(value).takeOr(uint64_t{0});
+  }
+  tail_ = std::max(head_, tail_);
+  next_ = head_;
+
+  // This scan only finds requests left behind by an upgrade.
+  std::vector<std::string> legacy;
+  scanDatabaseKeys(kQueries, legacy, kDistributedQueryPrefix);
+  for (const auto& key : legacy) {
+    DistributedQueryRequest request;
+    request.id = key.substr(kDistributedQueryPrefix.size());
+    if (getDatabaseValue(kQueries, key, request.query).ok() &&
+        append(request).ok()) {
+      deleteDatabaseValue(kQueries, key);
+    }
+  }
+}
+
+Status DistributedQueue::append(const DistributedQueryRequest& request) {
+  std::string json;
+  auto s = serializeDistributedQueryRequestJSON(request, json);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // The request and the new tail are written together.
+  s = setDatabaseBatch(kDistributedQueue,
+                       {{queueKey(kQueueRequestPrefix, tail_), json},
+                        {kQueueTailKey, std::to_string(tail_ + 1)}});
+  if (s.ok()) {
+    tail_++;
+  }
+  return s;
+}
+
+Status DistributedQueue::push(const DistributedQueryRequest& request) {
+  WriteLock lock(mutex_);
+  load();
+  return append(request);
+}
+
+bool DistributedQueue::claim(DistributedQueryRequest& request,
+                             uint64_t& index,
+                             size_t& attempts) {
+  WriteLock lock(mutex_);
+  load();
+
+  while (!released_.empty() || next_ < tail_) {
+    if (!released_.empty()) {
+      index = *released_.begin();
+      released_.erase(released_.begin());
+    } else {
+      index = next_++;
+    }
+
+    // Requests acknowledged before a restart no longer exist.
+    std::string json;
+    auto request_key = queueKey(kQueueRequestPrefix, index);
+    if (!getDatabaseValue(kDistributedQueue, request_key, json).ok() ||
+        !deserializeDistributedQueryRequestJSON(json, request).ok()) {
+      deleteDatabaseValue(kDistributedQueue, request_key);
+      deleteDatabaseValue(kDistributedQueue,
+                          queueKey(kQueueAttemptsPrefix, index));
+      acknowledged_.insert(index);
+      continue;
+    }
+
+    // Count the claim before the request runs, it may not return.
+    std::string value;
+    auto attempts_key = queueKey(kQueueAttemptsPrefix, index);
+    attempts = 1;
+    if (getDatabaseValue(kDistributedQueue, attempts_key, value).ok()) {
+      attempts += tryTo<size_t>(value).takeOr(size_t{0});
+    }
+    setDatabaseValue(kDistributedQueue, attempts_key, std::to_string(attempts));
+    advance();
+    return true;
+  }
+  advance();
+  return false;
+}
+
+Status DistributedQueue::acknowledge(uint64_t index) {
+  WriteLock lock(mutex_);
+  load();
+
+  auto s = deleteDatabaseValue(kDistributedQueue,
+                               queueKey(kQueueRequestPrefix, index));
+  if (!s.ok()) {
+    return s;
+  }
+  deleteDatabaseValue(kDistributedQueue, queueKey(kQueueAttemptsPrefix, index));
+
+  acknowledged_.insert(index);
+  return advance();
+}
+
+Status DistributedQueue::release(uint64_t index) {
+  WriteLock lock(mutex_);
+  load();
+
+  std::string value;
+  auto attempts_key = queueKey(kQueueAttemptsPrefix, index);
+  if (getDatabaseValue(kDistributedQueue, attempts_key, value).ok()) {
+    auto attempts = tryTo<size_t>(value).takeOr(size_t{0});
+    auto s = (attempts > 1)
+                 ? setDatabaseValue(kDistributedQueue,
+                                    attempts_key,
+                                    std::to_string(attempts - 1))
+                 : deleteDatabaseValue(kDistributedQueue, attempts_key);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
+  released_.insert(index);
+  return Status::success();
+}
+
+Status DistributedQueue::advance() {
+  // The head only moves past a contiguous run of acknowledged requests.
+  auto head = head_;
+  while (!acknowledged_.empty() && *acknowledged_.begin() == head_) {
+    acknowledged_.erase(acknowledged_.begin());
+    head_++;
+  }
+
+  if (head_ != head) {
+    return setDatabaseValue(
+        kDistributedQueue, kQueueHeadKey, std::to_string(head_));
+  }
+  return Status::success();
+}
+
+size_t DistributedQueue::pending() {
+  WriteLock lock(mutex_);
+  load();
+  return static_cast<size_t>(tail_ - next_) + released_.size();
+}
+
 size_t Distributed::getPendingQueryCount() {
-  std::vector<std::string> queries;
-  scanDatabaseKeys(kQueries, queries, kDistributedQueryPrefix);
-  return queries.size();
+  return queue_->pending();
 }
 
 size_t Distributed::getCompletedCount() {
@@ -111,26 +304,197 @@ void Distributed::addResult(const DistributedQueryResult& result) {
   results_.push_back(result);
 }
 
+DistributedQueryResult Distributed::runQuery(
+    const DistributedQueryRequest& request, size_t attempts) {
+  if (attempts > FLAGS_distributed_max_attempts) {
+    LOG(WARNING) << "Not executing distributed query: " << request.id
+                 << ": it did not complete in " << (attempts - 1)
+                 << " previous attempt(s)";
+    return DistributedQueryResult(
+        request,
+        {},
+        {},
+        Status(1, "Distributed query did not complete in a previous run"));
+  }
+
+  LOG(INFO) << "Executing distributed query: " << request.id << ": "
+            << request.query;
+
+  // Keep track of the request executing on this thread, for carves.
+  Distributed::setCurrentRequestId(request.id);
+  auto const request_id_guard =
+      scope_guard::create([]() { Distributed::setCurrentRequestId(""); });
+
+  std::unique_ptr<SQLDeadline> deadline;
+  if (FLAGS_distributed_query_timeout > 0) {
+    deadline = std::make_unique<SQLDeadline>(
+        std::chrono::seconds(FLAGS_distributed_query_timeout));
+  }
+
+  SQL sql(request.query);
+  if (!sql.getStatus().ok()) {
+    LOG(ERROR) << "Error executing distributed query: " << request.id << ": "
+               << sql.getMessageString();
+  }
+
+  return DistributedQueryResult(
+      request, sql.rows(), sql.columns(), sql.getStatus());
+}
+
 Status Distributed::runQueries() {
-  while (getPendingQueryCount() > 0) {
-    auto request = popRequest();
-    LOG(INFO) << "Executing distributed query: " << request.id << ": "
-              << request.query;
-
-    // Keep track of the currently executing request
-    Distributed::setCurrentRequestId(request.id);
-
-    SQL sql(request.query);
-    if (!sql.getStatus().ok()) {
-      LOG(ERROR) << "Error executing distributed query: " << request.id << ": "
-                 << sql.getMessageString();
+  if (FLAGS_distributed_workers > 0) {
+    return runQueriesConcurrently();
+  }
+
+  DistributedQueryRequest request;
+  uint64_t index = 0;
+  size_t attempts = 0;
+  std::vector<uint64_t> claimed;
+  while (popRequest(request, index, attempts)) {
+    addResult(runQuery(request, attempts));
+    claimed.push_back(index);
+  }
+
+  // Requests are only removed once their results are written, the others
+  // run again on the next call.
+  auto status = flushCompleted();
+  if (!status.ok()) {
+    results_.clear();
+  }
+  for (auto claimed_index : claimed) {
+    if (status.ok()) {
+      queue_->acknowledge(claimed_index);
+    } else {
+      queue_->release(claimed_index);
     }
+  }
+  return status;
+}
 
-    DistributedQueryResult result(
-        request, sql.rows(), sql.columns(), sql.getStatus());
-    addResult(result);
+Status Distributed::runQueriesConcurrently() {
+  auto pending = getPendingQueryCount();
+  if (pending == 0) {
+    return Status::success();
   }
-  return flushCompleted();
+
+  // Workers claim requests one at a time, in order, so the cheap queries
+  // queued behind an expensive one are not held up by it. A request's
+  // attempt is only counted once a worker starts it.
+  std::mutex write_mutex;
+  Status status;
+  std::vector<uint64_t> unwritten;
+  std::atomic<bool> write_failed{false};
+  auto worker = [&]() {
+    DistributedQueryRequest request;
+    uint64_t index = 0;
+    size_t attempts = 0;
+    while (!write_failed && popRequest(request, index, attempts)) {
+      auto result = runQuery(request, attempts);
+
+      // Writes are serialized, the plugin may not be re-entrant.
+      std::lock_guard<std::mutex> lock(write_mutex);
+      auto s = writeResult(result);
+      if (s.ok()) {
+        queue_->acknowledge(index);
+        continue;
+      }
+
+      // Stop claiming requests, the writes are retried on the next call.
+      LOG(ERROR) << "Error writing distributed query results: " << request.id
+                 << ": " << s.getMessage();
+      status = s;
+      unwritten.push_back(index);
+      write_failed = true;
+    }
+  };
+
+  auto count = std::min<size_t>(FLAGS_distributed_workers, pending);
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < count; i++) {
+    workers.emplace_back(worker);
+  }
+
+  // The calling thread is the first worker.
+  worker();
+  for (auto& thread : workers) {
+    thread.join();
+  }
+
+  // Released only now, so no worker of this call claims them again.
+  for (auto index : unwritten) {
+    queue_->release(index);
+  }
+  return status;
+}
+
+Status Distributed::serializeResult(const DistributedQueryResult& result,
+                                    size_t first,
+                                    size_t count,
+                                    size_t chunk,
+                                    size_t chunks,
+                                    std::string& json) {
+  auto doc = JSON::newObject();
+  auto queries_obj = doc.getObject();
+  auto statuses_obj = doc.getObject();
+
+  auto arr = doc.getArray();
+  for (size_t i = first; i < first + count; i++) {
+    auto row_obj = doc.getObject();
+    auto s = serializeRow(result.results[i], result.columns, doc, row_obj);
+    if (!s.ok()) {
+      return s;
+    }
+    doc.push(row_obj, arr);
+  }
+  doc.add(result.request.id, arr, queries_obj);
+  doc.add(result.request.id, result.status.getCode(), statuses_obj);
+
+  doc.add("queries", queries_obj);
+  doc.add("statuses", statuses_obj);
+  if (chunks > 1) {
+    auto chunk_obj = doc.getObject();
+    doc.add("index", chunk, chunk_obj);
+    doc.add("count", chunks, chunk_obj);
+
+    auto chunks_obj = doc.getObject();
+    doc.add(result.request.id, chunk_obj, chunks_obj);
+    doc.add("chunks", chunks_obj);
+  }
+  return doc.toString(json);
+}
+
+Status Distributed::writeResult(const DistributedQueryResult& result) {
+  auto distributed_plugin = RegistryFactory::get().getActive("distributed");
+  if (!RegistryFactory::get().exists("distributed", distributed_plugin)) {
+    return Status(1, "Missing distributed plugin " + distributed_plugin);
+  }
+
+  auto rows = result.results.size();
+  auto chunk_rows = static_cast<size_t>(FLAGS_distributed_write_chunk_rows);
+  if (chunk_rows == 0) {
+    chunk_rows = std::max<size_t>(rows, 1);
+  }
+  auto chunks = std::max<size_t>((rows + chunk_rows - 1) / chunk_rows, 1);
+
+  for (size_t chunk = 0; chunk < chunks; chunk++) {
+    auto first = chunk * chunk_rows;
+    auto count = std::min(chunk_rows, rows - first);
+
+    std::string json;
+    auto s = serializeResult(result, first, count, chunk, chunks, json);
+    if (!s.ok()) {
+      return s;
+    }
+
+    PluginResponse response;
+    s = Registry::call("distributed",
+                       {{"action", "writeResults"}, {"results", json}},
+                       response);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::success();
 }
 
 Status Distributed::flushCompleted() {
@@ -211,7 +575,10 @@ Status Distributed::acceptWork(const std::string& work) {
         }
 
         if (queries_to_run.empty() || queries_to_run.count(name)) {
-          setDatabaseValue(kQueries, kDistributedQueryPrefix + name, query);
+          DistributedQueryRequest request;
+          request.id = std::move(name);
+          request.query = std::move(query);
+          queue_->push(request);
         }
       }
     }
@@ -232,18 +599,10 @@ Status Distributed::acceptWork(const std::string& work) {
   return Status::success();
 }
 
-DistributedQueryRequest Distributed::popRequest() {
-  // Read all pending queries.
-  std::vector<std::string> queries;
-  scanDatabaseKeys(kQueries, queries, kDistributedQueryPrefix);
-
-  // Set the last-most-recent query as the request, and delete it.
-  DistributedQueryRequest request;
-  const auto& next = queries.front();
-  request.id = next.substr(kDistributedQueryPrefix.size());
-  getDatabaseValue(kQueries, next, request.query);
-  deleteDatabaseValue(kQueries, next);
-  return request;
+bool Distributed::popRequest(DistributedQueryRequest& request,
+                             uint64_t& index,
+                             size_t& attempts) {
+  return queue_->claim(request, index, attempts);
 }
 
 std::string Distributed::getCurrentRequestId() {
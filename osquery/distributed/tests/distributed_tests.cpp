@@ -6,7 +6,11 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <map>
+#include <mutex>
 
 #include <gtest/gtest.h>
 
@@ -26,6 +30,55 @@ namespace osquery {
 DECLARE_bool(disable_database);
 DECLARE_string(distributed_tls_read_endpoint);
 DECLARE_string(distributed_tls_write_endpoint);
+DECLARE_uint64(distributed_workers);
+DECLARE_uint64(distributed_query_timeout);
+DECLARE_uint64(distributed_write_chunk_rows);
+
+/// A query that keeps SQLite busy for a noticeable time.
+const std::string kSlowDistributedQuery{
+    "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c "
+    "WHERE x < 3000000) SELECT count(*) AS n FROM c"};
+
+/**
+ * A local stand-in for the TLS distributed plugin.
+ *
+ * Serves a fixed set of queries and records when each write arrives.
+ */
+class StandInDistributedPlugin : public DistributedPlugin {
+ public:
+  Status getQueries(std::string& json) override {
+    json = queries_;
+    start_ = std::chrono::steady_clock::now();
+    return Status::success();
+  }
+
+  Status writeResults(const std::string& json) override {
+    auto doc = JSON::newObject();
+    if (!doc.fromString(json) || !doc.doc().IsObject()) {
+      return Status(1, "Malformed distributed write");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_);
+    for (const auto& query : doc.doc()["queries"].GetObject()) {
+      std::string id = query.name.GetString();
+      writes_.push_back({id, elapsed});
+      rows_[id] += query.value.GetArray().Size();
+      statuses_[id] = doc.doc()["statuses"][id.c_str()].GetInt();
+    }
+    return Status::success();
+  }
+
+ public:
+  std::string queries_;
+  std::chrono::steady_clock::time_point start_;
+
+  std::mutex mutex_;
+  std::vector<std::pair<std::string, std::chrono::milliseconds>> writes_;
+  std::map<std::string, size_t> rows_;
+  std::map<std::string, int> statuses_;
+};
 
 class DistributedTests : public testing::Test {
  protected:
@@ -186,6 +239,282 @@ TEST_F(DistributedTests, test_deserialize_distributed_query_result_json) {
   EXPECT_EQ(r.results[0]["foo"], "bar");
 }
 
+TEST_F(DistributedTests, test_serialize_result_chunks) {
+  DistributedQueryResult r;
+  r.request.id = "foo";
+  r.columns = {"i"};
+  for (size_t i = 0; i < 5; i++) {
+    r.results.push_back({{"i", std::to_string(i)}});
+  }
+
+  std::string json;
+  auto s = Distributed::serializeResult(r, 2, 2, 1, 3, json);
+  ASSERT_TRUE(s.ok());
+
+  auto doc = JSON::newObject();
+  ASSERT_TRUE(doc.fromString(json));
+  ASSERT_EQ(doc.doc()["queries"]["foo"].Size(), 2U);
+  const auto& rows = doc.doc()["queries"]["foo"];
+  EXPECT_EQ(std::string(rows[0]["i"].GetString()), "2");
+  EXPECT_EQ(doc.doc()["statuses"]["foo"].GetInt(), 0);
+  EXPECT_EQ(doc.doc()["chunks"]["foo"]["index"].GetUint64(), 1U);
+  EXPECT_EQ(doc.doc()["chunks"]["foo"]["count"].GetUint64(), 3U);
+
+  // A result written in one request carries no chunk information.
+  s = Distributed::serializeResult(r, 0, 5, 0, 1, json);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(doc.fromString(json));
+  EXPECT_FALSE(doc.doc().HasMember("chunks"));
+}
+
+TEST_F(DistributedTests, test_concurrent_time_to_first_result) {
+  auto& rf = RegistryFactory::get();
+  auto plugin = std::make_shared<StandInDistributedPlugin>();
+  rf.registry("distributed")->add("stand_in", plugin);
+  ASSERT_TRUE(rf.setActive("distributed", "stand_in").ok());
+
+  // The expensive query sorts first, so a serial run starts with it.
+  auto work = JSON::newObject();
+  auto queries = work.getObject();
+  work.addCopy("a_slow", kSlowDistributedQuery, queries);
+  for (size_t i = 0; i < 6; i++) {
+    work.addCopy("fast_" + std::to_string(i),
+                 "SELECT " + std::to_string(i) + " AS i",
+                 queries);
+  }
+  work.add("queries", queries);
+  work.toString(plugin->queries_);
+
+  auto workers = FLAGS_distributed_workers;
+  auto chunk_rows = FLAGS_distributed_write_chunk_rows;
+  std::map<size_t, std::chrono::milliseconds> first_result;
+  for (size_t mode : {0, 4}) {
+    FLAGS_distributed_workers = mode;
+    plugin->writes_.clear();
+    plugin->rows_.clear();
+
+    auto dist = Distributed();
+    ASSERT_TRUE(dist.pullUpdates().ok());
+    ASSERT_EQ(dist.getPendingQueryCount(), 7U);
+    EXPECT_TRUE(dist.runQueries().ok());
+    EXPECT_EQ(dist.getPendingQueryCount(), 0U);
+
+    ASSERT_EQ(plugin->rows_.size(), 7U);
+    for (const auto& status : plugin->statuses_) {
+      EXPECT_EQ(status.second, 0) << status.first;
+    }
+    first_result[mode] = plugin->writes_.front().second;
+
+    auto slow = std::find_if(
+        plugin->writes_.begin(),
+        plugin->writes_.end(),
+        [](const std::pair<std::string, std::chrono::milliseconds>& write) {
+          return write.first == "a_slow";
+        });
+    ASSERT_NE(slow, plugin->writes_.end());
+    if (mode == 0) {
+      // Serially, every result waits for the batch write.
+      EXPECT_EQ(plugin->writes_.front().second, slow->second);
+    } else {
+      // Concurrently, the cheap queries are answered while the slow runs.
+      EXPECT_NE(plugin->writes_.front().first, "a_slow");
+      EXPECT_EQ(plugin->writes_.back().first, "a_slow");
+    }
+  }
+
+  std::cout << "Time to first result: serial " << first_result[0].count()
+            << "ms, concurrent " << first_result[4].count() << "ms"
+            << std::endl;
+
+  // Large results are split across several writes.
+  FLAGS_distributed_write_chunk_rows = 2;
+  plugin->writes_.clear();
+  plugin->rows_.clear();
+  plugin->queries_ =
+      "{\"queries\": {\"rows\": \"WITH RECURSIVE c(x) AS (SELECT 1 UNION "
+      "ALL SELECT x + 1 FROM c WHERE x < 5) SELECT x FROM c\"}}";
+  auto dist = Distributed();
+  ASSERT_TRUE(dist.pullUpdates().ok());
+  EXPECT_TRUE(dist.runQueries().ok());
+  EXPECT_EQ(plugin->writes_.size(), 3U);
+  EXPECT_EQ(plugin->rows_["rows"], 5U);
+
+  FLAGS_distributed_workers = workers;
+  FLAGS_distributed_write_chunk_rows = chunk_rows;
+  rf.registry("distributed")->remove("stand_in");
+}
+
+TEST_F(DistributedTests, test_query_timeout) {
+  auto timeout = FLAGS_distributed_query_timeout;
+  FLAGS_distributed_query_timeout = 1;
+
+  // Without a limit this query would run for hours.
+  DistributedQueryRequest request;
+  request.id = "forever";
+  request.query =
+      "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) "
+      "SELECT count(*) FROM c";
+
+  auto dist = Distributed();
+  auto start = std::chrono::steady_clock::now();
+  auto result = dist.runQuery(request);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_FALSE(result.status.ok());
+  EXPECT_LT(elapsed, std::chrono::seconds(30));
+
+  // The deadline ends with the query.
+  FLAGS_distributed_query_timeout = 0;
+  request.query = "SELECT 1 AS one";
+  result = dist.runQuery(request);
+  EXPECT_TRUE(result.status.ok());
+  FLAGS_distributed_query_timeout = timeout;
+}
+
+/// Remove every queued request, so each test starts from an empty queue.
+static void clearDistributedQueue() {
+  std::vector<std::string> keys;
+  scanDatabaseKeys(kDistributedQueue, keys);
+  for (const auto& key : keys) {
+    deleteDatabaseValue(kDistributedQueue, key);
+  }
+}
+
+static DistributedQueryRequest makeRequest(const std::string& id) {
+  DistributedQueryRequest request;
+  request.id = id;
+  request.query = "SELECT '" + id + "' AS id";
+  return request;
+}
+
+TEST_F(DistributedTests, test_queue_fifo) {
+  clearDistributedQueue();
+
+  DistributedQueue queue;
+  EXPECT_EQ(queue.pending(), 0U);
+  for (const auto& id : {"first", "second", "third"}) {
+    EXPECT_TRUE(queue.push(makeRequest(id)).ok());
+  }
+  EXPECT_EQ(queue.pending(), 3U);
+
+  DistributedQueryRequest request;
+  uint64_t index = 0;
+  size_t attempts = 0;
+  for (const auto& id : {"first", "second", "third"}) {
+    ASSERT_TRUE(queue.claim(request, index, attempts));
+    EXPECT_EQ(request.id, id);
+    EXPECT_EQ(attempts, 1U);
+    EXPECT_TRUE(queue.acknowledge(index).ok());
+  }
+  EXPECT_EQ(queue.pending(), 0U);
+  EXPECT_FALSE(queue.claim(request, index, attempts));
+
+  // Only the head and tail indexes remain.
+  std::vector<std::string> keys;
+  scanDatabaseKeys(kDistributedQueue, keys);
+  EXPECT_EQ(keys.size(), 2U);
+}
+
+TEST_F(DistributedTests, test_queue_restart) {
+  clearDistributedQueue();
+
+  uint64_t first = 0;
+  {
+    DistributedQueue queue;
+    for (const auto& id : {"first", "second", "third"}) {
+      queue.push(makeRequest(id));
+    }
+
+    // The first request is running when the process stops, the second
+    // already completed.
+    DistributedQueryRequest request;
+    uint64_t second = 0;
+    size_t attempts = 0;
+    ASSERT_TRUE(queue.claim(request, first, attempts));
+    ASSERT_TRUE(queue.claim(request, second, attempts));
+    EXPECT_TRUE(queue.acknowledge(second).ok());
+    EXPECT_EQ(queue.pending(), 1U);
+  }
+
+  DistributedQueue queue;
+  DistributedQueryRequest request;
+  uint64_t index = 0;
+  size_t attempts = 0;
+  ASSERT_TRUE(queue.claim(request, index, attempts));
+  EXPECT_EQ(request.id, "first");
+  EXPECT_EQ(index, first);
+  EXPECT_EQ(attempts, 2U);
+  queue.acknowledge(index);
+
+  ASSERT_TRUE(queue.claim(request, index, attempts));
+  EXPECT_EQ(request.id, "third");
+  EXPECT_EQ(attempts, 1U);
+  queue.acknowledge(index);
+  EXPECT_FALSE(queue.claim(request, index, attempts));
+}
+
+TEST_F(DistributedTests, test_queue_release) {
+  clearDistributedQueue();
+
+  DistributedQueue queue;
+  for (const auto& id : {"first", "second"}) {
+    queue.push(makeRequest(id));
+  }
+
+  // A request whose results were not written is claimed again first, the
+  // returned claim is not counted.
+  DistributedQueryRequest request;
+  uint64_t index = 0;
+  size_t attempts = 0;
+  ASSERT_TRUE(queue.claim(request, index, attempts));
+  EXPECT_EQ(queue.pending(), 1U);
+  EXPECT_TRUE(queue.release(index).ok());
+  EXPECT_EQ(queue.pending(), 2U);
+
+  ASSERT_TRUE(queue.claim(request, index, attempts));
+  EXPECT_EQ(request.id, "first");
+  EXPECT_EQ(attempts, 1U);
+  queue.acknowledge(index);
+
+  ASSERT_TRUE(queue.claim(request, index, attempts));
+  EXPECT_EQ(request.id, "second");
+  queue.acknowledge(index);
+  EXPECT_FALSE(queue.claim(request, index, attempts));
+  EXPECT_EQ(queue.pending(), 0U);
+}
+
+TEST_F(DistributedTests, test_queue_adopts_legacy_requests) {
+  clearDistributedQueue();
+  setDatabaseValue(kQueries, "distributed.legacy", "SELECT 1 AS one");
+
+  DistributedQueue queue;
+  EXPECT_EQ(queue.pending(), 1U);
+
+  std::string value;
+  EXPECT_FALSE(getDatabaseValue(kQueries, "distributed.legacy", value).ok());
+
+  DistributedQueryRequest request;
+  uint64_t index = 0;
+  size_t attempts = 0;
+  ASSERT_TRUE(queue.claim(request, index, attempts));
+  EXPECT_EQ(request.id, "legacy");
+  EXPECT_EQ(request.query, "SELECT 1 AS one");
+  queue.acknowledge(index);
+}
+
+TEST_F(DistributedTests, test_queue_interrupted_request) {
+  clearDistributedQueue();
+
+  // A request that did not complete is reported instead of re-run.
+  auto dist = Distributed();
+  auto result = dist.runQuery(makeRequest("crashed"), 2);
+  EXPECT_FALSE(result.status.ok());
+  EXPECT_TRUE(result.results.empty());
+
+  result = dist.runQuery(makeRequest("retried"), 1);
+  EXPECT_TRUE(result.status.ok());
+  EXPECT_EQ(result.results.size(), 1U);
+}
+
 TEST_F(DistributedTests, DISABLED_test_workflow) {
   startServer();
 
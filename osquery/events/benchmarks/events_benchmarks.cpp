@@ -17,6 +17,9 @@
 
 namespace osquery {
 
+DECLARE_uint64(events_batch_size);
+DECLARE_bool(events_batch_wal);
+
 class BenchmarkEventPublisher
     : public EventPublisher<SubscriptionContext, EventContext> {
   DECLARE_PUBLISHER("benchmark");
@@ -66,6 +69,16 @@ class BenchmarkEventSubscriber
     addBatch(row_list, t);
   }
 
+  void benchmarkAddBuffered() {
+    Row r;
+    r["testing"] = "hello";
+    add(r);
+  }
+
+  void flushRows() {
+    flushBatch(true);
+  }
+
   void clearRows() {
     auto ee = expire_events_;
     auto et = expire_time_;
@@ -134,6 +147,30 @@ static void EVENTS_add_events(benchmark::State& state) {
 
 BENCHMARK(EVENTS_add_events);
 
+static void EVENTS_add_buffered_events(benchmark::State& state) {
+  auto batch_size = FLAGS_events_batch_size;
+  auto batch_wal = FLAGS_events_batch_wal;
+  FLAGS_events_batch_size = state.range(0);
+  FLAGS_events_batch_wal = (state.range(1) != 0);
+
+  auto sub = std::make_shared<BenchmarkEventSubscriber>();
+  while (state.KeepRunning()) {
+    sub->benchmarkAddBuffered();
+  }
+  sub->flushRows();
+  state.SetItemsProcessed(state.iterations());
+  sub->clearRows();
+
+  FLAGS_events_batch_size = batch_size;
+  FLAGS_events_batch_wal = batch_wal;
+}
+
+BENCHMARK(EVENTS_add_buffered_events)
+    ->ArgPair(1, 0)
+    ->ArgPair(100, 0)
+    ->ArgPair(1000, 0)
+    ->ArgPair(1000, 1);
+
 static void EVENTS_retrieve_events(benchmark::State& state) {
   auto sub = std::make_shared<BenchmarkEventSubscriber>();
 
@@ -6,8 +6,11 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <algorithm>
 #include <chrono>
 #include <exception>
+#include <iterator>
+#include <limits>
 #include <thread>
 
 #include <boost/algorithm/string.hpp>
@@ -32,8 +35,14 @@ namespace osquery {
 CREATE_REGISTRY(EventPublisherPlugin, "event_publisher");
 CREATE_REGISTRY(EventSubscriberPlugin, "event_subscriber");
 
-/// Checkpoint interval to inspect max event buffering.
-#define EVENTS_CHECKPOINT 256
+/// Interval between checks of the event expiration service.
+const std::chrono::milliseconds kEventsExpirationInterval{1000};
+
+/// Buffered rows are capped at this many batches when writes keep failing.
+const size_t kEventsBatchMaxBatches{10};
+
+/// Overflowing subscribers are expired by the service instead of inline.
+static std::atomic<bool> kExpirationServiceRunning{false};
 
 FLAG(bool, disable_events, false, "Disable osquery publish/subscribe system");
 
@@ -50,6 +59,39 @@ FLAG(uint64, events_expiry, 3600, "Timeout to expire event subscriber results");
 // overriding in subclasses
 FLAG(uint64, events_max, 50000, "Maximum number of events per type to buffer");
 
+FLAG(uint64,
+     events_batch_size,
+     1000,
+     "Number of event rows a subscriber buffers before writing (1 to disable)");
+
+FLAG(uint64,
+     events_batch_interval,
+     1000,
+     "Milliseconds event rows may be buffered before writing, rows buffered "
+     "when osquery crashes are lost unless events_batch_wal is set. Rows that "
+    "cannot be written are kept up to 10 batches, then the oldest are dropped");
+
+FLAG(bool,
+     events_batch_wal,
+     true,
+     "Log buffered event rows so they are written after a crash");
+
+/// Applies events_max expirations outside of the publisher threads.
+class EventExpirationRunner : public InternalRunnable {
+ public:
+  EventExpirationRunner() : InternalRunnable("EventExpirationRunner") {}
+
+ protected:
+  void start() override {
+    kExpirationServiceRunning = true;
+    while (!interrupted()) {
+      EventFactory::expireSubscribers();
+      pause(kEventsExpirationInterval);
+    }
+    kExpirationServiceRunning = false;
+  }
+};
+
 static inline EventTime timeFromRecord(const std::string& record) {
   // Convert a stored index "as string bytes" to a time value.
   return static_cast<EventTime>(tryTo<long long>(record).takeOr(0ll));
@@ -105,29 +147,27 @@ static inline void setOptimizeData(EventTime time,
 void EventSubscriberPlugin::genTable(RowYield& yield, QueryContext& context) {
   // Stop is an unsigned (-1), our end of time equivalent.
   EventTime start = 0, stop = 0;
-  if (context.constraints["time"].getAll().size() > 0) {
-    // Use the 'time' constraint to optimize backing-store lookups.
-    for (const auto& constraint : context.constraints["time"].getAll()) {
-      EventTime expr = timeFromRecord(constraint.expr);
-      if (constraint.op == EQUALS) {
-        stop = start = expr;
-        break;
-      } else if (constraint.op == GREATER_THAN) {
-        start = std::max(start, expr + 1);
-      } else if (constraint.op == GREATER_THAN_OR_EQUALS) {
-        start = std::max(start, expr);
-      } else if (constraint.op == LESS_THAN) {
-        stop = std::min(stop, expr - 1);
-      } else if (constraint.op == LESS_THAN_OR_EQUALS) {
-        stop = std::min(stop, expr);
-      }
+  bool satisfiable = true;
+  if (context.constraints["time"].exists()) {
+    // Use the 'time' constraints to optimize backing-store lookups.
+    long long lower = 0;
+    auto upper = std::numeric_limits<long long>::max();
+    satisfiable = context.constraints["time"].getRange(lower, upper);
+    if (upper <= 0) {
+      // A stop of 0 is unbounded, and no event is recorded at time 0.
+      satisfiable = false;
+    } else if (upper < std::numeric_limits<long long>::max()) {
+      stop = static_cast<EventTime>(upper);
     }
-  } else if (Initializer::isDaemon() && FLAGS_events_optimize) {
-    // If the daemon is querying a subscriber without a 'time' constraint and
-    // allows optimization, only emit events since the last query.
+    start = static_cast<EventTime>(std::max(lower, 0LL));
+  }
+
+  if (Initializer::isDaemon() && FLAGS_events_optimize) {
+    // If the daemon is querying a subscriber and allows optimization, only
+    // emit events since the last query.
     std::string query_name;
     getOptimizeData(optimize_time_, optimize_eid_, query_name, dbNamespace());
-    start = optimize_time_;
+    start = std::max(start, optimize_time_);
     optimize_time_ = getUnixTime() - 1;
 
     // Track the queries that have selected data.
@@ -136,7 +176,10 @@ void EventSubscriberPlugin::genTable(RowYield& yield, QueryContext& context) {
       queries_.insert(query_name);
     }
   }
-  get(yield, start, stop);
+
+  if (satisfiable) {
+    get(yield, start, stop);
+  }
 }
 
 EventContextID EventPublisherPlugin::numEvents() const {
@@ -183,6 +226,10 @@ std::vector<std::string> EventSubscriberPlugin::getIndexes(EventTime start,
   auto index_key = "indexes." + dbNamespace();
   std::vector<std::string> indexes;
 
+  // Expirations rewrite the index and records, as recordEvents does.
+  WriteLock lock(event_record_lock_);
+  auto expire = executedAllQueries();
+
   EventTime l_start = (start > 0) ? start / 60 : 0;
   EventTime r_stop = (stop > 0) ? stop / 60 + 1 : 0;
 
@@ -200,7 +247,7 @@ std::vector<std::string> EventSubscriberPlugin::getIndexes(EventTime start,
     auto step_stop = (step + 1) * 60;
     if (step_stop <= expire_time_) {
       expirations.push_back(bin);
-    } else if (step_start < expire_time_ && sort) {
+    } else if (step_start < expire_time_ && sort && expire) {
       expireRecords("60", bin, false);
     }
 
@@ -210,7 +257,7 @@ std::vector<std::string> EventSubscriberPlugin::getIndexes(EventTime start,
   }
 
   // Rewrite the index lists and delete each expired item.
-  if (!expirations.empty()) {
+  if (!expirations.empty() && expire) {
     expireIndexes("60", bins, expirations);
   }
 
@@ -232,10 +279,6 @@ std::vector<std::string> EventSubscriberPlugin::getIndexes(EventTime start,
 void EventSubscriberPlugin::expireRecords(const std::string& list_type,
                                           const std::string& index,
                                           bool all) {
-  if (!executedAllQueries()) {
-    return;
-  }
-
   auto record_key = "records." + dbNamespace();
   auto data_key = "data." + dbNamespace();
 
@@ -249,7 +292,7 @@ void EventSubscriberPlugin::expireRecords(const std::string& list_type,
                         data_key + '.' + expired_records.rbegin()->first);
   } else {
     for (const auto& record : expired_records) {
-      if (record.second <= expire_time_) {
+      if (all || record.second <= expire_time_) {
         deleteDatabaseValue(kEvents, data_key + '.' + record.first);
       } else {
         persisting_records.push_back(record.first + ':' +
@@ -266,16 +309,25 @@ void EventSubscriberPlugin::expireRecords(const std::string& list_type,
     setDatabaseValue(
         kEvents, record_key + "." + list_type + "." + index, new_records);
   }
+
+  WriteLock lock(partition_lock_);
+  auto partition = partitions_.find(timeFromRecord(index));
+  if (partition != partitions_.end()) {
+    auto remaining = all ? 0 : std::min(partition->second,
+                                        persisting_records.size());
+    partition_count_ -= partition->second - remaining;
+    if (remaining == 0) {
+      partitions_.erase(partition);
+    } else {
+      partition->second = remaining;
+    }
+  }
 }
 
 void EventSubscriberPlugin::expireIndexes(
     const std::string& list_type,
     const std::vector<std::string>& indexes,
     const std::vector<std::string>& expirations) {
-  if (!executedAllQueries()) {
-    return;
-  }
-
   auto index_key = "indexes." + dbNamespace();
 
   // Construct a mutable list of persisting indexes to rewrite as records.
@@ -294,16 +346,16 @@ void EventSubscriberPlugin::expireIndexes(
 }
 
 void EventSubscriberPlugin::expireCheck() {
-  auto data_key = "data." + dbNamespace();
-  auto eid_key = "eid." + dbNamespace();
-  // Min key will be the last surviving key.
-  size_t threshold_key = 0;
+  auto limit = getEventsMax();
+  WriteLock lock(event_record_lock_);
 
+  std::vector<std::string> expirations;
+  std::string trim_index;
+  size_t trim_count = 0;
   {
-    auto limit = getEventsMax();
-    std::vector<std::string> keys;
-    scanDatabaseKeys(kEvents, keys, data_key);
-    if (keys.size() <= limit) {
+    WriteLock partition_lock(partition_lock_);
+    loadPartitions();
+    if (partition_count_ <= limit) {
       return;
     }
 
@@ -311,71 +363,106 @@ void EventSubscriberPlugin::expireCheck() {
     LOG(WARNING) << "Expiring events for subscriber: " << getName()
                  << " (overflowed limit " << limit << ")";
     VLOG(1) << "Subscriber events " << getName() << " exceeded limit " << limit
-            << " by: " << keys.size() - limit;
-    // Inspect the N-FLAGS_events_max -th event's value and expire before the
-    // time within the content.
-    std::string last_key;
-    getDatabaseValue(kEvents, eid_key, last_key);
-    // The EID is the next-index.
-    // EID - events_max is the most last-recent event to keep.
-    threshold_key = boost::lexical_cast<size_t>(last_key) - getEventsMax();
-
-    // Scan each of the keys in keys, if their ID portion is < threshold.
-    // Nix them, this requires lots of conversions, use with care.
-    std::string max_key;
-    std::string min_key;
-    unsigned long min_key_value = 0;
-    unsigned long max_key_value = 0;
-    for (const auto& key : keys) {
-      auto const key_value =
-          tryTo<unsigned long int>(key.substr(key.rfind('.') + 1), 10)
-              .takeOr(0ul);
-
-      if (key_value < static_cast<unsigned long>(threshold_key)) {
-        min_key_value = (min_key_value == 0 || key_value < min_key_value)
-                            ? key_value
-                            : min_key_value;
-        if (min_key_value == key_value) {
-          min_key = key;
-        }
+            << " by: " << partition_count_ - limit;
+
+    // Drop the oldest partitions while the newer ones still hold the limit.
+    // The partition that crosses the limit, at most the newest, is trimmed.
+    auto remaining = partition_count_;
+    for (auto partition = partitions_.begin(); partition != partitions_.end();
+         ++partition) {
+      if (remaining <= limit) {
+        break;
+      }
 
-        max_key_value = (key_value > max_key_value) ? key_value : max_key_value;
-        if (max_key_value == key_value) {
-          max_key = key;
-        }
+      auto newest = std::next(partition) == partitions_.end();
+      if (newest || remaining - partition->second < limit) {
+        trim_index = std::to_string(partition->first);
+        trim_count = remaining - limit;
+        break;
       }
+      remaining -= partition->second;
+      expirations.push_back(std::to_string(partition->first));
     }
+  }
 
-    if (!min_key.empty()) {
-      if (max_key_value == min_key_value) {
-        deleteDatabaseValue(kEvents, min_key);
-      } else {
-        deleteDatabaseRange(kEvents, min_key, max_key);
-      }
+  if (!expirations.empty()) {
+    std::string content;
+    getDatabaseValue(kEvents, "indexes." + dbNamespace() + ".60", content);
+    std::vector<std::string> bins;
+    boost::split(bins, content, boost::is_any_of(","));
+    expireIndexes("60", bins, expirations);
+  }
+
+  if (trim_count > 0) {
+    expireOldestRecords("60", trim_index, trim_count);
+  }
+}
+
+void EventSubscriberPlugin::expireOldestRecords(const std::string& list_type,
+                                                const std::string& index,
+                                                size_t count) {
+  auto record_key = "records." + dbNamespace() + "." + list_type + "." + index;
+  auto data_key = "data." + dbNamespace();
+
+  // Records are appended to a bin as they are written, the oldest first.
+  auto records = getRecords({list_type + '.' + index}, false);
+  count = std::min(count, records.size());
+  std::vector<std::string> persisting_records;
+  for (size_t i = 0; i < records.size(); ++i) {
+    if (i < count) {
+      deleteDatabaseValue(kEvents, data_key + '.' + records[i].first);
+    } else {
+      persisting_records.push_back(records[i].first + ':' +
+                                   std::to_string(records[i].second));
     }
   }
 
-  // Convert the key index into a time using the content.
-  // The last-recent event is fetched and the corresponding time is used as
-  // the expiration time for the subscriber.
-  std::string content;
-  getDatabaseValue(kEvents, data_key + "." + toIndex(threshold_key), content);
+  if (persisting_records.empty()) {
+    deleteDatabaseValue(kEvents, record_key);
+  } else {
+    setDatabaseValue(kEvents,
+                     record_key,
+                     boost::algorithm::join(persisting_records, ","));
+  }
+
+  WriteLock lock(partition_lock_);
+  auto partition = partitions_.find(timeFromRecord(index));
+  if (partition != partitions_.end()) {
+    auto expired = std::min(partition->second, count);
+    partition_count_ -= expired;
+    partition->second -= expired;
+    if (partition->second == 0) {
+      partitions_.erase(partition);
+    }
+  }
+}
 
-  // Decode the value into a row structure to extract the time.
-  Row r;
-  if (!deserializeRowJSON(content, r) || r.count("time") == 0) {
+void EventSubscriberPlugin::loadPartitions() {
+  if (partitions_loaded_) {
     return;
   }
+  partitions_loaded_ = true;
 
-  // The last time will become the implicit expiration time.
-  size_t last_time = boost::lexical_cast<size_t>(r.at("time"));
-  if (last_time > 0) {
-    expire_time_ = last_time - (last_time % 60);
+  std::string content;
+  getDatabaseValue(kEvents, "indexes." + dbNamespace() + ".60", content);
+  if (content.empty()) {
+    return;
   }
 
-  // Finally, attempt an index query to trigger expirations.
-  // In this case the result set is not used.
-  getIndexes(expire_time_, 0, false);
+  auto record_key = "records." + dbNamespace() + ".60.";
+  for (const auto& bin : split(content, ",")) {
+    std::string record_value;
+    getDatabaseValue(kEvents, record_key + bin, record_value);
+    if (record_value.empty()) {
+      continue;
+    }
+
+    // Each record is separated by a ','.
+    auto count = static_cast<size_t>(
+        std::count(record_value.begin(), record_value.end(), ',') + 1);
+    partitions_[timeFromRecord(bin)] += count;
+    partition_count_ += count;
+  }
 }
 
 bool EventSubscriberPlugin::executedAllQueries() const {
@@ -426,52 +513,79 @@ std::vector<EventRecord> EventSubscriberPlugin::getRecords(
 }
 
 Status EventSubscriberPlugin::recordEvents(
-    const std::vector<std::string>& event_id_list, EventTime event_time) {
+    const std::vector<EventRecord>& records) {
   WriteLock lock(event_record_lock_);
-
-  DatabaseStringValueList database_data;
-  database_data.reserve(2U);
+  {
+    // Count the stored events before this batch is stored.
+    WriteLock partition_lock(partition_lock_);
+    loadPartitions();
+  }
 
   // The list key includes the list type (bin size) and the list ID (bin).
   // The list_id is the MOST-Specific key ID, the bin for this list.
   // If the event time was 13 and the time_list is 5 seconds, lid = 2.
-  auto list_id = boost::lexical_cast<std::string>(event_time / 60);
-  std::string time_value = boost::lexical_cast<std::string>(event_time);
-
-  // The record is identified by the event type then module name.
-  // Append the record (eid, unix_time) to the list bin.
-  auto database_key = "records." + dbNamespace() + ".60." + list_id;
+  // A batch may span bins, each is read and written once.
+  std::map<EventTime, std::string> record_values;
   auto index_key = "indexes." + dbNamespace() + ".60";
+  std::string index_value;
+  bool index_read = false;
+  bool index_changed = false;
 
-  std::string record_value;
-  getDatabaseValue(kEvents, database_key, record_value);
-
-  for (const auto& eid : event_id_list) {
-    if (record_value.length() == 0) {
-      // This is a new list_id for list_key, append the ID to the indirect
-      // lookup for this list_key.
-      std::string index_value;
-      getDatabaseValue(kEvents, index_key, index_value);
-      if (index_value.length() == 0) {
-        // A new index.
-        index_value = list_id;
-      } else {
-        index_value += "," + list_id;
+  for (const auto& record : records) {
+    auto list_id = record.second / 60;
+    auto value = record_values.find(list_id);
+    if (value == record_values.end()) {
+      // The record is identified by the event type then module name.
+      // Append the record (eid, unix_time) to the list bin.
+      value = record_values.emplace(list_id, std::string()).first;
+      getDatabaseValue(kEvents,
+                       "records." + dbNamespace() + ".60." +
+                           std::to_string(list_id),
+                       value->second);
+      if (value->second.empty()) {
+        // This is a new list_id for list_key, append the ID to the indirect
+        // lookup for this list_key.
+        if (!index_read) {
+          getDatabaseValue(kEvents, index_key, index_value);
+          index_read = true;
+        }
+        if (!index_value.empty()) {
+          index_value += ',';
+        }
+        index_value += std::to_string(list_id);
+        index_changed = true;
       }
-      database_data.push_back(std::make_pair(index_key, index_value));
-      record_value = eid + ":" + time_value;
-    } else {
-      // Tokenize a record using ',' and the EID/time using ':'.
-      record_value += "," + eid + ":" + time_value;
     }
+
+    // Tokenize a record using ',' and the EID/time using ':'.
+    if (!value->second.empty()) {
+      value->second += ',';
+    }
+    value->second += record.first + ':' + std::to_string(record.second);
+  }
+
+  DatabaseStringValueList database_data;
+  database_data.reserve(record_values.size() + 1);
+  if (index_changed) {
+    database_data.push_back(std::make_pair(index_key, std::move(index_value)));
+  }
+  for (auto& value : record_values) {
+    database_data.push_back(std::make_pair(
+        "records." + dbNamespace() + ".60." + std::to_string(value.first),
+        std::move(value.second)));
   }
 
-  database_data.push_back(std::make_pair(database_key, record_value));
   auto status = setDatabaseBatch(kEvents, database_data);
   if (!status.ok()) {
     LOG(ERROR) << "Could not put Event Records";
+    return status;
   }
 
+  WriteLock partition_lock(partition_lock_);
+  for (const auto& record : records) {
+    partitions_[record.second / 60]++;
+  }
+  partition_count_ += records.size();
   return status;
 }
 
@@ -511,6 +625,9 @@ const std::string EventSubscriberPlugin::getEventID() {
 void EventSubscriberPlugin::get(RowYield& yield,
                                 EventTime start,
                                 EventTime stop) {
+  // Buffered rows are visible to queries.
+  flushBatch(true);
+
   // Get the records for this time range.
   auto indexes = getIndexes(start, stop);
   auto records = getRecords(indexes);
@@ -568,27 +685,175 @@ void EventSubscriberPlugin::get(RowYield& yield,
 
 Status EventSubscriberPlugin::add(const Row& r) {
   std::vector<Row> batch = {r};
-  return addBatch(batch, getUnixTime());
+  return addBatch(batch);
 }
 
 Status EventSubscriberPlugin::addBatch(std::vector<Row>& row_list) {
-  return addBatch(row_list, getUnixTime());
+  auto event_time = getUnixTime();
+  if (FLAGS_events_batch_size <= 1) {
+    return addBatch(row_list, event_time);
+  }
+
+  auto event_time_str = std::to_string(event_time);
+  WriteLock lock(event_batch_lock_);
+  if (!batch_recovered_) {
+    recoverBatch();
+  }
+  if (batch_.empty()) {
+    batch_start_ = std::chrono::steady_clock::now();
+  }
+
+  DatabaseStringValueList wal_data;
+  for (auto& row : row_list) {
+    row["time"] = event_time_str;
+    if (FLAGS_events_batch_wal) {
+      // One write per row, without the index reads of a flush.
+      std::string serialized_row;
+      if (serializeRowJSON(row, serialized_row).ok()) {
+        wal_data.push_back(std::make_pair(
+            "wal." + dbNamespace() + "." + toIndex(batch_wal_next_++),
+            std::move(serialized_row)));
+      }
+    }
+    batch_.push_back(std::move(row));
+  }
+
+  if (!wal_data.empty()) {
+    auto status = setDatabaseBatch(kEvents, wal_data);
+    if (!status.ok()) {
+      VLOG(1) << "Cannot log buffered events: " << status.getMessage();
+    }
+  }
+  trimBatch();
+
+  lock.unlock();
+  return flushBatch(false);
 }
 
 Status EventSubscriberPlugin::addBatch(std::vector<Row>& row_list,
                                        EventTime custom_event_time) {
+  auto event_time = custom_event_time != 0 ? custom_event_time : getUnixTime();
+  auto event_time_str = std::to_string(event_time);
+  for (auto& row : row_list) {
+    row["time"] = event_time_str;
+  }
+  return writeRows(row_list);
+}
+
+Status EventSubscriberPlugin::flushBatch(bool force) {
+  WriteLock lock(event_batch_lock_);
+  if (!batch_recovered_) {
+    recoverBatch();
+  }
+
+  if (batch_.empty()) {
+    return Status::success();
+  }
+
+  if (!force && batch_.size() < FLAGS_events_batch_size) {
+    auto age = std::chrono::steady_clock::now() - batch_start_;
+    if (age < std::chrono::milliseconds(FLAGS_events_batch_interval)) {
+      return Status::success();
+    }
+  }
+
+  auto status = writeRows(batch_);
+  if (!status.ok()) {
+    // Keep the rows and their log, the next flush writes them again.
+    VLOG(1) << "Cannot write buffered events: " << status.getMessage();
+    return status;
+  }
+
+  batch_.clear();
+  if (batch_wal_next_ > batch_wal_first_) {
+    // The logged rows are written, a crash before this replays them again.
+    deleteDatabaseRange(
+        kEvents,
+        "wal." + dbNamespace() + "." + toIndex(batch_wal_first_),
+        "wal." + dbNamespace() + "." + toIndex(batch_wal_next_ - 1));
+    batch_wal_first_ = batch_wal_next_;
+  }
+  return status;
+}
+
+void EventSubscriberPlugin::trimBatch() {
+  auto limit = FLAGS_events_batch_size * kEventsBatchMaxBatches;
+  if (batch_.size() <= limit) {
+    return;
+  }
+
+  // Trim a batch below the limit, so a failing store is not trimmed for
+  // every added row.
+  auto dropped = batch_.size() - (limit - FLAGS_events_batch_size);
+  batch_.erase(batch_.begin(), batch_.begin() + dropped);
+  if (batch_wal_next_ > batch_wal_first_) {
+    // Log entries follow the row order, rows that could not be logged are
+    // rare and only shift which entries are dropped.
+    auto wal_last = std::min(batch_wal_first_ + dropped, batch_wal_next_);
+    deleteDatabaseRange(
+        kEvents,
+        "wal." + dbNamespace() + "." + toIndex(batch_wal_first_),
+        "wal." + dbNamespace() + "." + toIndex(wal_last - 1));
+    batch_wal_first_ = wal_last;
+  }
+
+  LOG(WARNING) << "Dropped " << dropped
+               << " buffered events that could not be written for subscriber: "
+               << getName();
+}
+
+void EventSubscriberPlugin::recoverBatch() {
+  batch_recovered_ = true;
+
+  auto wal_key = "wal." + dbNamespace() + ".";
+  std::vector<std::string> keys;
+  scanDatabaseKeys(kEvents, keys, wal_key);
+  if (keys.empty()) {
+    return;
+  }
+
+  // Keys are ordered by their zero-padded sequence.
+  std::sort(keys.begin(), keys.end());
+  std::vector<Row> recovered;
+  recovered.reserve(keys.size() + batch_.size());
+  for (const auto& key : keys) {
+    std::string content;
+    Row r;
+    if (getDatabaseValue(kEvents, key, content).ok() &&
+        deserializeRowJSON(content, r).ok() && r.count("time") > 0) {
+      recovered.push_back(std::move(r));
+    }
+  }
+
+  VLOG(1) << "Recovered " << recovered.size()
+          << " buffered events for subscriber: " << getName();
+  auto first = keys.front().substr(wal_key.size());
+  auto last = keys.back().substr(wal_key.size());
+  batch_wal_first_ = static_cast<size_t>(
+      tryTo<unsigned long int>(first, 10).takeOr(0ul));
+  batch_wal_next_ = std::max(
+      batch_wal_next_,
+      static_cast<size_t>(tryTo<unsigned long int>(last, 10).takeOr(0ul)) + 1);
+
+  // Recovered rows are older than rows buffered by this process.
+  std::move(batch_.begin(), batch_.end(), std::back_inserter(recovered));
+  batch_ = std::move(recovered);
+  batch_start_ = std::chrono::steady_clock::now();
+  trimBatch();
+}
+
+Status EventSubscriberPlugin::writeRows(std::vector<Row>& row_list) {
   DatabaseStringValueList database_data;
   database_data.reserve(row_list.size());
 
-  std::vector<std::string> event_id_list;
-  event_id_list.reserve(row_list.size());
-
-  auto event_time = custom_event_time != 0 ? custom_event_time : getUnixTime();
-  auto event_time_str = std::to_string(event_time);
+  std::vector<EventRecord> records;
+  records.reserve(row_list.size());
 
+  auto data_key = "data." + dbNamespace() + ".";
   for (auto& row : row_list) {
-    row["time"] = event_time_str;
-    row["eid"] = getEventID();
+    auto event_time = timeFromRecord(row["time"]);
+    auto eid = getEventID();
+    row["eid"] = eid;
 
     // Serialize and store the row data, for query-time retrieval.
     std::string serialized_row;
@@ -608,17 +873,11 @@ Status EventSubscriberPlugin::addBatch(std::vector<Row>& row_list,
     EventFactory::forwardEvent(serialized_row);
 
     // Store the event data in the batch
-    database_data.push_back(std::make_pair(
-        "data." + dbNamespace() + "." + row["eid"], serialized_row));
+    database_data.push_back(
+        std::make_pair(data_key + eid, std::move(serialized_row)));
 
-    event_id_list.push_back(std::move(row["eid"]));
+    records.push_back(std::make_pair(std::move(eid), event_time));
     event_count_++;
-
-    // Use the last EventID and a checkpoint bucket size to periodically apply
-    // buffer eviction. Eviction occurs if the total count exceeds events_max.
-    if (last_eid_ % EVENTS_CHECKPOINT == 0) {
-      expireCheck();
-    }
   }
 
   if (database_data.empty()) {
@@ -631,7 +890,22 @@ Status EventSubscriberPlugin::addBatch(std::vector<Row>& row_list,
     return status;
   }
 
-  return recordEvents(event_id_list, event_time);
+  status = recordEvents(records);
+  bool overflow = false;
+  {
+    ReadLock lock(partition_lock_);
+    overflow = partition_count_ > getEventsMax();
+  }
+
+  // Eviction occurs if the total count exceeds events_max.
+  if (overflow) {
+    if (kExpirationServiceRunning) {
+      expire_pending_ = true;
+    } else {
+      expireCheck();
+    }
+  }
+  return status;
 }
 
 EventPublisherRef EventSubscriberPlugin::getPublisher() const {
@@ -665,6 +939,9 @@ void EventFactory::delay() {
       ef.threads_.push_back(thread_);
     }
   }
+
+  // Subscribers overflowing events_max drop partitions on a service thread.
+  Dispatcher::addService(std::make_shared<EventExpirationRunner>());
 }
 
 Status EventPublisherPlugin::addSubscription(
@@ -792,6 +1069,9 @@ Status EventFactory::run(const std::string& type_id) {
       break;
     }
     publisher->restart_count_++;
+
+    // Write rows buffered by subscribers once their batch is full or expired.
+    flushSubscribers(type_id, false);
     // This is a 'default' cool-off implemented in InterruptableRunnable.
     // If a publisher fails to perform some sort of interruption point, this
     // prevents the thread from thrashing through exiting checks.
@@ -1049,6 +1329,7 @@ Status EventFactory::deregisterEventSubscriber(const std::string& sub) {
   }
 
   auto& subscriber = ef.event_subs_.at(sub);
+  subscriber->flushBatch(true);
   subscriber->state(EventState::EVENT_NONE);
   subscriber->tearDown();
   ef.event_subs_.erase(sub);
@@ -1073,6 +1354,45 @@ std::vector<std::string> EventFactory::subscriberNames() {
   return names;
 }
 
+void EventFactory::flushSubscribers(const std::string& type_id, bool force) {
+  std::vector<EventSubscriberRef> subscribers;
+  {
+    auto& ef = EventFactory::getInstance();
+    RecursiveLock lock(ef.factory_lock_);
+    for (const auto& subscriber : ef.event_subs_) {
+      if (type_id.empty() || subscriber.second->getType() == type_id) {
+        subscribers.push_back(subscriber.second);
+      }
+    }
+  }
+
+  // Writing does not hold the factory lock.
+  for (const auto& subscriber : subscribers) {
+    auto status = subscriber->flushBatch(force);
+    if (!status.ok()) {
+      VLOG(1) << "Cannot write events for subscriber "
+              << subscriber->getName() << ": " << status.getMessage();
+    }
+  }
+}
+
+void EventFactory::expireSubscribers() {
+  std::vector<EventSubscriberRef> subscribers;
+  {
+    auto& ef = EventFactory::getInstance();
+    RecursiveLock lock(ef.factory_lock_);
+    for (const auto& subscriber : ef.event_subs_) {
+      subscribers.push_back(subscriber.second);
+    }
+  }
+
+  for (const auto& subscriber : subscribers) {
+    if (subscriber->expire_pending_.exchange(false)) {
+      subscriber->expireCheck();
+    }
+  }
+}
+
 void EventFactory::end(bool join) {
   auto& ef = EventFactory::getInstance();
 
@@ -1090,6 +1410,9 @@ void EventFactory::end(bool join) {
     }
   }
 
+  // Publishers are stopped, write the remaining buffered rows.
+  flushSubscribers("", true);
+
   {
     RecursiveLock lock(ef.factory_lock_);
     // A small cool off helps OS API event publisher flushing.
@@ -0,0 +1,517 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <linux/limits.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include <osquery/config/config.h>
+#include <osquery/events/linux/fanotify.h>
+#include <osquery/filesystem/filesystem.h>
+#include <osquery/logger.h>
+#include <osquery/registry_factory.h>
+#include <osquery/utils/system/time.h>
+
+namespace fs = boost::filesystem;
+
+namespace osquery {
+
+CLI_FLAG(bool,
+         enable_fanotify,
+         false,
+         "Publish file events with fanotify marks instead of inotify watches");
+
+/// Bytes read from the fanotify handle at once, enough for several hundred
+/// events with file handles and names.
+static const size_t kFanotifyBufferSize = 256 * 1024;
+
+/// Translation between the inotify masks used by subscriptions and fanotify.
+static const std::vector<std::pair<uint32_t, uint64_t>> kFanotifyMasks = {
+    {IN_ACCESS, FAN_ACCESS},
+    {IN_ATTRIB, FAN_ATTRIB},
+    {IN_CLOSE_WRITE, FAN_CLOSE_WRITE},
+    {IN_CREATE, FAN_CREATE},
+    {IN_DELETE, FAN_DELETE},
+    {IN_MODIFY, FAN_MODIFY},
+    {IN_MOVED_FROM, FAN_MOVED_FROM},
+    {IN_MOVED_TO, FAN_MOVED_TO},
+    {IN_OPEN, FAN_OPEN},
+};
+
+/// Without file handles, mount marks only report events with an open file.
+static const uint64_t kFanotifyMountEvents =
+    FAN_ACCESS | FAN_MODIFY | FAN_CLOSE_WRITE | FAN_OPEN;
+
+REGISTER(FanotifyEventPublisher, "event_publisher", "fanotify");
+
+bool FanotifyPattern::matches(const std::string& path) const {
+  return ::fnmatch(pattern.c_str(), path.c_str(), flags) == 0;
+}
+
+FanotifyPattern getFanotifyPattern(const std::string& path) {
+  FanotifyPattern compiled;
+  compiled.flags = FNM_PATHNAME;
+
+  auto recursive = path.find("**");
+  if (recursive != std::string::npos) {
+    compiled.pattern = path.substr(0, recursive);
+    while (compiled.pattern.size() > 1 && compiled.pattern.back() == '/') {
+      compiled.pattern.pop_back();
+    }
+    if (compiled.pattern == "/") {
+      // Without FNM_PATHNAME the wildcard also matches '/'.
+      compiled.pattern = "/*";
+      compiled.flags = 0;
+    } else {
+      // The prefix matches the leading directories of the path.
+      compiled.flags |= FNM_LEADING_DIR;
+    }
+  } else if (!path.empty() &&
+             (path.back() == '/' || (path.find('*') == std::string::npos &&
+                                     isDirectory(path).ok()))) {
+    compiled.pattern = path;
+    if (compiled.pattern.back() != '/') {
+      compiled.pattern += '/';
+    }
+    compiled.pattern += '*';
+  } else {
+    compiled.pattern = path;
+  }
+  return compiled;
+}
+
+std::vector<FanotifyPattern> getFanotifyExcludePatterns(
+    const std::string& path) {
+  std::vector<FanotifyPattern> patterns;
+  if (path.empty()) {
+    return patterns;
+  }
+
+  auto pattern = getFanotifyPattern(path);
+  patterns.push_back(pattern);
+  if ((pattern.flags & FNM_LEADING_DIR) == 0 && pattern.pattern.back() != '*') {
+    // As with inotify, the children of an excluded directory are excluded.
+    pattern.pattern += "/*";
+    patterns.push_back(std::move(pattern));
+  }
+  return patterns;
+}
+
+/// The existing directory containing the non-wildcard part of a path.
+static std::string getMarkRoot(const std::string& path) {
+  auto root = path.substr(0, path.find('*'));
+  root = root.substr(0, root.rfind('/') + 1);
+
+  boost::system::error_code ec;
+  fs::path existing(root.empty() ? "/" : root);
+  while (!fs::exists(existing, ec) && existing.has_parent_path()) {
+    existing = existing.parent_path();
+  }
+  return existing.string();
+}
+
+/// Read the path of an open descriptor into path.
+static bool readDescriptorPath(int fd, std::string& path) {
+  char link[32];
+  ::snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+
+  char target[PATH_MAX];
+  auto size = ::readlink(link, target, sizeof(target));
+  if (size <= 0 || static_cast<size_t>(size) >= sizeof(target)) {
+    return false;
+  }
+  path.assign(target, static_cast<size_t>(size));
+  return true;
+}
+
+Status FanotifyEventPublisher::setUp() {
+  if (!FLAGS_enable_fanotify) {
+    return Status(1, "Publisher disabled via configuration");
+  }
+
+  auto flags = FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK;
+  auto event_flags = O_RDONLY | O_LARGEFILE | O_CLOEXEC;
+#ifdef FAN_REPORT_DFID_NAME
+  // File handles and names report directory entry events (Linux 5.9+).
+  fanotify_handle_ = ::fanotify_init(flags | FAN_REPORT_DFID_NAME, event_flags);
+  report_fid_ = (fanotify_handle_ != -1);
+#endif
+  if (fanotify_handle_ == -1) {
+    fanotify_handle_ = ::fanotify_init(flags, event_flags);
+  }
+  if (fanotify_handle_ == -1) {
+    return Status(1,
+                  std::string("Could not start fanotify: ") + strerror(errno));
+  }
+
+  scratch_.resize(kFanotifyBufferSize);
+  path_.reserve(PATH_MAX);
+  VLOG(1) << "fanotify reports "
+          << (report_fid_ ? "file handles using filesystem marks"
+                          : "open files using mount marks");
+  return Status::success();
+}
+
+void FanotifyEventPublisher::removeMarks() {
+  if (fanotify_handle_ != -1) {
+    ::fanotify_mark(fanotify_handle_,
+                    FAN_MARK_FLUSH | FAN_MARK_MOUNT,
+                    0,
+                    AT_FDCWD,
+                    nullptr);
+#ifdef FAN_MARK_FILESYSTEM
+    ::fanotify_mark(fanotify_handle_,
+                    FAN_MARK_FLUSH | FAN_MARK_FILESYSTEM,
+                    0,
+                    AT_FDCWD,
+                    nullptr);
+#endif
+  }
+
+  for (const auto& mark : marks_) {
+    if (mark.mount_fd != -1) {
+      ::close(mark.mount_fd);
+    }
+  }
+  marks_.clear();
+}
+
+void FanotifyEventPublisher::configure() {
+  if (fanotify_handle_ == -1) {
+    // This publisher has not been setup correctly.
+    return;
+  }
+
+  // Copy the subscribed paths first, fire() holds the subscription lock
+  // while it takes the publisher lock.
+  std::vector<std::pair<const INotifySubscriptionContext*, std::string>> paths;
+  std::vector<uint32_t> masks;
+  {
+    ReadLock subscription_lock(subscription_lock_);
+    for (const auto& sub : subscriptions_) {
+      auto sc = getSubscriptionContext(sub->context);
+      paths.emplace_back(sc.get(), sc->path);
+      masks.push_back((sc->mask == 0) ? kFileDefaultMasks : sc->mask);
+    }
+  }
+
+  WriteLock lock(mutex_);
+  removeMarks();
+  subscribed_.clear();
+  excluded_.clear();
+
+  auto parser = Config::getParser("file_paths");
+  if (parser != nullptr) {
+    const auto& doc = parser->getData().doc();
+    if (doc.HasMember("exclude_paths") && doc["exclude_paths"].IsObject()) {
+      for (const auto& category : doc["exclude_paths"].GetObject()) {
+        for (const auto& excl_path : category.value.GetArray()) {
+          std::string pattern = excl_path.GetString();
+          if (pattern.empty()) {
+            continue;
+          }
+          replaceGlobWildcards(pattern);
+          for (auto& compiled : getFanotifyExcludePatterns(pattern)) {
+            excluded_.push_back(std::move(compiled));
+          }
+        }
+      }
+    }
+  }
+
+  uint64_t events = 0;
+  std::vector<std::string> roots;
+  for (size_t i = 0; i < paths.size(); i++) {
+    auto& path = paths[i].second;
+    replaceGlobWildcards(path);
+    subscribed_[paths[i].first] =
+        std::make_pair(getFanotifyPattern(path), masks[i]);
+    for (const auto& bit : kFanotifyMasks) {
+      if (masks[i] & bit.first) {
+        events |= bit.second;
+      }
+    }
+    roots.push_back(getMarkRoot(path));
+  }
+
+  uint32_t type = FAN_MARK_MOUNT;
+  if (report_fid_) {
+#ifdef FAN_MARK_FILESYSTEM
+    type = FAN_MARK_FILESYSTEM;
+#endif
+    // Directories are created, deleted and moved too.
+    events |= FAN_ONDIR;
+  } else {
+    events &= kFanotifyMountEvents;
+  }
+  if (events == 0 || (events & ~FAN_ONDIR) == 0) {
+    return;
+  }
+
+  for (const auto& root : roots) {
+    struct stat st;
+    if (::stat(root.c_str(), &st) != 0) {
+      continue;
+    }
+
+    auto marked = std::find_if(
+        marks_.begin(), marks_.end(), [&st](const FanotifyMark& mark) {
+          return mark.device == st.st_dev;
+        });
+    if (marked != marks_.end()) {
+      continue;
+    }
+
+    if (::fanotify_mark(fanotify_handle_,
+                        FAN_MARK_ADD | type,
+                        events,
+                        AT_FDCWD,
+                        root.c_str()) != 0) {
+      LOG(WARNING) << "Could not add fanotify mark on " << root << ": "
+                   << strerror(errno);
+      continue;
+    }
+
+    FanotifyMark mark;
+    mark.path = root;
+    mark.device = st.st_dev;
+    if (report_fid_) {
+      struct statfs fs_stat;
+      if (::statfs(root.c_str(), &fs_stat) == 0) {
+        std::memcpy(mark.fsid, &fs_stat.f_fsid, sizeof(mark.fsid));
+      }
+      mark.mount_fd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    VLOG(1) << "Added fanotify mark on: " << root;
+    marks_.push_back(std::move(mark));
+  }
+}
+
+void FanotifyEventPublisher::tearDown() {
+  WriteLock lock(mutex_);
+  removeMarks();
+  if (fanotify_handle_ != -1) {
+    ::close(fanotify_handle_);
+    fanotify_handle_ = -1;
+  }
+}
+
+bool FanotifyEventPublisher::resolvePath(
+    const struct fanotify_event_metadata* event) {
+  if (event->fd >= 0) {
+    auto resolved = readDescriptorPath(event->fd, path_);
+    ::close(event->fd);
+    return resolved;
+  }
+
+#ifdef FAN_REPORT_DFID_NAME
+  // The information records follow the metadata.
+  auto info = reinterpret_cast<const char*>(event) + event->metadata_len;
+  auto end = reinterpret_cast<const char*>(event) + event->event_len;
+  while (info + sizeof(struct fanotify_event_info_header) <= end) {
+    auto header =
+        reinterpret_cast<const struct fanotify_event_info_header*>(info);
+    if (header->len == 0) {
+      break;
+    }
+
+    if (header->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME ||
+        header->info_type == FAN_EVENT_INFO_TYPE_DFID ||
+        header->info_type == FAN_EVENT_INFO_TYPE_FID) {
+      auto fid = reinterpret_cast<const struct fanotify_event_info_fid*>(info);
+      auto handle = reinterpret_cast<struct file_handle*>(
+          const_cast<unsigned char*>(fid->handle));
+
+      auto mark = std::find_if(
+          marks_.begin(), marks_.end(), [fid](const FanotifyMark& m) {
+            return std::memcmp(m.fsid, &fid->fsid, sizeof(m.fsid)) == 0;
+          });
+      if (mark == marks_.end() || mark->mount_fd == -1) {
+        return false;
+      }
+
+      int fd = ::open_by_handle_at(mark->mount_fd, handle, O_PATH | O_CLOEXEC);
+      if (fd == -1) {
+        // The directory was removed before the event was read.
+        return false;
+      }
+      auto resolved = readDescriptorPath(fd, path_);
+      ::close(fd);
+      if (!resolved) {
+        return false;
+      }
+
+      if (header->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+        auto name = reinterpret_cast<const char*>(handle->f_handle +
+                                                  handle->handle_bytes);
+        if (std::strcmp(name, ".") != 0) {
+          if (path_.back() != '/') {
+            path_ += '/';
+          }
+          path_ += name;
+        }
+      }
+      return true;
+    }
+    info += header->len;
+  }
+#endif
+  return false;
+}
+
+bool FanotifyEventPublisher::isWanted(uint32_t mask) const {
+  for (const auto& pattern : excluded_) {
+    if (pattern.matches(path_)) {
+      return false;
+    }
+  }
+
+  for (const auto& subscribed : subscribed_) {
+    if ((subscribed.second.second & mask) &&
+        subscribed.second.first.matches(path_)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Status FanotifyEventPublisher::run() {
+  struct pollfd fds[1];
+  fds[0].fd = fanotify_handle_;
+  fds[0].events = POLLIN;
+  int selector = ::poll(fds, 1, 1000);
+  if (selector == -1) {
+    if (errno == EINTR) {
+      return Status::success();
+    }
+    LOG(WARNING) << "Could not read fanotify handle";
+    return Status(1, "fanotify poll failed");
+  }
+
+  if (selector == 0 || !(fds[0].revents & POLLIN)) {
+    return Status::success();
+  }
+
+  // A single read returns every queued event that fits in the scratch space.
+  auto size = ::read(fanotify_handle_, scratch_.data(), scratch_.size());
+  if (size == -1) {
+    if (errno == EAGAIN || errno == EINTR) {
+      return Status::success();
+    }
+    return Status(1, "fanotify read failed");
+  }
+
+  {
+    ReadLock lock(mutex_);
+    auto pid = ::getpid();
+    auto event = reinterpret_cast<struct fanotify_event_metadata*>(
+        scratch_.data());
+    for (; FAN_EVENT_OK(event, size); event = FAN_EVENT_NEXT(event, size)) {
+      if (event->vers != FANOTIFY_METADATA_VERSION) {
+        return Status(1, "Unexpected fanotify metadata version");
+      }
+
+      if (event->mask & FAN_Q_OVERFLOW) {
+        VLOG(1) << "fanotify was overflown";
+        continue;
+      }
+
+      // Files read by osquery itself, for example to hash them, are skipped.
+      if (event->pid == pid) {
+        if (event->fd >= 0) {
+          ::close(event->fd);
+        }
+        continue;
+      }
+      if (!resolvePath(event)) {
+        continue;
+      }
+
+      // Translate the (possibly merged) mask and filter on the resolved path,
+      // contexts are only allocated for wanted events.
+      uint32_t mask = 0;
+      for (const auto& bit : kFanotifyMasks) {
+        if (event->mask & bit.second) {
+          mask |= bit.first;
+        }
+      }
+      if (mask == 0 || !isWanted(mask)) {
+        continue;
+      }
+
+      // Emit each action once, as inotify would.
+      const std::string* previous = nullptr;
+      for (const auto& action : kMaskActions) {
+        if (!(mask & action.first) ||
+            (previous != nullptr && action.second == *previous)) {
+          continue;
+        }
+        previous = &action.second;
+
+        auto ec = createEventContext();
+        ec->event = std::make_unique<struct inotify_event>();
+        ec->event->wd = -1;
+        ec->event->mask = action.first;
+        if (event->mask & FAN_ONDIR) {
+          ec->event->mask |= IN_ISDIR;
+        }
+        ec->path = path_;
+        ec->action = action.second;
+        batch_.push_back(std::move(ec));
+      }
+    }
+  }
+
+  for (const auto& ec : batch_) {
+    fire(ec);
+  }
+  batch_.clear();
+  return Status::success();
+}
+
+bool FanotifyEventPublisher::shouldFire(
+    const INotifySubscriptionContextRef& sc,
+    const INotifyEventContextRef& ec) const {
+  ReadLock lock(mutex_);
+  auto subscribed = subscribed_.find(sc.get());
+  if (subscribed == subscribed_.end()) {
+    return false;
+  }
+
+  // The subscription may supply a required event mask.
+  if (!(ec->event->mask & subscribed->second.second)) {
+    return false;
+  }
+  return subscribed->second.first.matches(ec->path);
+}
+
+const std::string& FileChangeEventSubscriber::getType() const {
+  static const std::string fanotify =
+      EventFactory::getType<FanotifyEventPublisher>();
+  if (FLAGS_enable_fanotify) {
+    return fanotify;
+  }
+  return EventSubscriber<INotifyEventPublisher>::getType();
+}
+
+const std::string FileChangeEventSubscriber::dbNamespace() const {
+  return EventSubscriber<INotifyEventPublisher>::getType() + '.' + getName();
+}
+
+} // namespace osquery
@@ -0,0 +1,158 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/fanotify.h>
+#include <sys/types.h>
+
+#include <osquery/events.h>
+#include <osquery/events/linux/inotify.h>
+#include <osquery/flags.h>
+
+namespace osquery {
+
+DECLARE_bool(enable_fanotify);
+
+/// An fnmatch(3) pattern and flags compiled from a configured path.
+struct FanotifyPattern {
+  std::string pattern;
+  int flags{0};
+
+  /// Match a path, without allocating.
+  bool matches(const std::string& path) const;
+};
+
+/**
+ * @brief Compile a configured file path into fnmatch patterns.
+ *
+ * A "**" suffix matches everything below its prefix, a directory matches its
+ * children and anything else matches the path, with '*' within a component.
+ */
+FanotifyPattern getFanotifyPattern(const std::string& path);
+
+/// Compile an exclude_paths entry, which also excludes a directory's children.
+std::vector<FanotifyPattern> getFanotifyExcludePatterns(
+    const std::string& path);
+
+/// A filesystem or mount marked by the fanotify publisher.
+struct FanotifyMark {
+  /// A path on the filesystem or mount, the mark covers everything on it.
+  std::string path;
+
+  /// Device of the path, each device is marked once.
+  dev_t device{0};
+
+  /// Filesystem ID reported with file handles.
+  int fsid[2]{0, 0};
+
+  /// Descriptor used to open the file handles reported for this filesystem.
+  int mount_fd{-1};
+};
+
+/**
+ * @brief A Linux `fanotify` EventPublisher for file changes.
+ *
+ * Instead of an inotify watch per directory, this publisher adds one mark per
+ * filesystem (or per mount on kernels without file handle reporting) that
+ * contains a subscribed path. Events are matched against the subscription
+ * patterns and exclude_paths before any allocation, in a reused buffer.
+ *
+ * It publishes the inotify contexts, so file_events and yara_events use it
+ * unchanged when --enable_fanotify is set.
+ */
+class FanotifyEventPublisher
+    : public EventPublisher<INotifySubscriptionContext, INotifyEventContext> {
+  DECLARE_PUBLISHER("fanotify");
+
+ public:
+  ~FanotifyEventPublisher() override {
+    tearDown();
+  }
+
+  /// Create the `fanotify` handle, preferring file handle reporting.
+  Status setUp() override;
+
+  /// Mark the filesystems containing subscribed paths.
+  void configure() override;
+
+  /// Release the `fanotify` handle and the marks.
+  void tearDown() override;
+
+  /// Read and fire a batch of events.
+  Status run() override;
+
+ private:
+  /// Match the subscription pattern and mask.
+  bool shouldFire(const INotifySubscriptionContextRef& sc,
+                  const INotifyEventContextRef& ec) const override;
+
+  /// Resolve the path of an event into path_.
+  bool resolvePath(const struct fanotify_event_metadata* event);
+
+  /// Check resolved path_ against exclude_paths and the subscriptions.
+  bool isWanted(uint32_t mask) const;
+
+  /// Remove all marks and close their descriptors.
+  void removeMarks();
+
+ private:
+  /// The fanotify file descriptor handle.
+  int fanotify_handle_{-1};
+
+  /// Events carry file handles and names (Linux 5.9+).
+  bool report_fid_{false};
+
+  /// Marked filesystems or mounts.
+  std::vector<FanotifyMark> marks_;
+
+  /// Pattern and inotify mask of each subscription.
+  std::map<const INotifySubscriptionContext*,
+           std::pair<FanotifyPattern, uint32_t>>
+      subscribed_;
+
+  /// Events pertaining to these paths are not propagated.
+  std::vector<FanotifyPattern> excluded_;
+
+  /// Scratch space for reading events, reused by each run.
+  std::vector<char> scratch_;
+
+  /// The path of the event being read, reused by each event.
+  std::string path_;
+
+  /// Contexts created from one read, fired together.
+  std::vector<INotifyEventContextRef> batch_;
+
+  /// Access to marks and patterns.
+  mutable Mutex mutex_;
+
+ public:
+  FRIEND_TEST(FanotifyTests, test_fanotify_events);
+};
+
+/**
+ * @brief A subscriber of file change events from inotify or fanotify.
+ *
+ * Both publishers use the inotify contexts. Events are stored under the
+ * inotify namespace either way, so switching keeps the buffered events.
+ */
+class FileChangeEventSubscriber
+    : public EventSubscriber<INotifyEventPublisher> {
+ public:
+  const std::string& getType() const override;
+
+ protected:
+  const std::string dbNamespace() const override;
+};
+
+} // namespace osquery
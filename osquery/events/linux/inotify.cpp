@@ -16,6 +16,7 @@
 
 #include <osquery/config/config.h>
 #include <osquery/filesystem/filesystem.h>
+#include <osquery/filesystem/walker.h>
 #include <osquery/logger.h>
 #include <osquery/registry_factory.h>
 #include <osquery/utils/system/time.h>
@@ -372,9 +373,18 @@ bool INotifyEventPublisher::addMonitor(const std::string& path,
   }
 
   if (recursive && isDirectory(path).ok()) {
-    std::vector<std::string> children;
     // Get a list of children of this directory (requested recursive watches).
-    listDirectoriesInDirectory(path, children, true);
+    // Excluded directories are pruned during the walk, with their subtrees.
+    WalkOptions options;
+    options.limits = GLOB_FOLDERS;
+    if (!exclude_paths_.empty()) {
+      options.exclude = [this](const std::string& child) {
+        return exclude_paths_.find(child);
+      };
+    }
+
+    std::vector<std::string> children;
+    walkDirectory(path, children, options);
 
     boost::system::error_code ec;
     for (const auto& child : children) {
@@ -28,9 +28,14 @@
 namespace osquery {
 DECLARE_bool(disable_database);
 
-static TableRows genRows(EventSubscriberPlugin* sub) {
+static TableRows genRows(EventSubscriberPlugin* sub,
+                         const std::vector<Constraint>& time = {}) {
   auto vtc = std::make_shared<VirtualTableContent>();
   QueryContext context(vtc);
+  context.constraints["time"].affinity = BIGINT_TYPE;
+  for (const auto& constraint : time) {
+    context.constraints["time"].add(constraint);
+  }
   RowGenerator::pull_type generator(std::bind(&EventSubscriberPlugin::genTable,
                                               sub,
                                               std::placeholders::_1,
@@ -51,6 +56,9 @@ static TableRows genRows(EventSubscriberPlugin* sub) {
 DECLARE_uint64(events_expiry);
 DECLARE_uint64(events_max);
 DECLARE_bool(events_optimize);
+DECLARE_uint64(events_batch_size);
+DECLARE_uint64(events_batch_interval);
+DECLARE_bool(events_batch_wal);
 
 class EventsDatabaseTests : public ::testing::Test {
   void SetUp() override {
@@ -127,6 +135,20 @@ class DBFakeEventSubscriber : public EventSubscriber<DBFakeEventPublisher> {
     return Status::success();
   }
 
+  /// Add a row through the buffered ingestion.
+  Status testAddBuffered() {
+    Row r;
+    r["testing"] = "hello from the buffer";
+    return add(r);
+  }
+
+  /// Count the stored rows and records without flushing the buffer.
+  size_t countStored(const std::string& prefix) {
+    std::vector<std::string> keys;
+    scanDatabaseKeys(kEvents, keys, prefix + "." + dbNamespace() + ".");
+    return keys.size();
+  }
+
   size_t getEventsMax() override {
     return max_;
   }
@@ -356,6 +378,39 @@ TEST_F(EventsDatabaseTests, test_gentable) {
   EXPECT_LE(6U, keys.size());
 }
 
+TEST_F(EventsDatabaseTests, test_gentable_time_range) {
+  auto sub = std::make_shared<DBFakeEventSubscriber>();
+  sub->setEventsExpiry(0);
+  auto status = sub->testAdd(1);
+  status = sub->testAdd(2);
+  status = sub->testAdd(11);
+  status = sub->testAdd(61);
+  status = sub->testAdd((1 * 3600) + 1);
+  status = sub->testAdd((2 * 3600) + 1);
+
+  // Only the indexes overlapping the time range are read.
+  auto results = genRows(sub.get(),
+                         {Constraint(GREATER_THAN, "10"),
+                          Constraint(LESS_THAN_OR_EQUALS, "3601")});
+  EXPECT_EQ(3U, results.size()); // 11, 61, 3601
+
+  // An IN list selects the span of its members, SQLite filters the rest.
+  results =
+      genRows(sub.get(), {Constraint(EQUALS, "2"), Constraint(EQUALS, "61")});
+  EXPECT_EQ(3U, results.size()); // 2, 11, 61
+
+  // Unsatisfiable ranges do not read any records.
+  results = genRows(sub.get(), {Constraint(LESS_THAN, "1")});
+  EXPECT_EQ(0U, results.size());
+  results = genRows(
+      sub.get(), {Constraint(GREATER_THAN, "61"), Constraint(LESS_THAN, "11")});
+  EXPECT_EQ(0U, results.size());
+
+  // Without constraints every event is returned.
+  results = genRows(sub.get());
+  EXPECT_EQ(6U, results.size());
+}
+
 TEST_F(EventsDatabaseTests, test_optimize) {
   auto sub = std::make_shared<DBFakeEventSubscriber>();
   for (size_t i = 800; i < 800 + 10; ++i) {
@@ -403,7 +458,7 @@ TEST_F(EventsDatabaseTests, test_expire_check) {
   sub->setEventsMax(50);
   size_t t = 10000;
 
-  // We are still at the mercy of the opaque EVENTS_CHECKPOINT define.
+  // Whole 60-second partitions are expired once the limit overflows.
   for (size_t x = 0; x < 3; x++) {
     size_t num_events = 256 * x;
     for (size_t i = 0; i < num_events; i++) {
@@ -444,4 +499,158 @@ TEST_F(EventsDatabaseTests, test_expire_check) {
     }
   }
 }
+
+TEST_F(EventsDatabaseTests, test_batch_flush) {
+  auto batch_size = FLAGS_events_batch_size;
+  auto batch_interval = FLAGS_events_batch_interval;
+  FLAGS_events_batch_size = 10;
+  FLAGS_events_batch_interval = 3600 * 1000;
+
+  auto sub = std::make_shared<DBFakeEventSubscriber>();
+  for (size_t i = 0; i < 9; i++) {
+    EXPECT_TRUE(sub->testAddBuffered().ok());
+  }
+  EXPECT_EQ(0U, sub->countStored("data"));
+
+  // The tenth row fills the batch.
+  EXPECT_TRUE(sub->testAddBuffered().ok());
+  EXPECT_EQ(10U, sub->countStored("data"));
+  EXPECT_LT(0U, sub->countStored("records"));
+
+  // Queries write the buffered rows first.
+  EXPECT_TRUE(sub->testAddBuffered().ok());
+  EXPECT_EQ(10U, sub->countStored("data"));
+  auto results = genRows(sub.get());
+  EXPECT_EQ(11U, results.size());
+
+  // An expired batch is written by the next row.
+  FLAGS_events_batch_interval = 0;
+  EXPECT_TRUE(sub->testAddBuffered().ok());
+  EXPECT_EQ(12U, sub->countStored("data"));
+
+  FLAGS_events_batch_size = batch_size;
+  FLAGS_events_batch_interval = batch_interval;
+}
+
+TEST_F(EventsDatabaseTests, test_batch_recovery) {
+  auto batch_size = FLAGS_events_batch_size;
+  auto batch_interval = FLAGS_events_batch_interval;
+  auto batch_wal = FLAGS_events_batch_wal;
+  FLAGS_events_batch_size = 100;
+  FLAGS_events_batch_interval = 3600 * 1000;
+  FLAGS_events_batch_wal = true;
+
+  {
+    auto sub = std::make_shared<DBFakeEventSubscriber>();
+    for (size_t i = 0; i < 5; i++) {
+      EXPECT_TRUE(sub->testAddBuffered().ok());
+    }
+    EXPECT_EQ(5U, sub->countStored("wal"));
+    EXPECT_EQ(0U, sub->countStored("data"));
+
+    // Simulate a crash, the buffer is lost.
+    sub->batch_.clear();
+  }
+
+  auto sub = std::make_shared<DBFakeEventSubscriber>();
+  EXPECT_TRUE(sub->testAddBuffered().ok());
+  EXPECT_EQ(6U, sub->countStored("wal"));
+
+  auto results = genRows(sub.get());
+  EXPECT_EQ(6U, results.size());
+  EXPECT_EQ(0U, sub->countStored("wal"));
+
+  FLAGS_events_batch_size = batch_size;
+  FLAGS_events_batch_interval = batch_interval;
+  FLAGS_events_batch_wal = batch_wal;
+}
+
+TEST_F(EventsDatabaseTests, test_batch_limit) {
+  auto batch_size = FLAGS_events_batch_size;
+  auto batch_interval = FLAGS_events_batch_interval;
+  auto batch_wal = FLAGS_events_batch_wal;
+  FLAGS_events_batch_size = 1000;
+  FLAGS_events_batch_interval = 3600 * 1000;
+  FLAGS_events_batch_wal = true;
+
+  {
+    auto sub = std::make_shared<DBFakeEventSubscriber>();
+    for (size_t i = 0; i < 120; i++) {
+      EXPECT_TRUE(sub->testAddBuffered().ok());
+    }
+    EXPECT_EQ(120U, sub->countStored("wal"));
+    sub->batch_.clear();
+  }
+
+  // More than 10 batches are trimmed to 9, with their log entries.
+  FLAGS_events_batch_size = 10;
+  auto sub = std::make_shared<DBFakeEventSubscriber>();
+  {
+    WriteLock lock(sub->event_batch_lock_);
+    sub->recoverBatch();
+  }
+  EXPECT_EQ(90U, sub->batch_.size());
+  EXPECT_EQ(90U, sub->countStored("wal"));
+  EXPECT_EQ(30U, sub->batch_wal_first_);
+
+  auto results = genRows(sub.get());
+  EXPECT_EQ(90U, results.size());
+  EXPECT_EQ(0U, sub->countStored("wal"));
+
+  FLAGS_events_batch_size = batch_size;
+  FLAGS_events_batch_interval = batch_interval;
+  FLAGS_events_batch_wal = batch_wal;
+}
+
+TEST_F(EventsDatabaseTests, test_partition_expiration) {
+  auto sub = std::make_shared<DBFakeEventSubscriber>();
+  sub->setEventsMax(100);
+
+  // Three partitions of 60 events, overflows drop the oldest partition and
+  // trim the partition that crosses the limit.
+  for (size_t t = 60; t < 240; t++) {
+    sub->testAdd(t);
+  }
+  EXPECT_EQ(100U, sub->partition_count_);
+  ASSERT_EQ(2U, sub->partitions_.size());
+  EXPECT_EQ(40U, sub->partitions_[2]);
+  EXPECT_EQ(60U, sub->partitions_[3]);
+
+  std::vector<std::string> datas;
+  scanDatabaseKeys(kEvents, datas, "data." + sub->dbNamespace() + ".");
+  EXPECT_EQ(100U, datas.size());
+  auto results = genRows(sub.get());
+  EXPECT_EQ(100U, results.size());
+
+  // Counts are restored from the stored records.
+  auto restored = std::make_shared<DBFakeEventSubscriber>();
+  restored->loadPartitions();
+  EXPECT_EQ(100U, restored->partition_count_);
+  EXPECT_EQ(40U, restored->partitions_[2]);
+  EXPECT_EQ(60U, restored->partitions_[3]);
+}
+
+TEST_F(EventsDatabaseTests, test_partition_expiration_burst) {
+  auto sub = std::make_shared<DBFakeEventSubscriber>();
+  sub->setEventsMax(10);
+
+  // A single partition holding more than the limit keeps its newest events.
+  for (size_t t = 600; t < 625; t++) {
+    sub->testAdd(t);
+  }
+  EXPECT_EQ(10U, sub->partition_count_);
+  ASSERT_EQ(1U, sub->partitions_.size());
+  EXPECT_EQ(10U, sub->partitions_[10]);
+
+  std::vector<std::string> datas;
+  scanDatabaseKeys(kEvents, datas, "data." + sub->dbNamespace() + ".");
+  EXPECT_EQ(10U, datas.size());
+
+  auto results = genRows(sub.get());
+  ASSERT_EQ(10U, results.size());
+  for (const auto& row : results) {
+    auto r = static_cast<Row>(*row);
+    EXPECT_LE(615, std::stoi(r.at("time")));
+  }
+}
 } // namespace osquery
@@ -0,0 +1,191 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <gtest/gtest.h>
+
+#include <osquery/database.h>
+#include <osquery/events.h>
+#include <osquery/events/linux/fanotify.h>
+#include <osquery/filesystem/filesystem.h>
+#include <osquery/registry_factory.h>
+#include <osquery/utils/info/tool_type.h>
+
+namespace fs = boost::filesystem;
+
+namespace osquery {
+DECLARE_bool(disable_database);
+
+const int kMaxEventLatency = 3000;
+
+class FanotifyTests : public testing::Test {
+ protected:
+  void SetUp() override {
+    kToolType = ToolType::TEST;
+    registryAndPluginInit();
+
+    FLAGS_disable_database = true;
+    DatabasePlugin::setAllowOpen(true);
+    DatabasePlugin::initPlugin();
+
+    Registry::get().registry("config_parser")->setUp();
+
+    test_dir_ =
+        fs::weakly_canonical(fs::temp_directory_path() /
+                             fs::unique_path("fanotify-trigger.%%%%.%%%%"))
+            .string();
+    fs::create_directories(test_dir_);
+  }
+
+  void TearDown() override {
+    removePath(test_dir_);
+  }
+
+  /// Events of the test process are ignored, write from a child.
+  void writeFromChild(const std::string& path) {
+    auto pid = ::fork();
+    if (pid == 0) {
+      FILE* fd = fopen(path.c_str(), "w");
+      if (fd != nullptr) {
+        fputs("fanotify", fd);
+        fclose(fd);
+      }
+      ::_exit(0);
+    }
+    ::waitpid(pid, nullptr, 0);
+  }
+
+ protected:
+  std::string test_dir_;
+};
+
+TEST_F(FanotifyTests, test_fanotify_patterns) {
+  auto recursive = getFanotifyPattern("/home/**");
+  EXPECT_TRUE(recursive.matches("/home/user"));
+  EXPECT_TRUE(recursive.matches("/home/user/.ssh/id_rsa"));
+  EXPECT_FALSE(recursive.matches("/homeless"));
+
+  auto stem = getFanotifyPattern("/home/*/.ssh/**");
+  EXPECT_TRUE(stem.matches("/home/user/.ssh/keys/id_rsa"));
+  EXPECT_FALSE(stem.matches("/home/user/other/.ssh/id_rsa"));
+
+  auto everything = getFanotifyPattern("/**");
+  EXPECT_TRUE(everything.matches("/etc/passwd"));
+
+  auto directory = getFanotifyPattern("/etc/");
+  EXPECT_TRUE(directory.matches("/etc/passwd"));
+  EXPECT_FALSE(directory.matches("/etc/ssh/sshd_config"));
+
+  auto leaf = getFanotifyPattern("/etc/*.conf");
+  EXPECT_TRUE(leaf.matches("/etc/resolv.conf"));
+  EXPECT_FALSE(leaf.matches("/etc/passwd"));
+
+  auto file = getFanotifyPattern("/etc/passwd");
+  EXPECT_TRUE(file.matches("/etc/passwd"));
+  EXPECT_FALSE(file.matches("/etc/passwd-"));
+
+  // Excluding a path also excludes its children.
+  auto excluded = getFanotifyExcludePatterns("/tmp/cache");
+  ASSERT_EQ(2U, excluded.size());
+  EXPECT_TRUE(excluded[0].matches("/tmp/cache"));
+  EXPECT_TRUE(excluded[1].matches("/tmp/cache/file"));
+  EXPECT_TRUE(getFanotifyExcludePatterns("").empty());
+}
+
+class TestFanotifyEventSubscriber : public FileChangeEventSubscriber {
+ public:
+  TestFanotifyEventSubscriber() {
+    setName("TestFanotifyEventSubscriber");
+  }
+
+  Status init() override {
+    return Status::success();
+  }
+
+  Status Callback(const ECRef& ec, const SCRef& sc) {
+    WriteLock lock(paths_lock_);
+    paths_.push_back(ec->path);
+    actions_.push_back(ec->action);
+    return Status::success();
+  }
+
+  bool WaitForPath(const std::string& path, int max) {
+    for (int delay = 0; delay < max * 1000; delay += 50) {
+      {
+        WriteLock lock(paths_lock_);
+        if (std::find(paths_.begin(), paths_.end(), path) != paths_.end()) {
+          return true;
+        }
+      }
+      ::usleep(50);
+    }
+    return false;
+  }
+
+  std::vector<std::string> paths() {
+    WriteLock lock(paths_lock_);
+    return paths_;
+  }
+
+ private:
+  std::vector<std::string> paths_;
+  std::vector<std::string> actions_;
+  Mutex paths_lock_;
+};
+
+TEST_F(FanotifyTests, test_fanotify_events) {
+  FLAGS_enable_fanotify = true;
+  auto pub = std::make_shared<FanotifyEventPublisher>();
+  auto status = EventFactory::registerEventPublisher(pub);
+  if (!status.ok()) {
+    // fanotify requires CAP_SYS_ADMIN.
+    LOG(WARNING) << "Skipping fanotify test: " << status.getMessage();
+    FLAGS_enable_fanotify = false;
+    return;
+  }
+
+  auto sub = std::make_shared<TestFanotifyEventSubscriber>();
+  EXPECT_EQ("fanotify", sub->getType());
+  EventFactory::registerEventSubscriber(sub);
+
+  auto sc = sub->createSubscriptionContext();
+  sc->path = test_dir_ + "/**";
+  sc->mask = IN_CLOSE_WRITE | IN_MODIFY;
+  sub->subscribe(&TestFanotifyEventSubscriber::Callback, sc);
+  pub->configure();
+  EXPECT_EQ(1U, pub->marks_.size());
+
+  std::thread thread(EventFactory::run, "fanotify");
+  while (!pub->hasStarted()) {
+    ::usleep(20);
+  }
+
+  // A file in a nested directory needs no additional watch.
+  auto nested = test_dir_ + "/nested/deeper";
+  fs::create_directories(nested);
+  writeFromChild(nested + "/file");
+  EXPECT_TRUE(sub->WaitForPath(nested + "/file", kMaxEventLatency));
+
+  // Files written by this process are not reported.
+  writeTextFile(test_dir_ + "/self", "fanotify");
+  writeFromChild(test_dir_ + "/child");
+  EXPECT_TRUE(sub->WaitForPath(test_dir_ + "/child", kMaxEventLatency));
+  auto paths = sub->paths();
+  EXPECT_EQ(paths.end(),
+            std::find(paths.begin(), paths.end(), test_dir_ + "/self"));
+
+  EventFactory::end(true);
+  thread.join();
+  FLAGS_enable_fanotify = false;
+}
+} // namespace osquery
@@ -0,0 +1,169 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include <boost/filesystem.hpp>
+
+#include <osquery/filesystem/fileops.h>
+#include <osquery/filesystem/filesystem.h>
+#include <osquery/filesystem/walker.h>
+#include <osquery/flags.h>
+
+namespace fs = boost::filesystem;
+
+namespace osquery {
+
+DECLARE_uint32(glob_threads);
+
+/// Directory fan-out per level, 4 levels gives 10,000 leaf directories.
+const size_t kTreeFanout = 10;
+const size_t kTreeLevels = 4;
+
+/// Files per leaf directory, for a total of 1M files.
+const size_t kTreeLeafFiles = 100;
+
+/**
+ * A synthetic tree with 1M files, built once and removed at exit.
+ *
+ * Building the tree takes a while, the first benchmark to run pays for it.
+ */
+class SyntheticTree {
+ public:
+  static const std::string& root() {
+    static SyntheticTree tree;
+    return tree.root_;
+  }
+
+  ~SyntheticTree() {
+    boost::system::error_code ec;
+    fs::remove_all(root_, ec);
+  }
+
+ private:
+  SyntheticTree() {
+    root_ = (fs::temp_directory_path() /
+             fs::unique_path("osquery.benchmarks.walker.%%%%.%%%%"))
+                .string();
+    build(root_, 0);
+    root_ += '/';
+  }
+
+  void build(const std::string& dir, size_t level) {
+    fs::create_directories(dir);
+    if (level == kTreeLevels) {
+      for (size_t i = 0; i < kTreeLeafFiles; i++) {
+        auto path = dir + "/file" + std::to_string(i);
+        int fd = ::open(path.c_str(), O_CREAT | O_WRONLY, 0644);
+        if (fd >= 0) {
+          ::close(fd);
+        }
+      }
+      return;
+    }
+
+    for (size_t i = 0; i < kTreeFanout; i++) {
+      build(dir + "/dir" + std::to_string(i), level + 1);
+    }
+  }
+
+ private:
+  std::string root_;
+};
+
+/// The previous expansion: one glob(3) call per level, each re-walking the
+/// levels above it.
+static void FILESYSTEM_glob_recursive_levels(benchmark::State& state) {
+  const auto& root = SyntheticTree::root();
+
+  size_t count = 0;
+  while (state.KeepRunning()) {
+    std::vector<std::string> results;
+    auto pattern = root + "**";
+    for (size_t level = 0; level <= kTreeLevels + 1; level++) {
+      auto matches = platformGlob(pattern);
+      if (matches.empty()) {
+        break;
+      }
+      results.insert(results.end(), matches.begin(), matches.end());
+      pattern += "/**";
+    }
+    count = results.size();
+  }
+  state.counters["paths"] = static_cast<double>(count);
+}
+
+BENCHMARK(FILESYSTEM_glob_recursive_levels)->Unit(benchmark::kMillisecond);
+
+static void FILESYSTEM_resolve_recursive(benchmark::State& state) {
+  const auto& root = SyntheticTree::root();
+  auto threads = FLAGS_glob_threads;
+  FLAGS_glob_threads = static_cast<uint32_t>(state.range(0));
+
+  size_t count = 0;
+  while (state.KeepRunning()) {
+    std::vector<std::string> results;
+    resolveFilePattern(root + "%%", results, GLOB_ALL | GLOB_NO_CANON);
+    count = results.size();
+  }
+  state.counters["paths"] = static_cast<double>(count);
+  FLAGS_glob_threads = threads;
+}
+
+BENCHMARK(FILESYSTEM_resolve_recursive)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->Unit(benchmark::kMillisecond);
+
+/// Walk for folders only, the shape used by recursive FIM watches.
+static void FILESYSTEM_walk_folders(benchmark::State& state) {
+  const auto& root = SyntheticTree::root();
+
+  WalkOptions options;
+  options.limits = GLOB_FOLDERS;
+  options.threads = static_cast<size_t>(state.range(0));
+
+  size_t count = 0;
+  while (state.KeepRunning()) {
+    std::vector<std::string> results;
+    walkDirectory(root, results, options);
+    count = results.size();
+  }
+  state.counters["paths"] = static_cast<double>(count);
+}
+
+BENCHMARK(FILESYSTEM_walk_folders)->Arg(1)->Arg(4)->Unit(
+    benchmark::kMillisecond);
+
+/// Exclude half of the top-level subtrees, they are never opened.
+static void FILESYSTEM_walk_excluded(benchmark::State& state) {
+  const auto& root = SyntheticTree::root();
+
+  WalkOptions options;
+  options.threads = 4;
+  options.exclude = [&root](const std::string& path) {
+    return path.size() == root.size() + 5 && path.back() == '/' &&
+           (path[root.size() + 3] - '0') % 2 == 1;
+  };
+
+  size_t count = 0;
+  while (state.KeepRunning()) {
+    std::vector<std::string> results;
+    walkDirectory(root, results, options);
+    count = results.size();
+  }
+  state.counters["paths"] = static_cast<double>(count);
+}
+
+BENCHMARK(FILESYSTEM_walk_excluded)->Unit(benchmark::kMillisecond);
+} // namespace osquery
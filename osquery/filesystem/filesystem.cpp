@@ -6,6 +6,8 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <cstdint>
+#include <memory>
 #include <sstream>
 
 #include <fcntl.h>
@@ -14,6 +16,7 @@
 #ifndef WIN32
 #include <glob.h>
 #include <pwd.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #endif
 
@@ -23,6 +26,7 @@
 #include <boost/property_tree/json_parser.hpp>
 
 #include <osquery/filesystem/filesystem.h>
+#include <osquery/filesystem/walker.h>
 #include <osquery/flags.h>
 #include <osquery/logger.h>
 #include <osquery/sql.h>
@@ -30,6 +34,7 @@
 #include <osquery/utils/system/system.h>
 
 #include <osquery/utils/json/json.h>
+#include <osquery/utils/scope_guard.h>
 
 namespace pt = boost::property_tree;
 namespace fs = boost::filesystem;
@@ -45,6 +50,17 @@ HIDDEN_FLAG(bool, allow_unsafe, false, "Allow unsafe executable permissions");
 /// Disable forensics (atime/mtime preserving) file reads.
 HIDDEN_FLAG(bool, disable_forensic, true, "Disable atime/mtime preservation");
 
+/**
+ * Map regular files of at least this size in readFileView, 0 disables.
+ *
+ * A file truncated by another process while mapped raises SIGBUS, so this is
+ * only safe where the files read are not concurrently rewritten.
+ */
+HIDDEN_FLAG(uint64,
+            read_mmap_min,
+            0,
+            "Map files of at least this many bytes for sequential reads");
+
 static const size_t kMaxRecursiveGlobs = 64;
 
 Status writeTextFile(const fs::path& path,
@@ -72,6 +88,23 @@ Status writeTextFile(const fs::path& path,
   return Status::success();
 }
 
+/// Apply the max byte-read based on file/link target ownership.
+static Status checkReadMax(const fs::path& path,
+                           off_t file_size,
+                           bool dry_run) {
+  auto read_max = static_cast<off_t>(FLAGS_read_max);
+  if (file_size > read_max) {
+    if (!dry_run) {
+      LOG(WARNING) << "Cannot read file that exceeds size limit: "
+                   << path.string();
+      VLOG(1) << "Cannot read " << path.string()
+              << " size exceeds limit: " << file_size << " > " << read_max;
+    }
+    return Status(1, "File exceeds read limits");
+  }
+  return Status::success();
+}
+
 struct OpenReadableFile : private boost::noncopyable {
  public:
   explicit OpenReadableFile(const fs::path& path, bool blocking = false) {
@@ -107,14 +140,9 @@ Status readFile(const fs::path& path,
 
   // Apply the max byte-read based on file/link target ownership.
   auto read_max = static_cast<off_t>(FLAGS_read_max);
-  if (file_size > read_max) {
-    if (!dry_run) {
-      LOG(WARNING) << "Cannot read file that exceeds size limit: "
-                   << path.string();
-      VLOG(1) << "Cannot read " << path.string()
-              << " size exceeds limit: " << file_size << " > " << read_max;
-    }
-    return Status(1, "File exceeds read limits");
+  auto limits = checkReadMax(path, file_size, dry_run);
+  if (!limits.ok()) {
+    return limits;
   }
 
   if (dry_run) {
@@ -130,14 +158,23 @@ Status readFile(const fs::path& path,
   PlatformTime times;
   handle.fd->getFileTimes(times);
 
+  // Attempt to restore the atime and mtime before the file read, including
+  // when the read stops early.
+  auto const times_manager = scope_guard::create([&]() {
+    if (preserve_time && !FLAGS_disable_forensic) {
+      handle.fd->setFileTimes(times);
+    }
+  });
+
   off_t total_bytes = 0;
   if (file_size == 0 || block_size > 0) {
     // Reset block size to a sane minimum.
     block_size = (block_size < 4096) ? 4096 : block_size;
     ssize_t part_bytes = 0;
     bool overflow = false;
+    std::string part(block_size, '\0');
     do {
-      std::string part(block_size, '\0');
+      part.resize(block_size);
       part_bytes = handle.fd->read(&part[0], block_size);
       if (part_bytes > 0) {
         total_bytes += static_cast<off_t>(part_bytes);
@@ -162,10 +199,164 @@ Status readFile(const fs::path& path,
     } while (handle.fd->hasPendingIo());
     predicate(content, file_size);
   }
+  return Status::success();
+}
+
+namespace {
+
+/// Size of the per-thread buffer used by readFileView.
+const size_t kReadViewBufferSize = 64 * 1024;
+
+/// Alignment of the per-thread buffer, a page keeps reads page-aligned.
+const size_t kReadViewBufferAlignment = 4096;
+
+/**
+ * @brief A lazily allocated, page-aligned per-thread read buffer.
+ *
+ * A predicate may itself read a file, in that case the nested read gets its
+ * own buffer rather than overwriting the view the outer predicate holds.
+ */
+class ReadViewBuffer : private boost::noncopyable {
+ public:
+  ReadViewBuffer() {
+    static thread_local std::unique_ptr<char[]> storage{nullptr};
+    static thread_local bool in_use{false};
+
+    if (in_use) {
+      local_.reset(new char[kReadViewBufferSize + kReadViewBufferAlignment]);
+      data_ = align(local_.get());
+      return;
+    }
+
+    if (storage == nullptr) {
+      storage.reset(new char[kReadViewBufferSize + kReadViewBufferAlignment]);
+    }
+    data_ = align(storage.get());
+    in_use_ = &in_use;
+    in_use = true;
+  }
+
+  ~ReadViewBuffer() {
+    if (in_use_ != nullptr) {
+      *in_use_ = false;
+    }
+  }
+
+  char* data() const {
+    return data_;
+  }
+
+ private:
+  static char* align(char* buffer) {
+    auto address = reinterpret_cast<uintptr_t>(buffer);
+    auto offset = (kReadViewBufferAlignment -
+                   (address % kReadViewBufferAlignment)) %
+                  kReadViewBufferAlignment;
+    return buffer + offset;
+  }
+
+ private:
+  char* data_{nullptr};
+  bool* in_use_{nullptr};
+  std::unique_ptr<char[]> local_{nullptr};
+};
+
+} // namespace
+
+#ifndef WIN32
+/// Pass the content of a regular file as a single view of a private mapping.
+static bool readFileMapped(
+    PlatformFile& file,
+    size_t file_size,
+    const std::function<void(boost::string_view)>& predicate) {
+  auto fd = file.nativeHandle();
+  struct stat file_stat;
+  if (::fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+    return false;
+  }
+
+  auto mapping = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  ::madvise(mapping, file_size, MADV_SEQUENTIAL);
+  predicate(boost::string_view(static_cast<const char*>(mapping), file_size));
+  ::munmap(mapping, file_size);
+  return true;
+}
+#endif
+
+Status readFileView(
+    const fs::path& path,
+    const std::function<void(boost::string_view data)>& predicate,
+    bool preserve_time,
+    bool blocking) {
+  OpenReadableFile handle(path, blocking);
+  if (handle.fd == nullptr || !handle.fd->isValid()) {
+    return Status(1, "Cannot open file for reading: " + path.string());
+  }
 
-  // Attempt to restore the atime and mtime before the file read.
-  if (preserve_time && !FLAGS_disable_forensic) {
-    handle.fd->setFileTimes(times);
+  auto file_size = static_cast<off_t>(handle.fd->size());
+  auto limits = checkReadMax(path, file_size, false);
+  if (!limits.ok()) {
+    return limits;
+  }
+
+  PlatformTime times;
+  if (preserve_time) {
+    handle.fd->getFileTimes(times);
+  }
+
+  // Attempt to restore the atime and mtime before the file read, including
+  // when the read stops early.
+  auto const times_manager = scope_guard::create([&]() {
+    if (preserve_time && !FLAGS_disable_forensic) {
+      handle.fd->setFileTimes(times);
+    }
+  });
+
+  bool mapped = false;
+#ifndef WIN32
+  if (FLAGS_read_mmap_min > 0 && file_size > 0 &&
+      static_cast<uint64_t>(file_size) >= FLAGS_read_mmap_min) {
+    mapped = readFileMapped(*handle.fd, file_size, predicate);
+  }
+#endif
+
+  if (!mapped) {
+#ifdef __linux__
+    ::posix_fadvise(handle.fd->nativeHandle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    // Special files report a size of 0, read them until the end.
+    ReadViewBuffer buffer;
+    auto read_max = static_cast<off_t>(FLAGS_read_max);
+    off_t total_bytes = 0;
+    ssize_t part_bytes = 0;
+    do {
+      part_bytes = handle.fd->read(buffer.data(), kReadViewBufferSize);
+      if (part_bytes <= 0) {
+        break;
+      }
+
+      total_bytes += static_cast<off_t>(part_bytes);
+      if (total_bytes >= read_max) {
+        return Status(1, "File exceeds read limits");
+      }
+
+      bool overflow = file_size > 0 && total_bytes > file_size;
+      if (overflow) {
+        // The file grew while reading, stop at its size when opened.
+        part_bytes -= (total_bytes - file_size);
+      }
+
+      predicate(
+          boost::string_view(buffer.data(), static_cast<size_t>(part_bytes)));
+      if (overflow) {
+        break;
+      }
+    } while (true);
   }
   return Status::success();
 }
@@ -182,10 +373,10 @@ Status readFile(const fs::path& path,
                   dry_run,
                   preserve_time,
                   ([&content](std::string& buffer, size_t _size) {
-                    if (buffer.size() == _size) {
-                      content += std::move(buffer);
+                    if (buffer.size() == _size && content.empty()) {
+                      content = std::move(buffer);
                     } else {
-                      content += buffer.substr(0, _size);
+                      content.append(buffer, 0, _size);
                     }
                   }),
                   blocking);
@@ -294,11 +485,48 @@ static bool checkForLoops(std::set<int>& dsym_inos, std::string path) {
   return false;
 }
 
+#ifndef WIN32
+/**
+ * @brief Expand a pattern ending in a recursive wildcard in a single pass.
+ *
+ * Each level of a repeated glob(3) re-reads every directory above it. Instead
+ * resolve the non-recursive stem once and walk each matching directory.
+ */
+static bool genRecursiveGlobs(const std::string& path,
+                              std::vector<std::string>& results,
+                              GlobLimits limits) {
+  // Only a trailing "/**" is handled, other shapes keep the glob semantics.
+  if (path.size() < 3 || path.compare(path.size() - 3, 3, "/**") != 0) {
+    return false;
+  }
+
+  std::vector<std::string> roots;
+  for (auto& stem : platformGlob(path.substr(0, path.size() - 2))) {
+    if (stem.back() == '/') {
+      roots.push_back(std::move(stem));
+    }
+  }
+
+  WalkOptions options;
+  options.limits = limits;
+  options.max_depth = kMaxRecursiveGlobs - 1;
+  walkDirectories(roots, results, options);
+  return true;
+}
+#endif
+
 static void genGlobs(std::string path,
                      std::vector<std::string>& results,
                      GlobLimits limits) {
   // Use our helped escape/replace for wildcards.
   replaceGlobWildcards(path, limits);
+
+#ifndef WIN32
+  if (genRecursiveGlobs(path, results, limits)) {
+    return;
+  }
+#endif
+
   // inodes of directory symlinks for loop detection
   std::set<int> dsym_inos;
 
@@ -10,6 +10,7 @@
 
 #include <osquery/filesystem/fileops.h>
 
+#include <functional>
 #include <map>
 #include <set>
 #include <string>
@@ -17,6 +18,7 @@
 
 #include <boost/filesystem/path.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <boost/utility/string_view.hpp>
 
 namespace osquery {
 
@@ -86,6 +88,27 @@ Status readFile(const boost::filesystem::path& path,
                 std::function<void(std::string& buffer, size_t size)> predicate,
                 bool blocking = false);
 
+/**
+ * @brief Read a file as a sequence of read-only views.
+ *
+ * The views reference a reusable per-thread buffer, or a read-only mapping of
+ * the file when it is a regular file of at least --read_mmap_min bytes. They
+ * are only valid for the duration of each predicate call. The same read_max
+ * limit applies as for readFile.
+ *
+ * @param path the path of the file that you would like to read.
+ * @param predicate called with each successive part of the file content.
+ * @param preserve_time Attempt to preserve file mtime and atime.
+ * @param blocking Request a blocking read.
+ *
+ * @return an instance of Status, indicating success or failure.
+ */
+Status readFileView(
+    const boost::filesystem::path& path,
+    const std::function<void(boost::string_view data)>& predicate,
+    bool preserve_time = false,
+    bool blocking = false);
+
 /**
  * @brief Write text to disk.
  *
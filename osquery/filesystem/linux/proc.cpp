@@ -11,13 +11,26 @@
 
 #include <boost/filesystem.hpp>
 
-#include <osquery/logger.h>
 #include <osquery/filesystem/filesystem.h>
 #include <osquery/filesystem/linux/proc.h>
+#include <osquery/flags.h>
+#include <osquery/logger.h>
 #include <osquery/utils/conversions/split.h>
 
-
 namespace osquery {
+
+HIDDEN_FLAG(string,
+            procfs_root,
+            "",
+            "Prefix of the procfs paths read by Linux tables");
+
+std::string getProcPath(const std::string& path) {
+  if (path.empty()) {
+    return FLAGS_procfs_root + "/proc";
+  }
+  return FLAGS_procfs_root + "/proc/" + path;
+}
+
 const std::vector<std::string> kUserNamespaceList = {
     "cgroup", "ipc", "mnt", "net", "pid", "user", "uts"};
 
@@ -66,7 +79,7 @@ Status procGetProcessNamespaces(const std::string& process_id,
     namespaces = kUserNamespaceList;
   }
 
-  auto process_namespace_root = kLinuxProcPath + "/" + process_id + "/ns";
+  auto process_namespace_root = getProcPath(process_id + "/ns");
 
   for (const auto& namespace_name : namespaces) {
     ino_t namespace_inode;
@@ -221,7 +234,7 @@ Status procGetSocketList(int family,
                          ino_t net_ns,
                          const std::string& pid,
                          SocketInfoList& result) {
-  std::string path = kLinuxProcPath + "/" + pid + "/net/";
+  std::string path = getProcPath(pid + "/net/");
 
   switch (family) {
   case AF_INET:
@@ -327,7 +340,7 @@ Status procDescriptors(const std::string& process,
 Status procReadDescriptor(const std::string& process,
                           const std::string& descriptor,
                           std::string& result) {
-  auto link = kLinuxProcPath + "/" + process + "/fd/" + descriptor;
+  auto link = getProcPath(process + "/fd/" + descriptor);
 
   char result_path[PATH_MAX] = {0};
   auto size = readlink(link.c_str(), result_path, sizeof(result_path) - 1);
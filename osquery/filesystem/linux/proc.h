@@ -21,7 +21,16 @@
 #include <osquery/utils/conversions/tryto.h>
 
 namespace osquery {
-const std::string kLinuxProcPath = "/proc";
+
+/**
+ * @brief Get a path within procfs.
+ *
+ * Linux tables read procfs below the hidden --procfs_root prefix, which
+ * benchmarks point at a synthetic tree.
+ *
+ * @param path a path relative to /proc, or empty for /proc itself.
+ */
+std::string getProcPath(const std::string& path = "");
 
 struct SocketInfo final {
   std::string socket;
@@ -140,7 +149,7 @@ Status procGetSocketInodeToProcessInfoMap(const std::string& pid,
 template <typename UserData>
 Status procEnumerateProcesses(UserData& user_data,
                               bool (*callback)(const std::string&, UserData&)) {
-  boost::filesystem::directory_iterator it(kLinuxProcPath), end;
+  boost::filesystem::directory_iterator it(getProcPath()), end;
 
   try {
     for (; it != end; ++it) {
@@ -189,7 +198,7 @@ Status procEnumerateProcessDescriptors(const std::string& pid,
                                                         const std::string& fd,
                                                         const std::string& link,
                                                         UserData& user_data)) {
-  std::string descriptors_path = kLinuxProcPath + "/" + pid + "/fd";
+  std::string descriptors_path = getProcPath(pid + "/fd");
 
   try {
     boost::filesystem::directory_iterator it(descriptors_path), end;
@@ -7,7 +7,11 @@
  */
 
 #include <osquery/filesystem/filesystem.h>
+#include <osquery/filesystem/mock_file_structure.h>
 
+#include <cstdio>
+
+#include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 
 namespace osquery {
@@ -46,4 +50,117 @@ fs::path createMockFileStructure() {
   return root_dir;
 }
 
+static void createMockProcess(const fs::path& proc,
+                              const std::string& pid,
+                              const MockProcfsOptions& options,
+                              size_t& socket_inode) {
+  auto dir = proc / pid;
+  fs::create_directories(dir / "fd");
+  fs::create_directories(dir / "ns");
+
+  writeTextFile(dir / "stat",
+                pid + " (mock" + pid +
+                    ") S 1 " + pid + " " + pid +
+                    " 0 -1 4194560 1000 0 0 0 150 50 0 0 20 0 1 0 "
+                    "10000 100000000 1000 18446744073709551615 1 1 0 0 0 0 "
+                    "0 4096 0 0 0 0 17 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n");
+  writeTextFile(dir / "status",
+                "Name:\tmock" + pid + "\nState:\tS (sleeping)\nPid:\t" + pid +
+                    "\nPPid:\t1\nUid:\t1000\t1000\t1000\t1000\n"
+                    "Gid:\t1000\t1000\t1000\t1000\n"
+                    "VmSize:\t  100000 kB\nVmRSS:\t    4000 kB\n"
+                    "Threads:\t1\n");
+  writeTextFile(dir / "io",
+                "rchar: 4096\nwchar: 1024\nsyscr: 10\nsyscw: 5\n"
+                "read_bytes: 4096\nwrite_bytes: 1024\n"
+                "cancelled_write_bytes: 0\n");
+  writeTextFile(dir / "cmdline",
+                std::string("/usr/bin/mock\0--pid\0", 20) + pid + '\0');
+
+  boost::system::error_code ec;
+  fs::create_symlink("/usr/bin/mock", dir / "exe", ec);
+  fs::create_symlink("/", dir / "cwd", ec);
+  fs::create_symlink("/", dir / "root", ec);
+  fs::create_symlink("../net", dir / "net", ec);
+
+  // Every process shares the namespaces of pid 1.
+  size_t ns_inode = 4026531835;
+  for (const auto& ns : {"cgroup", "ipc", "mnt", "net", "pid", "user", "uts"}) {
+    auto target = std::string(ns) + ":[" + std::to_string(ns_inode++) + "]";
+    fs::create_symlink(target, dir / "ns" / ns, ec);
+  }
+
+  for (size_t fd = 0; fd < options.fds; fd++) {
+    std::string target;
+    if (socket_inode < options.sockets) {
+      target = "socket:[" + std::to_string(10000 + socket_inode++) + "]";
+    } else {
+      target = "/var/lib/mock/" + pid + "/" + std::to_string(fd);
+    }
+    fs::create_symlink(target, dir / "fd" / std::to_string(fd), ec);
+  }
+}
+
+fs::path createMockProcfsStructure(const MockProcfsOptions& options) {
+  const auto root_dir = fs::temp_directory_path() /
+                        fs::unique_path("osquery.tests.procfs.%%%%.%%%%");
+  const auto proc = root_dir / "proc";
+  fs::create_directories(proc / "net");
+
+  size_t socket_inode = 0;
+  for (size_t i = 0; i < options.pids; i++) {
+    createMockProcess(proc, std::to_string(i + 1), options, socket_inode);
+  }
+
+  // Sockets are owned by descriptors in the order they were linked.
+  std::string tcp =
+      "  sl  local_address rem_address   st tx_queue rx_queue tr tm->when "
+      "retrnsmt   uid  timeout inode\n";
+  char line[256];
+  for (size_t i = 0; i < options.sockets; i++) {
+    std::snprintf(line,
+                  sizeof(line),
+                  "%4zu: 0100007F:%04zX 0100007F:%04zX 01 00000000:00000000 "
+                  "00:00000000 00000000  1000        0 %zu 1 "
+                  "0000000000000000 20 4 30 10 -1\n",
+                  i,
+                  1024 + (i % 60000),
+                  443 + (i % 1000),
+                  10000 + i);
+    tcp += line;
+  }
+  writeTextFile(proc / "net" / "tcp", tcp);
+
+  const std::string inet_header{
+      "  sl  local_address rem_address   st tx_queue rx_queue tr tm->when "
+      "retrnsmt   uid  timeout inode\n"};
+  for (const auto& name : {"icmp", "raw", "udp", "udplite"}) {
+    writeTextFile(proc / "net" / name, inet_header);
+    writeTextFile(proc / "net" / (std::string(name) + "6"), inet_header);
+  }
+  writeTextFile(proc / "net" / "tcp6", inet_header);
+  writeTextFile(proc / "net" / "unix",
+                "Num       RefCount Protocol Flags    Type St Inode Path\n");
+
+  std::string mounts;
+  for (size_t i = 0; i < options.mounts; i++) {
+    mounts += (i % 2 == 0 ? "tmpfs " : "/dev/sda1 ") + root_dir.string() +
+              (i % 2 == 0 ? " tmpfs" : " ext4") + " rw,relatime 0 0\n";
+  }
+  writeTextFile(proc / "mounts", mounts);
+
+  std::string iomem;
+  for (size_t i = 0; i < options.iomem_regions; i++) {
+    std::snprintf(line,
+                  sizeof(line),
+                  "%08zx-%08zx : System RAM\n",
+                  i * 0x100000,
+                  i * 0x100000 + 0xfffff);
+    iomem += line;
+  }
+  writeTextFile(proc / "iomem", iomem);
+
+  return root_dir;
+}
+
 } // namespace osquery
@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <cstddef>
+
 #include <boost/filesystem/path.hpp>
 
 namespace osquery {
@@ -15,4 +17,33 @@ namespace osquery {
 // generate a small directory structure for testing
 boost::filesystem::path createMockFileStructure();
 
+/// The size of a synthetic procfs tree.
+struct MockProcfsOptions {
+  /// Number of /proc/<pid> directories.
+  size_t pids{100};
+
+  /// Number of descriptors per process.
+  size_t fds{10};
+
+  /// Number of TCP sockets, owned by the first descriptors.
+  size_t sockets{100};
+
+  /// Number of /proc/mounts entries.
+  size_t mounts{10};
+
+  /// Number of /proc/iomem regions.
+  size_t iomem_regions{100};
+};
+
+/**
+ * @brief Generate a synthetic procfs tree for tables reading --procfs_root.
+ *
+ * Every process shares one network namespace, so the socket tables are
+ * written once in /proc/net and linked from each /proc/<pid>/net.
+ *
+ * @return the root path, which contains the proc directory.
+ */
+boost::filesystem::path createMockProcfsStructure(
+    const MockProcfsOptions& options);
+
 } // namespace
@@ -0,0 +1,401 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <boost/noncopyable.hpp>
+
+#include <osquery/filesystem/walker.h>
+#include <osquery/flags.h>
+#include <osquery/logger.h>
+#include <osquery/utils/scope_guard.h>
+
+namespace osquery {
+
+HIDDEN_FLAG(uint32,
+            glob_threads,
+            4,
+            "Maximum threads used to walk recursive globs (default 4)");
+
+namespace {
+
+/// Size of the buffer handed to each getdents64 call.
+const size_t kDirentBufferSize = 32 * 1024;
+
+#ifdef __linux__
+/// The kernel's getdents64 record, glibc does not export this layout.
+struct LinuxDirent64 {
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+#endif
+
+/// A directory identity, by (device, inode).
+using WalkIdentity = std::pair<dev_t, ino_t>;
+
+/// What identifying a single directory found.
+struct WalkStat {
+  /// The path could be stat'd.
+  bool found{false};
+
+  WalkIdentity identity;
+};
+
+/// What reading a single directory found.
+struct WalkRead {
+  /// The directory was opened and read.
+  bool opened{false};
+
+  /// Paths to report, directories end with a '/'.
+  std::vector<std::string> entries;
+
+  /// Subdirectories to read at the next level.
+  std::vector<std::string> children;
+};
+
+/// Helper threads started once and reused for every level of a walk.
+class WalkPool : private boost::noncopyable {
+ public:
+  /// The calling thread of run is one of the workers.
+  explicit WalkPool(size_t workers) {
+    for (size_t i = 1; i < workers; i++) {
+      helpers_.emplace_back([this]() { loop(); });
+    }
+  }
+
+  ~WalkPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& helper : helpers_) {
+      helper.join();
+    }
+  }
+
+  /// Call task for every index below count and wait for all of them.
+  void run(size_t count, const std::function<void(size_t)>& task) {
+    // Helpers are only woken when there is more than one task.
+    if (count <= 1 || helpers_.empty()) {
+      for (size_t i = 0; i < count; i++) {
+        task(i);
+      }
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &task;
+      count_ = count;
+      next_ = 0;
+      busy_ = helpers_.size();
+      generation_++;
+    }
+    wake_.notify_all();
+
+    work();
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return busy_ == 0; });
+  }
+
+ private:
+  void work() {
+    for (size_t i = next_++; i < count_; i = next_++) {
+      (*task_)(i);
+    }
+  }
+
+  void loop() {
+    size_t generation = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock,
+                   [&]() { return stop_ || generation_ != generation; });
+        if (stop_) {
+          return;
+        }
+        generation = generation_;
+      }
+
+      work();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        busy_--;
+      }
+      done_.notify_one();
+    }
+  }
+
+ private:
+  std::vector<std::thread> helpers_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+
+  /// Bumped for each run, helpers wait for a change.
+  size_t generation_{0};
+  bool stop_{false};
+
+  /// Helpers that have not finished the current run.
+  size_t busy_{0};
+
+  const std::function<void(size_t)>* task_{nullptr};
+  size_t count_{0};
+  std::atomic<size_t> next_{0};
+};
+
+class DirectoryWalker : private boost::noncopyable {
+ public:
+  DirectoryWalker(const WalkOptions& options, size_t workers)
+      : options_(options), pool_(workers) {}
+
+  /// Run the walk to completion, the calling thread is the first worker.
+  Status walk(const std::vector<std::string>& roots,
+              std::vector<std::string>& results);
+
+ private:
+  /// Read a single directory, the path always ends with a '/'.
+  void read(const std::string& path,
+            const WalkIdentity& identity,
+            size_t depth,
+            WalkRead& out);
+
+  /// Handle a single entry returned for a directory.
+  void entry(int fd,
+             const std::string& path,
+             size_t depth,
+             const char* name,
+             unsigned char type,
+             WalkRead& out);
+
+ private:
+  const WalkOptions& options_;
+
+  WalkPool pool_;
+
+  /// Directories read so far, only changed between levels.
+  std::set<WalkIdentity> seen_;
+};
+
+void DirectoryWalker::entry(int fd,
+                            const std::string& path,
+                            size_t depth,
+                            const char* name,
+                            unsigned char type,
+                            WalkRead& out) {
+  if (name[0] == '.') {
+    if (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')) {
+      return;
+    }
+    if (!options_.include_hidden) {
+      return;
+    }
+  }
+
+  bool is_dir = (type == DT_DIR);
+  if (type == DT_LNK || type == DT_UNKNOWN) {
+    // Follow symlinks like glob(3), dangling links are reported as files.
+    struct stat link_stat;
+    is_dir =
+        ::fstatat(fd, name, &link_stat, 0) == 0 && S_ISDIR(link_stat.st_mode);
+  }
+
+  if (!is_dir && !(options_.limits & GLOB_FILES)) {
+    return;
+  }
+
+  auto child = path + name;
+  if (is_dir) {
+    child += '/';
+  }
+
+  if (options_.exclude != nullptr && options_.exclude(child)) {
+    return;
+  }
+
+  if (is_dir && depth + 1 < options_.max_depth) {
+    out.children.push_back(child);
+  }
+
+  if (!is_dir || (options_.limits & GLOB_FOLDERS)) {
+    out.entries.push_back(std::move(child));
+  }
+}
+
+void DirectoryWalker::read(const std::string& path,
+                           const WalkIdentity& identity,
+                           size_t depth,
+                           WalkRead& out) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  auto const fd_guard = scope_guard::create([fd]() { ::close(fd); });
+
+  // A path replaced since it was identified may not be deduplicated.
+  struct stat dir_stat;
+  if (::fstat(fd, &dir_stat) != 0 ||
+      std::make_pair(dir_stat.st_dev, dir_stat.st_ino) != identity) {
+    return;
+  }
+  out.opened = true;
+
+#ifdef __linux__
+  thread_local std::vector<char> buffer(kDirentBufferSize);
+  while (true) {
+    auto size = ::syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+    if (size <= 0) {
+      break;
+    }
+
+    for (long offset = 0; offset < size;) {
+      auto dirent = reinterpret_cast<LinuxDirent64*>(buffer.data() + offset);
+      offset += dirent->d_reclen;
+      entry(fd, path, depth, dirent->d_name, dirent->d_type, out);
+    }
+  }
+#else
+  // fdopendir takes ownership of the descriptor it is given.
+  int dir_fd = ::dup(fd);
+  if (dir_fd < 0) {
+    return;
+  }
+
+  DIR* dir = ::fdopendir(dir_fd);
+  if (dir == nullptr) {
+    ::close(dir_fd);
+    return;
+  }
+
+  struct dirent* dirent = nullptr;
+  while ((dirent = ::readdir(dir)) != nullptr) {
+    entry(fd, path, depth, dirent->d_name, dirent->d_type, out);
+  }
+  ::closedir(dir);
+#endif
+}
+
+Status DirectoryWalker::walk(const std::vector<std::string>& roots,
+                             std::vector<std::string>& results) {
+  std::vector<std::string> level;
+  for (const auto& root : roots) {
+    if (root.empty()) {
+      continue;
+    }
+    level.push_back((root.back() == '/') ? root : root + '/');
+  }
+
+  size_t opened = 0;
+  for (size_t depth = 0; !level.empty(); depth++) {
+    std::vector<WalkStat> stats(level.size());
+    pool_.run(level.size(), [&](size_t i) {
+      struct stat dir_stat;
+      if (::stat(level[i].c_str(), &dir_stat) == 0 &&
+          S_ISDIR(dir_stat.st_mode)) {
+        stats[i].found = true;
+        stats[i].identity = std::make_pair(dir_stat.st_dev, dir_stat.st_ino);
+      }
+    });
+
+    // Directories are deduplicated before they are read. One reached by
+    // several paths of a level is kept for the first path in level order,
+    // so the results do not depend on thread timing.
+    std::vector<size_t> selected;
+    for (size_t i = 0; i < level.size(); i++) {
+      if (!stats[i].found) {
+        continue;
+      }
+      if (!seen_.insert(stats[i].identity).second) {
+        VLOG(1) << "Directory loop detected possibly involving: " << level[i];
+        continue;
+      }
+      selected.push_back(i);
+    }
+
+    std::vector<WalkRead> reads(selected.size());
+    pool_.run(selected.size(), [&](size_t i) {
+      auto index = selected[i];
+      read(level[index], stats[index].identity, depth, reads[i]);
+    });
+
+    std::vector<std::string> entries;
+    std::vector<std::string> next;
+    for (auto& read : reads) {
+      if (!read.opened) {
+        continue;
+      }
+
+      if (depth == 0) {
+        opened++;
+      }
+      std::move(read.entries.begin(),
+                read.entries.end(),
+                std::back_inserter(entries));
+      std::move(read.children.begin(),
+                read.children.end(),
+                std::back_inserter(next));
+    }
+
+    // Match the level-by-level, sorted order of repeated glob(3) calls.
+    std::sort(entries.begin(), entries.end());
+    results.reserve(results.size() + entries.size());
+    std::move(entries.begin(), entries.end(), std::back_inserter(results));
+
+    std::sort(next.begin(), next.end());
+    level = std::move(next);
+  }
+
+  if (opened == 0 && !roots.empty()) {
+    return Status(1, "Could not open directory: " + roots.front());
+  }
+  return Status::success();
+}
+
+} // namespace
+
+Status walkDirectories(const std::vector<std::string>& roots,
+                       std::vector<std::string>& results,
+                       const WalkOptions& options) {
+  size_t workers = (options.threads > 0) ? options.threads : FLAGS_glob_threads;
+  workers = std::min<size_t>(
+      workers, std::max<size_t>(std::thread::hardware_concurrency(), 1));
+
+  DirectoryWalker walker(options, std::max<size_t>(workers, 1));
+  return walker.walk(roots, results);
+}
+
+Status walkDirectory(const std::string& root,
+                     std::vector<std::string>& results,
+                     const WalkOptions& options) {
+  return walkDirectories({root}, results, options);
+}
+
+} // namespace osquery
@@ -11,6 +11,11 @@
 
 #include <stdio.h>
 
+#ifndef WIN32
+#include <sys/stat.h>
+#include <sys/time.h>
+#endif
+
 #include <gtest/gtest.h>
 
 #include <boost/filesystem.hpp>
@@ -36,6 +41,8 @@ namespace fs = boost::filesystem;
 namespace osquery {
 
 DECLARE_uint64(read_max);
+DECLARE_uint64(read_mmap_min);
+DECLARE_bool(disable_forensic);
 
 class FilesystemTests : public testing::Test {
  protected:
@@ -184,6 +191,91 @@ TEST_F(FilesystemTests, test_read_limit) {
   EXPECT_TRUE(status.ok());
 }
 
+TEST_F(FilesystemTests, test_read_file_view) {
+  // Write a file spanning several read buffers, with an unaligned tail.
+  std::string expected;
+  for (size_t i = 0; expected.size() < 300 * 1024; i++) {
+    expected += std::to_string(i) + ',';
+  }
+  auto test_file = test_working_dir_ / "view.txt";
+  ASSERT_TRUE(writeTextFile(test_file, expected).ok());
+
+  for (auto mmap_min : {0ULL, 1ULL}) {
+    FLAGS_read_mmap_min = mmap_min;
+
+    std::string content;
+    size_t parts = 0;
+    auto status = readFileView(test_file, [&](boost::string_view data) {
+      content.append(data.data(), data.size());
+      parts++;
+    });
+    EXPECT_TRUE(status.ok());
+    EXPECT_EQ(content, expected);
+    EXPECT_GT(parts, 0U);
+  }
+  FLAGS_read_mmap_min = 0;
+
+  // A predicate may read other files without clobbering its own view.
+  std::string outer;
+  std::string inner;
+  readFileView(test_file, [&](boost::string_view data) {
+    if (inner.empty()) {
+      readFile(fake_directory_ / "root.txt", inner);
+      readFileView(fake_directory_ / "roto.txt", [](boost::string_view) {});
+    }
+    outer.append(data.data(), data.size());
+  });
+  EXPECT_EQ(outer, expected);
+  EXPECT_EQ(inner, "root");
+
+  auto max = FLAGS_read_max;
+  FLAGS_read_max = 3;
+  EXPECT_FALSE(
+      readFileView(fake_directory_ / "root.txt", [](boost::string_view) {})
+          .ok());
+  FLAGS_read_max = max;
+}
+
+#ifndef WIN32
+TEST_F(FilesystemTests, test_forensic_read_limit) {
+  auto test_file = test_working_dir_ / "forensic.txt";
+  ASSERT_TRUE(writeTextFile(test_file, "12345").ok());
+
+  // An access time older than the modification time is updated by a read.
+  struct timeval times[2] = {{1000, 0}, {2000, 0}};
+  ASSERT_EQ(::utimes(test_file.c_str(), times), 0);
+
+  // Reading as many bytes as read_max stops the read early.
+  auto forensic = FLAGS_disable_forensic;
+  auto max = FLAGS_read_max;
+  FLAGS_disable_forensic = false;
+  FLAGS_read_max = 5;
+  std::string content;
+  EXPECT_FALSE(forensicReadFile(test_file, content).ok());
+  EXPECT_FALSE(readFileView(test_file, [](boost::string_view) {}, true).ok());
+  FLAGS_read_max = max;
+  FLAGS_disable_forensic = forensic;
+
+  // The times are restored all the same.
+  struct stat file_stat;
+  ASSERT_EQ(::stat(test_file.c_str(), &file_stat), 0);
+  EXPECT_EQ(file_stat.st_atime, 1000);
+  EXPECT_EQ(file_stat.st_mtime, 2000);
+}
+#endif
+
+TEST_F(FilesystemTests, test_read_proc_view) {
+  if (isPlatform(PlatformType::TYPE_LINUX)) {
+    // Special files report no size and are read until the end.
+    std::string content;
+    fs::path stat_path("/proc/" + std::to_string(platformGetPid()) + "/stat");
+    EXPECT_TRUE(readFileView(stat_path, [&content](boost::string_view data) {
+                  content.append(data.data(), data.size());
+                }).ok());
+    EXPECT_GT(content.size(), 0U);
+  }
+}
+
 TEST_F(FilesystemTests, test_list_files_missing_directory) {
   std::vector<std::string> results;
   auto status = listFilesInDirectory("/foo/bar", results);
@@ -0,0 +1,159 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <osquery/filesystem/filesystem.h>
+#include <osquery/filesystem/mock_file_structure.h>
+#include <osquery/filesystem/walker.h>
+
+namespace fs = boost::filesystem;
+
+namespace osquery {
+
+class WalkerTests : public testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = fs::canonical(createMockFileStructure()).string() + '/';
+  }
+
+  void TearDown() override {
+    fs::remove_all(root_);
+  }
+
+  bool contains(const std::vector<std::string>& all, const std::string& n) {
+    return std::find(all.begin(), all.end(), n) != all.end();
+  }
+
+ protected:
+  std::string root_;
+};
+
+TEST_F(WalkerTests, test_walk_matches_recursive_glob) {
+  for (size_t threads : {1, 4}) {
+    WalkOptions options;
+    options.threads = threads;
+
+    std::vector<std::string> results;
+    EXPECT_TRUE(walkDirectory(root_, results, options).ok());
+    EXPECT_EQ(results.size(), 20U);
+    EXPECT_TRUE(contains(results, root_ + "deep11/deep2/deep3/level3.txt"));
+    EXPECT_TRUE(contains(results, root_ + "deep11/deep2/deep3/"));
+
+    // Entries are ordered by depth, then by path.
+    EXPECT_EQ(results.front(), root_ + "deep1/");
+    EXPECT_EQ(results.back(), root_ + "deep11/deep2/deep3/level3.txt");
+  }
+}
+
+TEST_F(WalkerTests, test_walk_limits) {
+  WalkOptions options;
+  options.limits = GLOB_FOLDERS;
+
+  std::vector<std::string> folders;
+  walkDirectory(root_, folders, options);
+  EXPECT_EQ(folders.size(), 10U);
+  for (const auto& folder : folders) {
+    EXPECT_EQ(folder.back(), '/');
+  }
+
+  options.limits = GLOB_FILES;
+  options.max_depth = 1;
+
+  std::vector<std::string> files;
+  walkDirectory(root_, files, options);
+  EXPECT_EQ(files.size(), 4U);
+  EXPECT_TRUE(contains(files, root_ + "root2.txt"));
+}
+
+TEST_F(WalkerTests, test_walk_exclude_prunes_subtree) {
+  WalkOptions options;
+  options.exclude = [this](const std::string& path) {
+    return path == root_ + "deep11/";
+  };
+
+  std::vector<std::string> results;
+  walkDirectory(root_, results, options);
+  EXPECT_EQ(results.size(), 13U);
+  for (const auto& result : results) {
+    EXPECT_NE(result.find(root_ + "deep11"), 0U);
+  }
+}
+
+TEST_F(WalkerTests, test_walk_hidden) {
+  writeTextFile(root_ + ".hidden", "hidden");
+
+  std::vector<std::string> results;
+  walkDirectory(root_, results);
+  EXPECT_FALSE(contains(results, root_ + ".hidden"));
+
+  WalkOptions options;
+  options.include_hidden = true;
+  results.clear();
+  walkDirectory(root_, results, options);
+  EXPECT_TRUE(contains(results, root_ + ".hidden"));
+}
+
+TEST_F(WalkerTests, test_walk_symlink_loop) {
+  boost::system::error_code ec;
+  fs::create_directory_symlink(root_, root_ + "deep1/loop", ec);
+  ASSERT_FALSE(ec);
+
+  for (size_t threads : {1, 4}) {
+    WalkOptions options;
+    options.threads = threads;
+
+    // The link is reported once and not descended.
+    std::vector<std::string> results;
+    walkDirectory(root_, results, options);
+    EXPECT_EQ(results.size(), 21U);
+    EXPECT_TRUE(contains(results, root_ + "deep1/loop/"));
+    EXPECT_FALSE(contains(results, root_ + "deep1/loop/root.txt"));
+  }
+}
+
+TEST_F(WalkerTests, test_walk_duplicate_is_stable) {
+  // Two paths at the same depth reach the same directory.
+  boost::system::error_code ec;
+  fs::create_directory_symlink(
+      root_ + "deep11/deep2", root_ + "deep1/alias", ec);
+  ASSERT_FALSE(ec);
+
+  std::vector<std::string> expected;
+  for (size_t run = 0; run < 20; run++) {
+    WalkOptions options;
+    options.threads = (run % 2 == 0) ? 1 : 4;
+
+    // The first path by depth, then path, is the one descended.
+    std::vector<std::string> results;
+    walkDirectory(root_, results, options);
+    EXPECT_TRUE(contains(results, root_ + "deep1/alias/deep3/"));
+    EXPECT_FALSE(contains(results, root_ + "deep11/deep2/deep3/"));
+    if (run == 0) {
+      expected = results;
+    }
+    EXPECT_EQ(results, expected);
+  }
+}
+
+TEST_F(WalkerTests, test_walk_missing_root) {
+  std::vector<std::string> results;
+  EXPECT_FALSE(walkDirectory(root_ + "not_there/", results).ok());
+  EXPECT_TRUE(results.empty());
+
+  // Missing roots do not hide the results of the others.
+  EXPECT_TRUE(
+      walkDirectories({root_ + "not_there/", root_ + "deep1/"}, results).ok());
+  EXPECT_EQ(results.size(), 3U);
+}
+
+} // namespace osquery
@@ -0,0 +1,77 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <osquery/filesystem/filesystem.h>
+#include <osquery/utils/status/status.h>
+
+namespace osquery {
+
+/// Options for a single-pass recursive directory walk.
+struct WalkOptions {
+  /**
+   * @brief Types of entries to return.
+   *
+   * Directories are always descended, but when folders are not requested
+   * their paths are never built. When files are not requested, entries the
+   * kernel reports as non-directories are skipped without a stat.
+   */
+  GlobLimits limits{GLOB_ALL};
+
+  /// Maximum number of levels below each root to visit.
+  size_t max_depth{64};
+
+  /// Include entries whose names begin with a '.', glob(3) skips these.
+  bool include_hidden{false};
+
+  /**
+   * @brief Optional exclusion predicate.
+   *
+   * Called with every candidate path (directories end with a '/') before it
+   * is added to the results. A true return drops the entry, and for
+   * directories the entire subtree is pruned. May be called concurrently.
+   */
+  std::function<bool(const std::string& path)> exclude{nullptr};
+
+  /// Worker threads to use, 0 selects the --glob_threads default.
+  size_t threads{0};
+};
+
+/**
+ * @brief Recursively list one or more directory trees.
+ *
+ * Each directory is opened and read once, a level at a time. The directories
+ * of a level are shared across a small pool of threads, started once for the
+ * walk. Directories reached more than once (symlink loops, bind mounts) are
+ * detected by (device, inode) before they are read, and only the first path,
+ * by depth and then path, is descended.
+ *
+ * Results use the same shape as resolveFilePattern: directories carry a
+ * trailing '/' and entries are ordered by depth, then by path.
+ *
+ * @param roots directories to walk, the roots themselves are not returned.
+ * @param results output vector of discovered paths.
+ * @param options walk limits, see WalkOptions.
+ *
+ * @return failure if none of the roots could be opened.
+ */
+Status walkDirectories(const std::vector<std::string>& roots,
+                       std::vector<std::string>& results,
+                       const WalkOptions& options = WalkOptions());
+
+/// See walkDirectories, for a single root directory.
+Status walkDirectory(const std::string& root,
+                     std::vector<std::string>& results,
+                     const WalkOptions& options = WalkOptions());
+
+} // namespace osquery
@@ -0,0 +1,138 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <boost/filesystem.hpp>
+
+#include <osquery/filesystem/filesystem.h>
+#include <osquery/flags.h>
+#include <osquery/hashing/hashing.h>
+
+namespace fs = boost::filesystem;
+
+namespace osquery {
+
+DECLARE_uint64(read_mmap_min);
+
+/// Number of files hashed per iteration.
+const size_t kHashedFiles = 10000;
+
+/**
+ * Mixed file sizes, out of every 100 files.
+ *
+ * Mostly small configuration-sized files, with a tail of larger binaries.
+ */
+const std::vector<std::pair<size_t, size_t>> kHashedFileSizes = {
+    {70, 1024},
+    {20, 16 * 1024},
+    {9, 128 * 1024},
+    {1, 2 * 1024 * 1024},
+};
+
+/// A set of 10k files of mixed sizes, built once and removed at exit.
+class HashedFiles {
+ public:
+  static const std::vector<std::string>& paths() {
+    static HashedFiles files;
+    return files.paths_;
+  }
+
+  ~HashedFiles() {
+    boost::system::error_code ec;
+    fs::remove_all(root_, ec);
+  }
+
+ private:
+  HashedFiles() {
+    root_ = fs::temp_directory_path() /
+            fs::unique_path("osquery.benchmarks.hashing.%%%%.%%%%");
+    fs::create_directories(root_);
+
+    size_t index = 0;
+    while (index < kHashedFiles) {
+      for (const auto& size : kHashedFileSizes) {
+        for (size_t i = 0; i < size.first && index < kHashedFiles; i++) {
+          auto path = (root_ / ("file" + std::to_string(index++))).string();
+          writeTextFile(path, std::string(size.second, 'A' + (index % 26)));
+          paths_.push_back(path);
+        }
+      }
+    }
+  }
+
+ private:
+  fs::path root_;
+  std::vector<std::string> paths_;
+};
+
+static void HASHING_files_chunked(benchmark::State& state) {
+  const auto& paths = HashedFiles::paths();
+
+  size_t bytes = 0;
+  while (state.KeepRunning()) {
+    for (const auto& path : paths) {
+      Hash hash(HASH_TYPE_SHA256);
+      readFile(path,
+               0,
+               4096,
+               false,
+               true,
+               ([&hash, &bytes](std::string& buffer, size_t size) {
+                 hash.update(&buffer[0], size);
+                 bytes += size;
+               }));
+      benchmark::DoNotOptimize(hash.digest());
+    }
+  }
+  state.SetBytesProcessed(bytes);
+}
+
+BENCHMARK(HASHING_files_chunked)->Unit(benchmark::kMillisecond);
+
+static void HASHING_files_view(benchmark::State& state) {
+  const auto& paths = HashedFiles::paths();
+  auto mmap_min = FLAGS_read_mmap_min;
+  FLAGS_read_mmap_min = static_cast<uint64_t>(state.range(0));
+
+  size_t bytes = 0;
+  while (state.KeepRunning()) {
+    for (const auto& path : paths) {
+      Hash hash(HASH_TYPE_SHA256);
+      readFileView(path,
+                   [&hash, &bytes](boost::string_view data) {
+                     hash.update(data.data(), data.size());
+                     bytes += data.size();
+                   },
+                   true);
+      benchmark::DoNotOptimize(hash.digest());
+    }
+  }
+  state.SetBytesProcessed(bytes);
+  FLAGS_read_mmap_min = mmap_min;
+}
+
+BENCHMARK(HASHING_files_view)
+    ->Arg(0)
+    ->Arg(256 * 1024)
+    ->Unit(benchmark::kMillisecond);
+
+static void HASHING_multi_from_file(benchmark::State& state) {
+  const auto& paths = HashedFiles::paths();
+
+  while (state.KeepRunning()) {
+    for (const auto& path : paths) {
+      auto hashes = hashMultiFromFile(
+          HASH_TYPE_MD5 | HASH_TYPE_SHA1 | HASH_TYPE_SHA256, path);
+      benchmark::DoNotOptimize(hashes);
+    }
+  }
+}
+
+BENCHMARK(HASHING_multi_from_file)->Unit(benchmark::kMillisecond);
+} // namespace osquery
@@ -22,9 +22,6 @@
 
 namespace osquery {
 
-/// The buffer read size from file IO to hashing structures.
-const size_t kHashChunkSize{4096};
-
 Hash::~Hash() {
   if (ctx_ != nullptr) {
     free(ctx_);
@@ -96,19 +93,16 @@ MultiHashes hashMultiFromFile(int mask, const std::string& path) {
   };
 
   auto blocking = isPlatform(PlatformType::TYPE_WINDOWS);
-  auto s = readFile(path,
-                    0,
-                    kHashChunkSize,
-                    false,
-                    true,
-                    ([&hashes, &mask](std::string& buffer, size_t size) {
-                      for (auto& hash : hashes) {
-                        if (mask & hash.first) {
-                          hash.second->update(&buffer[0], size);
-                        }
-                      }
-                    }),
-                    blocking);
+  auto s = readFileView(path,
+                        ([&hashes, &mask](boost::string_view data) {
+                          for (auto& hash : hashes) {
+                            if (mask & hash.first) {
+                              hash.second->update(data.data(), data.size());
+                            }
+                          }
+                        }),
+                        true,
+                        blocking);
 
   MultiHashes mh = {};
   if (!s.ok()) {
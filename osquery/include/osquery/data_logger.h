@@ -106,6 +106,9 @@ Status logQueryLogItem(const QueryLogItem& item, const std::string& receiver);
  */
 Status logSnapshotQuery(const QueryLogItem& item);
 
+/// The bytes of serialized query results this process has sent to loggers.
+size_t getResultLogBytes();
+
 /**
  * @brief Sink a set of buffered status logs.
  *
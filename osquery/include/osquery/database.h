@@ -51,6 +51,12 @@ extern const std::string kEvents;
 /// The "domain" where the results of carve queries are stored.
 extern const std::string kCarves;
 
+/// The "domain" holding the persistent queue of distributed queries.
+extern const std::string kDistributedQueue;
+
+/// The "domain" caching package inventories and their file indexes.
+extern const std::string kPackages;
+
 /// The key for the DB version
 extern const std::string kDbVersionKey;
 
@@ -254,6 +260,9 @@ Status setDatabaseValue(const std::string& domain,
 Status setDatabaseBatch(const std::string& domain,
                         const DatabaseStringValueList& data);
 
+/// The bytes of keys and values this process has set in the backing-store.
+size_t getDatabaseBytesWritten();
+
 /// Remove a domain/key identified value from backing-store.
 Status deleteDatabaseValue(const std::string& domain, const std::string& key);
 
@@ -8,11 +8,15 @@
 
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
 #include <osquery/plugins/plugin.h>
 #include <osquery/query.h>
+#include <osquery/utils/mutex.h>
 #include <osquery/utils/status/status.h>
 
 namespace osquery {
@@ -196,6 +200,84 @@ class DistributedPlugin : public Plugin {
   Status call(const PluginRequest& request, PluginResponse& response) override;
 };
 
+/**
+ * @brief A persistent FIFO of distributed query requests
+ *
+ * Requests are stored in the kDistributedQueue domain under sequential
+ * indexes, next to the head and tail indexes. Pushing, claiming and
+ * acknowledging a request each cost a constant number of database operations
+ * regardless of how many requests are queued, and the pending count is kept
+ * in memory.
+ *
+ * A claimed request stays in the queue, along with the number of times it was
+ * claimed, until it is acknowledged. A request that was running when the
+ * process died is claimed again when the queue is next loaded, and the
+ * caller decides from its attempt count whether it should be re-run.
+ */
+class DistributedQueue {
+ public:
+  /// Append a request to the tail of the queue.
+  Status push(const DistributedQueryRequest& request);
+
+  /**
+   * @brief Claim the oldest request that has not been claimed yet
+   *
+   * Released requests are claimed first.
+   *
+   * @param request the output request.
+   * @param index the output position, used to acknowledge the request.
+   * @param attempts the output number of claims, including this one.
+   * @return false if there are no requests left to claim.
+   */
+  bool claim(DistributedQueryRequest& request,
+             uint64_t& index,
+             size_t& attempts);
+
+  /// Remove a claimed request, it will not be claimed again.
+  Status acknowledge(uint64_t index);
+
+  /**
+   * @brief Return a claimed request to the queue
+   *
+   * The request is claimed again before any newer request, and the claim
+   * that is returned is not counted as an attempt.
+   */
+  Status release(uint64_t index);
+
+  /// Get the number of requests waiting to be claimed.
+  size_t pending();
+
+ private:
+  /// Read the persisted indexes and adopt requests queued by older versions.
+  void load();
+
+  /// Persist a new request together with the tail index.
+  Status append(const DistributedQueryRequest& request);
+
+  /// Move the head past requests that were acknowledged.
+  Status advance();
+
+ private:
+  Mutex mutex_;
+
+  bool loaded_{false};
+
+  /// Oldest request that has not been acknowledged.
+  uint64_t head_{0};
+
+  /// Next request to claim, requests before it are running or finished.
+  uint64_t next_{0};
+
+  /// Position of the next pushed request.
+  uint64_t tail_{0};
+
+  /// Requests acknowledged out of order, ahead of the head.
+  std::set<uint64_t> acknowledged_;
+
+  /// Requests returned to the queue, claimed before the next request.
+  std::set<uint64_t> released_;
+};
+
 /**
  * @brief Class for managing the set of distributed queries to execute
  *
@@ -214,7 +296,7 @@ class DistributedPlugin : public Plugin {
 class Distributed {
  public:
   /// Default constructor
-  Distributed() {}
+  Distributed() : queue_(std::make_unique<DistributedQueue>()) {}
 
   /// Retrieve queued queries from a remote server
   Status pullUpdates();
@@ -231,7 +313,7 @@ class Distributed {
   /// Process and execute queued queries
   Status runQueries();
 
-  // Getter for ID of currently executing request
+  /// Get the ID of the request running on the calling thread.
   static std::string getCurrentRequestId();
 
  protected:
@@ -247,11 +329,16 @@ class Distributed {
   Status acceptWork(const std::string& work);
 
   /**
-   * @brief Pop a request object off of the queries_ member
+   * @brief Claim the next request from the distributed queue
+   *
+   * The request must be acknowledged with queue_->acknowledge(index) once it
+   * has been executed.
    *
-   * @return a DistributedQueryRequest object which needs to be executed
+   * @return false if there are no pending requests.
    */
-  DistributedQueryRequest popRequest();
+  bool popRequest(DistributedQueryRequest& request,
+                  uint64_t& index,
+                  size_t& attempts);
 
   /**
    * @brief Queue a result to be batch sent to the server
@@ -265,16 +352,55 @@ class Distributed {
    */
   Status flushCompleted();
 
-  // Setter for ID of currently executing request
+  /**
+   * @brief Execute a single request, applying --distributed_query_timeout
+   *
+   * A request claimed more than --distributed_max_attempts times was running
+   * when osquery stopped, it is reported as failed rather than executed.
+   */
+  DistributedQueryResult runQuery(const DistributedQueryRequest& request,
+                                  size_t attempts = 1);
+
+  /**
+   * @brief Execute queued queries on a pool of --distributed_workers threads
+   *
+   * Each result is written to the distributed plugin as soon as its query
+   * completes, rather than batched with the results of the other queries.
+   */
+  Status runQueriesConcurrently();
+
+  /**
+   * @brief Write the result of a single query to the server
+   *
+   * Results with more than --distributed_write_chunk_rows rows are split
+   * across several writes, each carrying its position in a "chunks" object.
+   */
+  Status writeResult(const DistributedQueryResult& result);
+
+  /// Serialize a slice of a result's rows as a write request body.
+  static Status serializeResult(const DistributedQueryResult& result,
+                                size_t first,
+                                size_t count,
+                                size_t chunk,
+                                size_t chunks,
+                                std::string& json);
+
+  /// Set the ID of the request running on the calling thread.
   static void setCurrentRequestId(const std::string& cReqId);
 
   std::vector<DistributedQueryResult> results_;
 
-  // ID of the currently executing query
-  static std::string currentRequestId_;
+  /// Pending requests, persisted in the backing store.
+  std::unique_ptr<DistributedQueue> queue_;
+
+  /// ID of the request executing on each worker thread.
+  static thread_local std::string currentRequestId_;
 
  private:
   friend class DistributedTests;
   FRIEND_TEST(DistributedTests, DISABLED_test_workflow);
+  FRIEND_TEST(DistributedTests, test_serialize_result_chunks);
+  FRIEND_TEST(DistributedTests, test_query_timeout);
+  FRIEND_TEST(DistributedTests, test_queue_interrupted_request);
 };
 }
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <functional>
 #include <map>
 #include <memory>
@@ -407,7 +408,8 @@ class EventSubscriberPlugin : public Plugin, public Eventer {
   /**
    * @brief Store parsed event data from an EventCallback in a backing store.
    *
-   * This method stores a single event
+   * This method stores a single event. Rows are buffered and written in
+   * batches, see addBatch.
    *
    * @param r The row to add
    *
@@ -425,7 +427,12 @@ class EventSubscriberPlugin : public Plugin, public Eventer {
    * The backing store data retrieval is optimized by time-based indexes. It
    * is important to added EventTime as it relates to "when the event occurred".
    *
-   * @param row_list A (writable) vector of osquery Row elements.
+   * The rows are time-stamped and buffered, then written once
+   * `--events_batch_size` rows are buffered or the oldest row is older than
+   * `--events_batch_interval`. Buffered rows are written before any `get`.
+   *
+   * @param row_list A (writable) vector of osquery Row elements, the rows are
+   * moved into the buffer.
    *
    * @return Was the element added to the backing store.
    */
@@ -448,6 +455,30 @@ class EventSubscriberPlugin : public Plugin, public Eventer {
   virtual Status addBatch(std::vector<Row>& row_list,
                           EventTime custom_event_time) final;
 
+  /**
+   * @brief Write the buffered rows.
+   *
+   * Rows that cannot be written, and their log entries, stay buffered, see
+   * trimBatch.
+   *
+   * @param force if false, only write a full or expired buffer.
+   */
+  Status flushBatch(bool force);
+
+  /// Store time-stamped rows, their EventIDs and time indexes.
+  Status writeRows(std::vector<Row>& row_list);
+
+  /// Buffer the rows a previous process logged but did not write.
+  void recoverBatch();
+
+  /**
+   * @brief Drop the oldest buffered rows, and their log entries, when the
+   * buffer holds more than 10 batches.
+   *
+   * The buffer only grows this large while rows cannot be written.
+   */
+  void trimBatch();
+
  private:
   /*
    * @brief When `get`ing event results, return EventID%s from time indexes.
@@ -510,34 +541,43 @@ class EventSubscriberPlugin : public Plugin, public Eventer {
                      const std::string& index,
                      bool all);
 
+  /// Expire the count oldest datums of a bin.
+  void expireOldestRecords(const std::string& list_type,
+                           const std::string& index,
+                           size_t count);
+
   /**
    * @brief Inspect the number of events, expire those overflowing events_max.
    *
-   * When the event manager starts, or after a checkpoint number of events,
-   * the EventFactory will call expireCheck for each subscriber.
+   * Events are counted per 60-second bin (a partition). When the count exceeds
+   * the configured `events_max` limit the oldest partitions are dropped as a
+   * whole while the newer partitions still hold `events_max` events. The
+   * oldest events of the partition crossing the limit are then trimmed, so
+   * the newest `events_max` events are always kept.
    *
-   * The subscriber must count the number of buffered records and check if
-   * that count exceeds the configured `events_max` limit. If an overflow
-   * occurs the subscriber will expire N-events_max from the end of the queue.
+   * Writes that overflow the limit request a check from the expiration
+   * service, or run it inline when the service is not running.
    */
   void expireCheck();
 
+  /// Count the stored events of each partition, once.
+  void loadPartitions();
+
   /**
-   * @brief Add an EventID, EventTime pair to all matching list types.
+   * @brief Add EventID, EventTime pairs to all matching list types.
    *
    * The list types are defined by time size. Based on the EventTime this pair
    * is added to the list bin for each list type. If there are two list types:
    * 60 seconds and 3600 seconds and `time` is 92, this pair will be added to
    * list type 1 bin 4 and list type 2 bin 1.
    *
-   * @param event_id_list A vector of (unique) EventIDs
-   * @param event_time The event time for this batch
+   * Each bin touched by the batch is read and written once.
+   *
+   * @param records A vector of (unique) EventIDs and their event times
    *
    * @return Were the indexes recorded.
    */
-
-  Status recordEvents(const std::vector<std::string>& event_id_list,
-                      EventTime event_time);
+  Status recordEvents(const std::vector<EventRecord>& records);
 
   /**
    * @brief Get the expiration timeout for this event type
@@ -690,6 +730,39 @@ class EventSubscriberPlugin : public Plugin, public Eventer {
   /// Lock used when recording queries executing against this subscriber.
   mutable Mutex event_query_record_;
 
+  /// Rows waiting to be written as a single batch.
+  std::vector<Row> batch_;
+
+  /// When the oldest buffered row was added.
+  std::chrono::steady_clock::time_point batch_start_;
+
+  /// Write-ahead log sequence of the oldest buffered row.
+  size_t batch_wal_first_{0};
+
+  /// Write-ahead log sequence of the next buffered row.
+  size_t batch_wal_next_{0};
+
+  /// Rows logged by a previous process were buffered.
+  bool batch_recovered_{false};
+
+  /// Lock used when buffering and writing batched rows.
+  Mutex event_batch_lock_;
+
+  /// Stored events per 60-second bin.
+  std::map<EventTime, size_t> partitions_;
+
+  /// Stored events in all partitions.
+  size_t partition_count_{0};
+
+  /// The partitions were counted from the backing store.
+  bool partitions_loaded_{false};
+
+  /// Lock used when counting events, taken after event_record_lock_.
+  Mutex partition_lock_;
+
+  /// The partitions overflow events_max, see expireCheck.
+  std::atomic<bool> expire_pending_{false};
+
  private:
   friend class EventFactory;
   friend class EventPublisherPlugin;
@@ -703,6 +776,10 @@ class EventSubscriberPlugin : public Plugin, public Eventer {
   FRIEND_TEST(EventsDatabaseTests, test_expire_check);
   FRIEND_TEST(EventsDatabaseTests, test_optimize);
   FRIEND_TEST(EventsDatabaseTests, test_record_corruption);
+  FRIEND_TEST(EventsDatabaseTests, test_batch_flush);
+  FRIEND_TEST(EventsDatabaseTests, test_batch_recovery);
+  FRIEND_TEST(EventsDatabaseTests, test_batch_limit);
+  FRIEND_TEST(EventsDatabaseTests, test_partition_expiration);
   FRIEND_TEST(EventsTests, test_event_subscriber_configure);
   friend class DBFakeEventSubscriber;
   friend class BenchmarkEventSubscriber;
@@ -887,6 +964,18 @@ class EventFactory : private boost::noncopyable {
    */
   static void end(bool join = false);
 
+  /// Expire the subscribers with an overflowing events_max.
+  static void expireSubscribers();
+
+ private:
+  /**
+   * @brief Write the rows buffered by subscribers of a publisher.
+   *
+   * @param type_id the publisher type, or empty for all subscribers.
+   * @param force if false, only write full or expired buffers.
+   */
+  static void flushSubscribers(const std::string& type_id, bool force);
+
  public:
   EventFactory(EventFactory const&) = delete;
   EventFactory& operator=(EventFactory const&) = delete;
@@ -9,6 +9,8 @@
 #pragma once
 
 #include <chrono>
+#include <cstddef>
+#include <limits>
 #include <string>
 
 #include "osquery/utils/conversions/tryto.h"
@@ -24,6 +26,7 @@ struct RecordKeys {
   std::string timestamp;
   std::string pre_aggregation;
   std::string sync;
+  std::string histogram;
 };
 
 struct HostIdentifierKeys {
@@ -56,6 +59,7 @@ enum class PreAggregationType {
   P50, // Estimates 50th percentile
   P95, // Estimates 95th percentile
   P99, // Estimates 99th percentile
+  Histogram, // Log-bucketed distribution, merged across points
   // not existing PreAggregationType, upper limit definition
   InvalidTypeUpperLimit,
 };
@@ -88,6 +92,56 @@ void record(const std::string& path,
             const bool sync = false,
             TimePoint time_point = Clock::now());
 
+/**
+ * @brief A handle to a pre-registered monitoring path.
+ *
+ * Register paths that are recorded often, such as per-table or per-event
+ * counters, once and keep the handle. Recording through a Sum, Min or Max
+ * handle adds the value to an accumulator of the calling thread: the path
+ * is not formatted or looked up, and no lock is taken. The pre-aggregation
+ * flusher merges the accumulators of every thread.
+ *
+ * Other types, and points recorded while the pre-aggregation buffer is
+ * disabled, are passed to record().
+ *
+ * Common way to use it:
+ * @code{.cpp}
+ * static const auto kEvents = monitoring::registerMetric(
+ *     "events.fired", monitoring::PreAggregationType::Sum);
+ * kEvents.record(1);
+ * @endcode
+ */
+class Metric {
+ public:
+  /// An unregistered handle, which records nothing.
+  Metric() = default;
+
+  /// Record new point of the registered path.
+  void record(ValueType value) const;
+
+ private:
+  Metric(std::size_t id, PreAggregationType pre_aggregation)
+      : id_(id), pre_aggregation_(pre_aggregation) {}
+
+ private:
+  std::size_t id_{std::numeric_limits<std::size_t>::max()};
+  PreAggregationType pre_aggregation_{PreAggregationType::None};
+
+ private:
+  friend Metric registerMetric(const std::string& path,
+                               PreAggregationType pre_aggregation);
+};
+
+/**
+ * @brief Register a path to record points of through a handle.
+ *
+ * Registering the same path and pre_aggregation type again returns an equal
+ * handle. Registration takes a lock, keep the handle instead of registering
+ * per point.
+ */
+Metric registerMetric(const std::string& path,
+                      PreAggregationType pre_aggregation);
+
 /**
  * Force flush the pre-aggregation buffer.
  * Please use it, only when it's totally necessary.
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <map>
 #include <string>
 #include <vector>
@@ -157,6 +158,36 @@ class SQL : private only_movable {
   ColumnNames columns_;
 };
 
+/**
+ * @brief Bound the run time of queries executed by the current thread.
+ *
+ * While an instance is in scope, SQLite statements stepped on this thread are
+ * interrupted once the deadline passes and the query fails. Tables are only
+ * interrupted between rows, so a table that is not a generator finishes
+ * producing its rows before the query stops.
+ *
+ * @code{.cpp}
+ *   SQLDeadline deadline(std::chrono::seconds(30));
+ *   SQL sql("SELECT * FROM file WHERE path LIKE '/%%'");
+ * @endcode
+ */
+class SQLDeadline {
+ public:
+  explicit SQLDeadline(std::chrono::milliseconds timeout);
+  ~SQLDeadline();
+
+  SQLDeadline(const SQLDeadline&) = delete;
+  SQLDeadline& operator=(const SQLDeadline&) = delete;
+
+  /// Check if the current thread has a deadline and it has passed.
+  static bool expired();
+
+ private:
+  /// Deadlines nest, the outer deadline is restored when this one ends.
+  std::chrono::steady_clock::time_point previous_;
+  bool had_previous_{false};
+};
+
 
 /**
  * @brief Execute a query.
@@ -244,7 +244,8 @@ struct ConstraintList : private boost::noncopyable {
    * expression. The affinity of the constraint will be used as the affinite
    * and lexical type of the expression and set of constraint expressions.
    * If there are no predicate constraints in this list, all expression will
-   * match. Constraints are limitations.
+   * match. Constraints are limitations. Equality constraints are the members
+   * of an IN list, the expression must match one of them.
    *
    * @param expr a SQL type expression of the column literal type to check.
    * @return If the expression matched all constraints.
@@ -333,6 +334,36 @@ struct ConstraintList : private boost::noncopyable {
     return constraints_;
   }
 
+  /**
+   * @brief Narrow a numeric range using the comparison constraints.
+   *
+   * The inclusive range [lower, upper] is intersected with each GREATER_THAN,
+   * GREATER_THAN_OR_EQUALS, LESS_THAN and LESS_THAN_OR_EQUALS constraint.
+   * EQUALS constraints (which include each member of an IN list) narrow the
+   * range to the span of their values. Expressions that cannot be cast to
+   * the literal type are ignored, the range only ever includes more values
+   * than the query will select.
+   *
+   * @param lower [input/output] the inclusive lower bound.
+   * @param upper [input/output] the inclusive upper bound.
+   * @return false if no value can match the constraints.
+   */
+  template <typename T>
+  bool getRange(T& lower, T& upper) const;
+
+  /**
+   * @brief Get the literal prefixes of LIKE or GLOB pattern constraints.
+   *
+   * The prefix is the pattern content before its first wildcard. Any value
+   * matching a pattern begins with its prefix, LIKE prefixes are compared
+   * without ASCII case. A table may use prefixes to limit a search, such as
+   * the set of directories or keys it will visit.
+   *
+   * @param op either LIKE or GLOB.
+   * @return The set of prefixes, empty patterns return an empty prefix.
+   */
+  std::set<std::string> getPrefixes(ConstraintOperator op) const;
+
   /**
    * @brief Add a new Constraint to the list of constraints.
    *
@@ -770,9 +801,10 @@ class TablePlugin : public Plugin {
    * This implementation uses nearly %5 more cycles than the generate method
    * when the table content is small (less than 100 rows) and has a disadvantage
    * of not being cachable since the entire contents are not available before
-   * post-filter aggregations. This implementation prevents the need for
-   * multiple representations of table content existing simultaneously and is
-   * always more memory efficient. It can be more compute efficient for tables
+   * post-filter aggregations. Cacheable tables also implement generate, which
+   * scheduled queries use to drain and cache the generator. This
+   * implementation prevents the need for multiple representations of table
+   * content existing simultaneously and is always more memory efficient. It can be more compute efficient for tables
    * with over 1000 rows.
    *
    * @param yield a callable that takes a single Row as input.
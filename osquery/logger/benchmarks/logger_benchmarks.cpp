@@ -11,6 +11,7 @@
 #include <osquery/core.h>
 #include <osquery/flags.h>
 #include <osquery/logger.h>
+#include <osquery/query.h>
 #include <osquery/registry_factory.h>
 
 namespace osquery {
@@ -82,4 +83,51 @@ static void LOGGER_logstring_plugin(benchmark::State& state) {
 }
 
 BENCHMARK(LOGGER_logstring_plugin);
+
+static QueryLogItem getBenchmarkLogItem(size_t rows, size_t decorations) {
+  QueryLogItem item;
+  item.name = "benchmark";
+  item.identifier = "benchmark.example.com";
+  item.calendar_time = "Mon Jan  1 00:00:00 2018 UTC";
+  item.time = 1514764800;
+  for (size_t i = 0; i < decorations; i++) {
+    item.decorations["decoration_" + std::to_string(i)] = "value";
+  }
+
+  for (size_t i = 0; i < rows; i++) {
+    RowTyped r;
+    r["pid"] = static_cast<long long>(i);
+    r["name"] = std::string("process");
+    r["path"] = std::string("/usr/bin/process");
+    r["cmdline"] = std::string("/usr/bin/process --flag=value");
+    r["resident_size"] = static_cast<long long>(i * 4096);
+    item.results.added.push_back(std::move(r));
+  }
+  return item;
+}
+
+static void LOGGER_serialize_events(benchmark::State& state) {
+  auto item = getBenchmarkLogItem(state.range(0), state.range(1));
+  while (state.KeepRunning()) {
+    std::vector<std::string> events;
+    serializeQueryLogItemAsEventsJSON(item, events);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(LOGGER_serialize_events)
+    ->ArgPair(1, 0)
+    ->ArgPair(100, 10)
+    ->ArgPair(10000, 10);
+
+static void LOGGER_serialize_item(benchmark::State& state) {
+  auto item = getBenchmarkLogItem(state.range(0), state.range(1));
+  while (state.KeepRunning()) {
+    std::string json;
+    serializeQueryLogItemJSON(item, json);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(LOGGER_serialize_item)->ArgPair(100, 10)->ArgPair(10000, 10);
 }
@@ -11,6 +11,7 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <future>
 #include <queue>
 #include <thread>
@@ -397,7 +398,18 @@ Status logString(const std::string& message,
 
 namespace {
 const std::string kTotalQueryCounterMonitorPath("query.total.count");
+
+/// Bytes of serialized query results sent to loggers.
+std::atomic<size_t> kResultLogBytes{0};
+
+void countResultLogBytes(const std::vector<std::string>& json_items) {
+  size_t bytes = 0;
+  for (const auto& json : json_items) {
+    bytes += json.size();
+  }
+  kResultLogBytes.fetch_add(bytes, std::memory_order_relaxed);
 }
+} // namespace
 
 Status logQueryLogItem(const QueryLogItem& results) {
   return logQueryLogItem(results, RegistryFactory::get().getActive("logger"));
@@ -427,6 +439,7 @@ Status logQueryLogItem(const QueryLogItem& results,
     return status;
   }
 
+  countResultLogBytes(json_items);
   for (const auto& json : json_items) {
     status = logString(json, "event", receiver);
   }
@@ -456,6 +469,7 @@ Status logSnapshotQuery(const QueryLogItem& item) {
     return status;
   }
 
+  countResultLogBytes(json_items);
   for (const auto& json : json_items) {
     auto receiver = RegistryFactory::get().getActive("logger");
     for (const auto& logger : osquery::split(receiver, ",")) {
@@ -472,6 +486,10 @@ Status logSnapshotQuery(const QueryLogItem& item) {
   return status;
 }
 
+size_t getResultLogBytes() {
+  return kResultLogBytes.load(std::memory_order_relaxed);
+}
+
 size_t queuedStatuses() {
   ReadLock lock(kBufferedLogSinkLogs);
   return BufferedLogSink::get().dump().size();
@@ -0,0 +1,675 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <iterator>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <zstd.h>
+
+#include <osquery/filesystem/filesystem.h>
+#include <osquery/logger/result_spool.h>
+#include <osquery/utils/json/json.h>
+#include <osquery/utils/system/time.h>
+
+namespace fs = boost::filesystem;
+
+namespace osquery {
+
+namespace {
+
+const std::string kSpoolMagic{"OSQSPL01"};
+const std::string kSpoolFooterMagic{"OSQSPEND"};
+
+const char kBlockMarker = 'B';
+const char kFooterMarker = 'F';
+
+const char kAbsentCell = 0;
+const char kStringCell = 1;
+const char kValueCell = 2;
+
+/// Favor compression speed, results are spooled as queries run.
+const int kSpoolCompressionLevel = 3;
+
+/// Larger column chunks are taken as corruption.
+const uint64_t kMaxColumnSize = 1024 * 1024 * 1024;
+
+void putVarint(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+void putString(std::string& out, const std::string& value) {
+  putVarint(out, value.size());
+  out.append(value);
+}
+
+/// Reads the encoded integers and strings of a spool.
+class SpoolInput {
+ public:
+  SpoolInput(const std::string& data, size_t pos) : data_(data), pos_(pos) {}
+
+  bool getByte(char& value) {
+    if (pos_ >= data_.size()) {
+      return false;
+    }
+    value = data_[pos_++];
+    return true;
+  }
+
+  bool getVarint(uint64_t& value) {
+    value = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
+      char byte = 0;
+      if (!getByte(byte)) {
+        return false;
+      }
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool getBytes(size_t size, std::string& value) {
+    if (size > data_.size() - pos_) {
+      return false;
+    }
+    value.assign(data_, pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+  bool getString(std::string& value) {
+    uint64_t size = 0;
+    return getVarint(size) && getBytes(size, value);
+  }
+
+  bool skip(size_t size) {
+    if (size > data_.size() - pos_) {
+      return false;
+    }
+    pos_ += size;
+    return true;
+  }
+
+  size_t pos() const {
+    return pos_;
+  }
+
+  bool done() const {
+    return pos_ >= data_.size();
+  }
+
+ private:
+  const std::string& data_;
+  size_t pos_{0};
+};
+
+/// A column of a read block.
+struct SpoolColumn {
+  std::vector<std::string> path;
+  std::string cells;
+};
+
+Status readSpoolFile(const std::string& path, std::string& data) {
+  std::ifstream input(path, std::ios::in | std::ios::binary);
+  if (!input.is_open()) {
+    return Status::failure("Cannot open spool " + path);
+  }
+
+  data.assign(std::istreambuf_iterator<char>(input),
+              std::istreambuf_iterator<char>());
+  if (data.compare(0, kSpoolMagic.size(), kSpoolMagic) != 0) {
+    return Status::failure(path + " is not a result spool");
+  }
+  return Status::success();
+}
+
+/**
+ * Read a block after its marker.
+ *
+ * The column cells are only decompressed if columns is not null.
+ */
+Status readBlock(SpoolInput& input,
+                 std::string& name,
+                 uint64_t& rows,
+                 std::vector<SpoolColumn>* columns) {
+  uint64_t column_count = 0;
+  if (!input.getString(name) || !input.getVarint(rows) ||
+      !input.getVarint(column_count)) {
+    return Status::failure("Truncated spool block header");
+  }
+
+  for (uint64_t i = 0; i < column_count; ++i) {
+    SpoolColumn column;
+    uint64_t parts = 0;
+    if (!input.getVarint(parts)) {
+      return Status::failure("Truncated spool column");
+    }
+    for (uint64_t j = 0; j < parts; ++j) {
+      std::string part;
+      if (!input.getString(part)) {
+        return Status::failure("Truncated spool column");
+      }
+      column.path.push_back(std::move(part));
+    }
+
+    uint64_t size = 0;
+    uint64_t compressed_size = 0;
+    if (!input.getVarint(size) || !input.getVarint(compressed_size) ||
+        size > kMaxColumnSize) {
+      return Status::failure("Malformed spool column");
+    }
+    if (columns == nullptr) {
+      if (!input.skip(compressed_size)) {
+        return Status::failure("Truncated spool column");
+      }
+      continue;
+    }
+
+    std::string compressed;
+    if (!input.getBytes(compressed_size, compressed)) {
+      return Status::failure("Truncated spool column");
+    }
+    column.cells.resize(size);
+    auto result = ZSTD_decompress(&column.cells[0],
+                                  column.cells.size(),
+                                  compressed.data(),
+                                  compressed.size());
+    if (ZSTD_isError(result) || result != size) {
+      return Status::failure("Cannot decompress spool column");
+    }
+    columns->push_back(std::move(column));
+  }
+  return Status::success();
+}
+
+/// Add a cell at a path of member names, creating the objects above it.
+void addCell(rapidjson::Document& doc,
+             const std::vector<std::string>& path,
+             char kind,
+             const std::string& cell) {
+  auto& allocator = doc.GetAllocator();
+  rapidjson::Value* node = &doc;
+  for (size_t i = 0; i + 1 < path.size(); ++i) {
+    auto member = node->FindMember(path[i]);
+    if (member == node->MemberEnd()) {
+      node->AddMember(rapidjson::Value(path[i], allocator),
+                      rapidjson::Value(rapidjson::kObjectType),
+                      allocator);
+      member = node->MemberEnd() - 1;
+    } else if (!member->value.IsObject()) {
+      return;
+    }
+    node = &member->value;
+  }
+
+  rapidjson::Value value;
+  if (kind == kStringCell) {
+    value.SetString(cell, allocator);
+  } else {
+    rapidjson::Document parsed(&allocator);
+    parsed.Parse(cell.c_str());
+    if (parsed.HasParseError()) {
+      return;
+    }
+    value.CopyFrom(parsed, allocator);
+  }
+  node->AddMember(rapidjson::Value(path.back(), allocator), value, allocator);
+}
+
+/// Convert the rows of a read block to JSON lines.
+Status writeBlockLines(std::vector<SpoolColumn>& columns,
+                       uint64_t rows,
+                       const std::function<void(const std::string&)>& line) {
+  std::vector<SpoolInput> cells;
+  for (const auto& column : columns) {
+    cells.emplace_back(column.cells, 0);
+  }
+
+  for (uint64_t row = 0; row < rows; ++row) {
+    rapidjson::Document doc;
+    doc.SetObject();
+    for (size_t i = 0; i < columns.size(); ++i) {
+      char kind = kAbsentCell;
+      if (!cells[i].getByte(kind)) {
+        return Status::failure("Truncated spool column cells");
+      }
+      if (kind == kAbsentCell) {
+        continue;
+      }
+
+      std::string cell;
+      if (!cells[i].getString(cell)) {
+        return Status::failure("Truncated spool column cells");
+      }
+      addCell(doc, columns[i].path, kind, cell);
+    }
+
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    doc.Accept(writer);
+    line(std::string(buffer.GetString(), buffer.GetSize()));
+  }
+  return Status::success();
+}
+
+Status readFooter(const std::string& data,
+                  std::vector<ResultSpoolBlock>& blocks) {
+  auto end = data.size() - kSpoolFooterMagic.size();
+  uint64_t offset = 0;
+  for (size_t i = 0; i < 8; ++i) {
+    offset |= static_cast<uint64_t>(static_cast<unsigned char>(
+                  data[end - 8 + i]))
+              << (8 * i);
+  }
+
+  SpoolInput input(data, offset);
+  char marker = 0;
+  uint64_t count = 0;
+  if (offset >= end || !input.getByte(marker) || marker != kFooterMarker ||
+      !input.getVarint(count)) {
+    return Status::failure("Malformed spool footer");
+  }
+
+  for (uint64_t i = 0; i < count; ++i) {
+    ResultSpoolBlock block;
+    uint64_t block_offset = 0;
+    uint64_t rows = 0;
+    if (!input.getString(block.name) || !input.getVarint(block_offset) ||
+        !input.getVarint(rows)) {
+      return Status::failure("Malformed spool footer");
+    }
+    block.offset = static_cast<size_t>(block_offset);
+    block.rows = static_cast<size_t>(rows);
+    blocks.push_back(std::move(block));
+  }
+  return Status::success();
+}
+
+Status scanBlocks(const std::string& data,
+                  std::vector<ResultSpoolBlock>& blocks) {
+  SpoolInput input(data, kSpoolMagic.size());
+  while (!input.done()) {
+    ResultSpoolBlock block;
+    block.offset = input.pos();
+
+    char marker = 0;
+    input.getByte(marker);
+    if (marker == kFooterMarker) {
+      break;
+    } else if (marker != kBlockMarker) {
+      return Status::failure("Malformed spool block");
+    }
+
+    uint64_t rows = 0;
+    auto status = readBlock(input, block.name, rows, nullptr);
+    if (!status.ok()) {
+      return status;
+    }
+    block.rows = static_cast<size_t>(rows);
+    blocks.push_back(std::move(block));
+  }
+  return Status::success();
+}
+
+Status readIndex(const std::string& data,
+                 std::vector<ResultSpoolBlock>& blocks) {
+  auto min_size = kSpoolMagic.size() + 8 + kSpoolFooterMagic.size();
+  if (data.size() >= min_size &&
+      data.compare(data.size() - kSpoolFooterMagic.size(),
+                   kSpoolFooterMagic.size(),
+                   kSpoolFooterMagic) == 0) {
+    return readFooter(data, blocks);
+  }
+
+  // The writer did not finish the spool.
+  return scanBlocks(data, blocks);
+}
+
+/// Calls cell with the path and encoded cell of each member of a row.
+void flattenRow(const rapidjson::Value& object,
+                std::vector<std::string>& path,
+                const std::function<void(const std::vector<std::string>&,
+                                         char,
+                                         const char*,
+                                         size_t)>& cell) {
+  for (const auto& member : object.GetObject()) {
+    path.emplace_back(member.name.GetString(), member.name.GetStringLength());
+    if (member.value.IsObject() && member.value.MemberCount() > 0) {
+      flattenRow(member.value, path, cell);
+    } else if (member.value.IsString()) {
+      cell(path,
+           kStringCell,
+           member.value.GetString(),
+           member.value.GetStringLength());
+    } else {
+      rapidjson::StringBuffer buffer;
+      rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+      member.value.Accept(writer);
+      cell(path, kValueCell, buffer.GetString(), buffer.GetSize());
+    }
+    path.pop_back();
+  }
+}
+
+} // namespace
+
+ResultSpoolWriter::ResultSpoolWriter(std::string path,
+                                     size_t block_rows,
+                                     size_t max_size,
+                                     int mode)
+    : path_(std::move(path)),
+      block_rows_(std::max<size_t>(block_rows, 1)),
+      max_size_(max_size),
+      mode_(mode) {}
+
+ResultSpoolWriter::~ResultSpoolWriter() {
+  writeBlocks();
+  writeFooter();
+}
+
+Status ResultSpoolWriter::add(const std::string& json) {
+  rapidjson::Document doc;
+  doc.Parse(json.c_str());
+  if (doc.HasParseError() || !doc.IsObject()) {
+    return Status::failure("Cannot spool a result that is not a JSON object");
+  }
+
+  std::string name;
+  auto member = doc.FindMember("name");
+  if (member != doc.MemberEnd() && member->value.IsString()) {
+    name.assign(member->value.GetString(), member->value.GetStringLength());
+  }
+
+  if (blocks_.empty()) {
+    oldest_ = std::chrono::steady_clock::now();
+  }
+
+  auto& block = blocks_[name];
+  std::vector<std::string> path;
+  flattenRow(doc,
+             path,
+             [&block](const std::vector<std::string>& cell_path,
+                      char kind,
+                      const char* value,
+                      size_t size) {
+               auto it = block.index.find(cell_path);
+               if (it == block.index.end()) {
+                 Column column;
+                 column.path = cell_path;
+                 column.cells.assign(block.rows, kAbsentCell);
+                 column.rows = block.rows;
+                 it = block.index.emplace(cell_path, block.columns.size())
+                          .first;
+                 block.columns.push_back(std::move(column));
+               }
+
+               // A repeated member keeps its first value.
+               auto& column = block.columns[it->second];
+               if (column.rows == block.rows) {
+                 column.cells.push_back(kind);
+                 putVarint(column.cells, size);
+                 column.cells.append(value, size);
+                 column.rows++;
+               }
+             });
+  block.rows++;
+  for (auto& column : block.columns) {
+    if (column.rows < block.rows) {
+      column.cells.push_back(kAbsentCell);
+      column.rows++;
+    }
+  }
+
+  if (block.rows < block_rows_) {
+    return Status::success();
+  }
+
+  auto status = writeBlock(name, block);
+  if (!status.ok()) {
+    return status;
+  }
+  blocks_.erase(name);
+  if (max_size_ != 0 && size_ >= max_size_) {
+    status = rotate();
+  }
+  return status;
+}
+
+Status ResultSpoolWriter::writeBlocks() {
+  for (auto block = blocks_.begin(); block != blocks_.end();) {
+    auto status = writeBlock(block->first, block->second);
+    if (!status.ok()) {
+      return status;
+    }
+    block = blocks_.erase(block);
+  }
+  return Status::success();
+}
+
+Status ResultSpoolWriter::flush() {
+  auto status = writeBlocks();
+  if (status.ok() && max_size_ != 0 && size_ >= max_size_) {
+    status = rotate();
+  }
+  return status;
+}
+
+Status ResultSpoolWriter::flush(std::chrono::seconds max_age) {
+  if (blocks_.empty() ||
+      std::chrono::steady_clock::now() - oldest_ < max_age) {
+    return Status::success();
+  }
+  return flush();
+}
+
+Status ResultSpoolWriter::rotate() {
+  // Rows that cannot be written stay buffered for the next spool.
+  auto status = writeBlocks();
+  auto footer_status = writeFooter();
+  auto archive_status = archive();
+  if (!status.ok()) {
+    return status;
+  } else if (!footer_status.ok()) {
+    return footer_status;
+  }
+  return archive_status;
+}
+
+Status ResultSpoolWriter::archive() {
+  output_.close();
+
+  boost::system::error_code ec;
+  if (!fs::exists(path_, ec) || fs::file_size(path_, ec) == 0) {
+    return Status::success();
+  }
+
+  auto rotated = path_ + "." + std::to_string(getUnixTime());
+  auto base = rotated;
+  for (size_t i = 1; fs::exists(rotated, ec); ++i) {
+    rotated = base + "." + std::to_string(i);
+  }
+  fs::rename(path_, rotated, ec);
+  if (ec) {
+    return Status::failure("Cannot rotate spool " + path_ + ": " +
+                           ec.message());
+  }
+  return Status::success();
+}
+
+Status ResultSpoolWriter::open() {
+  // A spool of a previous writer is complete, move it aside.
+  auto status = archive();
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Create the spool with its permissions before it holds any results.
+  status = writeTextFile(path_, "", mode_, PF_CREATE_ALWAYS | PF_WRITE);
+  if (!status.ok()) {
+    return status;
+  }
+
+  output_.open(path_, std::ios::out | std::ios::app | std::ios::binary);
+  if (!output_.is_open()) {
+    return Status::failure("Cannot open spool " + path_);
+  }
+  size_ = 0;
+  index_.clear();
+  status = write(kSpoolMagic);
+  if (!status.ok()) {
+    // The next block starts the spool again.
+    output_.close();
+  }
+  return status;
+}
+
+Status ResultSpoolWriter::write(const std::string& out) {
+  output_.write(out.data(), out.size());
+  output_.flush();
+  if (output_.good()) {
+    size_ += out.size();
+    return Status::success();
+  }
+
+  // Drop a partial write, so the spool ends with a complete block.
+  output_.close();
+  boost::system::error_code ec;
+  fs::resize_file(path_, size_, ec);
+  output_.clear();
+  output_.open(path_, std::ios::out | std::ios::app | std::ios::binary);
+  return Status::failure("Cannot write to spool " + path_);
+}
+
+Status ResultSpoolWriter::writeBlock(const std::string& name, Block& block) {
+  if (block.rows == 0) {
+    return Status::success();
+  }
+
+  if (!output_.is_open()) {
+    auto status = open();
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  std::string out;
+  out.push_back(kBlockMarker);
+  putString(out, name);
+  putVarint(out, block.rows);
+  putVarint(out, block.columns.size());
+  std::string compressed;
+  for (const auto& column : block.columns) {
+    putVarint(out, column.path.size());
+    for (const auto& part : column.path) {
+      putString(out, part);
+    }
+
+    compressed.resize(ZSTD_compressBound(column.cells.size()));
+    auto size = ZSTD_compress(&compressed[0],
+                              compressed.size(),
+                              column.cells.data(),
+                              column.cells.size(),
+                              kSpoolCompressionLevel);
+    if (ZSTD_isError(size)) {
+      return Status::failure("Cannot compress spool column: " +
+                             std::string(ZSTD_getErrorName(size)));
+    }
+    putVarint(out, column.cells.size());
+    putVarint(out, size);
+    out.append(compressed.data(), size);
+  }
+
+  ResultSpoolBlock entry;
+  entry.name = name;
+  entry.offset = size_;
+  entry.rows = block.rows;
+  auto status = write(out);
+  if (status.ok()) {
+    index_.push_back(std::move(entry));
+  }
+  return status;
+}
+
+Status ResultSpoolWriter::writeFooter() {
+  if (!output_.is_open()) {
+    return Status::success();
+  }
+
+  std::string out;
+  out.push_back(kFooterMarker);
+  putVarint(out, index_.size());
+  for (const auto& block : index_) {
+    putString(out, block.name);
+    putVarint(out, block.offset);
+    putVarint(out, block.rows);
+  }
+  uint64_t offset = size_;
+  for (size_t i = 0; i < 8; ++i) {
+    out.push_back(static_cast<char>((offset >> (8 * i)) & 0xff));
+  }
+  out.append(kSpoolFooterMagic);
+  return write(out);
+}
+
+Status readResultSpoolIndex(const std::string& path,
+                            std::vector<ResultSpoolBlock>& blocks) {
+  std::string data;
+  auto status = readSpoolFile(path, data);
+  if (!status.ok()) {
+    return status;
+  }
+  return readIndex(data, blocks);
+}
+
+Status readResultSpool(const std::string& path,
+                       const std::string& name,
+                       const std::function<void(const std::string&)>& line) {
+  std::string data;
+  auto status = readSpoolFile(path, data);
+  if (!status.ok()) {
+    return status;
+  }
+
+  // An unfinished spool is converted up to its first malformed block.
+  std::vector<ResultSpoolBlock> blocks;
+  auto index_status = readIndex(data, blocks);
+  for (const auto& block : blocks) {
+    if (!name.empty() && block.name != name) {
+      continue;
+    }
+
+    SpoolInput input(data, block.offset);
+    char marker = 0;
+    if (!input.getByte(marker) || marker != kBlockMarker) {
+      return Status::failure("Malformed spool block");
+    }
+
+    std::string block_name;
+    uint64_t rows = 0;
+    std::vector<SpoolColumn> columns;
+    status = readBlock(input, block_name, rows, &columns);
+    if (!status.ok()) {
+      return status;
+    }
+    status = writeBlockLines(columns, rows, line);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return index_status;
+}
+
+} // namespace osquery
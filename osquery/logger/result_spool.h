@@ -0,0 +1,178 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <osquery/utils/status/status.h>
+
+namespace osquery {
+
+/// A spool block as listed in the footer.
+struct ResultSpoolBlock {
+  std::string name;
+
+  /// Offset of the block in the spool.
+  size_t offset{0};
+
+  size_t rows{0};
+};
+
+/**
+ * @brief A columnar spool of JSON result lines.
+ *
+ * Result lines are grouped into blocks of rows by their "name" member, the
+ * query name. Each member of a row, nested objects flattened into paths of
+ * member names, becomes a column of the block, and each column's cells are
+ * compressed with zstd. Repeated values of a query's columns compress far
+ * better than JSON lines, and a reader can skip blocks of unwanted queries.
+ *
+ * The file layout, integers are LEB128 varints unless noted:
+ *
+ *   file   := "OSQSPL01" block* [footer]
+ *   block  := 'B' name rows columns column*
+ *   column := parts (string){parts} size compressed_size zstd(cell{rows})
+ *   cell   := 0 | 1 string | 2 string
+ *   footer := 'F' blocks (name offset rows){blocks} offset(uint64le) "OSQSPEND"
+ *
+ * A string is its length followed by its bytes. Cells are absent (0), JSON
+ * strings (1), or other JSON values in their serialized form (2). The footer
+ * indexes the block offsets, it is written when a spool is rotated or
+ * closed; a spool without one is read by scanning its blocks.
+ *
+ * Rows keep their order within a query, not across queries.
+ */
+class ResultSpoolWriter : private boost::noncopyable {
+ public:
+  /**
+   * @brief Spool into a file, rotating it when it reaches max_size bytes.
+   *
+   * Rows are buffered per query until block_rows are spooled at once. A
+   * max_size of 0 never rotates. A spool left by a previous writer is
+   * rotated before writing. Spool files are created with the permissions of
+   * mode.
+   */
+  ResultSpoolWriter(std::string path,
+                    size_t block_rows,
+                    size_t max_size,
+                    int mode = 0640);
+
+  /// Write buffered rows and the footer.
+  ~ResultSpoolWriter();
+
+  /**
+   * @brief Buffer a JSON result line, writing its query's block when full.
+   *
+   * A block that cannot be written stays buffered and is written again by
+   * the next add or flush of the query.
+   */
+  Status add(const std::string& json);
+
+  /// Write the blocks of every buffered row, keeping those that fail.
+  Status flush();
+
+  /// Write the buffered rows if the oldest was added max_age ago.
+  Status flush(std::chrono::seconds max_age);
+
+  /**
+   * @brief Finish the spool and move it aside for shipping.
+   *
+   * Buffered rows and the footer are written and the file is renamed to
+   * "<path>.<unix time>". The next row starts a new spool.
+   */
+  Status rotate();
+
+  /// Bytes written to the current spool file.
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  /// A column of buffered rows.
+  struct Column {
+    /// Member names from the row down to the value.
+    std::vector<std::string> path;
+
+    /// Serialized cells, one per row.
+    std::string cells;
+
+    size_t rows{0};
+  };
+
+  /// The buffered rows of a query.
+  struct Block {
+    std::vector<Column> columns;
+
+    /// Column positions by path.
+    std::map<std::vector<std::string>, size_t> index;
+
+    size_t rows{0};
+  };
+
+ private:
+  /// Start a new spool file.
+  Status open();
+
+  /// Close the spool file and rename it aside, if it is not empty.
+  Status archive();
+
+  /// Write every buffered block, each is dropped once written.
+  Status writeBlocks();
+
+  Status writeBlock(const std::string& name, Block& block);
+  Status writeFooter();
+
+  /// Append to the spool file, truncating a partial write.
+  Status write(const std::string& out);
+
+ private:
+  std::string path_;
+  size_t block_rows_{0};
+  size_t max_size_{0};
+  int mode_{0};
+
+  std::ofstream output_;
+  size_t size_{0};
+
+  /// Buffered rows by query name.
+  std::map<std::string, Block> blocks_;
+
+  /// The blocks written to the current spool.
+  std::vector<ResultSpoolBlock> index_;
+
+  std::chrono::steady_clock::time_point oldest_;
+};
+
+/**
+ * @brief List the blocks of a spool.
+ *
+ * Uses the footer if the spool has one, otherwise scans the blocks.
+ */
+Status readResultSpoolIndex(const std::string& path,
+                            std::vector<ResultSpoolBlock>& blocks);
+
+/**
+ * @brief Convert a spool back to JSON result lines.
+ *
+ * Calls line with each row, in block order, limited to the blocks of a
+ * query name unless name is empty.
+ */
+Status readResultSpool(const std::string& path,
+                       const std::string& name,
+                       const std::function<void(const std::string&)>& line);
+
+} // namespace osquery
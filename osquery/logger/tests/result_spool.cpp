@@ -0,0 +1,228 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <gtest/gtest.h>
+
+#include <osquery/logger/result_spool.h>
+#include <osquery/utils/json/json.h>
+
+namespace fs = boost::filesystem;
+
+namespace osquery {
+
+class ResultSpoolTests : public testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = fs::temp_directory_path() /
+           fs::unique_path("osquery.tests.result_spool.%%%%.%%%%");
+    fs::create_directories(dir_);
+    path_ = (dir_ / "results.spool").string();
+  }
+
+  void TearDown() override {
+    boost::system::error_code ec;
+    fs::remove_all(dir_, ec);
+  }
+
+  std::vector<std::string> readLines(const std::string& path,
+                                     const std::string& name = "") {
+    std::vector<std::string> lines;
+    auto status = readResultSpool(
+        path, name, [&lines](const std::string& line) {
+          lines.push_back(line);
+        });
+    EXPECT_TRUE(status.ok()) << status.getMessage();
+    return lines;
+  }
+
+  std::vector<std::string> rotatedSpools() {
+    std::vector<std::string> spools;
+    for (const auto& entry : fs::directory_iterator(dir_)) {
+      if (entry.path().filename().string().find("results.spool.") == 0) {
+        spools.push_back(entry.path().string());
+      }
+    }
+    return spools;
+  }
+
+ protected:
+  fs::path dir_;
+  std::string path_;
+};
+
+/// Compare JSON lines regardless of member order.
+static void expectSameJSON(const std::string& expected,
+                           const std::string& actual) {
+  rapidjson::Document left;
+  rapidjson::Document right;
+  left.Parse(expected.c_str());
+  right.Parse(actual.c_str());
+  ASSERT_FALSE(left.HasParseError());
+  ASSERT_FALSE(right.HasParseError()) << actual;
+  EXPECT_TRUE(left == right) << expected << " != " << actual;
+}
+
+TEST_F(ResultSpoolTests, test_round_trip) {
+  std::vector<std::string> users = {
+      "{\"name\":\"users\",\"hostIdentifier\":\"host\",\"unixTime\":1,"
+      "\"columns\":{\"uid\":\"0\",\"username\":\"root\"},\"action\":\"added\"}",
+      "{\"name\":\"users\",\"hostIdentifier\":\"host\",\"unixTime\":1,"
+      "\"columns\":{\"uid\":\"1000\"},\"action\":\"removed\"}",
+      "{\"name\":\"users\",\"hostIdentifier\":\"host\",\"unixTime\":2,"
+      "\"columns\":{\"uid\":\"1001\",\"username\":\"\"},\"action\":\"added\","
+      "\"decorations\":{\"tags\":[\"a\",\"b\"]},\"counter\":null}",
+  };
+  std::vector<std::string> processes = {
+      "{\"name\":\"processes\",\"columns\":{\"pid\":\"1\"},\"epoch\":0}",
+      "{\"name\":\"processes\",\"columns\":{\"pid\":\"2\"},\"epoch\":0}",
+  };
+
+  {
+    ResultSpoolWriter writer(path_, 2, 0);
+    ASSERT_TRUE(writer.add(users[0]).ok());
+    ASSERT_TRUE(writer.add(processes[0]).ok());
+    ASSERT_TRUE(writer.add(users[1]).ok());
+    ASSERT_TRUE(writer.add(processes[1]).ok());
+    ASSERT_TRUE(writer.add(users[2]).ok());
+    EXPECT_FALSE(writer.add("not json").ok());
+    EXPECT_FALSE(writer.add("[1, 2]").ok());
+  }
+
+  // Two full blocks were written as they filled, the rest on close.
+  std::vector<ResultSpoolBlock> blocks;
+  ASSERT_TRUE(readResultSpoolIndex(path_, blocks).ok());
+  ASSERT_EQ(3U, blocks.size());
+  EXPECT_EQ("users", blocks[0].name);
+  EXPECT_EQ(2U, blocks[0].rows);
+  EXPECT_EQ("processes", blocks[1].name);
+  EXPECT_EQ(2U, blocks[1].rows);
+  EXPECT_EQ("users", blocks[2].name);
+  EXPECT_EQ(1U, blocks[2].rows);
+
+  auto lines = readLines(path_);
+  ASSERT_EQ(5U, lines.size());
+  expectSameJSON(users[0], lines[0]);
+  expectSameJSON(users[1], lines[1]);
+  expectSameJSON(processes[0], lines[2]);
+  expectSameJSON(processes[1], lines[3]);
+  expectSameJSON(users[2], lines[4]);
+
+  lines = readLines(path_, "processes");
+  ASSERT_EQ(2U, lines.size());
+  expectSameJSON(processes[0], lines[0]);
+  expectSameJSON(processes[1], lines[1]);
+  EXPECT_TRUE(readLines(path_, "missing").empty());
+}
+
+TEST_F(ResultSpoolTests, test_flush_without_footer) {
+  std::string line = "{\"name\":\"q\",\"columns\":{\"a\":\"1\"}}";
+  auto partial = (dir_ / "partial").string();
+
+  // Copy the spool while it is open, before the footer is written.
+  size_t size = 0;
+  {
+    ResultSpoolWriter writer(path_, 100, 0);
+    ASSERT_TRUE(writer.add(line).ok());
+    ASSERT_TRUE(writer.flush(std::chrono::seconds(3600)).ok());
+    EXPECT_EQ(0U, writer.size());
+    ASSERT_TRUE(writer.flush(std::chrono::seconds(0)).ok());
+    EXPECT_LT(0U, writer.size());
+    ASSERT_TRUE(writer.add(line).ok());
+    ASSERT_TRUE(writer.flush().ok());
+    size = writer.size();
+    fs::copy_file(path_, partial);
+  }
+
+  std::vector<ResultSpoolBlock> blocks;
+  ASSERT_TRUE(readResultSpoolIndex(partial, blocks).ok());
+  EXPECT_EQ(2U, blocks.size());
+
+  auto lines = readLines(partial);
+  ASSERT_EQ(2U, lines.size());
+  expectSameJSON(line, lines[1]);
+
+  // A truncated block is reported after the complete blocks are read.
+  fs::resize_file(partial, size - 1);
+  lines.clear();
+  auto status = readResultSpool(partial, "", [&lines](const std::string& l) {
+    lines.push_back(l);
+  });
+  EXPECT_FALSE(status.ok());
+  EXPECT_EQ(1U, lines.size());
+}
+
+TEST_F(ResultSpoolTests, test_rotation) {
+  std::string line =
+      "{\"name\":\"q\",\"columns\":{\"path\":\"/bin/sh\"},"
+      "\"action\":\"added\"}";
+  {
+    ResultSpoolWriter writer(path_, 1, 1);
+    ASSERT_TRUE(writer.add(line).ok());
+    ASSERT_TRUE(writer.add(line).ok());
+    EXPECT_FALSE(fs::exists(path_));
+  }
+
+  auto spools = rotatedSpools();
+  ASSERT_EQ(2U, spools.size());
+  for (const auto& spool : spools) {
+    auto lines = readLines(spool);
+    ASSERT_EQ(1U, lines.size());
+    expectSameJSON(line, lines[0]);
+  }
+
+  // A spool left behind is rotated before a new writer starts one.
+  {
+    ResultSpoolWriter writer(path_, 1, 0);
+    ASSERT_TRUE(writer.add(line).ok());
+  }
+  {
+    ResultSpoolWriter writer(path_, 1, 0);
+    ASSERT_TRUE(writer.add(line).ok());
+  }
+  EXPECT_EQ(3U, rotatedSpools().size());
+  EXPECT_EQ(1U, readLines(path_).size());
+}
+
+TEST_F(ResultSpoolTests, test_failed_write_keeps_rows) {
+  std::string line = "{\"name\":\"q\",\"columns\":{\"a\":\"1\"}}";
+  auto missing = dir_ / "missing";
+  auto path = (missing / "results.spool").string();
+
+  ResultSpoolWriter writer(path, 1, 0);
+  EXPECT_FALSE(writer.add(line).ok());
+  EXPECT_FALSE(writer.flush().ok());
+
+  // The rows that could not be written are kept until the spool can be.
+  fs::create_directories(missing);
+  ASSERT_TRUE(writer.add(line).ok());
+  EXPECT_EQ(2U, readLines(path).size());
+}
+
+#ifndef WIN32
+TEST_F(ResultSpoolTests, test_mode) {
+  std::string line = "{\"name\":\"q\",\"columns\":{\"a\":\"1\"}}";
+  {
+    ResultSpoolWriter writer(path_, 1, 1, 0600);
+    ASSERT_TRUE(writer.add(line).ok());
+  }
+
+  // Rotated spools keep the permissions they were created with.
+  auto spools = rotatedSpools();
+  ASSERT_EQ(1U, spools.size());
+  EXPECT_EQ(fs::owner_read | fs::owner_write,
+            fs::status(spools[0]).permissions());
+}
+#endif
+
+} // namespace osquery
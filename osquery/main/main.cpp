@@ -51,6 +51,7 @@ CLI_FLAG(bool, install, false, "Install osqueryd as a service");
 CLI_FLAG(bool, uninstall, false, "Uninstall osqueryd as a service");
 
 DECLARE_bool(disable_caching);
+DECLARE_uint64(schedule_benchmark);
 
 const std::string kWatcherWorkerName{"osqueryd: worker"};
 
@@ -97,6 +98,19 @@ int profile(int argc, char* argv[]) {
 int startDaemon(Initializer& runner) {
   runner.start();
 
+  if (FLAGS_schedule_benchmark > 0) {
+    // Run the schedule without waiting between steps and report what it used.
+    std::string report;
+    auto s = runScheduleBenchmark(FLAGS_schedule_benchmark, report);
+    if (s.ok()) {
+      std::cout << report << std::endl;
+    } else {
+      LOG(ERROR) << "Schedule benchmark failed: " << s.toString();
+    }
+    runner.requestShutdown(s.ok() ? EXIT_SUCCESS : EXIT_FAILURE);
+    return 0;
+  }
+
   // Conditionally begin the distributed query service
   auto s = startDistributed();
   if (!s.ok()) {
@@ -0,0 +1,76 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <boost/format.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <osquery/flags.h>
+#include <osquery/numeric_monitoring.h>
+
+namespace osquery {
+
+DECLARE_bool(enable_numeric_monitoring);
+DECLARE_uint64(numeric_monitoring_pre_aggregation_time);
+
+/// Buffer points for longer than any benchmark runs, nothing is dispatched.
+static void enableMonitoring() {
+  static const bool enabled = []() {
+    FLAGS_enable_numeric_monitoring = true;
+    FLAGS_numeric_monitoring_pre_aggregation_time = 3600;
+    return true;
+  }();
+  benchmark::DoNotOptimize(enabled);
+}
+
+/**
+ * Record by a formatted path, as per-table and per-event counters did.
+ * Every point takes the buffer lock, run with more threads to see the
+ * contention.
+ */
+static void NUMERIC_MONITORING_record_path(benchmark::State& state) {
+  enableMonitoring();
+  while (state.KeepRunning()) {
+    monitoring::record(
+        (boost::format("benchmark.table.%s.rows") % "processes").str(),
+        1,
+        monitoring::PreAggregationType::Sum);
+  }
+}
+
+BENCHMARK(NUMERIC_MONITORING_record_path)->ThreadRange(1, 16)->UseRealTime();
+
+/// Record through a registered handle into per-thread accumulators.
+static void NUMERIC_MONITORING_record_metric(benchmark::State& state) {
+  enableMonitoring();
+  static const auto metric = monitoring::registerMetric(
+      "benchmark.table.processes.rows", monitoring::PreAggregationType::Sum);
+  while (state.KeepRunning()) {
+    metric.record(1);
+  }
+}
+
+BENCHMARK(NUMERIC_MONITORING_record_metric)->ThreadRange(1, 16)->UseRealTime();
+
+/// Record Max points through a handle, which compare and swap.
+static void NUMERIC_MONITORING_record_metric_max(benchmark::State& state) {
+  enableMonitoring();
+  static const auto metric = monitoring::registerMetric(
+      "benchmark.table.processes.max_rows",
+      monitoring::PreAggregationType::Max);
+  monitoring::ValueType value = 0;
+  while (state.KeepRunning()) {
+    metric.record(value++);
+  }
+}
+
+BENCHMARK(NUMERIC_MONITORING_record_metric_max)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+} // namespace osquery
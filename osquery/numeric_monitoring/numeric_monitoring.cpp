@@ -6,6 +6,7 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <limits>
 #include <unordered_map>
 
 #include <boost/io/detail/quoted_manip.hpp>
@@ -60,7 +61,8 @@ const auto& getAggregationTypeToStringTable() {
           {PreAggregationType::P10, "p10"},
           {PreAggregationType::P50, "p50"},
           {PreAggregationType::P95, "p95"},
-          {PreAggregationType::P99, "p99"}};
+          {PreAggregationType::P99, "p99"},
+          {PreAggregationType::Histogram, "histogram"}};
   return table;
 }
 
@@ -117,45 +119,50 @@ class PreAggregationBuffer final {
               const PreAggregationType& pre_aggregation,
               const bool sync,
               const TimePoint& time_point) {
+    auto point = Point(path, value, pre_aggregation, time_point);
     if (0 == FLAGS_numeric_monitoring_pre_aggregation_time || sync) {
-      dispatchOne(path, value, pre_aggregation, sync, time_point);
+      dispatchOne(point, sync);
     } else {
       std::lock_guard<std::mutex> lock(mutex_);
-      cache_.addPoint(Point(path, value, pre_aggregation, time_point));
+      cache_.addPoint(std::move(point));
     }
   }
 
   void flush() {
+    mergeShards();
     auto points = takeCachedPoints();
     for (const auto& pt : points) {
-      dispatchOne(
-          pt.path_, pt.value_, pt.pre_aggregation_type_, false, pt.time_point_);
+      dispatchOne(pt, false);
     }
   }
 
  private:
+  void mergeShards() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PreAggregationShards::get().takePoints(cache_, Clock::now());
+  }
+
   std::vector<Point> takeCachedPoints() {
     std::lock_guard<std::mutex> lock(mutex_);
     auto points = cache_.takePoints();
     return points;
   }
 
-  void dispatchOne(const std::string& path,
-                   const ValueType& value,
-                   const PreAggregationType& pre_aggregation,
-                   const bool sync,
-                   const TimePoint& time_point) {
+  void dispatchOne(const Point& point, const bool sync) {
+    auto request = PluginRequest{
+        {recordKeys().path, point.path_},
+        {recordKeys().value, std::to_string(point.value_)},
+        {recordKeys().pre_aggregation,
+         to<std::string>(point.pre_aggregation_type_)},
+        {recordKeys().timestamp,
+         std::to_string(point.time_point_.time_since_epoch().count())},
+        {recordKeys().sync, sync ? "true" : "false"},
+    };
+    if (point.pre_aggregation_type_ == PreAggregationType::Histogram) {
+      request[recordKeys().histogram] = point.histogram_.toString();
+    }
     auto status = Registry::call(
-        registryName(),
-        FLAGS_numeric_monitoring_plugins,
-        {
-            {recordKeys().path, path},
-            {recordKeys().value, std::to_string(value)},
-            {recordKeys().pre_aggregation, to<std::string>(pre_aggregation)},
-            {recordKeys().timestamp,
-             std::to_string(time_point.time_since_epoch().count())},
-            {recordKeys().sync, sync ? "true" : "false"},
-        });
+        registryName(), FLAGS_numeric_monitoring_plugins, request);
     if (!status.ok()) {
       LOG(ERROR) << "Data loss. Numeric monitoring point dispatch failed: "
                  << status.what();
@@ -205,5 +212,28 @@ void record(const std::string& path,
       path, value, pre_aggregation, sync, std::move(time_point));
 }
 
+void Metric::record(ValueType value) const {
+  if (!FLAGS_enable_numeric_monitoring ||
+      id_ == std::numeric_limits<std::size_t>::max()) {
+    return;
+  }
+
+  if (0 != FLAGS_numeric_monitoring_pre_aggregation_time &&
+      PreAggregationShards::accumulates(id_, pre_aggregation_)) {
+    // Schedules the flusher of the accumulated points.
+    PreAggregationBuffer::get();
+    PreAggregationShards::get().add(id_, pre_aggregation_, value);
+  } else {
+    monitoring::record(
+        PreAggregationShards::get().path(id_), value, pre_aggregation_);
+  }
+}
+
+Metric registerMetric(const std::string& path,
+                      PreAggregationType pre_aggregation) {
+  return Metric(PreAggregationShards::get().intern(path, pre_aggregation),
+                pre_aggregation);
+}
+
 } // namespace monitoring
 } // namespace osquery
@@ -31,6 +31,7 @@ RecordKeys createRecordKeys() {
   keys.timestamp = "timestamp";
   keys.pre_aggregation = "pre_aggregation";
   keys.sync = "sync";
+  keys.histogram = "histogram";
   return keys;
 };
 
@@ -6,6 +6,9 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <cmath>
+#include <limits>
+
 #include <boost/io/detail/quoted_manip.hpp>
 
 #include <osquery/logger.h>
@@ -15,6 +18,104 @@ namespace osquery {
 
 namespace monitoring {
 
+std::size_t Histogram::bucketOf(ValueType value) noexcept {
+  if (value <= 0) {
+    return 0;
+  }
+
+  const auto sub_buckets = std::size_t{1} << kSubBucketBits;
+  auto unsigned_value = static_cast<std::uint64_t>(value);
+  if (unsigned_value < sub_buckets) {
+    return static_cast<std::size_t>(unsigned_value);
+  }
+
+  // The power of two of the value and its top bits below the leading one.
+  std::size_t exponent = 0;
+  for (auto rest = unsigned_value >> 1; rest != 0; rest >>= 1) {
+    ++exponent;
+  }
+  auto mantissa = (unsigned_value >> (exponent - kSubBucketBits)) &
+                  (sub_buckets - 1);
+  return (exponent - kSubBucketBits + 1) * sub_buckets +
+         static_cast<std::size_t>(mantissa);
+}
+
+ValueType Histogram::bucketLowerBound(std::size_t bucket) noexcept {
+  const auto sub_buckets = std::size_t{1} << kSubBucketBits;
+  if (bucket < sub_buckets) {
+    return static_cast<ValueType>(bucket);
+  }
+
+  auto exponent = bucket / sub_buckets + kSubBucketBits - 1;
+  auto mantissa = static_cast<std::uint64_t>(bucket % sub_buckets);
+  return static_cast<ValueType>((sub_buckets + mantissa)
+                                << (exponent - kSubBucketBits));
+}
+
+void Histogram::add(ValueType value, std::uint64_t count) {
+  if (count == 0) {
+    return;
+  }
+
+  value = std::max(value, ValueType{0});
+  min_ = (count_ == 0) ? value : std::min(min_, value);
+  max_ = (count_ == 0) ? value : std::max(max_, value);
+  sum_ += value * static_cast<ValueType>(count);
+  count_ += count;
+  buckets_[bucketOf(value)] += count;
+}
+
+void Histogram::merge(const Histogram& other) {
+  if (other.count_ == 0) {
+    return;
+  }
+
+  min_ = (count_ == 0) ? other.min_ : std::min(min_, other.min_);
+  max_ = (count_ == 0) ? other.max_ : std::max(max_, other.max_);
+  sum_ += other.sum_;
+  count_ += other.count_;
+  for (const auto& bucket : other.buckets_) {
+    buckets_[bucket.first] += bucket.second;
+  }
+}
+
+ValueType Histogram::quantile(double q) const {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  q = std::min(std::max(q, 0.0), 1.0);
+  auto rank = std::max<std::uint64_t>(
+      static_cast<std::uint64_t>(std::ceil(q * count_)), 1);
+  if (rank >= count_) {
+    return max_;
+  }
+
+  std::uint64_t seen = 0;
+  for (const auto& bucket : buckets_) {
+    seen += bucket.second;
+    if (seen >= rank) {
+      return std::min(std::max(bucketLowerBound(bucket.first), min_), max_);
+    }
+  }
+  return max_;
+}
+
+std::string Histogram::toString() const {
+  auto result = std::to_string(sum_) + ";" + std::to_string(min_) + ";" +
+                std::to_string(max_) + ";";
+  auto first = true;
+  for (const auto& bucket : buckets_) {
+    if (!first) {
+      result += ",";
+    }
+    first = false;
+    result += std::to_string(bucketLowerBound(bucket.first)) + ":" +
+              std::to_string(bucket.second);
+  }
+  return result;
+}
+
 Point::Point(std::string path,
              ValueType value,
              PreAggregationType pre_aggregation_type,
@@ -22,7 +123,12 @@ Point::Point(std::string path,
     : path_(std::move(path)),
       value_(std::move(value)),
       pre_aggregation_type_(std::move(pre_aggregation_type)),
-      time_point_(std::move(time_point)) {}
+      time_point_(std::move(time_point)) {
+  if (pre_aggregation_type_ == PreAggregationType::Histogram) {
+    histogram_.add(value_);
+    value_ = 1;
+  }
+}
 
 bool Point::tryToAggregate(const Point& new_point) {
   if (path_ != new_point.path_) {
@@ -61,6 +167,10 @@ bool Point::tryToAggregate(const Point& new_point) {
   case PreAggregationType::Max:
     value_ = std::max(value_, new_point.value_);
     break;
+  case PreAggregationType::Histogram:
+    histogram_.merge(new_point.histogram_);
+    value_ = static_cast<ValueType>(histogram_.count());
+    break;
   case PreAggregationType::InvalidTypeUpperLimit:
     // nothing to do, the type is invalid
     LOG(ERROR) << "Invalid Pre-aggregation type "
@@ -91,5 +201,191 @@ std::vector<Point> PreAggregationCache::takePoints() {
   return taken_points;
 }
 
+namespace {
+
+/// Accumulators are allocated in blocks of ids.
+constexpr std::size_t kAccumulatorBlockSize = 256;
+
+/// The value of an accumulator without points.
+ValueType getEmptyValue(PreAggregationType type) {
+  switch (type) {
+  case PreAggregationType::Min:
+    return std::numeric_limits<ValueType>::max();
+  case PreAggregationType::Max:
+    return std::numeric_limits<ValueType>::min();
+  default:
+    return 0;
+  }
+}
+
+struct Accumulator {
+  std::atomic<ValueType> value{0};
+
+  /// Set after a point is added, cleared by the flusher.
+  std::atomic<bool> recorded{false};
+};
+
+using AccumulatorBlock = std::array<Accumulator, kAccumulatorBlockSize>;
+
+} // namespace
+
+struct PreAggregationShards::Shard {
+  Shard() {
+    for (auto& block : blocks) {
+      block = nullptr;
+    }
+  }
+
+  /// Blocks are created under the shards mutex, before their ids are used.
+  std::array<std::atomic<AccumulatorBlock*>,
+             kMaxAccumulated / kAccumulatorBlockSize>
+      blocks;
+
+  /// True while a live thread records into the shard.
+  bool owned{false};
+};
+
+/// Returns the shard of a thread when the thread exits.
+struct PreAggregationShards::ShardOwner {
+  ~ShardOwner() {
+    if (shard != nullptr) {
+      PreAggregationShards::get().releaseShard(shard);
+    }
+  }
+
+  Shard* shard{nullptr};
+};
+
+PreAggregationShards& PreAggregationShards::get() {
+  // Never destroyed, threads may exit after static destructors ran.
+  static auto* instance = new PreAggregationShards();
+  return *instance;
+}
+
+bool PreAggregationShards::accumulates(std::size_t id,
+                                       PreAggregationType type) noexcept {
+  return id < kMaxAccumulated &&
+         (type == PreAggregationType::Sum || type == PreAggregationType::Min ||
+          type == PreAggregationType::Max);
+}
+
+std::size_t PreAggregationShards::intern(const std::string& path,
+                                         PreAggregationType type) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto key = std::make_pair(path, type);
+  auto it = ids_.find(key);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+
+  auto id = paths_.size();
+  paths_.push_back(key);
+  ids_.emplace(std::move(key), id);
+  if (accumulates(id, type)) {
+    for (auto* shard : shards_) {
+      initAccumulator(*shard, id);
+    }
+  }
+  return id;
+}
+
+std::string PreAggregationShards::path(std::size_t id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return (id < paths_.size()) ? paths_[id].first : "";
+}
+
+void PreAggregationShards::initAccumulator(Shard& shard, std::size_t id) {
+  auto& block = shard.blocks[id / kAccumulatorBlockSize];
+  if (block.load(std::memory_order_relaxed) == nullptr) {
+    block.store(new AccumulatorBlock(), std::memory_order_release);
+  }
+  auto& accumulator =
+      (*block.load(std::memory_order_relaxed))[id % kAccumulatorBlockSize];
+  accumulator.value = getEmptyValue(paths_[id].second);
+}
+
+PreAggregationShards::Shard* PreAggregationShards::acquireShard() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto* shard : shards_) {
+    if (!shard->owned) {
+      shard->owned = true;
+      return shard;
+    }
+  }
+
+  auto* shard = new Shard();
+  shard->owned = true;
+  for (std::size_t id = 0; id < paths_.size(); ++id) {
+    if (accumulates(id, paths_[id].second)) {
+      initAccumulator(*shard, id);
+    }
+  }
+  shards_.push_back(shard);
+  return shard;
+}
+
+void PreAggregationShards::releaseShard(Shard* shard) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  shard->owned = false;
+}
+
+void PreAggregationShards::add(std::size_t id,
+                               PreAggregationType type,
+                               ValueType value) {
+  static thread_local ShardOwner owner;
+  if (owner.shard == nullptr) {
+    owner.shard = acquireShard();
+  }
+
+  auto* block = owner.shard->blocks[id / kAccumulatorBlockSize].load(
+      std::memory_order_acquire);
+  if (block == nullptr) {
+    // The id was not interned.
+    return;
+  }
+
+  auto& accumulator = (*block)[id % kAccumulatorBlockSize];
+  if (type == PreAggregationType::Sum) {
+    accumulator.value.fetch_add(value, std::memory_order_relaxed);
+  } else {
+    auto previous = accumulator.value.load(std::memory_order_relaxed);
+    while ((type == PreAggregationType::Min) ? value < previous
+                                             : value > previous) {
+      if (accumulator.value.compare_exchange_weak(
+              previous, value, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+  }
+  accumulator.recorded.store(true, std::memory_order_relaxed);
+}
+
+void PreAggregationShards::takePoints(PreAggregationCache& cache,
+                                      const TimePoint& time_point) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto* shard : shards_) {
+    for (std::size_t id = 0; id < paths_.size(); ++id) {
+      const auto& type = paths_[id].second;
+      if (!accumulates(id, type)) {
+        continue;
+      }
+
+      auto& accumulator = (*shard->blocks[id / kAccumulatorBlockSize].load(
+          std::memory_order_acquire))[id % kAccumulatorBlockSize];
+      if (!accumulator.recorded.exchange(false, std::memory_order_relaxed)) {
+        continue;
+      }
+
+      // A point racing with the flush may leave an empty accumulator marked.
+      auto empty = getEmptyValue(type);
+      auto value = accumulator.value.exchange(empty, std::memory_order_relaxed);
+      if (type != PreAggregationType::Sum && value == empty) {
+        continue;
+      }
+      cache.addPoint(Point(paths_[id].first, value, type, time_point));
+    }
+  }
+}
+
 } // namespace monitoring
 } // namespace osquery
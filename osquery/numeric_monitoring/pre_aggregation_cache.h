@@ -8,7 +8,15 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <osquery/numeric_monitoring.h>
 
@@ -16,6 +24,63 @@ namespace osquery {
 
 namespace monitoring {
 
+/**
+ * A log-bucketed histogram, as in HdrHistogram.
+ *
+ * Values below 2^kSubBucketBits have a bucket each. Larger values share
+ * 2^kSubBucketBits buckets per power of two, so a bucket's lower bound is
+ * within 1/16 of the values in it. Histograms with the same buckets merge
+ * without losing precision, quantiles of many points, threads or hosts can be
+ * estimated from the merged buckets. Negative values are counted as 0.
+ */
+class Histogram {
+ public:
+  static constexpr std::size_t kSubBucketBits = 4;
+
+  /// Add a value count times.
+  void add(ValueType value, std::uint64_t count = 1);
+
+  /// Add the values of another histogram.
+  void merge(const Histogram& other);
+
+  /// The number of values added.
+  std::uint64_t count() const noexcept {
+    return count_;
+  }
+
+  /**
+   * Estimate the q quantile, q in [0, 1].
+   *
+   * Returns the lower bound of the bucket holding the quantile, within the
+   * minimum and maximum values, and the maximum for q = 1. Returns 0 for an
+   * empty histogram.
+   */
+  ValueType quantile(double q) const;
+
+  /**
+   * Compact string form, "<sum>;<min>;<max>;<bucket>:<count>,...".
+   *
+   * Buckets are named by their lower bound and listed in increasing order,
+   * empty buckets are left out.
+   */
+  std::string toString() const;
+
+  /// The bucket of a value.
+  static std::size_t bucketOf(ValueType value) noexcept;
+
+  /// The smallest value of a bucket.
+  static ValueType bucketLowerBound(std::size_t bucket) noexcept;
+
+ private:
+  /// Value counts by bucket.
+  std::map<std::size_t, std::uint64_t> buckets_;
+
+  std::uint64_t count_{0};
+  ValueType sum_{0};
+  ValueType min_{0};
+  ValueType max_{0};
+};
+
 /**
  * Monitoring system smallest unit
  * Consists of watched value itself, watching time, unique name for this set of
@@ -53,6 +118,9 @@ class Point {
   ValueType value_;
   PreAggregationType pre_aggregation_type_;
   TimePoint time_point_;
+
+  /// The values of a Histogram point, whose value_ is their count.
+  Histogram histogram_;
 };
 
 class PreAggregationCache {
@@ -72,5 +140,69 @@ class PreAggregationCache {
   std::vector<Point> points_;
 };
 
+/**
+ * Per-thread accumulators of interned monitoring paths.
+ *
+ * Each path and pre-aggregation type is interned once into an id. Every
+ * recording thread owns a shard with one accumulator per id and updates it
+ * with relaxed atomics, so threads recording the same path share neither a
+ * lock nor a cache line. takePoints() drains every shard into a
+ * PreAggregationCache, which merges the points of the threads.
+ *
+ * Only Sum, Min and Max paths are accumulated, the other types keep each
+ * point. Shards of exited threads are kept, with their accumulated values,
+ * and handed to the next new thread.
+ */
+class PreAggregationShards final {
+ public:
+  /// The number of interned paths that are given accumulators.
+  static constexpr std::size_t kMaxAccumulated = 16384;
+
+  static PreAggregationShards& get();
+
+  /// Intern a path, the same path and type always get the same id.
+  std::size_t intern(const std::string& path, PreAggregationType type);
+
+  /// The path of an interned id.
+  std::string path(std::size_t id) const;
+
+  /// True if the points of an interned id are accumulated.
+  static bool accumulates(std::size_t id, PreAggregationType type) noexcept;
+
+  /**
+   * Add a point to the calling thread's accumulator of an id.
+   *
+   * The id must be accumulated, see accumulates(). This neither locks nor
+   * allocates, apart from taking a shard on the thread's first point.
+   */
+  void add(std::size_t id, PreAggregationType type, ValueType value);
+
+  /// Move the points accumulated by every thread into the cache.
+  void takePoints(PreAggregationCache& cache, const TimePoint& time_point);
+
+ private:
+  PreAggregationShards() = default;
+
+  struct Shard;
+  struct ShardOwner;
+
+  Shard* acquireShard();
+  void releaseShard(Shard* shard);
+
+  /// Create the accumulators of an id in a shard.
+  void initAccumulator(Shard& shard, std::size_t id);
+
+ private:
+  mutable std::mutex mutex_;
+
+  /// Interned paths and types by id.
+  std::vector<std::pair<std::string, PreAggregationType>> paths_;
+
+  std::map<std::pair<std::string, PreAggregationType>, std::size_t> ids_;
+
+  /// Every shard ever taken, shards are never freed.
+  std::vector<Shard*> shards_;
+};
+
 } // namespace monitoring
 } // namespace osquery
@@ -6,6 +6,9 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <thread>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include <boost/filesystem.hpp>
@@ -55,6 +58,8 @@ TEST_F(NumericMonitoringTests, PreAggregationTypeToStringAndBack) {
   testAggrTypeToStringAndBack(monitoring::PreAggregationType::Sum, "sum");
   testAggrTypeToStringAndBack(monitoring::PreAggregationType::Min, "min");
   testAggrTypeToStringAndBack(monitoring::PreAggregationType::Max, "max");
+  testAggrTypeToStringAndBack(monitoring::PreAggregationType::Histogram,
+                              "histogram");
 }
 
 TEST_F(NumericMonitoringTests, PreAggregationTypeToStringRecall) {
@@ -141,6 +146,112 @@ TEST_F(NumericMonitoringTests, record_with_buffer) {
   Dispatcher::joinServices();
 }
 
+TEST_F(NumericMonitoringTests, record_metric_with_buffer) {
+  const auto isEnabled = FLAGS_enable_numeric_monitoring;
+  const auto plugins = FLAGS_numeric_monitoring_plugins;
+  const auto pre_aggregation_time =
+      FLAGS_numeric_monitoring_pre_aggregation_time;
+
+  FLAGS_enable_numeric_monitoring = true;
+  FLAGS_numeric_monitoring_plugins = kNameForTestPlugin;
+  FLAGS_numeric_monitoring_pre_aggregation_time = 1;
+
+  auto status = RegistryFactory::get().setActive(
+      monitoring::registryName(), FLAGS_numeric_monitoring_plugins);
+  ASSERT_TRUE(status.ok());
+
+  monitoring::flush();
+  NumericMonitoringInMemoryTestPlugin::points.clear();
+
+  const auto monitoring_path = "some.registered.path.to.heaven";
+  const auto metric = monitoring::registerMetric(
+      monitoring_path, monitoring::PreAggregationType::Sum);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < 4; ++i) {
+    threads.emplace_back([&metric]() {
+      metric.record(monitoring::ValueType{83});
+      metric.record(monitoring::ValueType{88});
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Points recorded by path are merged with the registered ones.
+  monitoring::record(monitoring_path,
+                     monitoring::ValueType{93},
+                     monitoring::PreAggregationType::Sum);
+
+  // A default handle is not registered and records nothing.
+  monitoring::Metric().record(monitoring::ValueType{1});
+  monitoring::flush();
+
+  ASSERT_EQ(1, NumericMonitoringInMemoryTestPlugin::points.size());
+  EXPECT_EQ(monitoring_path,
+            NumericMonitoringInMemoryTestPlugin::points.back().at(
+                monitoring::recordKeys().path));
+  auto valueInStr = NumericMonitoringInMemoryTestPlugin::points.back().at(
+      monitoring::recordKeys().value);
+  EXPECT_EQ(4 * (83 + 88) + 93, std::stoll(valueInStr));
+
+  // Without a pre-aggregation buffer points are dispatched immediately.
+  FLAGS_numeric_monitoring_pre_aggregation_time = 0;
+  NumericMonitoringInMemoryTestPlugin::points.clear();
+  metric.record(monitoring::ValueType{146});
+  ASSERT_EQ(1, NumericMonitoringInMemoryTestPlugin::points.size());
+  valueInStr = NumericMonitoringInMemoryTestPlugin::points.back().at(
+      monitoring::recordKeys().value);
+  EXPECT_EQ(146, std::stoll(valueInStr));
+
+  FLAGS_enable_numeric_monitoring = isEnabled;
+  FLAGS_numeric_monitoring_plugins = plugins;
+  FLAGS_numeric_monitoring_pre_aggregation_time = pre_aggregation_time;
+
+  Dispatcher::stopServices();
+  Dispatcher::joinServices();
+}
+
+TEST_F(NumericMonitoringTests, record_histogram_with_buffer) {
+  const auto isEnabled = FLAGS_enable_numeric_monitoring;
+  const auto plugins = FLAGS_numeric_monitoring_plugins;
+  const auto pre_aggregation_time =
+      FLAGS_numeric_monitoring_pre_aggregation_time;
+
+  FLAGS_enable_numeric_monitoring = true;
+  FLAGS_numeric_monitoring_plugins = kNameForTestPlugin;
+  FLAGS_numeric_monitoring_pre_aggregation_time = 1;
+
+  auto status = RegistryFactory::get().setActive(
+      monitoring::registryName(), FLAGS_numeric_monitoring_plugins);
+  ASSERT_TRUE(status.ok());
+
+  monitoring::flush();
+  NumericMonitoringInMemoryTestPlugin::points.clear();
+
+  const auto monitoring_path = "some.latency.to.heaven";
+  for (const auto value : {12, 3, 12, 40}) {
+    monitoring::record(monitoring_path,
+                       monitoring::ValueType{value},
+                       monitoring::PreAggregationType::Histogram);
+  }
+  monitoring::flush();
+
+  ASSERT_EQ(1, NumericMonitoringInMemoryTestPlugin::points.size());
+  const auto& point = NumericMonitoringInMemoryTestPlugin::points.back();
+  EXPECT_EQ(monitoring_path, point.at(monitoring::recordKeys().path));
+  EXPECT_EQ("4", point.at(monitoring::recordKeys().value));
+  EXPECT_EQ("histogram", point.at(monitoring::recordKeys().pre_aggregation));
+  EXPECT_EQ("67;3;40;3:1,12:2,40:1",
+            point.at(monitoring::recordKeys().histogram));
+
+  FLAGS_enable_numeric_monitoring = isEnabled;
+  FLAGS_numeric_monitoring_plugins = plugins;
+  FLAGS_numeric_monitoring_pre_aggregation_time = pre_aggregation_time;
+
+  Dispatcher::stopServices();
+  Dispatcher::joinServices();
+}
+
 TEST_F(NumericMonitoringTests, record_without_buffer) {
   const auto isEnabled = FLAGS_enable_numeric_monitoring;
   const auto plugins = FLAGS_numeric_monitoring_plugins;
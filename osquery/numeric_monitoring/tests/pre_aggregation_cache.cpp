@@ -9,6 +9,8 @@
 #include <chrono>
 #include <limits>
 #include <set>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -207,4 +209,141 @@ GTEST_TEST(PreAggregationCache, life_cycle) {
   EXPECT_EQ(1, counters[max_path]);
 }
 
+GTEST_TEST(PreAggregationHistogram, buckets) {
+  for (monitoring::ValueType value = 0; value < 16; ++value) {
+    EXPECT_EQ(value,
+              monitoring::Histogram::bucketLowerBound(
+                  monitoring::Histogram::bucketOf(value)));
+  }
+  EXPECT_EQ(0, monitoring::Histogram::bucketOf(-5));
+  EXPECT_EQ(100,
+            monitoring::Histogram::bucketLowerBound(
+                monitoring::Histogram::bucketOf(103)));
+  EXPECT_EQ(
+      monitoring::Histogram::bucketOf(1000),
+      monitoring::Histogram::bucketOf(monitoring::Histogram::bucketLowerBound(
+          monitoring::Histogram::bucketOf(1000))));
+
+  // Every bucket's lower bound is within 1/16 of its values.
+  auto previous = std::size_t{0};
+  for (monitoring::ValueType value = 1; value < (1 << 20); value += 7) {
+    auto bucket = monitoring::Histogram::bucketOf(value);
+    auto lower = monitoring::Histogram::bucketLowerBound(bucket);
+    ASSERT_GE(bucket, previous);
+    ASSERT_LE(lower, value);
+    ASSERT_LE(value - lower, value / 16);
+    previous = bucket;
+  }
+
+  const auto max = std::numeric_limits<monitoring::ValueType>::max();
+  auto last = monitoring::Histogram::bucketOf(max);
+  EXPECT_LE(monitoring::Histogram::bucketLowerBound(last), max);
+  EXPECT_GT(monitoring::Histogram::bucketLowerBound(last), max / 2);
+}
+
+GTEST_TEST(PreAggregationHistogram, quantiles) {
+  auto histogram = monitoring::Histogram{};
+  EXPECT_EQ(0, histogram.quantile(0.5));
+  for (monitoring::ValueType value = 1; value <= 1000; ++value) {
+    histogram.add(value);
+  }
+  EXPECT_EQ(1000, histogram.count());
+  EXPECT_EQ(1, histogram.quantile(0.0));
+  EXPECT_NEAR(500, histogram.quantile(0.5), 500 / 16);
+  EXPECT_NEAR(990, histogram.quantile(0.99), 990 / 16);
+  EXPECT_EQ(1000, histogram.quantile(1.0));
+
+  // Merging histograms is the same as adding all values to one.
+  auto low = monitoring::Histogram{};
+  auto high = monitoring::Histogram{};
+  for (monitoring::ValueType value = 1; value <= 1000; ++value) {
+    (value % 2 == 0 ? low : high).add(value);
+  }
+  low.merge(high);
+  EXPECT_EQ(histogram.toString(), low.toString());
+
+  auto small = monitoring::Histogram{};
+  small.add(3, 2);
+  small.add(40);
+  small.add(-1);
+  EXPECT_EQ("46;0;40;0:1,3:2,40:1", small.toString());
+}
+
+GTEST_TEST(PreAggregationPoint, tryToUpdate_histogram) {
+  const auto now = monitoring::Clock::now();
+  const auto path = "test.path.to.nowhere";
+  auto prev_pt = monitoring::Point(
+      path, 5, monitoring::PreAggregationType::Histogram, now);
+  EXPECT_EQ(1, prev_pt.value_);
+  auto new_pt = monitoring::Point(
+      path, 7, monitoring::PreAggregationType::Histogram, now);
+  ASSERT_TRUE(prev_pt.tryToAggregate(new_pt));
+  ASSERT_TRUE(prev_pt.tryToAggregate(new_pt));
+  EXPECT_EQ(3, prev_pt.value_);
+  EXPECT_EQ("19;5;7;5:1,7:2", prev_pt.histogram_.toString());
+}
+
+GTEST_TEST(PreAggregationShards, merge_threads) {
+  auto& shards = monitoring::PreAggregationShards::get();
+  const auto sum_id = shards.intern("test.shards.sum",
+                                    monitoring::PreAggregationType::Sum);
+  const auto min_id = shards.intern("test.shards.min",
+                                    monitoring::PreAggregationType::Min);
+  const auto max_id = shards.intern("test.shards.max",
+                                    monitoring::PreAggregationType::Max);
+  const auto none_id = shards.intern("test.shards.none",
+                                     monitoring::PreAggregationType::None);
+  EXPECT_EQ(sum_id,
+            shards.intern("test.shards.sum",
+                          monitoring::PreAggregationType::Sum));
+  EXPECT_NE(sum_id,
+            shards.intern("test.shards.sum",
+                          monitoring::PreAggregationType::Max));
+  EXPECT_EQ("test.shards.min", shards.path(min_id));
+  EXPECT_TRUE(monitoring::PreAggregationShards::accumulates(
+      sum_id, monitoring::PreAggregationType::Sum));
+  EXPECT_FALSE(monitoring::PreAggregationShards::accumulates(
+      none_id, monitoring::PreAggregationType::None));
+
+  std::vector<std::thread> threads;
+  for (monitoring::ValueType i = 1; i <= 4; ++i) {
+    threads.emplace_back([&shards, sum_id, min_id, max_id, i]() {
+      for (size_t j = 0; j < 1000; ++j) {
+        shards.add(sum_id, monitoring::PreAggregationType::Sum, i);
+        shards.add(min_id, monitoring::PreAggregationType::Min, i);
+        shards.add(max_id, monitoring::PreAggregationType::Max, i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  const auto now = monitoring::Clock::now();
+  auto cache = monitoring::PreAggregationCache{};
+  shards.takePoints(cache, now);
+  auto points = cache.takePoints();
+  ASSERT_EQ(3, points.size());
+
+  auto values = std::unordered_map<std::string, monitoring::ValueType>{};
+  for (const auto& p : points) {
+    values[p.path_] = p.value_;
+    EXPECT_EQ(now, p.time_point_);
+  }
+  EXPECT_EQ(10000, values["test.shards.sum"]);
+  EXPECT_EQ(1, values["test.shards.min"]);
+  EXPECT_EQ(4, values["test.shards.max"]);
+
+  // Taken points are not taken again, shards of exited threads are reused.
+  shards.takePoints(cache, now);
+  EXPECT_EQ(0, cache.size());
+  std::thread([&shards, sum_id]() {
+    shards.add(sum_id, monitoring::PreAggregationType::Sum, 5);
+  }).join();
+  shards.takePoints(cache, now);
+  points = cache.takePoints();
+  ASSERT_EQ(1, points.size());
+  EXPECT_EQ(5, points.front().value_);
+}
+
 } // namespace osquery
@@ -53,6 +53,13 @@ CodeProfiler::~CodeProfiler() {
             code_profiler_data_->getWallTime());
 
     record(names_, ".time.wall.millis", query_duration.count());
+
+    // Merged into a distribution of the wall time, for quantiles.
+    for (const auto& name : names_) {
+      monitoring::record(name + ".time.wall.millis",
+                         query_duration.count(),
+                         monitoring::PreAggregationType::Histogram);
+    }
   }
 }
 } // namespace osquery
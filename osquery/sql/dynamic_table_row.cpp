@@ -87,7 +87,7 @@ int DynamicTableRow::get_rowid(sqlite_int64 default_value,
 
 int DynamicTableRow::get_column(sqlite3_context* ctx,
                                 sqlite3_vtab* vtab,
-                                int col) {
+                                int col) const {
   VirtualTable* pVtab = (VirtualTable*)vtab;
   auto& column_name = std::get<0>(pVtab->content->columns[col]);
   auto& type = std::get<1>(pVtab->content->columns[col]);
@@ -100,12 +100,17 @@ int DynamicTableRow::get_column(sqlite3_context* ctx,
   }
 
   // Attempt to cast each xFilter-populated row/column to the SQLite type.
-  const auto& value = row[column_name];
-  if (this->row.count(column_name) == 0) {
+  // Rows may be shared between cursors so the lookup must not insert.
+  auto it = row.find(column_name);
+  if (it == row.end()) {
     // Missing content.
     VLOG(1) << "Error " << column_name << " is empty";
     sqlite3_result_null(ctx);
-  } else if (type == TEXT_TYPE || type == BLOB_TYPE) {
+    return SQLITE_OK;
+  }
+
+  const auto& value = it->second;
+  if (type == TEXT_TYPE || type == BLOB_TYPE) {
     sqlite3_result_text(
         ctx, value.c_str(), static_cast<int>(value.size()), SQLITE_STATIC);
   } else if (type == INTEGER_TYPE) {
@@ -143,6 +148,14 @@ int DynamicTableRow::get_column(sqlite3_context* ctx,
   return SQLITE_OK;
 }
 
+size_t DynamicTableRow::memory_size() const {
+  size_t size = sizeof(*this);
+  for (const auto& column : row) {
+    size += sizeof(column) + column.first.capacity() + column.second.capacity();
+  }
+  return size;
+}
+
 Status DynamicTableRow::serialize(JSON& doc, rj::Value& obj) const {
   for (const auto& i : row) {
     doc.addRef(i.first, i.second, obj);
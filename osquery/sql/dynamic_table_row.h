@@ -28,7 +28,10 @@ class DynamicTableRow : public TableRow {
     return row;
   }
   virtual int get_rowid(sqlite_int64 default_value, sqlite_int64* pRowid) const;
-  virtual int get_column(sqlite3_context* ctx, sqlite3_vtab* pVtab, int col);
+  virtual int get_column(sqlite3_context* ctx,
+                         sqlite3_vtab* pVtab,
+                         int col) const;
+  virtual size_t memory_size() const;
   virtual Status serialize(JSON& doc, rapidjson::Value& obj) const;
   virtual TableRowHolder clone() const;
   inline std::string& operator[](const std::string& key) {
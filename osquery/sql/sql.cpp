@@ -35,6 +35,29 @@ SQL::SQL(const std::string& query, bool use_cache) {
   }
 }
 
+/// The deadline of the queries run by this thread, if one is active.
+static thread_local std::chrono::steady_clock::time_point kQueryDeadline;
+static thread_local bool kQueryDeadlineActive{false};
+
+SQLDeadline::SQLDeadline(std::chrono::milliseconds timeout)
+    : previous_(kQueryDeadline), had_previous_(kQueryDeadlineActive) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  if (!kQueryDeadlineActive || deadline < kQueryDeadline) {
+    kQueryDeadline = deadline;
+  }
+  kQueryDeadlineActive = true;
+}
+
+SQLDeadline::~SQLDeadline() {
+  kQueryDeadline = previous_;
+  kQueryDeadlineActive = had_previous_;
+}
+
+bool SQLDeadline::expired() {
+  return kQueryDeadlineActive &&
+         std::chrono::steady_clock::now() >= kQueryDeadline;
+}
+
 const QueryData& SQL::rows() const {
   return results_;
 }
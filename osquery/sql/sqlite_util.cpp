@@ -264,8 +264,18 @@ SQLiteDBInstance::SQLiteDBInstance(sqlite3*& db, Mutex& mtx)
   }
 }
 
+/// Number of virtual machine instructions between deadline checks.
+const int kDeadlineCheckInstructions{1000};
+
+/// A non-zero return interrupts the statement, see SQLDeadline.
+static int checkQueryDeadline(void* /* unused */) {
+  return SQLDeadline::expired() ? 1 : 0;
+}
+
 static inline void openOptimized(sqlite3*& db) {
   sqlite3_open(":memory:", &db);
+  sqlite3_progress_handler(
+      db, kDeadlineCheckInstructions, checkQueryDeadline, nullptr);
 
   std::string settings;
   for (const auto& setting : kMemoryDBSettings) {
@@ -0,0 +1,117 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <osquery/flags.h>
+#include <osquery/logger.h>
+#include <osquery/sql/table_snapshot_cache.h>
+
+namespace osquery {
+
+FLAG(uint64,
+     table_snapshot_max_size,
+     64 * 1024 * 1024,
+     "Max bytes of table rows shared by scheduled queries within a step");
+
+DECLARE_bool(disable_caching);
+
+TableSnapshotCache& TableSnapshotCache::get() {
+  static TableSnapshotCache instance;
+  return instance;
+}
+
+std::string TableSnapshotCache::key(const std::string& table,
+                                    const QueryContext& context) {
+  // Separate each component with a unit separator, it is unlikely to appear
+  // within column names or constraint expressions.
+  std::string key = table;
+  for (const auto& list : context.constraints) {
+    for (const auto& constraint : list.second.getAll()) {
+      key += '\x1f' + list.first + '\x1f' + std::to_string(constraint.op) +
+             '\x1f' + constraint.expr;
+    }
+  }
+  return key;
+}
+
+TableRowsRef TableSnapshotCache::find(size_t step,
+                                      const std::string& table,
+                                      const QueryContext& context) {
+  if (FLAGS_disable_caching || FLAGS_table_snapshot_max_size == 0) {
+    return nullptr;
+  }
+
+  ReadLock lock(mutex_);
+  if (step != step_) {
+    return nullptr;
+  }
+
+  auto snapshots = snapshots_.find(key(table, context));
+  if (snapshots == snapshots_.end()) {
+    return nullptr;
+  }
+
+  // Any snapshot generated with at least the requested columns is usable.
+  for (const auto& snapshot : snapshots->second) {
+    if (!context.colsUsedBitset ||
+        (*context.colsUsedBitset & snapshot.columns) ==
+            *context.colsUsedBitset) {
+      return snapshot.rows;
+    }
+  }
+  return nullptr;
+}
+
+bool TableSnapshotCache::insert(size_t step,
+                                const std::string& table,
+                                const QueryContext& context,
+                                const TableRowsRef& rows) {
+  if (FLAGS_disable_caching || FLAGS_table_snapshot_max_size == 0) {
+    return false;
+  }
+
+  size_t size = 0;
+  for (const auto& row : *rows) {
+    size += row->memory_size();
+  }
+
+  WriteLock lock(mutex_);
+  if (step != step_) {
+    // Snapshots from a previous step are no longer fresh.
+    std::map<std::string, std::vector<Snapshot>>().swap(snapshots_);
+    size_ = 0;
+    step_ = step;
+  }
+
+  if (size_ + size > FLAGS_table_snapshot_max_size) {
+    VLOG(1) << "Table " << table << " rows exceed the snapshot cache size";
+    return false;
+  }
+
+  Snapshot snapshot;
+  if (context.colsUsedBitset) {
+    snapshot.columns = *context.colsUsedBitset;
+  } else {
+    snapshot.columns.set();
+  }
+  snapshot.rows = rows;
+  snapshots_[key(table, context)].push_back(std::move(snapshot));
+  size_ += size;
+  return true;
+}
+
+void TableSnapshotCache::clear() {
+  WriteLock lock(mutex_);
+  std::map<std::string, std::vector<Snapshot>>().swap(snapshots_);
+  size_ = 0;
+}
+
+size_t TableSnapshotCache::size() const {
+  ReadLock lock(mutex_);
+  return size_;
+}
+} // namespace osquery
@@ -0,0 +1,97 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <osquery/tables.h>
+#include <osquery/utils/mutex.h>
+
+namespace osquery {
+
+/// An immutable set of generated table rows that may be shared by cursors.
+using TableRowsRef = std::shared_ptr<const TableRows>;
+
+/**
+ * @brief An in-memory cache of table rows generated within a schedule step.
+ *
+ * Several scheduled queries executing within the same scheduler step often
+ * scan the same expensive tables, such as processes or listening_ports. The
+ * first scan generates the rows and each following scan with the same
+ * constraints, and a subset of the used columns, reads the same rows.
+ *
+ * Snapshots are only used by queries that requested the warm query cache,
+ * and only for the current schedule step. The scheduler clears the cache at
+ * the end of each step. The cache is bounded by --table_snapshot_max_size.
+ */
+class TableSnapshotCache : private boost::noncopyable {
+ public:
+  /// Singleton accessor.
+  static TableSnapshotCache& get();
+
+  /**
+   * @brief Find rows generated for a table during a step.
+   *
+   * @param step The schedule step.
+   * @param table The table name.
+   * @param context The query context with pushed-down constraints.
+   * @return The shared rows or nullptr if no snapshot exists.
+   */
+  TableRowsRef find(size_t step,
+                    const std::string& table,
+                    const QueryContext& context);
+
+  /**
+   * @brief Save the rows generated for a table during a step.
+   *
+   * If the rows would exceed the memory limit they are not saved.
+   *
+   * @return true if the snapshot was saved.
+   */
+  bool insert(size_t step,
+              const std::string& table,
+              const QueryContext& context,
+              const TableRowsRef& rows);
+
+  /// Drop every snapshot, called when a schedule step ends.
+  void clear();
+
+  /// The approximate memory used by all snapshots.
+  size_t size() const;
+
+ private:
+  struct Snapshot {
+    /// The columns the generating query used.
+    UsedColumnsBitset columns;
+
+    /// The generated rows.
+    TableRowsRef rows;
+  };
+
+  /// Create a key from the table name and constraints of a query context.
+  static std::string key(const std::string& table, const QueryContext& context);
+
+ private:
+  /// The step the snapshots were generated within.
+  size_t step_{0};
+
+  /// Approximate memory used by all snapshots.
+  size_t size_{0};
+
+  /// Snapshots for each table and constraints key.
+  std::map<std::string, std::vector<Snapshot>> snapshots_;
+
+  mutable Mutex mutex_;
+};
+} // namespace osquery
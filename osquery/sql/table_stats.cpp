@@ -0,0 +1,134 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <array>
+#include <atomic>
+
+#include <osquery/flags.h>
+#include <osquery/numeric_monitoring.h>
+#include <osquery/sql/table_stats.h>
+#include <osquery/utils/system/time.h>
+
+namespace osquery {
+
+FLAG(bool,
+     table_stats,
+     true,
+     "Count the time, CPU, and rows of each virtual table scan");
+
+DECLARE_bool(enable_numeric_monitoring);
+
+/// The binary's allocation counter, if any.
+static std::atomic<TableStats::AllocationCounter> kAllocationCounter{nullptr};
+
+TableScanStats& TableScanStats::operator+=(const TableScanStats& other) {
+  scans += other.scans;
+  cache_hits += other.cache_hits;
+  wall_time += other.wall_time;
+  cpu_time += other.cpu_time;
+  rows_generated += other.rows_generated;
+  rows_consumed += other.rows_consumed;
+  allocated_bytes += other.allocated_bytes;
+  return *this;
+}
+
+TableStats& TableStats::get() {
+  static TableStats instance;
+  return instance;
+}
+
+/// The counters recorded as numeric monitoring points, in TableMetrics order.
+static const std::array<const char*, 7> kTableMetricNames = {{
+    "scans",
+    "cache_hits",
+    "wall_time",
+    "cpu_time",
+    "rows_generated",
+    "rows_consumed",
+    "allocated_bytes",
+}};
+
+void TableStats::recordMonitoring(const std::string& table,
+                                  const TableScanStats& stats) {
+  auto it = metrics_.find(table);
+  if (it == metrics_.end()) {
+    TableMetrics metrics;
+    for (size_t i = 0; i < metrics.size(); ++i) {
+      metrics[i] = monitoring::registerMetric(
+          "table." + table + "." + kTableMetricNames[i],
+          monitoring::PreAggregationType::Sum);
+    }
+    it = metrics_.emplace(table, metrics).first;
+  }
+
+  const uint64_t values[] = {
+      stats.scans,
+      stats.cache_hits,
+      stats.wall_time,
+      stats.cpu_time,
+      stats.rows_generated,
+      stats.rows_consumed,
+      stats.allocated_bytes,
+  };
+  for (size_t i = 0; i < it->second.size(); ++i) {
+    it->second[i].record(static_cast<monitoring::ValueType>(values[i]));
+  }
+}
+
+void TableStats::record(const std::string& table,
+                        const std::string& constraints,
+                        const TableScanStats& stats) {
+  WriteLock lock(mutex_);
+  stats_[std::make_pair(table, constraints)] += stats;
+  if (FLAGS_enable_numeric_monitoring) {
+    recordMonitoring(table, stats);
+  }
+}
+
+std::map<TableStats::Key, TableScanStats> TableStats::snapshot() const {
+  ReadLock lock(mutex_);
+  return stats_;
+}
+
+void TableStats::reset() {
+  WriteLock lock(mutex_);
+  stats_.clear();
+}
+
+void TableStats::setAllocationCounter(AllocationCounter counter) {
+  kAllocationCounter = counter;
+}
+
+uint64_t TableStats::allocatedBytes() {
+  auto counter = kAllocationCounter.load();
+  return (counter != nullptr) ? counter() : 0;
+}
+
+TableScanTimer::TableScanTimer(TableScanStats& stats) {
+  if (!FLAGS_table_stats) {
+    return;
+  }
+
+  stats_ = &stats;
+  allocated_ = TableStats::allocatedBytes();
+  cpu_ = getThreadCPUTime();
+  wall_ = std::chrono::steady_clock::now();
+}
+
+TableScanTimer::~TableScanTimer() {
+  if (stats_ == nullptr) {
+    return;
+  }
+
+  stats_->wall_time += std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - wall_)
+                           .count();
+  stats_->cpu_time += getThreadCPUTime() - cpu_;
+  stats_->allocated_bytes += TableStats::allocatedBytes() - allocated_;
+}
+} // namespace osquery
@@ -0,0 +1,131 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+
+#include <boost/noncopyable.hpp>
+
+#include <osquery/numeric_monitoring.h>
+#include <osquery/tables.h>
+#include <osquery/utils/mutex.h>
+
+namespace osquery {
+
+/// Counters of the work done by virtual table scans.
+struct TableScanStats {
+  /// Number of xFilter calls.
+  uint64_t scans{0};
+
+  /// Scans that read rows from the schedule step's snapshot cache.
+  uint64_t cache_hits{0};
+
+  /// Microseconds spent generating rows.
+  uint64_t wall_time{0};
+
+  /// Microseconds of the scanning thread's CPU time spent generating rows.
+  uint64_t cpu_time{0};
+
+  uint64_t rows_generated{0};
+
+  /// Rows read or skipped by SQLite, fewer than generated if it stopped early.
+  uint64_t rows_consumed{0};
+
+  /// Bytes allocated while generating rows, if an allocation counter is set.
+  uint64_t allocated_bytes{0};
+
+  TableScanStats& operator+=(const TableScanStats& other);
+};
+
+/**
+ * @brief Per-table counters of every virtual table scan.
+ *
+ * Each cursor accumulates the time, CPU, rows, and allocations of its row
+ * generation across all of its scans and adds them here once, when it is
+ * closed, so the lock is not taken for each scan of a join's inner loop.
+ * Counters are kept for each table and constraint signature, the pushed-down
+ * columns and operators without their values, so costly access patterns
+ * stand out.
+ *
+ * The counters are reported by the osquery_table_stats table and, when
+ * numeric monitoring is enabled, as "table.<name>.<counter>" points.
+ */
+class TableStats : private boost::noncopyable {
+ public:
+  using Key = std::pair<std::string, std::string>;
+
+  /// Bytes allocated by the process, see setAllocationCounter.
+  using AllocationCounter = uint64_t (*)();
+
+ public:
+  /// Singleton accessor.
+  static TableStats& get();
+
+  /// Add the counters of a cursor's scans of a table.
+  void record(const std::string& table,
+              const std::string& constraints,
+              const TableScanStats& stats);
+
+  /// A copy of the counters by table and constraint signature.
+  std::map<Key, TableScanStats> snapshot() const;
+
+  /// Forget all counters.
+  void reset();
+
+  /**
+   * @brief Count allocated bytes with a hook provided by the binary.
+   *
+   * osquery does not replace the allocator. A binary that does, such as a
+   * benchmark counting operator new, may set a counter of the bytes it has
+   * allocated, and scans will report the difference.
+   */
+  static void setAllocationCounter(AllocationCounter counter);
+
+  /// The allocation counter's value, 0 if none is set.
+  static uint64_t allocatedBytes();
+
+ private:
+  using TableMetrics = std::array<monitoring::Metric, 7>;
+
+  /// Record the counters as numeric monitoring points.
+  void recordMonitoring(const std::string& table, const TableScanStats& stats);
+
+ private:
+  std::map<Key, TableScanStats> stats_;
+
+  /// Registered monitoring paths of each table.
+  std::map<std::string, TableMetrics> metrics_;
+
+  mutable Mutex mutex_;
+};
+
+/**
+ * @brief Measure row generation into a cursor's counters.
+ *
+ * Does nothing when --table_stats is disabled.
+ */
+class TableScanTimer : private boost::noncopyable {
+ public:
+  explicit TableScanTimer(TableScanStats& stats);
+
+  ~TableScanTimer();
+
+ private:
+  TableScanStats* stats_{nullptr};
+
+  std::chrono::steady_clock::time_point wall_;
+  uint64_t cpu_{0};
+  uint64_t allocated_{0};
+};
+} // namespace osquery
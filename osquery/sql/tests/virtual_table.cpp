@@ -6,6 +6,8 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <limits>
+
 #include <gtest/gtest.h>
 
 #include <osquery/core.h>
@@ -21,6 +23,8 @@
 namespace osquery {
 
 DECLARE_bool(disable_database);
+DECLARE_uint64(table_snapshot_max_size);
+DECLARE_bool(table_stats);
 
 class VirtualTableTests : public testing::Test {
  public:
@@ -560,6 +564,91 @@ TEST_F(VirtualTableTests, test_table_results_cache) {
   EXPECT_EQ(cache->generates_, 4U);
 }
 
+class snapshotTablePlugin : public TablePlugin {
+ private:
+  TableColumns columns() const override {
+    return {
+        std::make_tuple("i", TEXT_TYPE, ColumnOptions::INDEX),
+        std::make_tuple("d", TEXT_TYPE, ColumnOptions::DEFAULT),
+    };
+  }
+
+ public:
+  TableRows generate(QueryContext& ctx) override {
+    generates_++;
+    TableRows result;
+    result.push_back(make_table_row({{"i", "1"}, {"d", "one"}}));
+    result.push_back(make_table_row({{"i", "2"}, {"d", "two"}}));
+    return result;
+  }
+
+  size_t generates_{0};
+};
+
+TEST_F(VirtualTableTests, test_table_snapshot_cache) {
+  auto tables = RegistryFactory::get().registry("table");
+  auto snapshot = std::make_shared<snapshotTablePlugin>();
+  tables->add("table_snapshot", snapshot);
+  auto dbc = SQLiteDBManager::getUnique();
+  attachTableInternal(
+      "table_snapshot", snapshot->columnDefinition(false), dbc, false);
+
+  auto backup_step = TablePlugin::kCacheStep;
+  TablePlugin::kCacheStep = 100;
+  TableSnapshotCache::get().clear();
+
+  // Without the warm cache every scan generates.
+  QueryData results;
+  queryInternal("SELECT * FROM table_snapshot;", results, dbc);
+  queryInternal("SELECT * FROM table_snapshot;", results, dbc);
+  EXPECT_EQ(snapshot->generates_, 2U);
+  EXPECT_EQ(TableSnapshotCache::get().size(), 0U);
+
+  // Scans within a step share rows, including scans using fewer columns.
+  dbc->useCache(true);
+  results.clear();
+  queryInternal("SELECT * FROM table_snapshot;", results, dbc);
+  EXPECT_EQ(results.size(), 2U);
+  EXPECT_EQ(snapshot->generates_, 3U);
+  EXPECT_GT(TableSnapshotCache::get().size(), 0U);
+
+  results.clear();
+  queryInternal("SELECT d FROM table_snapshot;", results, dbc);
+  ASSERT_EQ(results.size(), 2U);
+  EXPECT_EQ(results[1]["d"], "two");
+  EXPECT_EQ(snapshot->generates_, 3U);
+
+  // Different pushed-down constraints are a different snapshot.
+  results.clear();
+  queryInternal("SELECT * FROM table_snapshot WHERE i = '1';", results, dbc);
+  EXPECT_EQ(results.size(), 1U);
+  EXPECT_EQ(snapshot->generates_, 4U);
+
+  // Snapshots from a previous step are not used.
+  TablePlugin::kCacheStep = 101;
+  queryInternal("SELECT * FROM table_snapshot;", results, dbc);
+  EXPECT_EQ(snapshot->generates_, 5U);
+
+  // Clearing the cache, as the scheduler does after each step.
+  TableSnapshotCache::get().clear();
+  EXPECT_EQ(TableSnapshotCache::get().size(), 0U);
+  queryInternal("SELECT * FROM table_snapshot;", results, dbc);
+  EXPECT_EQ(snapshot->generates_, 6U);
+
+  // Rows exceeding the memory limit are not saved.
+  auto backup_size = FLAGS_table_snapshot_max_size;
+  FLAGS_table_snapshot_max_size = 1;
+  TableSnapshotCache::get().clear();
+  queryInternal("SELECT * FROM table_snapshot;", results, dbc);
+  queryInternal("SELECT * FROM table_snapshot;", results, dbc);
+  EXPECT_EQ(snapshot->generates_, 8U);
+  EXPECT_EQ(TableSnapshotCache::get().size(), 0U);
+
+  FLAGS_table_snapshot_max_size = backup_size;
+  TablePlugin::kCacheStep = backup_step;
+  TableSnapshotCache::get().clear();
+}
+
 class yieldTablePlugin : public TablePlugin {
  private:
   TableColumns columns() const override {
@@ -605,6 +694,155 @@ TEST_F(VirtualTableTests, test_yield_generator) {
   EXPECT_EQ(results[0]["index"], "10");
 }
 
+class yieldLimitTablePlugin : public TablePlugin {
+ private:
+  TableColumns columns() const override {
+    return {
+        std::make_tuple("index", INTEGER_TYPE, ColumnOptions::DEFAULT),
+    };
+  }
+
+ public:
+  bool usesGenerator() const override {
+    return true;
+  }
+
+  void generator(RowYield& yield, QueryContext& qc) override {
+    // Count generators that finished, either normally or by being unwound.
+    struct Finished {
+      size_t& count;
+      ~Finished() {
+        count++;
+      }
+    } finished{finished_};
+
+    for (size_t i = 0; i < 1000; i++) {
+      auto r = make_table_row();
+      r["index"] = std::to_string(i);
+      yielded_++;
+      yield(std::move(r));
+    }
+  }
+
+  size_t yielded_{0};
+  size_t finished_{0};
+};
+
+TEST_F(VirtualTableTests, test_yield_generator_early_termination) {
+  auto table = std::make_shared<yieldLimitTablePlugin>();
+  auto table_registry = RegistryFactory::get().registry("table");
+  table_registry->add("yield_limit", table);
+
+  auto dbc = SQLiteDBManager::getUnique();
+  attachTableInternal(
+      "yield_limit", table->columnDefinition(false), dbc, false);
+
+  // A LIMIT stops the generator without producing the remaining rows.
+  QueryData results;
+  queryInternal("SELECT * FROM yield_limit LIMIT 3", results, dbc);
+  EXPECT_EQ(results.size(), 3U);
+  EXPECT_LE(table->yielded_, 4U);
+  EXPECT_EQ(table->finished_, 1U);
+
+  // So does an EXISTS subquery.
+  results.clear();
+  table->yielded_ = 0;
+  queryInternal(
+      "SELECT EXISTS (SELECT 1 FROM yield_limit) AS e", results, dbc);
+  ASSERT_EQ(results.size(), 1U);
+  EXPECT_EQ(results[0]["e"], "1");
+  EXPECT_LE(table->yielded_, 2U);
+  EXPECT_EQ(table->finished_, 2U);
+
+  // Scheduled queries materialize the rows into the step's snapshot.
+  auto backup_step = TablePlugin::kCacheStep;
+  TablePlugin::kCacheStep = 100;
+  TableSnapshotCache::get().clear();
+  dbc->useCache(true);
+  results.clear();
+  table->yielded_ = 0;
+  queryInternal("SELECT * FROM yield_limit LIMIT 3", results, dbc);
+  queryInternal("SELECT * FROM yield_limit LIMIT 3", results, dbc);
+  EXPECT_EQ(results.size(), 6U);
+  EXPECT_EQ(table->yielded_, 1000U);
+  EXPECT_EQ(table->finished_, 3U);
+
+  TablePlugin::kCacheStep = backup_step;
+  TableSnapshotCache::get().clear();
+}
+
+class yieldCacheTablePlugin : public TablePlugin {
+ private:
+  TableColumns columns() const override {
+    return {
+        std::make_tuple("index", INTEGER_TYPE, ColumnOptions::DEFAULT),
+    };
+  }
+
+  TableAttributes attributes() const override {
+    return TableAttributes::CACHEABLE;
+  }
+
+ public:
+  bool usesGenerator() const override {
+    return true;
+  }
+
+  void generator(RowYield& yield, QueryContext& qc) override {
+    yields_++;
+    for (size_t i = 0; i < 3; i++) {
+      auto r = make_table_row();
+      r["index"] = std::to_string(i);
+      yield(std::move(r));
+    }
+  }
+
+  TableRows generate(QueryContext& ctx) override {
+    generates_++;
+    TableRows results;
+    RowGenerator::pull_type rows(
+        [this, &ctx](RowYield& yield) { generator(yield, ctx); });
+    for (auto& row : rows) {
+      results.push_back(std::move(row));
+    }
+    return results;
+  }
+
+  size_t yields_{0};
+  size_t generates_{0};
+};
+
+TEST_F(VirtualTableTests, test_yield_generator_cacheable) {
+  auto table = std::make_shared<yieldCacheTablePlugin>();
+  auto table_registry = RegistryFactory::get().registry("table");
+  table_registry->add("yield_cache", table);
+
+  auto dbc = SQLiteDBManager::getUnique();
+  attachTableInternal(
+      "yield_cache", table->columnDefinition(false), dbc, false);
+
+  // Ad-hoc queries stream the generator.
+  QueryData results;
+  queryInternal("SELECT * FROM yield_cache", results, dbc);
+  EXPECT_EQ(results.size(), 3U);
+  EXPECT_EQ(table->yields_, 1U);
+  EXPECT_EQ(table->generates_, 0U);
+
+  // Scheduled queries use generate, which consults the table cache.
+  auto backup_step = TablePlugin::kCacheStep;
+  TablePlugin::kCacheStep = 100;
+  TableSnapshotCache::get().clear();
+  dbc->useCache(true);
+  results.clear();
+  queryInternal("SELECT * FROM yield_cache", results, dbc);
+  EXPECT_EQ(results.size(), 3U);
+  EXPECT_EQ(table->yields_, 2U);
+  EXPECT_EQ(table->generates_, 1U);
+
+  TablePlugin::kCacheStep = backup_step;
+  TableSnapshotCache::get().clear();
+}
+
 class likeTablePlugin : public TablePlugin {
  private:
   TableColumns columns() const override {
@@ -1061,4 +1299,154 @@ TEST_F(VirtualTableTests, test_noindex_constraints) {
   ASSERT_EQ("0", results[1]["straints"]);
 }
 
+struct PushdownTablePlugin : public TablePlugin {
+  TableColumns columns() const override {
+    return {
+        std::make_tuple("i", INTEGER_TYPE, ColumnOptions::INDEX),
+        std::make_tuple("time", BIGINT_TYPE, ColumnOptions::DEFAULT),
+        std::make_tuple("value", TEXT_TYPE, ColumnOptions::DEFAULT),
+    };
+  }
+
+  TableAttributes attributes() const override {
+    return TableAttributes::EVENT_BASED;
+  }
+
+  TableRows generate(QueryContext& context) override {
+    scans++;
+    for (const auto& i : context.constraints["i"].getAll<int>(EQUALS)) {
+      members.insert(i);
+    }
+    context.constraints["time"].getRange(time_lower, time_upper);
+    value_constraints += context.constraints["value"].getAll().size();
+
+    // Rows are filtered like tables that check matches on each candidate.
+    TableRows results;
+    for (int i = 0; i < 5; i++) {
+      if (context.constraints["i"].matches(i)) {
+        auto r = make_table_row();
+        r["i"] = INTEGER(i);
+        r["time"] = BIGINT(15);
+        r["value"] = "a";
+        results.push_back(std::move(r));
+      }
+    }
+    return results;
+  }
+
+  size_t scans{0};
+  std::set<int> members;
+  long long time_lower{0};
+  long long time_upper{std::numeric_limits<long long>::max()};
+  size_t value_constraints{0};
+  FRIEND_TEST(VirtualTableTests, test_constraint_pushdown);
+};
+
+TEST_F(VirtualTableTests, test_constraint_pushdown) {
+  auto dbc = SQLiteDBManager::getUnique();
+  auto table_registry = RegistryFactory::get().registry("table");
+
+  auto tablePlugin = std::make_shared<PushdownTablePlugin>();
+  table_registry->add("pushdown", tablePlugin);
+  attachTableInternal(
+      "pushdown", tablePlugin->columnDefinition(false), dbc, false);
+
+  // Every member of an IN list reaches the table, in one scan if SQLite
+  // supports processing the list at once.
+  QueryData results;
+  queryInternal("SELECT * FROM pushdown WHERE i IN (1, 2, 3)", results, dbc);
+  dbc->clearAffectedTables();
+  EXPECT_EQ(tablePlugin->members, std::set<int>({1, 2, 3}));
+  EXPECT_LE(tablePlugin->scans, 3U);
+
+  // Rows matching any member of the list are returned.
+  ASSERT_EQ(results.size(), 3U);
+  std::set<std::string> returned;
+  for (const auto& row : results) {
+    returned.insert(row.at("i"));
+  }
+  EXPECT_EQ(returned, std::set<std::string>({"1", "2", "3"}));
+
+  // Event tables receive time ranges, other unindexed columns are filtered
+  // by SQLite.
+  tablePlugin->scans = 0;
+  queryInternal(
+      "SELECT * FROM pushdown WHERE time > 10 AND time <= 20 AND value = 'a'",
+      results,
+      dbc);
+  dbc->clearAffectedTables();
+  EXPECT_EQ(1U, tablePlugin->scans);
+  EXPECT_EQ(11, tablePlugin->time_lower);
+  EXPECT_EQ(20, tablePlugin->time_upper);
+  EXPECT_EQ(0U, tablePlugin->value_constraints);
+}
+
+/// A counter that reports 64 allocated bytes each time it is read.
+static uint64_t countTestAllocations() {
+  static uint64_t bytes{0};
+  bytes += 64;
+  return bytes;
+}
+
+TEST_F(VirtualTableTests, test_table_stats) {
+  auto tables = RegistryFactory::get().registry("table");
+  auto table = std::make_shared<snapshotTablePlugin>();
+  tables->add("table_stats", table);
+  auto dbc = SQLiteDBManager::getUnique();
+  attachTableInternal(
+      "table_stats", table->columnDefinition(false), dbc, false);
+  TableStats::get().reset();
+
+  QueryData results;
+  queryInternal("SELECT * FROM table_stats;", results, dbc);
+  queryInternal("SELECT * FROM table_stats LIMIT 1;", results, dbc);
+  queryInternal("SELECT * FROM table_stats WHERE i = '1';", results, dbc);
+  queryInternal(
+      "SELECT * FROM table_stats WHERE i IN ('1', '2', '3');", results, dbc);
+
+  // Scans are counted by the columns and operators of their constraints.
+  auto stats = TableStats::get().snapshot();
+  ASSERT_EQ(stats.count({"table_stats", ""}), 1U);
+  auto all = stats.at({"table_stats", ""});
+  EXPECT_EQ(all.scans, 2U);
+  EXPECT_EQ(all.cache_hits, 0U);
+  EXPECT_EQ(all.rows_generated, 4U);
+  // The LIMIT stopped SQLite before it read every generated row.
+  EXPECT_LT(all.rows_consumed, all.rows_generated);
+  EXPECT_EQ(all.allocated_bytes, 0U);
+
+  // The members of an IN list share the signature of an equality.
+  ASSERT_EQ(stats.count({"table_stats", "i ="}), 1U);
+  EXPECT_LE(2U, stats.at({"table_stats", "i ="}).scans);
+  EXPECT_EQ(stats.size(), 2U);
+
+  // Scans reading a schedule step's snapshot are cache hits.
+  auto backup_step = TablePlugin::kCacheStep;
+  TablePlugin::kCacheStep = 200;
+  TableSnapshotCache::get().clear();
+  TableStats::setAllocationCounter(countTestAllocations);
+  dbc->useCache(true);
+  TableStats::get().reset();
+  queryInternal("SELECT * FROM table_stats;", results, dbc);
+  queryInternal("SELECT * FROM table_stats;", results, dbc);
+
+  all = TableStats::get().snapshot().at({"table_stats", ""});
+  EXPECT_EQ(all.scans, 2U);
+  EXPECT_EQ(all.cache_hits, 1U);
+  EXPECT_EQ(all.rows_generated, 2U);
+  EXPECT_EQ(all.rows_consumed, 4U);
+  EXPECT_EQ(all.allocated_bytes, 64U);
+
+  // Nothing is counted when disabled.
+  FLAGS_table_stats = false;
+  TableStats::get().reset();
+  queryInternal("SELECT * FROM table_stats;", results, dbc);
+  EXPECT_TRUE(TableStats::get().snapshot().empty());
+
+  FLAGS_table_stats = true;
+  TableStats::setAllocationCounter(nullptr);
+  TablePlugin::kCacheStep = backup_step;
+  TableSnapshotCache::get().clear();
+}
+
 } // namespace osquery
@@ -6,7 +6,9 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <algorithm>
 #include <atomic>
+#include <set>
 #include <unordered_set>
 
 #include <osquery/core.h>
@@ -31,6 +33,7 @@ FLAG(uint64,
 SHELL_FLAG(bool, planner, false, "Enable osquery runtime planner output");
 
 DECLARE_bool(disable_events);
+DECLARE_bool(table_stats);
 
 RecursiveMutex kAttachMutex;
 
@@ -73,6 +76,29 @@ static inline std::string opString(unsigned char op) {
   return "?";
 }
 
+/**
+ * @brief The columns and operators of a context's constraints, without values.
+ *
+ * Each column and operator is listed once, the members of an IN list are
+ * not counted, so the signatures of a table stay few.
+ */
+static std::string constraintSignature(const QueryContext& context) {
+  std::string signature;
+  for (const auto& list : context.constraints) {
+    std::set<unsigned char> ops;
+    for (const auto& constraint : list.second.getAll()) {
+      if (!ops.insert(constraint.op).second) {
+        continue;
+      }
+      if (!signature.empty()) {
+        signature += ", ";
+      }
+      signature += list.first + " " + opString(constraint.op);
+    }
+  }
+  return signature;
+}
+
 namespace {
 /// A list of tables that come from extensions; it is used to determine which
 /// table can be read/write
@@ -282,6 +308,44 @@ static void plan(const std::string& output) {
   }
 }
 
+/// Generate every row, draining the generator of tables that use one.
+static TableRows generateRows(const std::shared_ptr<TablePlugin>& table,
+                              QueryContext& context) {
+  // Cacheable generators drain themselves through the table cache.
+  bool cacheable = (table->attributes() & TableAttributes::CACHEABLE) != 0;
+  if (!table->usesGenerator() || cacheable) {
+    return table->generate(context);
+  }
+
+  TableRows rows;
+  RowGenerator::pull_type generator(std::bind(&TablePlugin::generator,
+                                              table,
+                                              std::placeholders::_1,
+                                              std::ref(context)));
+  while (generator) {
+    rows.push_back(generator.get());
+    generator();
+  }
+  return rows;
+}
+
+/// Count the rows SQLite read from the cursor's current scan.
+static void endScan(BaseCursor* pCur) {
+  pCur->stats.rows_consumed += std::max(pCur->row, pCur->consumed);
+}
+
+/// Add the counters of all of a cursor's scans to its table's stats.
+static void recordScans(BaseCursor* pCur) {
+  if (pCur->stats.scans == 0) {
+    return;
+  }
+
+  auto* pVtab = (VirtualTable*)pCur->base.pVtab;
+  endScan(pCur);
+  TableStats::get().record(
+      pVtab->content->name, pCur->constraints, pCur->stats);
+}
+
 int xOpen(sqlite3_vtab* tab, sqlite3_vtab_cursor** ppCursor) {
   auto* pCur = new BaseCursor;
   auto* pVtab = (VirtualTable*)tab;
@@ -297,6 +361,7 @@ int xOpen(sqlite3_vtab* tab, sqlite3_vtab_cursor** ppCursor) {
 int xClose(sqlite3_vtab_cursor* cur) {
   BaseCursor* pCur = (BaseCursor*)cur;
   plan("Closing cursor (" + std::to_string(pCur->id) + ")");
+  recordScans(pCur);
   delete pCur;
   return SQLITE_OK;
 }
@@ -328,9 +393,13 @@ int xDestroy(sqlite3_vtab* p) {
 int xNext(sqlite3_vtab_cursor* cur) {
   BaseCursor* pCur = (BaseCursor*)cur;
   if (pCur->uses_generator) {
-    pCur->generator->operator()();
+    {
+      TableScanTimer timer(pCur->stats);
+      pCur->generator->operator()();
+    }
     if (*pCur->generator) {
       pCur->current = pCur->generator->get();
+      pCur->stats.rows_generated++;
     }
   }
   pCur->row++;
@@ -341,8 +410,9 @@ int xRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
   *pRowid = 0;
 
   const BaseCursor* pCur = (BaseCursor*)cur;
-  auto data_it = std::next(pCur->rows.begin(), pCur->row);
-  if (data_it >= pCur->rows.end()) {
+  const auto& rows = pCur->data();
+  auto data_it = std::next(rows.begin(), pCur->row);
+  if (data_it >= rows.end()) {
     return SQLITE_ERROR;
   }
 
@@ -663,13 +733,17 @@ int xColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int col) {
     // Requested column index greater than column set size.
     return SQLITE_ERROR;
   }
-  if (!pCur->uses_generator && pCur->row >= pCur->rows.size()) {
+  if (!pCur->uses_generator && pCur->row >= pCur->data().size()) {
     // Request row index greater than row set size.
     return SQLITE_ERROR;
   }
 
-  TableRowHolder& row =
-      pCur->uses_generator ? pCur->current : pCur->rows[pCur->row];
+  if (pCur->row >= pCur->consumed) {
+    pCur->consumed = pCur->row + 1;
+  }
+
+  const TableRowHolder& row =
+      pCur->uses_generator ? pCur->current : pCur->data()[pCur->row];
   return row->get_column(ctx, cur->pVtab, col);
 }
 
@@ -683,9 +757,16 @@ static inline bool sensibleComparison(ColumnType type, unsigned char op) {
   return true;
 }
 
+static inline bool rangeComparison(unsigned char op) {
+  return (op == EQUALS || op == GREATER_THAN || op == GREATER_THAN_OR_EQUALS ||
+          op == LESS_THAN || op == LESS_THAN_OR_EQUALS);
+}
+
 static int xBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
   auto* pVtab = (VirtualTable*)tab;
   const auto& columns = pVtab->content->columns;
+  bool events =
+      (pVtab->content->attributes & TableAttributes::EVENT_BASED) != 0;
 
   ConstraintSet constraints;
   // Keep track of the index used for each valid constraint.
@@ -737,6 +818,11 @@ static int xBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
         cost = 1;
       } else if (options & (ColumnOptions::INDEX | ColumnOptions::ADDITIONAL)) {
         cost = 1;
+      } else if (events && name == "time" &&
+                 rangeComparison(constraint_info.op)) {
+        // Event subscribers select a time range from the backing store.
+        // The range narrows the scan but does not identify rows.
+        cost = std::min(cost, 100.0);
       } else {
         // not indexed, let sqlite filter it
         continue;
@@ -757,6 +843,14 @@ static int xBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
       // single row. See issue 5379.
 
       pIdxInfo->aConstraintUsage[i].argvIndex = static_cast<int>(++expr_index);
+#if SQLITE_VERSION_NUMBER >= 3038000
+      // Receive every member of an IN list within a single xFilter call,
+      // rather than one call per member.
+      if (constraint_info.op == SQLITE_INDEX_CONSTRAINT_EQ &&
+          sqlite3_vtab_in(pIdxInfo, static_cast<int>(i), -1)) {
+        sqlite3_vtab_in(pIdxInfo, static_cast<int>(i), 1);
+      }
+#endif
 
       if (FLAGS_planner) {
         plan("xBestIndex Adding index constraint for table: " +
@@ -835,8 +929,12 @@ static int xFilter(sqlite3_vtab_cursor* pVtabCursor,
   }
   pVtab->instance->addAffectedTable(content);
 
+  // A cursor filtered again, such as the inner loop of a join, starts a scan.
+  // Its scans are counted together and recorded when the cursor is closed.
+  endScan(pCur);
   pCur->row = 0;
   pCur->n = 0;
+  pCur->consumed = 0;
   QueryContext context(content);
 
   // The SQLite instance communicates to the TablePlugin via the context.
@@ -887,19 +985,36 @@ static int xFilter(sqlite3_vtab_cursor* pVtabCursor,
     auto& constraints = content->constraints[idxNum];
     if (argc > 0) {
       for (size_t i = 0; i < static_cast<size_t>(argc); ++i) {
-        auto expr = (const char*)sqlite3_value_text(argv[i]);
-        if (expr == nullptr || expr[0] == 0) {
-          // SQLite did not expose the expression value.
+        auto& constraint = constraints[i];
+        auto add_constraint = [&](sqlite3_value* value) {
+          auto expr = (const char*)sqlite3_value_text(value);
+          if (expr == nullptr || expr[0] == 0) {
+            // SQLite did not expose the expression value.
+            return;
+          }
+          // Set the expression from SQLite's now-populated argv.
+          constraint.second.expr = std::string(expr);
+          plan("Adding constraint to cursor (" + std::to_string(pCur->id) +
+               "): " + constraint.first + " " +
+               opString(constraint.second.op) + " " + constraint.second.expr);
+          // Add the constraint to the column-sorted query request map.
+          context.constraints[constraint.first].add(constraint.second);
+        };
+
+#if SQLITE_VERSION_NUMBER >= 3038000
+        // An IN list processed at once adds an EQUALS for each member.
+        sqlite3_value* member = nullptr;
+        if (sqlite3_vtab_in_first(argv[i], &member) == SQLITE_OK) {
+          while (member != nullptr) {
+            add_constraint(member);
+            if (sqlite3_vtab_in_next(argv[i], &member) != SQLITE_OK) {
+              break;
+            }
+          }
           continue;
         }
-        // Set the expression from SQLite's now-populated argv.
-        auto& constraint = constraints[i];
-        constraint.second.expr = std::string(expr);
-        plan("Adding constraint to cursor (" + std::to_string(pCur->id) +
-             "): " + constraint.first + " " + opString(constraint.second.op) +
-             " " + constraint.second.expr);
-        // Add the constraint to the column-sorted query request map.
-        context.constraints[constraint.first].add(constraint.second);
+#endif
+        add_constraint(argv[i]);
       }
     } else if (constraints.size() > 0) {
       // Constraints failed.
@@ -952,15 +1067,31 @@ static int xFilter(sqlite3_vtab_cursor* pVtabCursor,
   }
 
   // Reset the virtual table contents.
+  // A cursor may be filtered again before reaching EOF, for example as the
+  // inner loop of a join. Destroying a running generator unwinds its stack.
   pCur->rows.clear();
+  pCur->snapshot = nullptr;
+  pCur->generator = nullptr;
+  pCur->current = nullptr;
+  pCur->uses_generator = false;
   options.clear();
 
+  // Every scan of a cursor uses the same index, and so the same signature.
+  if (FLAGS_table_stats && pCur->stats.scans++ == 0) {
+    pCur->constraints = constraintSignature(context);
+  }
+
   // Generate the row data set.
   plan("Scanning rows for cursor (" + std::to_string(pCur->id) + ")");
   if (Registry::get().exists("table", pVtab->content->name, true)) {
     auto plugin = Registry::get().plugin("table", pVtab->content->name);
     auto table = std::dynamic_pointer_cast<TablePlugin>(plugin);
-    if (table->usesGenerator()) {
+    // Event subscribers track per-query optimization state and are always
+    // read lazily. Other generators share a materialized snapshot when
+    // scheduled, and stream rows otherwise so SQLite may stop early.
+    bool events = (table->attributes() & TableAttributes::EVENT_BASED) != 0;
+    if (table->usesGenerator() && (events || !context.useCache())) {
+      TableScanTimer timer(pCur->stats);
       pCur->uses_generator = true;
       pCur->generator = std::make_unique<RowGenerator::pull_type>(
           std::bind(&TablePlugin::generator,
@@ -969,20 +1100,52 @@ static int xFilter(sqlite3_vtab_cursor* pVtabCursor,
                     std::move(context)));
       if (*pCur->generator) {
         pCur->current = pCur->generator->get();
+        pCur->stats.rows_generated++;
       }
       return SQLITE_OK;
     }
-    pCur->rows = table->generate(context);
+
+    if (context.useCache()) {
+      // Scheduled queries within the same step share generated rows.
+      auto& snapshots = TableSnapshotCache::get();
+      auto step = TablePlugin::kCacheStep;
+      pCur->snapshot = snapshots.find(step, pVtab->content->name, context);
+      if (pCur->snapshot == nullptr) {
+        {
+          TableScanTimer timer(pCur->stats);
+          pCur->snapshot =
+              std::make_shared<const TableRows>(generateRows(table, context));
+        }
+        pCur->stats.rows_generated += pCur->snapshot->size();
+        snapshots.insert(step, pVtab->content->name, context, pCur->snapshot);
+      } else {
+        plan("Using snapshot rows for cursor (" + std::to_string(pCur->id) +
+             ")");
+        if (FLAGS_table_stats) {
+          pCur->stats.cache_hits++;
+        }
+      }
+    } else {
+      {
+        TableScanTimer timer(pCur->stats);
+        pCur->rows = table->generate(context);
+      }
+      pCur->stats.rows_generated += pCur->rows.size();
+    }
   } else {
     PluginRequest request = {{"action", "generate"}};
     TablePlugin::setRequestFromContext(context, request);
     QueryData qd;
-    Registry::call("table", pVtab->content->name, request, qd);
-    pCur->rows = tableRowsFromQueryData(std::move(qd));
+    {
+      TableScanTimer timer(pCur->stats);
+      Registry::call("table", pVtab->content->name, request, qd);
+      pCur->rows = tableRowsFromQueryData(std::move(qd));
+    }
+    pCur->stats.rows_generated += pCur->rows.size();
   }
 
   // Set the number of rows.
-  pCur->n = pCur->rows.size();
+  pCur->n = pCur->data().size();
 
   if (FLAGS_planner) {
     plan(pVtab->content->name +
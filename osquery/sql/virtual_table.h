@@ -14,6 +14,8 @@
 
 #include <osquery/tables.h>
 #include <osquery/sql/sqlite_util.h>
+#include <osquery/sql/table_snapshot_cache.h>
+#include <osquery/sql/table_stats.h>
 
 namespace osquery {
 
@@ -43,6 +45,9 @@ struct BaseCursor : private boost::noncopyable {
   /// Table data generated from last access.
   TableRows rows;
 
+  /// Table data shared from the schedule step's snapshot cache.
+  TableRowsRef snapshot{nullptr};
+
   /// Callable generator.
   std::unique_ptr<RowGenerator::pull_type> generator{nullptr};
 
@@ -57,6 +62,20 @@ struct BaseCursor : private boost::noncopyable {
 
   /// Total number of rows.
   size_t n{0};
+
+  /// Rows whose columns were read, SQLite may read a row without xNext.
+  size_t consumed{0};
+
+  /// Counters of every scan of the cursor, added to TableStats on close.
+  TableScanStats stats;
+
+  /// The constraint signature, the same for each scan of a cursor.
+  std::string constraints;
+
+  /// The rows read by the cursor, either generated or a shared snapshot.
+  const TableRows& data() const {
+    return (snapshot != nullptr) ? *snapshot : rows;
+  }
 };
 
 /**
@@ -0,0 +1,126 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <chrono>
+#include <thread>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <osquery/flags.h>
+#include <osquery/tables.h>
+#include <osquery/tables/applications/posix/docker_api.h>
+
+#include "osquery/tables/applications/posix/tests/docker_test_server.h"
+
+namespace fs = boost::filesystem;
+
+namespace osquery {
+
+DECLARE_string(docker_socket);
+
+namespace tables {
+
+QueryData genContainerStats(QueryContext& context);
+
+/// A container stats response, trimmed to the sections the table reads.
+const std::string kBenchmarkStats{
+    "{\"read\":\"2019-01-01T00:00:02.500000000Z\","
+    "\"preread\":\"2019-01-01T00:00:01.000000000Z\","
+    "\"pids_stats\":{\"current\":3},"
+    "\"blkio_stats\":{\"io_service_bytes_recursive\":["
+    "{\"major\":8,\"minor\":0,\"op\":\"Read\",\"value\":4096},"
+    "{\"major\":8,\"minor\":0,\"op\":\"Write\",\"value\":8192}]},"
+    "\"cpu_stats\":{\"cpu_usage\":{\"total_usage\":100000,"
+    "\"percpu_usage\":[25000,25000,25000,25000],"
+    "\"usage_in_kernelmode\":10000,\"usage_in_usermode\":90000},"
+    "\"system_cpu_usage\":1000000000,\"online_cpus\":4},"
+    "\"precpu_stats\":{\"cpu_usage\":{\"total_usage\":90000,"
+    "\"percpu_usage\":[22500,22500,22500,22500],"
+    "\"usage_in_kernelmode\":9000,\"usage_in_usermode\":81000},"
+    "\"system_cpu_usage\":990000000,\"online_cpus\":4},"
+    "\"memory_stats\":{\"usage\":1048576,\"max_usage\":2097152,"
+    "\"limit\":1073741824},"
+    "\"name\":\"/benchmark\",\"id\":\"abc\","
+    "\"networks\":{\"eth0\":{\"rx_bytes\":1024,\"rx_packets\":8,"
+    "\"tx_bytes\":512,\"tx_packets\":4}}}\n"};
+
+/// Serve the fake Docker API, sleeping for each stats request.
+static std::unique_ptr<DockerTestServer> startBenchmarkServer(
+    size_t stats_delay_ms) {
+  auto path = (fs::temp_directory_path() /
+               fs::unique_path("osquery.docker.%%%%.%%%%.sock"))
+                  .string();
+  auto server = std::make_unique<DockerTestServer>(
+      path, [stats_delay_ms](const std::string& uri) {
+        if (uri.find("/stats") != std::string::npos) {
+          std::this_thread::sleep_for(
+              std::chrono::milliseconds(stats_delay_ms));
+        }
+        return kBenchmarkStats;
+      });
+  server->start();
+  FLAGS_docker_socket = path;
+  return server;
+}
+
+/// Requests on pooled keep-alive connections.
+static void DOCKER_api_keep_alive(benchmark::State& state) {
+  auto server = startBenchmarkServer(0);
+  DockerClient client(FLAGS_docker_socket, 1);
+  while (state.KeepRunning()) {
+    JSON doc;
+    client.get("/containers/abc/json", doc);
+  }
+}
+
+BENCHMARK(DOCKER_api_keep_alive);
+
+/// Requests that each connect, like a client without a pool.
+static void DOCKER_api_connect(benchmark::State& state) {
+  auto server = startBenchmarkServer(0);
+  DockerClient client(FLAGS_docker_socket, 0);
+  while (state.KeepRunning()) {
+    JSON doc;
+    client.get("/containers/abc/json", doc);
+  }
+}
+
+BENCHMARK(DOCKER_api_connect);
+
+/**
+ * Query docker_container_stats for range(0) containers while the fake daemon
+ * takes range(1) milliseconds to sample each. Compare --docker_api_concurrency
+ * values with --benchmark_filter runs.
+ */
+static void DOCKER_container_stats(benchmark::State& state) {
+  auto server = startBenchmarkServer(state.range(1));
+
+  QueryContext context;
+  for (int64_t i = 0; i < state.range(0); i++) {
+    auto id = "abc" + std::to_string(i);
+    context.constraints["id"].add(Constraint(EQUALS, id));
+  }
+
+  while (state.KeepRunning()) {
+    auto results = genContainerStats(context);
+    benchmark::DoNotOptimize(results);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(DOCKER_container_stats)
+    ->ArgPair(10, 0)
+    ->ArgPair(200, 0)
+    ->ArgPair(200, 20)
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace tables
+} // namespace osquery
@@ -6,31 +6,23 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
-#include <iostream>
-#include <regex>
+#include <ctime>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
 
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
-// TODO(5591) Remove this when addressed by Boost's ASIO config.
-// https://www.boost.org/doc/libs/1_67_0/boost/asio/detail/config.hpp
-// Standard library support for std::string_view.
-#define BOOST_ASIO_DISABLE_STD_STRING_VIEW 1
-
-#include <boost/asio.hpp>
-#include <boost/foreach.hpp>
-
-#if !defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
-#error Boost error: Local sockets not available
-#endif
-
 #include <osquery/flags.h>
 #include <osquery/logger.h>
 #include <osquery/tables.h>
+#include <osquery/tables/applications/posix/docker_api.h>
 #include <osquery/utils/conversions/join.h>
 #include <osquery/utils/info/platform_type.h>
 #include <osquery/utils/json/json.h>
@@ -42,7 +34,6 @@
 #endif
 
 namespace pt = boost::property_tree;
-namespace local = boost::asio::local;
 
 namespace osquery {
 
@@ -68,56 +59,34 @@ namespace tables {
  *         message.
  */
 Status dockerApi(const std::string& uri, pt::ptree& tree) {
-  static const std::regex httpOkRegex("HTTP/1\\.(0|1) 200 OK\\\r");
+  std::string body;
+  auto status = DockerClient::get()->get(uri, body);
+  if (!status.ok()) {
+    return status;
+  }
 
   try {
-    local::stream_protocol::endpoint ep(FLAGS_docker_socket);
-    local::stream_protocol::iostream stream(ep);
-    if (!stream) {
-      return Status(
-          1, "Error connecting to docker sock: " + stream.error().message());
-    }
-
-    // Since keep-alive connections are not used, use HTTP/1.0
-    stream << "GET " << uri
-           << " HTTP/1.0\r\nAccept: */*\r\nConnection: close\r\n\r\n"
-           << std::flush;
-    if (stream.eof()) {
-      stream.close();
-      return Status(1, "Empty docker API response for: " + uri);
-    }
-
-    // All status responses are expected to be 200
-    std::string str;
-    getline(stream, str);
-
-    std::smatch match;
-    if (!std::regex_match(str, match, httpOkRegex)) {
-      stream.close();
-      return Status(1, "Invalid docker API response for " + uri + ": " + str);
-    }
-
-    // Skip empty line between header and body
-    while (!stream.eof() && str != "\r") {
-      getline(stream, str);
-    }
-
-    try {
-      pt::read_json(stream, tree);
-    } catch (const pt::ptree_error& e) {
-      stream.close();
-      return Status(
-          1, "Error reading docker API response for " + uri + ": " + e.what());
-    }
-
-    stream.close();
-  } catch (const std::exception& e) {
-    return Status(1, std::string("Error calling docker API: ") + e.what());
+    std::stringstream stream(body);
+    pt::read_json(stream, tree);
+  } catch (const pt::ptree_error& e) {
+    return Status(
+        1, "Error reading docker API response for " + uri + ": " + e.what());
   }
-
   return Status(0);
 }
 
+/**
+ * @brief Makes API calls to the docker UNIX socket.
+ *
+ * The JSON response is parsed while it is read from the socket.
+ *
+ * @param uri Relative URI to invoke GET HTTP method.
+ * @param doc JSON document where the result is stored.
+ */
+Status dockerApi(const std::string& uri, JSON& doc) {
+  return DockerClient::get()->get(uri, doc);
+}
+
 /**
  * @brief Entry point for docker_version table.
  */
@@ -373,6 +342,72 @@ Status getContainers(QueryContext& context,
   return Status(0);
 }
 
+/**
+ * @brief Utility method to join the strings of a JSON array.
+ *
+ * @param obj JSON object to look in.
+ * @param path Path of the array, a missing or null array is empty.
+ */
+std::string joinDockerArray(const rapidjson::Value& obj,
+                            const std::string& path) {
+  std::vector<std::string> items;
+  auto array = getDockerValue(obj, path);
+  if (array != nullptr && array->IsArray()) {
+    for (const auto& item : array->GetArray()) {
+      if (item.IsString()) {
+        items.push_back(item.GetString());
+      }
+    }
+  }
+  return osquery::join(items, ", ");
+}
+
+/**
+ * @brief Utility method to add the inspect details of a container.
+ *
+ * @param r Container row with an "id", the details are added to it.
+ */
+void getContainerDetails(Row& r) {
+  JSON details;
+  auto s = dockerApi("/containers/" + r["id"] + "/json?stream=false", details);
+  if (s.ok()) {
+    const auto& doc = details.doc();
+    r["pid"] = BIGINT(getDockerInt(doc, "State.Pid", -1));
+    r["started_at"] = getDockerString(doc, "State.StartedAt");
+    r["finished_at"] = getDockerString(doc, "State.FinishedAt");
+    r["privileged"] =
+        getDockerBool(doc, "HostConfig.Privileged") ? INTEGER(1) : INTEGER(0);
+    r["readonly_rootfs"] = getDockerBool(doc, "HostConfig.ReadonlyRootfs")
+                               ? INTEGER(1)
+                               : INTEGER(0);
+    r["path"] = getDockerString(doc, "Path");
+    r["config_entrypoint"] = joinDockerArray(doc, "Config.Entrypoint");
+    r["security_options"] = joinDockerArray(doc, "HostConfig.SecurityOpt");
+    r["env_variables"] = joinDockerArray(doc, "Config.Env");
+  } else {
+    VLOG(1) << "Failed to retrieve the inspect data for container " << r["id"]
+            << ": " << s.what();
+    return;
+  }
+
+// When building on linux, the extended schema of docker_containers will
+// add some additional columns to support user namespaces
+#ifdef __linux__
+  if (r["pid"] != "-1") {
+    ProcessNamespaceList namespace_list;
+    s = procGetProcessNamespaces(r["pid"], namespace_list);
+    if (s.ok()) {
+      for (const auto& pair : namespace_list) {
+        r[pair.first + "_namespace"] = std::to_string(pair.second);
+      }
+    } else {
+      VLOG(1) << "Failed to retrieve the namespace list for container "
+              << r["id"];
+    }
+  }
+#endif
+}
+
 /**
  * @brief Entry point for docker_containers table.
  */
@@ -405,72 +440,13 @@ QueryData genContainers(QueryContext& context) {
     r["created"] = BIGINT(container.get<uint64_t>("Created", 0));
     r["state"] = container.get<std::string>("State", "");
     r["status"] = container.get<std::string>("Status", "");
-
-    pt::ptree container_details;
-    s = dockerApi("/containers/" + r["id"] + "/json?stream=false",
-                  container_details);
-    if (s.ok()) {
-      r["pid"] =
-          BIGINT(container_details.get_child("State").get<pid_t>("Pid", -1));
-      r["started_at"] = container_details.get_child("State").get<std::string>(
-          "StartedAt", "");
-      r["finished_at"] = container_details.get_child("State").get<std::string>(
-          "FinishedAt", "");
-      r["privileged"] = container_details.get_child("HostConfig")
-                                .get<bool>("Privileged", false)
-                            ? INTEGER(1)
-                            : INTEGER(0);
-      r["readonly_rootfs"] = container_details.get_child("HostConfig")
-                                     .get<bool>("ReadonlyRootfs", false)
-                                 ? INTEGER(1)
-                                 : INTEGER(0);
-      r["path"] = container_details.get<std::string>("Path", "");
-
-      std::vector<std::string> entry_pts;
-      for (const auto& ent_pt :
-           container_details.get_child("Config.Entrypoint")) {
-        entry_pts.push_back(ent_pt.second.data());
-      }
-      r["config_entrypoint"] = osquery::join(entry_pts, ", ");
-
-      std::vector<std::string> sec_opts;
-      for (const auto& sec_opt :
-           container_details.get_child("HostConfig.SecurityOpt")) {
-        sec_opts.push_back(sec_opt.second.data());
-      }
-      r["security_options"] = osquery::join(sec_opts, ", ");
-
-      std::vector<std::string> env_vars;
-      for (const auto& env_var : container_details.get_child("Config.Env")) {
-        env_vars.push_back(env_var.second.data());
-      }
-      r["env_variables"] = osquery::join(env_vars, ", ");
-
-    } else {
-      VLOG(1) << "Failed to retrieve the inspect data for container "
-              << r["id"];
-    }
-
-// When building on linux, the extended schema of docker_containers will
-// add some additional columns to support user namespaces
-#ifdef __linux__
-    if (r["pid"] != "-1") {
-      ProcessNamespaceList namespace_list;
-      s = procGetProcessNamespaces(r["pid"], namespace_list);
-      if (s.ok()) {
-        for (const auto& pair : namespace_list) {
-          r[pair.first + "_namespace"] = std::to_string(pair.second);
-        }
-      } else {
-        VLOG(1) << "Failed to retrieve the namespace list for container "
-                << r["id"];
-      }
-    }
-#endif
-
     results.push_back(r);
   }
 
+  // Each inspect call waits on the daemon, the containers are inspected
+  // concurrently.
+  dockerForEach(results.size(),
+                [&results](size_t i) { getContainerDetails(results[i]); });
   return results;
 }
 
@@ -599,92 +575,113 @@ QueryData genContainerPorts(QueryContext& context) {
 }
 
 /**
- * @brief Entry point for docker_container_processes table.
+ * @brief Utility method to get the processes of a container.
+ *
+ * @param id Container id.
+ * @param ps_args The ps fields to request.
+ * @param results Rows for the container processes.
  */
-QueryData genContainerProcesses(QueryContext& context) {
-  QueryData results;
-  std::string ps_args;
+void getContainerProcesses(const std::string& id,
+                           const std::string& ps_args,
+                           QueryData& results) {
+  JSON container;
+  auto s = dockerApi("/containers/" + id + "/top?ps_args=axwwo%20" + ps_args,
+                     container);
+  if (!s.ok()) {
+    VLOG(1) << "Error getting docker container " << id << ": " << s.what();
+    return;
+  }
 
-  for (const auto& id : context.constraints["id"].getAll(EQUALS)) {
-    if (!checkConstraintValue(id)) {
-      continue;
-    }
+  auto processes = getDockerValue(container.doc(), "Processes");
+  if (processes == nullptr || !processes->IsArray()) {
+    VLOG(1) << "Error getting docker container processes " << id;
+    return;
+  }
 
-    pt::ptree container;
-
-    if (isPlatform(PlatformType::TYPE_OSX)) {
-      // osx: 19 fields
-      // currently OS X Docker API will only return
-      // "PID","USER","TIME","COMMAND" fields
-      ps_args =
-          "pid,state,uid,gid,svuid,svgid,rss,vsz,etime,ppid,pgid,wq,nice,user,"
-          "time,pcpu,pmem,comm,command";
-    } else if (isPlatform(PlatformType::TYPE_LINUX)) {
-      // linux: 21 fields
-      ps_args =
-          "pid,state,uid,gid,euid,egid,suid,sgid,rss,vsz,etime,ppid,pgrp,nlwp,"
-          "nice,user,time,pcpu,pmem,comm,cmd";
-    } else {
+  for (const auto& process : processes->GetArray()) {
+    if (!process.IsArray() || process.Empty()) {
       continue;
     }
 
-    auto s = dockerApi("/containers/" + id + "/top?ps_args=axwwo%20" + ps_args,
-                       container);
+    std::vector<std::string> vector;
+    for (const auto& v : process.GetArray()) {
+      vector.push_back(v.IsString() ? v.GetString() : "");
+    }
 
-    if (!s.ok()) {
-      VLOG(1) << "Error getting docker container " << id << ": " << s.what();
+    Row r;
+    r["id"] = id;
+    r["pid"] = BIGINT(vector.at(0));
+    r["wired_size"] = BIGINT(0); // No support for unpagable counters
+    if (isPlatform(PlatformType::TYPE_OSX) && vector.size() == 4) {
+      r["uid"] = BIGINT(vector.at(1));
+      r["time"] = vector.at(2);
+      r["cmdline"] = vector.at(3);
+    } else if (isPlatform(PlatformType::TYPE_LINUX) && vector.size() == 21) {
+      r["state"] = vector.at(1);
+      r["uid"] = BIGINT(vector.at(2));
+      r["gid"] = BIGINT(vector.at(3));
+      r["euid"] = BIGINT(vector.at(4));
+      r["egid"] = BIGINT(vector.at(5));
+      r["suid"] = BIGINT(vector.at(6));
+      r["sgid"] = BIGINT(vector.at(7));
+      r["resident_size"] = BIGINT(vector.at(8) + "000");
+      r["total_size"] = BIGINT(vector.at(9) + "000");
+      r["start_time"] = BIGINT(vector.at(10));
+      r["parent"] = BIGINT(vector.at(11));
+      r["pgroup"] = BIGINT(vector.at(12));
+      r["threads"] = INTEGER(vector.at(13));
+      r["nice"] = INTEGER(vector.at(14));
+      r["user"] = vector.at(15);
+      r["time"] = vector.at(16);
+      r["cpu"] = DOUBLE(vector.at(17));
+      r["mem"] = DOUBLE(vector.at(18));
+      r["name"] = vector.at(19);
+      r["cmdline"] = vector.at(20);
+    } else {
       continue;
     }
 
-    try {
-      for (const auto& processes : container.get_child("Processes")) {
-        std::vector<std::string> vector;
-        for (const auto& v : processes.second) {
-          vector.push_back(v.second.data());
-        }
+    results.push_back(r);
+  }
+}
 
-        Row r;
-        r["id"] = id;
-        r["pid"] = BIGINT(vector.at(0));
-        r["wired_size"] = BIGINT(0); // No support for unpagable counters
-        if (isPlatform(PlatformType::TYPE_OSX) && vector.size() == 4) {
-          r["uid"] = BIGINT(vector.at(1));
-          r["time"] = vector.at(2);
-          r["cmdline"] = vector.at(3);
-        } else if (isPlatform(PlatformType::TYPE_LINUX) &&
-                   vector.size() == 21) {
-          r["state"] = vector.at(1);
-          r["uid"] = BIGINT(vector.at(2));
-          r["gid"] = BIGINT(vector.at(3));
-          r["euid"] = BIGINT(vector.at(4));
-          r["egid"] = BIGINT(vector.at(5));
-          r["suid"] = BIGINT(vector.at(6));
-          r["sgid"] = BIGINT(vector.at(7));
-          r["resident_size"] = BIGINT(vector.at(8) + "000");
-          r["total_size"] = BIGINT(vector.at(9) + "000");
-          r["start_time"] = BIGINT(vector.at(10));
-          r["parent"] = BIGINT(vector.at(11));
-          r["pgroup"] = BIGINT(vector.at(12));
-          r["threads"] = INTEGER(vector.at(13));
-          r["nice"] = INTEGER(vector.at(14));
-          r["user"] = vector.at(15);
-          r["time"] = vector.at(16);
-          r["cpu"] = DOUBLE(vector.at(17));
-          r["mem"] = DOUBLE(vector.at(18));
-          r["name"] = vector.at(19);
-          r["cmdline"] = vector.at(20);
-        } else {
-          continue;
-        }
+/**
+ * @brief Entry point for docker_container_processes table.
+ */
+QueryData genContainerProcesses(QueryContext& context) {
+  std::string ps_args;
+  if (isPlatform(PlatformType::TYPE_OSX)) {
+    // osx: 19 fields
+    // currently OS X Docker API will only return
+    // "PID","USER","TIME","COMMAND" fields
+    ps_args =
+        "pid,state,uid,gid,svuid,svgid,rss,vsz,etime,ppid,pgid,wq,nice,user,"
+        "time,pcpu,pmem,comm,command";
+  } else if (isPlatform(PlatformType::TYPE_LINUX)) {
+    // linux: 21 fields
+    ps_args =
+        "pid,state,uid,gid,euid,egid,suid,sgid,rss,vsz,etime,ppid,pgrp,nlwp,"
+        "nice,user,time,pcpu,pmem,comm,cmd";
+  } else {
+    return {};
+  }
 
-        results.push_back(r);
-      }
-    } catch (const pt::ptree_error& e) {
-      VLOG(1) << "Error getting docker container processes " << id << ": "
-              << e.what();
+  std::vector<std::string> ids;
+  for (const auto& id : context.constraints["id"].getAll(EQUALS)) {
+    if (checkConstraintValue(id)) {
+      ids.push_back(id);
     }
   }
 
+  std::vector<QueryData> processes(ids.size());
+  dockerForEach(ids.size(), [&ids, &ps_args, &processes](size_t i) {
+    getContainerProcesses(ids[i], ps_args, processes[i]);
+  });
+
+  QueryData results;
+  for (auto& container : processes) {
+    std::move(container.begin(), container.end(), std::back_inserter(results));
+  }
   return results;
 }
 
@@ -747,18 +744,19 @@ long diffNanos(const std::string& iso1, const std::string& iso2) {
 
 /**
  * @brief Utility method to get cumulative value for specified "op" from
- *        child node in provided "tree".
+ *        the entries of the provided array.
  *
- * @param tree Tree to iterate.
- * @param op IO operation to look for in the child nodes.
+ * @param entries Array to iterate, may be null.
+ * @param op IO operation to look for in the entries.
  * @return Cumulative value for type "op".
  */
-std::string getIOBytes(const pt::ptree& tree, const std::string& op) {
+std::string getIOBytes(const rapidjson::Value* entries, const std::string& op) {
   uint64_t value = 0;
-  for (const auto& entry : tree) {
-    const pt::ptree& node = entry.second;
-    if (node.get<std::string>("op", "") == op) {
-      value += node.get<uint64_t>("value", 0);
+  if (entries != nullptr && entries->IsArray()) {
+    for (const auto& entry : entries->GetArray()) {
+      if (getDockerString(entry, "op") == op) {
+        value += getDockerUInt(entry, "value");
+      }
     }
   }
 
@@ -767,97 +765,111 @@ std::string getIOBytes(const pt::ptree& tree, const std::string& op) {
 
 /**
  * @brief Utility method to get cumulative value for specified "key" from
- *        child node in provided "tree".
+ *        the members of the provided object.
  *
- * @param tree Tree to iterate.
- * @param key Key to look for in the child nodes.
+ * @param networks Object to iterate, may be null.
+ * @param key Key to look for in the members.
  * @return Cumulative value for "key".
  */
-std::string getNetworkBytes(const pt::ptree& tree, const std::string& key) {
+std::string getNetworkBytes(const rapidjson::Value* networks,
+                            const std::string& key) {
   uint64_t value = 0;
-  for (const auto& node : tree) {
-    value += node.second.get<uint64_t>(key, 0);
+  if (networks != nullptr && networks->IsObject()) {
+    for (const auto& network : networks->GetObject()) {
+      value += getDockerUInt(network.value, key);
+    }
   }
 
   return BIGINT(value);
 }
 
+/**
+ * @brief Utility method to get the stats of a container.
+ *
+ * @param id Container id.
+ * @param r Row for the stats, left empty on errors.
+ */
+void getContainerStats(const std::string& id, Row& r) {
+  JSON container;
+  Status s = dockerApi("/containers/" + id + "/stats?stream=false", container);
+  if (!s.ok()) {
+    VLOG(1) << "Error getting docker container " << id << ": " << s.what();
+    return;
+  }
+
+  const auto& doc = container.doc();
+  if (!doc.IsObject()) {
+    VLOG(1) << "Error getting docker container stats " << id;
+    return;
+  }
+
+  r["id"] = id;
+  r["name"] = getDockerString(doc, "name");
+  r["pids"] = INTEGER(getDockerInt(doc, "pids_stats.current"));
+  const std::string& read = getDockerString(doc, "read");
+  long read_unix_time = getUnixTime(read, false);
+  r["read"] = BIGINT(read_unix_time);
+  const std::string& preread = getDockerString(doc, "preread");
+  long preread_unix_time = getUnixTime(preread, false);
+  r["preread"] = BIGINT(preread_unix_time);
+  long intervalNanos = ((read_unix_time - preread_unix_time) * 1000000000) +
+                       diffNanos(read, preread);
+  r["interval"] = BIGINT(intervalNanos);
+  auto io = getDockerValue(doc, "blkio_stats.io_service_bytes_recursive");
+  r["disk_read"] = getIOBytes(io, "Read");
+  r["disk_write"] = getIOBytes(io, "Write");
+  r["num_procs"] = INTEGER(getDockerInt(doc, "num_procs"));
+  r["cpu_total_usage"] =
+      BIGINT(getDockerUInt(doc, "cpu_stats.cpu_usage.total_usage"));
+  r["cpu_kernelmode_usage"] =
+      BIGINT(getDockerUInt(doc, "cpu_stats.cpu_usage.usage_in_kernelmode"));
+  r["cpu_usermode_usage"] =
+      BIGINT(getDockerUInt(doc, "cpu_stats.cpu_usage.usage_in_usermode"));
+  r["system_cpu_usage"] =
+      BIGINT(getDockerUInt(doc, "cpu_stats.system_cpu_usage"));
+  r["online_cpus"] = INTEGER(getDockerUInt(doc, "cpu_stats.online_cpus"));
+  r["pre_cpu_total_usage"] =
+      BIGINT(getDockerUInt(doc, "precpu_stats.cpu_usage.total_usage"));
+  r["pre_cpu_kernelmode_usage"] =
+      BIGINT(getDockerUInt(doc, "precpu_stats.cpu_usage.usage_in_kernelmode"));
+  r["pre_cpu_usermode_usage"] =
+      BIGINT(getDockerUInt(doc, "precpu_stats.cpu_usage.usage_in_usermode"));
+  r["pre_system_cpu_usage"] =
+      BIGINT(getDockerUInt(doc, "precpu_stats.system_cpu_usage"));
+  r["pre_online_cpus"] =
+      INTEGER(getDockerUInt(doc, "precpu_stats.online_cpus"));
+  r["memory_usage"] = BIGINT(getDockerUInt(doc, "memory_stats.usage"));
+  r["memory_max_usage"] = BIGINT(getDockerUInt(doc, "memory_stats.max_usage"));
+  r["memory_limit"] = BIGINT(getDockerUInt(doc, "memory_stats.limit"));
+  auto networks = getDockerValue(doc, "networks");
+  r["network_rx_bytes"] = getNetworkBytes(networks, "rx_bytes");
+  r["network_tx_bytes"] = getNetworkBytes(networks, "tx_bytes");
+}
+
 /**
  * @brief Entry point for docker_container_stats table.
  */
 QueryData genContainerStats(QueryContext& context) {
-  QueryData results;
+  std::vector<std::string> ids;
   for (const auto& id : context.constraints["id"].getAll(EQUALS)) {
-    if (!checkConstraintValue(id)) {
-      continue;
+    if (checkConstraintValue(id)) {
+      ids.push_back(id);
     }
+  }
 
-    pt::ptree container;
-    Status s =
-        dockerApi("/containers/" + id + "/stats?stream=false", container);
-    if (!s.ok()) {
-      VLOG(1) << "Error getting docker container " << id << ": " << s.what();
-      continue;
-    }
+  // The daemon takes a second or two to sample each container, the stats
+  // are requested concurrently.
+  std::vector<Row> stats(ids.size());
+  dockerForEach(ids.size(), [&ids, &stats](size_t i) {
+    getContainerStats(ids[i], stats[i]);
+  });
 
-    try {
-      Row r;
-      r["id"] = id;
-      r["name"] = container.get<std::string>("name", "");
-      r["pids"] = container.get<int>("pids_stats.current", 0);
-      const std::string& read = container.get<std::string>("read", "");
-      long read_unix_time = getUnixTime(read, false);
-      r["read"] = BIGINT(read_unix_time);
-      const std::string& preread = container.get<std::string>("preread", "");
-      long preread_unix_time = getUnixTime(preread, false);
-      r["preread"] = BIGINT(preread_unix_time);
-      long intervalNanos = ((read_unix_time - preread_unix_time) * 1000000000) +
-                           diffNanos(read, preread);
-      r["interval"] = BIGINT(intervalNanos);
-      r["disk_read"] = getIOBytes(
-          container.get_child("blkio_stats.io_service_bytes_recursive"),
-          "Read");
-      r["disk_write"] = getIOBytes(
-          container.get_child("blkio_stats.io_service_bytes_recursive"),
-          "Write");
-      r["num_procs"] = INTEGER(container.get<int>("num_procs", 0));
-      r["cpu_total_usage"] =
-          BIGINT(container.get<uint64_t>("cpu_stats.cpu_usage.total_usage", 0));
-      r["cpu_kernelmode_usage"] = BIGINT(container.get<uint64_t>(
-          "cpu_stats.cpu_usage.usage_in_kernelmode", 0));
-      r["cpu_usermode_usage"] = BIGINT(
-          container.get<uint64_t>("cpu_stats.cpu_usage.usage_in_usermode", 0));
-      r["system_cpu_usage"] =
-          BIGINT(container.get<uint64_t>("cpu_stats.system_cpu_usage", 0));
-      r["online_cpus"] =
-          INTEGER(container.get<uint64_t>("cpu_stats.online_cpus", 0));
-      r["pre_cpu_total_usage"] = BIGINT(
-          container.get<uint64_t>("precpu_stats.cpu_usage.total_usage", 0));
-      r["pre_cpu_kernelmode_usage"] = BIGINT(container.get<uint64_t>(
-          "precpu_stats.cpu_usage.usage_in_kernelmode", 0));
-      r["pre_cpu_usermode_usage"] = BIGINT(container.get<uint64_t>(
-          "precpu_stats.cpu_usage.usage_in_usermode", 0));
-      r["pre_system_cpu_usage"] =
-          BIGINT(container.get<uint64_t>("precpu_stats.system_cpu_usage", 0));
-      r["pre_online_cpus"] =
-          INTEGER(container.get<uint64_t>("precpu_stats.online_cpus", 0));
-      r["memory_usage"] =
-          BIGINT(container.get<uint64_t>("memory_stats.usage", 0));
-      r["memory_max_usage"] =
-          BIGINT(container.get<uint64_t>("memory_stats.max_usage", 0));
-      r["memory_limit"] =
-          BIGINT(container.get<uint64_t>("memory_stats.limit", 0));
-      r["network_rx_bytes"] =
-          getNetworkBytes(container.get_child("networks"), "rx_bytes");
-      r["network_tx_bytes"] =
-          getNetworkBytes(container.get_child("networks"), "tx_bytes");
-      results.push_back(r);
-    } catch (const pt::ptree_error& e) {
-      VLOG(1) << "Error getting docker container stats " << id << ": "
-              << e.what();
+  QueryData results;
+  for (auto& r : stats) {
+    if (!r.empty()) {
+      results.push_back(std::move(r));
     }
   }
-
   return results;
 }
 
@@ -0,0 +1,525 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <thread>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+// TODO(5591) Remove this when addressed by Boost's ASIO config.
+// https://www.boost.org/doc/libs/1_67_0/boost/asio/detail/config.hpp
+// Standard library support for std::string_view.
+#define BOOST_ASIO_DISABLE_STD_STRING_VIEW 1
+
+#include <boost/asio.hpp>
+
+#if !defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+#error Boost error: Local sockets not available
+#endif
+
+#include <osquery/flags.h>
+#include <osquery/logger.h>
+#include <osquery/tables/applications/posix/docker_api.h>
+
+namespace local = boost::asio::local;
+
+namespace osquery {
+
+DECLARE_string(docker_socket);
+
+FLAG(uint64,
+     docker_api_concurrency,
+     8,
+     "Maximum concurrent Docker API requests of a query");
+
+namespace tables {
+
+/// Size of the read buffer of each connection.
+const size_t kDockerBufferSize{16384};
+
+/// Longest accepted status or header line.
+const size_t kDockerMaxLine{8192};
+
+/// All sockets share one io_context, only synchronous operations are used.
+static boost::asio::io_context& dockerIO() {
+  static boost::asio::io_context io;
+  return io;
+}
+
+struct DockerClient::Connection {
+  Connection() : socket(dockerIO()), buffer(kDockerBufferSize) {}
+
+  /// Make sure unread bytes are buffered, false if the connection ended.
+  bool fill() {
+    if (begin < end) {
+      return true;
+    }
+
+    if (closed) {
+      return false;
+    }
+
+    boost::system::error_code ec;
+    auto size = socket.read_some(boost::asio::buffer(buffer), ec);
+    if (ec || size == 0) {
+      closed = true;
+      return false;
+    }
+
+    begin = 0;
+    end = size;
+    return true;
+  }
+
+  /// Read a line and drop the line ending.
+  bool readLine(std::string& line) {
+    line.clear();
+    while (fill()) {
+      auto c = buffer[begin++];
+      if (c == '\n') {
+        if (!line.empty() && line.back() == '\r') {
+          line.pop_back();
+        }
+        return true;
+      }
+
+      line.push_back(c);
+      if (line.size() > kDockerMaxLine) {
+        closed = true;
+        return false;
+      }
+    }
+    return false;
+  }
+
+  local::stream_protocol::socket socket;
+
+  /// Bytes read from the socket, the unread bytes are [begin, end).
+  std::vector<char> buffer;
+  size_t begin{0};
+  size_t end{0};
+
+  /// A read failed or the daemon closed the connection.
+  bool closed{false};
+};
+
+/**
+ * @brief A rapidjson input stream over an HTTP response body.
+ *
+ * The body is read from the connection while it is parsed, chunked bodies are
+ * decoded on the way. The stream ends with the body, leaving the connection
+ * ready for the next response.
+ */
+class DockerBodyStream : private boost::noncopyable {
+ public:
+  using Ch = char;
+
+  /**
+   * @brief Read a response body.
+   *
+   * @param conn the connection, positioned after the response headers.
+   * @param chunked the body uses chunked transfer encoding.
+   * @param until_close the body ends when the connection is closed.
+   * @param length the body size, if it is neither chunked nor until close.
+   */
+  DockerBodyStream(DockerClient::Connection& conn,
+                   bool chunked,
+                   bool until_close,
+                   size_t length)
+      : conn_(conn), chunked_(chunked), until_close_(until_close) {
+    if (until_close_) {
+      left_ = std::numeric_limits<size_t>::max();
+    } else if (!chunked_) {
+      left_ = length;
+    }
+  }
+
+  Ch Peek() {
+    return available() ? conn_.buffer[conn_.begin] : '\0';
+  }
+
+  Ch Take() {
+    if (!available()) {
+      return '\0';
+    }
+    consume(1);
+    return conn_.buffer[conn_.begin - 1];
+  }
+
+  size_t Tell() const {
+    return read_;
+  }
+
+  // The output functions are only used for in situ parsing.
+  Ch* PutBegin() {
+    return nullptr;
+  }
+
+  void Put(Ch) {}
+
+  void Flush() {}
+
+  size_t PutEnd(Ch*) {
+    return 0;
+  }
+
+  /// Append the rest of the body to a string.
+  void readAll(std::string& body) {
+    while (available()) {
+      auto size = std::min(left_, conn_.end - conn_.begin);
+      body.append(&conn_.buffer[conn_.begin], size);
+      consume(size);
+    }
+  }
+
+  /// Discard the rest of the body, true if the body was read completely.
+  bool finish() {
+    while (available()) {
+      consume(std::min(left_, conn_.end - conn_.begin));
+    }
+    return complete_;
+  }
+
+ private:
+  void consume(size_t size) {
+    conn_.begin += size;
+    left_ -= size;
+    read_ += size;
+  }
+
+  /// Make sure a byte of the body is buffered, false at the end of the body.
+  bool available() {
+    while (!done_) {
+      if (left_ > 0) {
+        if (conn_.fill()) {
+          return true;
+        }
+        // Only a body without a length may end with the connection.
+        done_ = true;
+        complete_ = until_close_;
+      } else if (chunked_) {
+        if (!nextChunk()) {
+          done_ = true;
+        }
+      } else {
+        done_ = true;
+        complete_ = true;
+      }
+    }
+    return false;
+  }
+
+  /// Read the next chunk size, or the trailers after the last chunk.
+  bool nextChunk() {
+    std::string line;
+    if (chunks_ > 0 && (!conn_.readLine(line) || !line.empty())) {
+      return false;
+    }
+
+    if (!conn_.readLine(line)) {
+      return false;
+    }
+
+    char* size_end = nullptr;
+    auto size = std::strtoull(line.c_str(), &size_end, 16);
+    if (size_end == line.c_str()) {
+      return false;
+    }
+
+    chunks_++;
+    if (size == 0) {
+      while (conn_.readLine(line)) {
+        if (line.empty()) {
+          done_ = true;
+          complete_ = true;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    left_ = static_cast<size_t>(size);
+    return true;
+  }
+
+ private:
+  DockerClient::Connection& conn_;
+  bool chunked_{false};
+  bool until_close_{false};
+
+  /// Bytes left in the body, or in the current chunk.
+  size_t left_{0};
+
+  /// Bytes of the body read so far.
+  size_t read_{0};
+
+  size_t chunks_{0};
+  bool done_{false};
+  bool complete_{false};
+};
+
+DockerClient::DockerClient(std::string socket, size_t max_idle)
+    : socket_(std::move(socket)), max_idle_(max_idle) {}
+
+DockerClient::~DockerClient() = default;
+
+std::shared_ptr<DockerClient> DockerClient::get() {
+  static Mutex client_mutex;
+  static std::shared_ptr<DockerClient> client;
+
+  WriteLock lock(client_mutex);
+  if (client == nullptr || client->socket() != FLAGS_docker_socket) {
+    client = std::make_shared<DockerClient>(FLAGS_docker_socket,
+                                            FLAGS_docker_api_concurrency);
+  }
+  return client;
+}
+
+Status DockerClient::get(const std::string& uri, JSON& doc) {
+  return call(uri, [&doc, &uri](DockerBodyStream& body) {
+    rapidjson::ParseResult pr = doc.doc().ParseStream(body);
+    if (!pr) {
+      return Status::failure("Error reading docker API response for " + uri +
+                             ": " + GetParseError_En(pr.Code()));
+    }
+    return Status::success();
+  });
+}
+
+Status DockerClient::get(const std::string& uri, std::string& body) {
+  return call(uri, [&body](DockerBodyStream& stream) {
+    stream.readAll(body);
+    return Status::success();
+  });
+}
+
+size_t DockerClient::idle() {
+  WriteLock lock(idle_mutex_);
+  return idle_.size();
+}
+
+Status DockerClient::acquire(std::unique_ptr<Connection>& conn, bool& reused) {
+  {
+    WriteLock lock(idle_mutex_);
+    if (!idle_.empty()) {
+      conn = std::move(idle_.back());
+      idle_.pop_back();
+      reused = true;
+      return Status::success();
+    }
+  }
+
+  reused = false;
+  conn = std::make_unique<Connection>();
+  boost::system::error_code ec;
+  conn->socket.connect(local::stream_protocol::endpoint(socket_), ec);
+  if (ec) {
+    return Status::failure("Error connecting to docker sock: " + ec.message());
+  }
+  return Status::success();
+}
+
+void DockerClient::release(std::unique_ptr<Connection> conn) {
+  WriteLock lock(idle_mutex_);
+  if (idle_.size() < max_idle_) {
+    idle_.push_back(std::move(conn));
+  }
+}
+
+Status DockerClient::call(const std::string& uri, const BodyReader& reader) {
+  const std::string request = "GET " + uri +
+                              " HTTP/1.1\r\nHost: docker\r\n"
+                              "Accept: application/json\r\n\r\n";
+
+  // The daemon may have closed an idle connection, which is only noticed
+  // when it is used. Those requests are sent again on a new connection.
+  for (size_t attempt = 0; attempt < 2; attempt++) {
+    std::unique_ptr<Connection> conn;
+    bool reused = false;
+    auto status = acquire(conn, reused);
+    if (!status.ok()) {
+      return status;
+    }
+
+    boost::system::error_code ec;
+    boost::asio::write(conn->socket, boost::asio::buffer(request), ec);
+    std::string line;
+    if (ec || !conn->readLine(line)) {
+      if (reused) {
+        continue;
+      }
+      return Status::failure("Empty docker API response for: " + uri);
+    }
+
+    // All status responses are expected to be 200.
+    if (!boost::starts_with(line, "HTTP/1.") || line.size() < 12 ||
+        line.compare(9, 3, "200") != 0) {
+      return Status::failure("Invalid docker API response for " + uri + ": " +
+                             line);
+    }
+
+    bool keep_alive = (line[7] == '1');
+    bool chunked = false;
+    bool has_length = false;
+    size_t length = 0;
+    while (true) {
+      if (!conn->readLine(line)) {
+        return Status::failure("Incomplete docker API response for: " + uri);
+      }
+      if (line.empty()) {
+        break;
+      }
+
+      auto colon = line.find(':');
+      if (colon == std::string::npos) {
+        continue;
+      }
+
+      auto name = boost::to_lower_copy(line.substr(0, colon));
+      auto value =
+          boost::to_lower_copy(boost::trim_copy(line.substr(colon + 1)));
+      if (name == "content-length") {
+        has_length = true;
+        length = static_cast<size_t>(std::strtoull(value.c_str(), nullptr, 10));
+      } else if (name == "transfer-encoding") {
+        chunked = (value.find("chunked") != std::string::npos);
+      } else if (name == "connection") {
+        if (value == "close") {
+          keep_alive = false;
+        } else if (value == "keep-alive") {
+          keep_alive = true;
+        }
+      }
+    }
+
+    bool until_close = !chunked && !has_length;
+    DockerBodyStream body(*conn, chunked, until_close, length);
+    status = reader(body);
+    if (!body.finish()) {
+      return Status::failure("Incomplete docker API response for: " + uri);
+    }
+
+    if (keep_alive && !until_close && !conn->closed &&
+        conn->begin == conn->end) {
+      release(std::move(conn));
+    }
+    return status;
+  }
+
+  return Status::failure("Error calling docker API: connection closed for " +
+                         uri);
+}
+
+void dockerForEach(size_t count, const std::function<void(size_t)>& action) {
+  auto threads = std::min<size_t>(
+      count, std::max<size_t>(1, FLAGS_docker_api_concurrency));
+
+  std::atomic<size_t> next{0};
+  auto worker = [&next, &action, count]() {
+    for (auto i = next++; i < count; i = next++) {
+      try {
+        action(i);
+      } catch (const std::exception& e) {
+        VLOG(1) << "Error calling docker API: " << e.what();
+      }
+    }
+  };
+
+  // The calling thread is one of the workers.
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < threads; i++) {
+    workers.emplace_back(worker);
+  }
+  worker();
+
+  for (auto& thread : workers) {
+    thread.join();
+  }
+}
+
+const rapidjson::Value* getDockerValue(const rapidjson::Value& obj,
+                                       const std::string& path) {
+  const rapidjson::Value* value = &obj;
+  size_t start = 0;
+  while (start <= path.size()) {
+    auto dot = path.find('.', start);
+    if (dot == std::string::npos) {
+      dot = path.size();
+    }
+
+    if (!value->IsObject()) {
+      return nullptr;
+    }
+
+    rapidjson::Value name(
+        rapidjson::StringRef(path.data() + start, dot - start));
+    auto member = value->FindMember(name);
+    if (member == value->MemberEnd()) {
+      return nullptr;
+    }
+
+    value = &member->value;
+    start = dot + 1;
+  }
+  return value;
+}
+
+std::string getDockerString(const rapidjson::Value& obj,
+                            const std::string& path,
+                            const std::string& def) {
+  auto value = getDockerValue(obj, path);
+  if (value == nullptr || !value->IsString()) {
+    return def;
+  }
+  return std::string(value->GetString(), value->GetStringLength());
+}
+
+long long getDockerInt(const rapidjson::Value& obj,
+                       const std::string& path,
+                       long long def) {
+  auto value = getDockerValue(obj, path);
+  if (value == nullptr || !value->IsNumber()) {
+    return def;
+  }
+
+  if (value->IsInt64()) {
+    return value->GetInt64();
+  } else if (value->IsUint64()) {
+    return static_cast<long long>(value->GetUint64());
+  }
+  return static_cast<long long>(value->GetDouble());
+}
+
+unsigned long long getDockerUInt(const rapidjson::Value& obj,
+                                 const std::string& path,
+                                 unsigned long long def) {
+  auto value = getDockerValue(obj, path);
+  if (value == nullptr || !value->IsNumber()) {
+    return def;
+  }
+
+  if (value->IsUint64()) {
+    return value->GetUint64();
+  } else if (value->IsInt64()) {
+    return static_cast<unsigned long long>(value->GetInt64());
+  }
+  return static_cast<unsigned long long>(value->GetDouble());
+}
+
+bool getDockerBool(const rapidjson::Value& obj, const std::string& path) {
+  auto value = getDockerValue(obj, path);
+  return value != nullptr && value->IsBool() && value->GetBool();
+}
+
+} // namespace tables
+} // namespace osquery
@@ -0,0 +1,124 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <osquery/utils/json/json.h>
+#include <osquery/utils/mutex.h>
+#include <osquery/utils/status/status.h>
+
+namespace osquery {
+namespace tables {
+
+class DockerBodyStream;
+
+/**
+ * @brief A keep-alive HTTP/1.1 client for the Docker UNIX socket API.
+ *
+ * Connections are returned to a small pool after each complete response and
+ * reused by later requests, from any thread. JSON response bodies are parsed
+ * while they are read from the socket, with or without chunked encoding.
+ */
+class DockerClient : private boost::noncopyable {
+ public:
+  /// The client for --docker_socket, replaced when the flag changes.
+  static std::shared_ptr<DockerClient> get();
+
+  /**
+   * @brief Create a client for a Docker socket.
+   *
+   * @param socket the path of the Docker UNIX domain socket.
+   * @param max_idle the number of idle connections kept open.
+   */
+  DockerClient(std::string socket, size_t max_idle);
+  ~DockerClient();
+
+  /// GET a URI and parse the JSON response body.
+  Status get(const std::string& uri, JSON& doc);
+
+  /// GET a URI and copy the response body.
+  Status get(const std::string& uri, std::string& body);
+
+  /// The Docker socket path.
+  const std::string& socket() const {
+    return socket_;
+  }
+
+  /// Number of open connections waiting for a request.
+  size_t idle();
+
+ private:
+  friend class DockerBodyStream;
+
+  struct Connection;
+
+  using BodyReader = std::function<Status(DockerBodyStream& body)>;
+
+  /// Send a GET request and read a 200 response body with the reader.
+  Status call(const std::string& uri, const BodyReader& reader);
+
+  /// Take an idle connection or connect a new one.
+  Status acquire(std::unique_ptr<Connection>& conn, bool& reused);
+
+  /// Keep a connection for the next request, if the pool has room.
+  void release(std::unique_ptr<Connection> conn);
+
+ private:
+  std::string socket_;
+  size_t max_idle_{0};
+
+  /// Protects the idle connections.
+  Mutex idle_mutex_;
+
+  std::vector<std::unique_ptr<Connection>> idle_;
+};
+
+/**
+ * @brief Call an action for each index on at most --docker_api_concurrency
+ * threads.
+ *
+ * Per-container API calls block in the daemon, the stats endpoint for about a
+ * second, so these are run concurrently. The action must be thread safe and
+ * only touch its own result slot.
+ *
+ * @param count the number of indexes, the action is called with 0 to count-1.
+ * @param action called once for each index.
+ */
+void dockerForEach(size_t count, const std::function<void(size_t)>& action);
+
+/// Access a member of a JSON object by a dot separated path, or nullptr.
+const rapidjson::Value* getDockerValue(const rapidjson::Value& obj,
+                                       const std::string& path);
+
+/// Get a string member by path, or the default if it is not a string.
+std::string getDockerString(const rapidjson::Value& obj,
+                            const std::string& path,
+                            const std::string& def = "");
+
+/// Get an integer member by path, or the default if it is not a number.
+long long getDockerInt(const rapidjson::Value& obj,
+                       const std::string& path,
+                       long long def = 0);
+
+/// Get an unsigned member by path, or the default if it is not a number.
+unsigned long long getDockerUInt(const rapidjson::Value& obj,
+                                 const std::string& path,
+                                 unsigned long long def = 0);
+
+/// Get a boolean member by path, or false.
+bool getDockerBool(const rapidjson::Value& obj, const std::string& path);
+
+} // namespace tables
+} // namespace osquery
@@ -0,0 +1,176 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <gtest/gtest.h>
+
+#include <osquery/flags.h>
+#include <osquery/tables.h>
+#include <osquery/tables/applications/posix/docker_api.h>
+
+#include "osquery/tables/applications/posix/tests/docker_test_server.h"
+
+namespace fs = boost::filesystem;
+
+namespace osquery {
+
+DECLARE_string(docker_socket);
+DECLARE_uint64(docker_api_concurrency);
+
+namespace tables {
+
+QueryData genContainerStats(QueryContext& context);
+
+const std::string kDockerTestStats{
+    "{\"read\":\"2019-01-01T00:00:02.500000000Z\","
+    "\"preread\":\"2019-01-01T00:00:01.000000000Z\","
+    "\"pids_stats\":{\"current\":3},"
+    "\"blkio_stats\":{\"io_service_bytes_recursive\":["
+    "{\"op\":\"Read\",\"value\":100},{\"op\":\"Write\",\"value\":20},"
+    "{\"op\":\"Read\",\"value\":5}]},"
+    "\"cpu_stats\":{\"cpu_usage\":{\"total_usage\":12345678901},"
+    "\"online_cpus\":2},"
+    "\"memory_stats\":{\"usage\":4096,\"limit\":8192},"
+    "\"name\":\"/test\","
+    "\"networks\":{\"eth0\":{\"rx_bytes\":10,\"tx_bytes\":1},"
+    "\"eth1\":{\"rx_bytes\":20,\"tx_bytes\":2}}}\n"};
+
+class DockerApiTests : public testing::Test {
+ protected:
+  void SetUp() override {
+    socket_ = (fs::temp_directory_path() /
+               fs::unique_path("osquery.docker.%%%%.%%%%.sock"))
+                  .string();
+    server_ = std::make_unique<DockerTestServer>(
+        socket_, [this](const std::string& uri) { return respond(uri); });
+    ASSERT_TRUE(server_->start());
+
+    socket_flag_ = FLAGS_docker_socket;
+    FLAGS_docker_socket = socket_;
+  }
+
+  void TearDown() override {
+    FLAGS_docker_socket = socket_flag_;
+    FLAGS_docker_api_concurrency = 8;
+    server_.reset();
+  }
+
+  std::string respond(const std::string& uri) {
+    if (uri == "/version") {
+      return "{\"Version\":\"18.09.0\",\"ApiVersion\":\"1.39\"}\n";
+    } else if (uri.find("/containers/") == 0 &&
+               uri.find("/stats") != std::string::npos) {
+      auto now = ++in_flight_;
+      auto seen = max_in_flight_.load();
+      while (now > seen && !max_in_flight_.compare_exchange_weak(seen, now)) {
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      in_flight_--;
+      // The daemon responds 404 for an unknown container.
+      return uri.find("/dead/") == std::string::npos ? kDockerTestStats : "";
+    }
+    return "";
+  }
+
+ protected:
+  std::string socket_;
+  std::string socket_flag_;
+  std::unique_ptr<DockerTestServer> server_;
+
+  std::atomic<size_t> in_flight_{0};
+  std::atomic<size_t> max_in_flight_{0};
+};
+
+TEST_F(DockerApiTests, test_keep_alive) {
+  DockerClient client(socket_, 2);
+
+  // Chunked and sized bodies both leave the connection reusable.
+  for (bool chunked : {true, false}) {
+    server_->setChunked(chunked);
+    for (size_t i = 0; i < 3; i++) {
+      JSON doc;
+      ASSERT_TRUE(client.get("/version", doc).ok());
+      EXPECT_EQ("18.09.0", getDockerString(doc.doc(), "Version"));
+    }
+  }
+  EXPECT_EQ(1U, server_->connections());
+  EXPECT_EQ(1U, client.idle());
+
+  // Error responses close the connection.
+  std::string body;
+  EXPECT_FALSE(client.get("/unknown", body).ok());
+  EXPECT_EQ(0U, client.idle());
+}
+
+TEST_F(DockerApiTests, test_closed_connection) {
+  DockerClient client(socket_, 2);
+  server_->setClose(true);
+
+  // The daemon closed the pooled connection, the request is sent again.
+  for (size_t i = 0; i < 3; i++) {
+    std::string body;
+    ASSERT_TRUE(client.get("/version", body).ok());
+    EXPECT_EQ("{\"Version\":\"18.09.0\",\"ApiVersion\":\"1.39\"}\n", body);
+  }
+  EXPECT_EQ(3U, server_->connections());
+}
+
+TEST_F(DockerApiTests, test_json_values) {
+  JSON doc;
+  ASSERT_TRUE(doc.fromString(kDockerTestStats).ok());
+  EXPECT_EQ("/test", getDockerString(doc.doc(), "name"));
+  EXPECT_EQ("", getDockerString(doc.doc(), "missing.name"));
+  EXPECT_EQ(3, getDockerInt(doc.doc(), "pids_stats.current"));
+  EXPECT_EQ(-1, getDockerInt(doc.doc(), "pids_stats.limit", -1));
+  EXPECT_EQ(12345678901ULL,
+            getDockerUInt(doc.doc(), "cpu_stats.cpu_usage.total_usage"));
+  EXPECT_EQ(0U, getDockerUInt(doc.doc(), "name"));
+  EXPECT_FALSE(getDockerBool(doc.doc(), "name"));
+}
+
+TEST_F(DockerApiTests, test_container_stats) {
+  FLAGS_docker_api_concurrency = 4;
+
+  QueryContext context;
+  for (size_t i = 0; i < 12; i++) {
+    auto id = "abc" + std::to_string(i);
+    context.constraints["id"].add(Constraint(EQUALS, id));
+  }
+  context.constraints["id"].add(Constraint(EQUALS, "dead"));
+  auto results = genContainerStats(context);
+
+  // The stats are requested concurrently, up to the configured limit.
+  EXPECT_LE(max_in_flight_.load(), 4U);
+  EXPECT_GT(max_in_flight_.load(), 1U);
+  EXPECT_LE(server_->connections(), 4U);
+  EXPECT_EQ(13U, server_->requests());
+
+  ASSERT_EQ(12U, results.size());
+  auto& r = results[0];
+  EXPECT_EQ("abc0", r["id"]);
+  EXPECT_EQ("/test", r["name"]);
+  EXPECT_EQ("3", r["pids"]);
+  EXPECT_EQ("1500000000", r["interval"]);
+  EXPECT_EQ("105", r["disk_read"]);
+  EXPECT_EQ("20", r["disk_write"]);
+  EXPECT_EQ("12345678901", r["cpu_total_usage"]);
+  EXPECT_EQ("2", r["online_cpus"]);
+  EXPECT_EQ("4096", r["memory_usage"]);
+  EXPECT_EQ("30", r["network_rx_bytes"]);
+  EXPECT_EQ("3", r["network_tx_bytes"]);
+}
+
+} // namespace tables
+} // namespace osquery
@@ -0,0 +1,227 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef MSG_NOSIGNAL
+// macOS sets SO_NOSIGPIPE on the socket instead.
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace osquery {
+namespace tables {
+
+/**
+ * @brief A fake Docker daemon serving keep-alive HTTP/1.1 on a UNIX socket.
+ *
+ * Each connection is served on its own thread, like the daemon does, so
+ * slow responses to concurrent requests overlap.
+ */
+class DockerTestServer {
+ public:
+  /// Return the JSON body for a request URI, an empty body responds 404.
+  using Responder = std::function<std::string(const std::string& uri)>;
+
+  DockerTestServer(std::string path, Responder responder)
+      : path_(std::move(path)), responder_(std::move(responder)) {}
+
+  ~DockerTestServer() {
+    stop();
+  }
+
+  /// Listen on the socket path and start accepting connections.
+  bool start() {
+    ::unlink(path_.c_str());
+    listener_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener_ < 0) {
+      return false;
+    }
+
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path_.c_str(), sizeof(addr.sun_path) - 1);
+    auto bound = ::bind(
+        listener_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    if (bound != 0 || ::listen(listener_, 128) != 0) {
+      ::close(listener_);
+      listener_ = -1;
+      return false;
+    }
+
+    acceptor_ = std::thread([this]() { accept(); });
+    return true;
+  }
+
+  /// Close the socket and every connection.
+  void stop() {
+    if (listener_ < 0) {
+      return;
+    }
+
+    // Shutting down the listener wakes the blocked accept.
+    ::shutdown(listener_, SHUT_RDWR);
+    acceptor_.join();
+    ::close(listener_);
+    listener_ = -1;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto fd : clients_) {
+      ::shutdown(fd, SHUT_RDWR);
+    }
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+    for (auto fd : clients_) {
+      ::close(fd);
+    }
+    clients_.clear();
+    threads_.clear();
+    ::unlink(path_.c_str());
+  }
+
+  /// Send bodies with chunked encoding instead of a Content-Length.
+  void setChunked(bool chunked) {
+    chunked_ = chunked;
+  }
+
+  /// Close each connection after one response.
+  void setClose(bool close) {
+    close_ = close;
+  }
+
+  /// Number of accepted connections.
+  size_t connections() const {
+    return connections_;
+  }
+
+  /// Number of served requests.
+  size_t requests() const {
+    return requests_;
+  }
+
+ private:
+  void accept() {
+    while (true) {
+      auto fd = ::accept(listener_, nullptr, nullptr);
+      if (fd < 0) {
+        return;
+      }
+
+#ifdef SO_NOSIGPIPE
+      int enable = 1;
+      ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+
+      connections_++;
+      std::lock_guard<std::mutex> lock(mutex_);
+      clients_.push_back(fd);
+      threads_.emplace_back([this, fd]() { serve(fd); });
+    }
+  }
+
+  void serve(int fd) {
+    std::string input;
+    char buffer[4096];
+    while (true) {
+      auto size = ::recv(fd, buffer, sizeof(buffer), 0);
+      if (size <= 0) {
+        return;
+      }
+      input.append(buffer, static_cast<size_t>(size));
+
+      size_t end;
+      while ((end = input.find("\r\n\r\n")) != std::string::npos) {
+        auto request = input.substr(0, end);
+        input.erase(0, end + 4);
+
+        auto uri_start = request.find(' ') + 1;
+        auto uri_end = request.find(' ', uri_start);
+        auto uri = request.substr(uri_start, uri_end - uri_start);
+        requests_++;
+        if (!respond(fd, responder_(uri)) || close_) {
+          ::shutdown(fd, SHUT_RDWR);
+          return;
+        }
+      }
+    }
+  }
+
+  bool respond(int fd, const std::string& body) {
+    std::string response;
+    if (body.empty()) {
+      response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    } else if (chunked_) {
+      // Split the body in two chunks to exercise the chunk framing.
+      response =
+          "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+          "Transfer-Encoding: chunked\r\n\r\n";
+      auto half = body.size() / 2;
+      appendChunk(response, body.substr(0, half));
+      appendChunk(response, body.substr(half));
+      response += "0\r\n\r\n";
+    } else {
+      response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                 "Content-Length: " +
+                 std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+
+    size_t sent = 0;
+    while (sent < response.size()) {
+      auto size = ::send(
+          fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+      if (size <= 0) {
+        return false;
+      }
+      sent += static_cast<size_t>(size);
+    }
+    return true;
+  }
+
+  static void appendChunk(std::string& response, const std::string& chunk) {
+    if (chunk.empty()) {
+      return;
+    }
+
+    char size[32];
+    std::snprintf(size, sizeof(size), "%zx\r\n", chunk.size());
+    response += size + chunk + "\r\n";
+  }
+
+ private:
+  std::string path_;
+  Responder responder_;
+  bool chunked_{true};
+  bool close_{false};
+
+  int listener_{-1};
+  std::thread acceptor_;
+  std::atomic<size_t> connections_{0};
+  std::atomic<size_t> requests_{0};
+
+  /// Protects the connection sockets and threads.
+  std::mutex mutex_;
+  std::vector<int> clients_;
+  std::vector<std::thread> threads_;
+};
+
+} // namespace tables
+} // namespace osquery
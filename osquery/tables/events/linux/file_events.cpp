@@ -10,7 +10,7 @@
 #include <string>
 
 #include <osquery/config/config.h>
-#include <osquery/events/linux/inotify.h>
+#include <osquery/events/linux/fanotify.h>
 #include <osquery/logger.h>
 #include <osquery/registry_factory.h>
 #include <osquery/tables.h>
@@ -23,7 +23,7 @@ namespace osquery {
  *
  * This is mostly an example EventSubscriber implementation.
  */
-class FileEventSubscriber : public EventSubscriber<INotifyEventPublisher> {
+class FileEventSubscriber : public FileChangeEventSubscriber {
  public:
   Status init() override {
     return Status(0);
@@ -6,10 +6,13 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <limits>
+
 #include <osquery/core.h>
 #include <osquery/filesystem/filesystem.h>
 #include <osquery/filesystem/linux/proc.h>
 #include <osquery/tables.h>
+#include <osquery/utils/conversions/tryto.h>
 
 namespace osquery {
 namespace tables {
@@ -31,6 +34,14 @@ QueryData genOpenSockets(QueryContext& context) {
   bool pid_filter = !(pids.empty() ||
                       std::find(pids.begin(), pids.end(), "-1") != pids.end());
 
+  // A pid range, such as 'pid > 1000', also restricts the inspected pids.
+  // Sockets without an associated pid are reported as pid -1.
+  long long lower = -1;
+  auto upper = std::numeric_limits<long long>::max();
+  if (!context.constraints["pid"].getRange(lower, upper)) {
+    return results;
+  }
+
   if (!pid_filter) {
     pids.clear();
     status = osquery::procProcesses(pids);
@@ -38,6 +49,16 @@ QueryData genOpenSockets(QueryContext& context) {
       VLOG(1) << "Failed to acquire pid list: " << status.what();
       return results;
     }
+    pid_filter = (lower > -1);
+  }
+
+  for (auto it = pids.begin(); it != pids.end();) {
+    auto pid = tryTo<long long>(*it).takeOr(-1ll);
+    if (pid < lower || pid > upper) {
+      it = pids.erase(it);
+    } else {
+      ++it;
+    }
   }
 
   /* Data for this table is fetched from 3 different sources and correlated.
@@ -464,9 +464,7 @@ void genProcResourceUsage(const QueryContext& context,
   }
 }
 
-TableRows genProcesses(QueryContext& context) {
-  TableRows results;
-
+void genProcesses(RowYield& yield, QueryContext& context) {
   auto pidlist = getProcList(context);
   for (const auto& pid : pidlist) {
     ProcessesRow* r = new ProcessesRow();
@@ -494,10 +492,8 @@ TableRows genProcesses(QueryContext& context) {
     genProcArch(context, pid, *r);
 
     std::unique_ptr<TableRow> tr(r);
-    results.push_back(std::move(tr));
+    yield(std::move(tr));
   }
-
-  return results;
 }
 
 QueryData genProcessEnvs(QueryContext& context) {
@@ -27,6 +27,7 @@
 #include <osquery/filesystem/filesystem.h>
 #include <osquery/sql/dynamic_table_row.h>
 #include <osquery/tables.h>
+#include <osquery/utils/scope_guard.h>
 
 namespace osquery {
 namespace tables {
@@ -103,7 +104,7 @@ void genProcessMap(struct procstat* pstat,
 
 void genProcess(struct procstat* pstat,
                 struct kinfo_proc* proc,
-                TableRows& results) {
+                RowYield& yield) {
   auto r = make_table_row();
   r["pid"] = INTEGER(proc->ki_pid);
   r["parent"] = INTEGER(proc->ki_ppid);
@@ -178,21 +179,20 @@ void genProcess(struct procstat* pstat,
   r["user_time"] = INTEGER(proc->ki_rusage.ru_utime.tv_sec);
   r["start_time"] = INTEGER(proc->ki_start.tv_sec);
 
-  results.push_back(r);
+  yield(std::move(r));
 }
 
-TableRows genProcesses(QueryContext& context) {
-  TableRows results;
+void genProcesses(RowYield& yield, QueryContext& context) {
   struct kinfo_proc* procs = nullptr;
   struct procstat* pstat = nullptr;
 
   auto cnt = getProcesses(context, &pstat, &procs);
+  // The generator may be unwound at any yield if the query stops early.
+  auto const procstat_manager = scope_guard::create(
+      [&pstat, &procs]() { procstatCleanup(pstat, procs); });
   for (unsigned int i = 0; i < cnt; i++) {
-    genProcess(pstat, &procs[i], results);
+    genProcess(pstat, &procs[i], yield);
   }
-
-  procstatCleanup(pstat, procs);
-  return results;
 }
 
 QueryData genProcessEnvs(QueryContext& context) {
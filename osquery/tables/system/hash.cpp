@@ -205,7 +205,7 @@ std::string genSsdeepForFile(const std::string& path) {
 void genHashForFile(const std::string& path,
                     const std::string& dir,
                     QueryContext& context,
-                    QueryData& results) {
+                    RowYield& yield) {
   // Must provide the path, filename, directory separate from boost path->string
   // helpers to match any explicit (query-parsed) predicate constraints.
   auto tr = TableRowHolder(new DynamicTableRow());
@@ -239,7 +239,7 @@ void genHashForFile(const std::string& path,
     context.setCache(path, tr);
   }
 
-  results.push_back(static_cast<Row>(r));
+  yield(std::move(tr));
 }
 
 void expandFSPathConstraints(QueryContext& context,
@@ -262,8 +262,7 @@ void expandFSPathConstraints(QueryContext& context,
       }));
 }
 
-QueryData genHash(QueryContext& context) {
-  QueryData results;
+void genHash(RowYield& yield, QueryContext& context) {
   boost::system::error_code ec;
 
   // The query must provide a predicate with constraints including path or
@@ -279,7 +278,7 @@ QueryData genHash(QueryContext& context) {
       continue;
     }
 
-    genHashForFile(path_string, path.parent_path().string(), context, results);
+    genHashForFile(path_string, path.parent_path().string(), context, yield);
   }
 
   // Now loop through constraints using the directory column constraint.
@@ -299,12 +298,10 @@ QueryData genHash(QueryContext& context) {
     for (; begin != end; ++begin) {
       if (boost::filesystem::is_regular_file(begin->path(), ec)) {
         genHashForFile(
-            begin->path().string(), directory_string, context, results);
+            begin->path().string(), directory_string, context, yield);
       }
     }
   }
-
-  return results;
 }
 } // namespace tables
 } // namespace osquery
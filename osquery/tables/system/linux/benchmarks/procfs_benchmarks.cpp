@@ -0,0 +1,183 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <new>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <osquery/filesystem/mock_file_structure.h>
+#include <osquery/flags.h>
+#include <osquery/registry.h>
+#include <osquery/tables.h>
+
+namespace fs = boost::filesystem;
+
+namespace osquery {
+
+/// Allocations through operator new, from every thread.
+static std::atomic<size_t> kAllocations{0};
+
+} // namespace osquery
+
+void* operator new(std::size_t size) {
+  osquery::kAllocations.fetch_add(1, std::memory_order_relaxed);
+  auto* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+namespace osquery {
+
+DECLARE_string(procfs_root);
+
+/**
+ * A synthetic procfs with 10k processes of 100 descriptors each, of which
+ * 200k are TCP sockets. Built once and removed at exit.
+ *
+ * Building the tree takes a while, the first benchmark to run pays for it.
+ */
+class SyntheticProcfs {
+ public:
+  static const std::string& root() {
+    static SyntheticProcfs procfs;
+    return procfs.root_;
+  }
+
+  ~SyntheticProcfs() {
+    boost::system::error_code ec;
+    fs::remove_all(root_, ec);
+  }
+
+ private:
+  SyntheticProcfs() {
+    MockProcfsOptions options;
+    options.pids = 10000;
+    options.fds = 100;
+    options.sockets = 200000;
+    options.mounts = 1000;
+    options.iomem_regions = 10000;
+    root_ = createMockProcfsStructure(options).string();
+  }
+
+ private:
+  std::string root_;
+};
+
+/**
+ * Read and write syscalls made by this process.
+ *
+ * These are the syscr and syscw counters of the real /proc/self/io, opens,
+ * stats and readlinks are not counted.
+ */
+static size_t getSyscallCount() {
+  std::ifstream io("/proc/self/io");
+  size_t count = 0;
+  std::string key;
+  size_t value = 0;
+  while (io >> key >> value) {
+    if (key == "syscr:" || key == "syscw:") {
+      count += value;
+    }
+  }
+  return count;
+}
+
+static TableRows generateTable(const std::shared_ptr<TablePlugin>& table,
+                               QueryContext& context) {
+  if (!table->usesGenerator()) {
+    return table->generate(context);
+  }
+
+  TableRows rows;
+  RowGenerator::pull_type generator(std::bind(&TablePlugin::generator,
+                                              table,
+                                              std::placeholders::_1,
+                                              std::ref(context)));
+  while (generator) {
+    rows.push_back(generator.get());
+    generator();
+  }
+  return rows;
+}
+
+/**
+ * Generate a Linux table over the synthetic procfs.
+ *
+ * Reports the rows per generation and the allocations and read/write
+ * syscalls per row. block_devices reads the host's udev database, which has
+ * no root prefix, and is included for its time per row.
+ */
+static void TABLES_linux_generate(benchmark::State& state,
+                                  const std::string& name) {
+  FLAGS_procfs_root = SyntheticProcfs::root();
+  auto table = std::dynamic_pointer_cast<TablePlugin>(
+      Registry::get().plugin("table", name));
+
+  size_t rows = 0;
+  size_t allocations = 0;
+  size_t syscalls = 0;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    auto allocations_start = kAllocations.load();
+    auto syscalls_start = getSyscallCount();
+    state.ResumeTiming();
+
+    QueryContext context;
+    auto results = generateTable(table, context);
+
+    state.PauseTiming();
+    allocations += kAllocations.load() - allocations_start;
+    syscalls += getSyscallCount() - syscalls_start;
+    rows += results.size();
+    results.clear();
+    state.ResumeTiming();
+  }
+
+  auto iterations = std::max<size_t>(state.iterations(), 1);
+  auto per_row = static_cast<double>(std::max<size_t>(rows, 1));
+  state.counters["rows"] = static_cast<double>(rows) / iterations;
+  state.counters["allocs_per_row"] = allocations / per_row;
+  state.counters["syscalls_per_row"] = syscalls / per_row;
+  state.SetItemsProcessed(rows);
+  FLAGS_procfs_root = "";
+}
+
+BENCHMARK_CAPTURE(TABLES_linux_generate, processes, "processes")
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(TABLES_linux_generate,
+                  process_open_sockets,
+                  "process_open_sockets")
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(TABLES_linux_generate,
+                  process_open_files,
+                  "process_open_files")
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(TABLES_linux_generate, mounts, "mounts")
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(TABLES_linux_generate, memory_map, "memory_map")
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(TABLES_linux_generate, block_devices, "block_devices")
+    ->Unit(benchmark::kMillisecond);
+} // namespace osquery
@@ -16,17 +16,29 @@ extern "C" {
 #include <dpkg/parsedump.h>
 }
 
+#include <algorithm>
+#include <cctype>
+
 #include <boost/algorithm/string.hpp>
+#include <boost/filesystem/path.hpp>
 
 #include <osquery/filesystem/filesystem.h>
+#include <osquery/hashing/hashing.h>
 #include <osquery/logger.h>
+#include <osquery/sql/dynamic_table_row.h>
 #include <osquery/system.h>
 #include <osquery/tables.h>
+#include <osquery/tables/system/linux/package_cache.h>
+#include <osquery/utils/scope_guard.h>
+
+namespace fs = boost::filesystem;
 
 namespace osquery {
 namespace tables {
 
 static const std::string kDPKGPath{"/var/lib/dpkg"};
+static const std::string kDPKGStatusPath{"/var/lib/dpkg/status"};
+static const std::string kDPKGUpdatesPath{"/var/lib/dpkg/updates"};
 
 /// A comparator used to sort the packages array.
 int pkg_sorter(const void *a, const void *b) {
@@ -121,8 +133,8 @@ const struct fieldinfo fieldinfos[] = {
     {FIELD("Revision"), f_revision, w_revision, 0},
     {}};
 
-void extractDebPackageInfo(const struct pkginfo *pkg, QueryData &results) {
-  Row r;
+void extractDebPackageInfo(const struct pkginfo *pkg, RowYield &yield) {
+  auto r = make_table_row();
 
   struct varbuf vb;
   varbuf_init(&vb, 20);
@@ -149,23 +161,18 @@ void extractDebPackageInfo(const struct pkginfo *pkg, QueryData &results) {
   }
   varbuf_destroy(&vb);
 
-  results.push_back(r);
+  yield(std::move(r));
 }
 
-QueryData genDebPackages(QueryContext &context) {
-  QueryData results;
-
-  if (!osquery::isDirectory(kDPKGPath)) {
-    TLOG << "Cannot find DPKG database: " << kDPKGPath;
-    return results;
-  }
-
-  auto dropper = DropPrivileges::get();
-  dropper->dropTo("nobody");
-
+/// Read every package through libdpkg, including pending journal updates.
+static void genDebPackagesFromDB(RowYield &yield) {
   struct pkg_array packages;
   dpkg_setup(&packages);
 
+  // The generator may be unwound at any yield if the query stops early.
+  auto const packages_manager =
+      scope_guard::create([&packages]() { dpkg_teardown(&packages); });
+
   for (int i = 0; i < packages.n_pkgs; i++) {
     struct pkginfo *pkg = packages.pkgs[i];
     // Casted to int to allow the older enums that were embedded in the packages
@@ -175,11 +182,169 @@ QueryData genDebPackages(QueryContext &context) {
       continue;
     }
 
-    extractDebPackageInfo(pkg, results);
+    extractDebPackageInfo(pkg, yield);
   }
+}
+
+bool parseDebStatusStanza(const std::string &stanza, Row &r) {
+  std::string status;
+  size_t start = 0;
+  while (start < stanza.size()) {
+    auto end = stanza.find('\n', start);
+    if (end == std::string::npos) {
+      end = stanza.size();
+    }
+    auto line = stanza.substr(start, end - start);
+    start = end + 1;
+
+    // Continuation lines of multi-line fields start with whitespace.
+    auto separator_position = line.find(':');
+    if (line.empty() || line[0] == ' ' || line[0] == '\t' ||
+        separator_position == std::string::npos) {
+      continue;
+    }
+
+    std::string key = line.substr(0, separator_position);
+    std::string value = line.substr(separator_position + 1);
+    boost::algorithm::trim(value);
+    if (key == "Status") {
+      status = std::move(value);
+      continue;
+    }
+
+    // The revision is written as part of the version.
+    auto it = kFieldMappings.find(key);
+    if (it != kFieldMappings.end() && key != "Revision") {
+      r[it->second] = std::move(value);
+    }
+  }
+
+  // The status is "want flag status", a missing status is not-installed.
+  std::vector<std::string> states;
+  boost::algorithm::split(states, status, boost::is_any_of(" "));
+  if (r.count("name") == 0 || states.size() != 3 ||
+      states[2] == "not-installed") {
+    return false;
+  }
+
+  // Like libdpkg, the revision follows the last hyphen of the version.
+  r["revision"] = "";
+  auto version = r.find("version");
+  if (version != r.end()) {
+    auto hyphen = version->second.rfind('-');
+    if (hyphen != std::string::npos) {
+      r["revision"] = version->second.substr(hyphen + 1);
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<PackageInventory> genDebInventory(
+    const std::string &status, const PackageInventory &previous) {
+  auto inventory = std::make_shared<PackageInventory>();
+
+  // Stanzas are separated by blank lines.
+  size_t start = 0;
+  while (start < status.size()) {
+    if (status[start] == '\n') {
+      start++;
+      continue;
+    }
 
-  dpkg_teardown(&packages);
-  return results;
+    auto end = status.find("\n\n", start);
+    if (end == std::string::npos) {
+      end = status.size();
+    }
+    auto stanza = status.substr(start, end - start);
+    start = end;
+
+    // Only stanzas that changed since the previous inventory are parsed.
+    auto digest = hashFromBuffer(HASH_TYPE_MD5, stanza.data(), stanza.size());
+    auto cached = previous.packages.find(digest);
+    if (cached != previous.packages.end()) {
+      inventory->packages.emplace(digest, cached->second);
+      continue;
+    }
+
+    Row r;
+    if (parseDebStatusStanza(stanza, r)) {
+      inventory->packages.emplace(digest, std::move(r));
+    }
+  }
+  return inventory;
+}
+
+/// Check for journal updates that libdpkg applies over the status file.
+static bool hasPendingDebUpdates() {
+  std::vector<std::string> updates;
+  if (!listFilesInDirectory(kDPKGUpdatesPath, updates).ok()) {
+    return false;
+  }
+
+  return std::any_of(
+      updates.begin(), updates.end(), [](const std::string &update) {
+        auto name = fs::path(update).filename().string();
+        return !name.empty() &&
+               std::all_of(name.begin(), name.end(), ::isdigit);
+      });
+}
+
+static const std::string &getDebField(const Row &r, const std::string &key) {
+  static const std::string kEmpty;
+  auto it = r.find(key);
+  return (it == r.end()) ? kEmpty : it->second;
+}
+
+void genDebPackages(RowYield &yield, QueryContext &context) {
+  if (!osquery::isDirectory(kDPKGPath)) {
+    TLOG << "Cannot find DPKG database: " << kDPKGPath;
+    return;
+  }
+
+  auto dropper = DropPrivileges::get();
+  dropper->dropTo("nobody");
+
+  // An interrupted or running dpkg leaves updates outside the status file.
+  if (hasPendingDebUpdates()) {
+    genDebPackagesFromDB(yield);
+    return;
+  }
+
+  // The status file is replaced by a rename whenever dpkg changes it.
+  auto inventory = getPackageInventory("deb");
+  auto stamp = getPackageDBStamp({kDPKGStatusPath});
+  if (stamp.empty() || stamp != inventory->stamp) {
+    std::string status;
+    if (!readFile(kDPKGStatusPath, status).ok()) {
+      TLOG << "Cannot read DPKG status: " << kDPKGStatusPath;
+      return;
+    }
+
+    auto updated = genDebInventory(status, *inventory);
+    updated->stamp = std::move(stamp);
+    auto s = setPackageInventory("deb", updated);
+    if (!s.ok()) {
+      VLOG(1) << "Cannot store the DPKG inventory: " << s.getMessage();
+    }
+    inventory = std::move(updated);
+  }
+
+  std::vector<const Row *> rows;
+  for (const auto &package : inventory->packages) {
+    rows.push_back(&package.second);
+  }
+  std::sort(rows.begin(), rows.end(), [](const Row *a, const Row *b) {
+    const auto &name_a = getDebField(*a, "name");
+    const auto &name_b = getDebField(*b, "name");
+    if (name_a != name_b) {
+      return name_a < name_b;
+    }
+    return getDebField(*a, "arch") < getDebField(*b, "arch");
+  });
+
+  for (const auto *row : rows) {
+    yield(TableRowHolder(new DynamicTableRow(Row(*row))));
+  }
 }
 }
 }
@@ -9,6 +9,7 @@
 #include <boost/algorithm/string.hpp>
 
 #include <osquery/filesystem/filesystem.h>
+#include <osquery/filesystem/linux/proc.h>
 #include <osquery/tables.h>
 #include <osquery/utils/conversions/split.h>
 #include <osquery/utils/expected/expected.h>
@@ -18,14 +19,12 @@ namespace fs = boost::filesystem;
 namespace osquery {
 namespace tables {
 
-const std::string kIOMemLocation = "/proc/iomem";
-
 QueryData genMemoryMap(QueryContext& context) {
   QueryData results;
 
   std::vector<std::string> regions;
   std::string content;
-  readFile(kIOMemLocation, content);
+  readFile(getProcPath("iomem"), content);
 
   regions = osquery::split(content, "\n");
   for (const auto& line : regions) {
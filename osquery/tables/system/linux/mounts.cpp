@@ -13,6 +13,7 @@
 
 #include <osquery/core.h>
 #include <osquery/filesystem/filesystem.h>
+#include <osquery/filesystem/linux/proc.h>
 #include <osquery/tables.h>
 #include <osquery/utils/system/filepath.h>
 
@@ -26,7 +27,7 @@ std::set<std::string> kMountStatBlacklist = {
 QueryData genMounts(QueryContext& context) {
   QueryData results;
 
-  FILE* mounts = setmntent("/proc/mounts", "r");
+  FILE* mounts = setmntent(getProcPath("mounts").c_str(), "r");
   if (mounts == nullptr) {
     return {};
   }
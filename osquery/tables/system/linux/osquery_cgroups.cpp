@@ -0,0 +1,83 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#include <osquery/core/linux/cgroups.h>
+#include <osquery/flags.h>
+#include <osquery/process/process.h>
+#include <osquery/tables.h>
+
+namespace fs = boost::filesystem;
+
+namespace osquery {
+
+DECLARE_bool(watchdog_cgroups);
+
+namespace tables {
+
+QueryData genOsqueryCgroups(QueryContext& context) {
+  QueryData results;
+  if (!FLAGS_watchdog_cgroups) {
+    return results;
+  }
+
+  // The watcher places itself, the worker and extensions in sibling leaves.
+  std::string own;
+  if (!getProcessCgroup(PlatformProcess::getCurrentPid(), own).ok()) {
+    return results;
+  }
+
+  // Without the watcher's leaf the parent is not a delegated osquery cgroup.
+  auto leaf = fs::path(own).filename().string();
+  if (leaf != "worker" && leaf != "watcher" &&
+      !boost::starts_with(leaf, "extension-")) {
+    return results;
+  }
+
+  boost::system::error_code ec;
+  auto root = fs::path(own).parent_path();
+  if (!fs::is_directory(root / "watcher", ec)) {
+    return results;
+  }
+
+  for (fs::directory_iterator it(root, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (!fs::is_directory(it->status())) {
+      continue;
+    }
+
+    auto path = it->path().string();
+    CgroupLimits limits;
+    CgroupStats stats;
+    if (!readCgroupLimits(path, limits).ok() ||
+        !readCgroupStats(path, stats).ok()) {
+      continue;
+    }
+
+    Row r;
+    r["name"] = it->path().filename().string();
+    r["path"] = path;
+    r["memory_high"] = BIGINT(limits.memory_high);
+    r["memory_max"] = BIGINT(limits.memory_max);
+    r["cpu_quota"] = BIGINT(limits.cpu_quota);
+    r["cpu_period"] = BIGINT(limits.cpu_period);
+    r["memory_current"] = BIGINT(stats.memory_current);
+    r["memory_high_events"] = BIGINT(stats.memory_high_events);
+    r["memory_max_events"] = BIGINT(stats.memory_max_events);
+    r["oom_kills"] = BIGINT(stats.oom_kills);
+    r["cpu_usage"] = BIGINT(stats.cpu_usage);
+    r["throttled_periods"] = BIGINT(stats.throttled_periods);
+    r["throttled_time"] = BIGINT(stats.throttled_time);
+    results.push_back(std::move(r));
+  }
+  return results;
+}
+} // namespace tables
+} // namespace osquery
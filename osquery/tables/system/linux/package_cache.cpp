@@ -0,0 +1,164 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <sys/stat.h>
+
+#include <osquery/database.h>
+#include <osquery/logger.h>
+#include <osquery/tables/system/linux/package_cache.h>
+#include <osquery/utils/mutex.h>
+
+namespace osquery {
+namespace tables {
+
+/// Protects the in-memory inventories.
+static Mutex kPackageInventoriesMutex;
+
+/// The last inventory of each package manager.
+static std::map<std::string, PackageInventoryRef> kPackageInventories;
+
+std::string getPackageDBStamp(const std::vector<std::string>& paths) {
+  std::string stamp;
+  for (const auto& path : paths) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+      continue;
+    }
+
+    stamp += path + ":" + std::to_string(st.st_ino) + ":" +
+             std::to_string(st.st_size) + ":" +
+             std::to_string(st.st_mtim.tv_sec) + "." +
+             std::to_string(st.st_mtim.tv_nsec) + ";";
+  }
+  return stamp;
+}
+
+std::string getPackageDBGeneration(const std::vector<std::string>& paths) {
+  std::string generation;
+  for (const auto& path : paths) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+      continue;
+    }
+
+    generation += path + ":" + std::to_string(st.st_dev) + ":" +
+                  std::to_string(st.st_ino) + ";";
+  }
+  return generation;
+}
+
+static Status deserializePackageInventory(const std::string& json,
+                                          PackageInventory& inventory) {
+  auto doc = JSON::newObject();
+  if (!doc.fromString(json).ok() || !doc.doc().IsObject()) {
+    return Status::failure("Cannot parse package inventory");
+  }
+
+  const auto& obj = doc.doc();
+  if (!obj.HasMember("stamp") || !obj["stamp"].IsString() ||
+      !obj.HasMember("packages") || !obj["packages"].IsObject()) {
+    return Status::failure("Malformed package inventory");
+  }
+
+  inventory.stamp = obj["stamp"].GetString();
+  if (obj.HasMember("generation") && obj["generation"].IsString()) {
+    inventory.generation = obj["generation"].GetString();
+  }
+  inventory.files = obj.HasMember("files") && JSON::valueToBool(obj["files"]);
+  for (const auto& package : obj["packages"].GetObject()) {
+    auto status = deserializeRow(package.value,
+                                 inventory.packages[package.name.GetString()]);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return Status::success();
+}
+
+static Status serializePackageInventory(const PackageInventory& inventory,
+                                        std::string& json) {
+  auto doc = JSON::newObject();
+  doc.addRef("stamp", inventory.stamp);
+  doc.addRef("generation", inventory.generation);
+  doc.add("files", inventory.files);
+
+  auto packages = doc.getObject();
+  for (const auto& package : inventory.packages) {
+    auto row = doc.getObject();
+    serializeRow(package.second, {}, doc, row);
+    doc.add(package.first, row, packages);
+  }
+  doc.add("packages", packages);
+  return doc.toString(json);
+}
+
+PackageInventoryRef getPackageInventory(const std::string& manager) {
+  WriteLock lock(kPackageInventoriesMutex);
+  auto it = kPackageInventories.find(manager);
+  if (it != kPackageInventories.end()) {
+    return it->second;
+  }
+
+  auto inventory = std::make_shared<PackageInventory>();
+  std::string json;
+  if (getDatabaseValue(kPackages, manager + ".inventory", json).ok()) {
+    auto status = deserializePackageInventory(json, *inventory);
+    if (!status.ok()) {
+      VLOG(1) << "Ignoring the stored " << manager
+              << " inventory: " << status.getMessage();
+      inventory = std::make_shared<PackageInventory>();
+    }
+  }
+
+  kPackageInventories[manager] = inventory;
+  return inventory;
+}
+
+Status setPackageInventory(const std::string& manager,
+                           PackageInventoryRef inventory) {
+  std::string json;
+  auto status = serializePackageInventory(*inventory, json);
+  if (!status.ok()) {
+    return status;
+  }
+
+  {
+    WriteLock lock(kPackageInventoriesMutex);
+    kPackageInventories[manager] = std::move(inventory);
+  }
+  return setDatabaseValue(kPackages, manager + ".inventory", json);
+}
+
+Status getPackageFiles(const std::string& manager,
+                       const std::string& key,
+                       QueryData& files) {
+  std::string json;
+  auto status = getDatabaseValue(kPackages, manager + ".files." + key, json);
+  if (!status.ok()) {
+    return status;
+  }
+  return deserializeQueryDataJSON(json, files);
+}
+
+Status setPackageFiles(const std::string& manager,
+                       const std::string& key,
+                       const QueryData& files) {
+  std::string json;
+  auto status = serializeQueryDataJSON(files, json);
+  if (!status.ok()) {
+    return status;
+  }
+  return setDatabaseValue(kPackages, manager + ".files." + key, json);
+}
+
+Status removePackageFiles(const std::string& manager, const std::string& key) {
+  return deleteDatabaseValue(kPackages, manager + ".files." + key);
+}
+
+} // namespace tables
+} // namespace osquery
@@ -0,0 +1,87 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <osquery/core/sql/query_data.h>
+#include <osquery/utils/status/status.h>
+
+namespace osquery {
+namespace tables {
+
+/**
+ * @brief The installed packages read from a package manager database.
+ *
+ * Package rows are keyed by an identity that changes whenever the package
+ * changes: the digest of a dpkg status stanza, or an rpmdb header instance.
+ * A changed database only needs the packages with new keys re-parsed.
+ */
+struct PackageInventory {
+  /// The stamp of the package database files the inventory was read from.
+  std::string stamp;
+
+  /// The generation of the package database files, see getPackageDBGeneration.
+  std::string generation;
+
+  /// Package rows by identity.
+  std::map<std::string, Row> packages;
+
+  /// True if a file index is stored for every package.
+  bool files{false};
+};
+
+using PackageInventoryRef = std::shared_ptr<const PackageInventory>;
+
+/**
+ * @brief Stamp package database files by their inode, size and mtime.
+ *
+ * Missing files are skipped, a database manager only writes some of them.
+ */
+std::string getPackageDBStamp(const std::vector<std::string>& paths);
+
+/**
+ * @brief Identify package database files by their device and inode.
+ *
+ * Rebuilding or migrating a database writes new files, which may renumber
+ * the keys of an inventory. Missing files are skipped.
+ */
+std::string getPackageDBGeneration(const std::vector<std::string>& paths);
+
+/**
+ * @brief Get the last inventory of a package manager.
+ *
+ * The inventory is kept in memory and in the backing store, so a restarted
+ * daemon does not read an unchanged package database again. An empty
+ * inventory is returned if none was stored.
+ */
+PackageInventoryRef getPackageInventory(const std::string& manager);
+
+/// Store the inventory of a package manager.
+Status setPackageInventory(const std::string& manager,
+                           PackageInventoryRef inventory);
+
+/// Get the stored file rows of a package.
+Status getPackageFiles(const std::string& manager,
+                       const std::string& key,
+                       QueryData& files);
+
+/// Store the file rows of a package.
+Status setPackageFiles(const std::string& manager,
+                       const std::string& key,
+                       const QueryData& files);
+
+/// Remove the stored file rows of a package.
+Status removePackageFiles(const std::string& manager, const std::string& key);
+
+} // namespace tables
+} // namespace osquery
@@ -6,6 +6,7 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <limits>
 #include <map>
 #include <string>
 
@@ -37,7 +38,7 @@ const int kMSIn1CLKTCK = (1000 / sysconf(_SC_CLK_TCK));
 
 inline std::string getProcAttr(const std::string& attr,
                                const std::string& pid) {
-  return "/proc/" + pid + "/" + attr;
+  return getProcPath(pid + "/" + attr);
 }
 
 inline std::string readProcCMDLine(const std::string& pid) {
@@ -122,10 +123,15 @@ Status deletedMatchesInode(const std::string& path, const std::string& pid) {
 
 std::set<std::string> getProcList(const QueryContext& context) {
   std::set<std::string> pidlist;
-  if (context.constraints.count("pid") > 0 &&
-      context.constraints.at("pid").exists(EQUALS)) {
-    for (const auto& pid : context.constraints.at("pid").getAll(EQUALS)) {
-      if (isDirectory("/proc/" + pid)) {
+  if (context.constraints.count("pid") == 0) {
+    osquery::procProcesses(pidlist);
+    return pidlist;
+  }
+
+  const auto& pids = context.constraints.at("pid");
+  if (pids.exists(EQUALS)) {
+    for (const auto& pid : pids.getAll(EQUALS)) {
+      if (isDirectory(getProcPath(pid))) {
         pidlist.insert(pid);
       }
     }
@@ -133,6 +139,21 @@ std::set<std::string> getProcList(const QueryContext& context) {
     osquery::procProcesses(pidlist);
   }
 
+  // Skip processes outside of a pid range before reading their details.
+  long long lower = 0;
+  auto upper = std::numeric_limits<long long>::max();
+  if (!pids.getRange(lower, upper)) {
+    return {};
+  }
+  for (auto it = pidlist.begin(); it != pidlist.end();) {
+    auto pid = tryTo<long long>(*it).takeOr(-1ll);
+    if (pid < lower || pid > upper) {
+      it = pidlist.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
   return pidlist;
 }
 
@@ -393,7 +414,7 @@ int getOnDisk(const std::string& pid, std::string& path) {
 
 void genProcess(const std::string& pid,
                 long system_boot_time,
-                TableRows& results) {
+                RowYield& yield) {
   // Parse the process stat and status.
   SimpleProcStat proc_stat(pid);
   // Parse the process io
@@ -458,7 +479,7 @@ void genProcess(const std::string& pid,
         std::to_string(write_bytes - cancelled_write_bytes);
   }
 
-  results.push_back(r);
+  yield(std::move(r));
 }
 
 void genNamespaces(const std::string& pid, QueryData& results) {
@@ -479,8 +500,7 @@ void genNamespaces(const std::string& pid, QueryData& results) {
   results.push_back(r);
 }
 
-TableRows genProcesses(QueryContext& context) {
-  TableRows results;
+void genProcesses(RowYield& yield, QueryContext& context) {
   auto system_boot_time = getUptime();
   if (system_boot_time > 0) {
     system_boot_time = std::time(nullptr) - system_boot_time;
@@ -488,10 +508,8 @@ TableRows genProcesses(QueryContext& context) {
 
   auto pidlist = getProcList(context);
   for (const auto& pid : pidlist) {
-    genProcess(pid, system_boot_time, results);
+    genProcess(pid, system_boot_time, yield);
   }
-
-  return results;
 }
 
 QueryData genProcessEnvs(QueryContext& context) {
@@ -14,6 +14,12 @@
 #include <rpm/rpmpgp.h>
 #include <rpm/rpmts.h>
 
+#include <fcntl.h>
+
+#include <cstdlib>
+#include <map>
+#include <set>
+
 #include <boost/noncopyable.hpp>
 
 #include <osquery/filesystem/filesystem.h>
@@ -21,6 +27,8 @@
 #include <osquery/sql/dynamic_table_row.h>
 #include <osquery/system.h>
 #include <osquery/tables.h>
+#include <osquery/tables/system/linux/package_cache.h>
+#include <osquery/utils/scope_guard.h>
 
 // librpm may be configured and compiled with glibc < 2.17.
 #if defined(__GLIBC__) && __GLIBC_MINOR__ > 17
@@ -36,6 +44,21 @@ namespace tables {
 // Maximum number of files per RPM.
 #define MAX_RPM_FILES (64 * 1024)
 
+/// The rpmdb files written by the Berkeley DB, ndb and sqlite backends.
+static const std::vector<std::string> kRpmDBPaths = {
+    "/var/lib/rpm/Packages",
+    "/var/lib/rpm/Packages.db",
+    "/var/lib/rpm/rpmdb.sqlite",
+    "/var/lib/rpm/rpmdb.sqlite-wal",
+};
+
+/// The rpmdb files replaced when the database is rebuilt or migrated.
+static const std::vector<std::string> kRpmDBGenerationPaths = {
+    "/var/lib/rpm/Packages",
+    "/var/lib/rpm/Packages.db",
+    "/var/lib/rpm/rpmdb.sqlite",
+};
+
 /**
  * @brief Return a string representation of the RPM tag type.
  *
@@ -116,130 +139,321 @@ class RpmEnvironmentManager : public boost::noncopyable {
   rpmlogCallback callback_{nullptr};
 };
 
-QueryData genRpmPackages(QueryContext& context) {
+/// Configure librpm and open the rpmdb read-only for the object's lifetime.
+class RpmDatabase : public boost::noncopyable {
+ public:
+  RpmDatabase() {
+    // The following implementation uses http://rpm.org/api/4.11.1/
+    rpmInitCrypto();
+    if (rpmReadConfigFiles(nullptr, nullptr) != 0) {
+      TLOG << "Cannot read RPM configuration files";
+      return;
+    }
+
+    ts_ = rpmtsCreate();
+    if (rpmtsOpenDB(ts_, O_RDONLY) != 0) {
+      TLOG << "Cannot open the RPM database";
+      rpmtsFree(ts_);
+      ts_ = nullptr;
+    }
+  }
+
+  ~RpmDatabase() {
+    if (ts_ != nullptr) {
+      rpmtsFree(ts_);
+    }
+    rpmFreeCrypto();
+    rpmFreeRpmrc();
+  }
+
+  /// The transaction set of the open rpmdb, nullptr if it cannot be read.
+  rpmts get() const {
+    return ts_;
+  }
+
+ private:
+  /// Isolate RPM/package inspection to the canonical: /usr/lib/rpm.
+  RpmEnvironmentManager env_manager_;
+
+  rpmts ts_{nullptr};
+};
+
+static Row genRpmPackage(Header header) {
+  Row r;
+  rpmtd td = rpmtdNew();
+  r["name"] = getRpmAttribute(header, RPMTAG_NAME, td);
+  r["version"] = getRpmAttribute(header, RPMTAG_VERSION, td);
+  r["release"] = getRpmAttribute(header, RPMTAG_RELEASE, td);
+  r["source"] = getRpmAttribute(header, RPMTAG_SOURCERPM, td);
+  r["size"] = getRpmAttribute(header, RPMTAG_SIZE, td);
+  r["sha1"] = getRpmAttribute(header, RPMTAG_SHA1HEADER, td);
+  r["arch"] = getRpmAttribute(header, RPMTAG_ARCH, td);
+  r["epoch"] = INTEGER(getRpmAttribute(header, RPMTAG_EPOCH, td));
+
+  rpmtdFree(td);
+  return r;
+}
+
+static QueryData genRpmFiles(rpmts ts,
+                             Header header,
+                             const std::string& package_name) {
   QueryData results;
+  rpmfi fi = rpmfiNew(ts, header, RPMTAG_BASENAMES, RPMFI_NOHEADER);
+  auto const fi_manager = scope_guard::create([&fi]() { rpmfiFree(fi); });
 
-  auto dropper = DropPrivileges::get();
-  if (!dropper->dropTo("nobody") && isUserAdmin()) {
-    LOG(WARNING) << "Cannot drop privileges for rpm_packages";
+  auto file_count = rpmfiFC(fi);
+  if (file_count <= 0) {
+    VLOG(1) << "RPM package " << package_name << " contains 0 files";
+    return results;
+  } else if (file_count > MAX_RPM_FILES) {
+    VLOG(1) << "RPM package " << package_name << " contains over "
+            << MAX_RPM_FILES << " files";
     return results;
   }
 
-  // Isolate RPM/package inspection to the canonical: /usr/lib/rpm.
-  RpmEnvironmentManager env_manager;
+  // Iterate over every file in this package.
+  for (size_t i = 0; rpmfiNext(fi) >= 0 && i < file_count; i++) {
+    Row r;
+    auto path = rpmfiFN(fi);
+    r["package"] = package_name;
+    r["path"] = (path != nullptr) ? path : "";
+    auto username = rpmfiFUser(fi);
+    r["username"] = (username != nullptr) ? username : "";
+    auto groupname = rpmfiFGroup(fi);
+    r["groupname"] = (groupname != nullptr) ? groupname : "";
+    r["mode"] = lsperms(rpmfiFMode(fi));
+    r["size"] = BIGINT(rpmfiFSize(fi));
+
+    int digest_algo;
+    auto digest = rpmfiFDigestHex(fi, &digest_algo);
+    if (digest_algo == PGPHASHALGO_SHA256) {
+      r["sha256"] = (digest != nullptr) ? digest : "";
+    }
+    if (digest != nullptr) {
+      free(digest);
+    }
 
-  // The following implementation uses http://rpm.org/api/4.11.1/
-  rpmInitCrypto();
-  if (rpmReadConfigFiles(nullptr, nullptr) != 0) {
-    TLOG << "Cannot read RPM configuration files";
-    return results;
+    results.push_back(std::move(r));
   }
+  return results;
+}
 
-  rpmts ts = rpmtsCreate();
-  rpmdbMatchIterator matches;
-  if (context.constraints["name"].exists(EQUALS)) {
-    auto name = (*context.constraints["name"].getAll(EQUALS).begin());
-    matches = rpmtsInitIterator(ts, RPMTAG_NAME, name.c_str(), name.size());
-  } else {
-    matches = rpmtsInitIterator(ts, RPMTAG_NAME, nullptr, 0);
+/**
+ * @brief Bring the rpm inventory up to date with the rpmdb.
+ *
+ * Packages are keyed by their rpmdb header instance. An installed, upgraded,
+ * or reinstalled package is written to a new instance, so only headers of new
+ * instances are read. With files, each package's file rows are kept in the
+ * backing store as well.
+ *
+ * Rebuilding or migrating the rpmdb renumbers the instances, so the cached
+ * rows are dropped when the rpmdb files are replaced. A cached row is also
+ * only reused if the name index still lists its name at that instance.
+ *
+ * @param files true if the file index is needed.
+ * @return the inventory, or nullptr if the rpmdb cannot be read.
+ */
+static PackageInventoryRef updateRpmInventory(bool files) {
+  auto inventory = getPackageInventory("rpm");
+  auto stamp = getPackageDBStamp(kRpmDBPaths);
+  if (!stamp.empty() && stamp == inventory->stamp &&
+      (inventory->files || !files)) {
+    return inventory;
   }
 
-  Header header;
-  while ((header = rpmdbNextIterator(matches)) != nullptr) {
-    Row r;
-    rpmtd td = rpmtdNew();
-    r["name"] = getRpmAttribute(header, RPMTAG_NAME, td);
-    r["version"] = getRpmAttribute(header, RPMTAG_VERSION, td);
-    r["release"] = getRpmAttribute(header, RPMTAG_RELEASE, td);
-    r["source"] = getRpmAttribute(header, RPMTAG_SOURCERPM, td);
-    r["size"] = getRpmAttribute(header, RPMTAG_SIZE, td);
-    r["sha1"] = getRpmAttribute(header, RPMTAG_SHA1HEADER, td);
-    r["arch"] = getRpmAttribute(header, RPMTAG_ARCH, td);
-    r["epoch"] = INTEGER(getRpmAttribute(header, RPMTAG_EPOCH, td));
+  RpmDatabase db;
+  auto ts = db.get();
+  if (ts == nullptr) {
+    return nullptr;
+  }
 
-    rpmtdFree(td);
-    results.push_back(r);
+  // The name index lists every header instance without loading headers.
+  std::map<unsigned int, std::string> offsets;
+  auto names = rpmdbIndexIteratorInit(rpmtsGetRdb(ts), RPMDBI_NAME);
+  if (names != nullptr) {
+    const void* key = nullptr;
+    size_t key_size = 0;
+    while (rpmdbIndexIteratorNext(names, &key, &key_size) == 0) {
+      std::string name(static_cast<const char*>(key), key_size);
+      if (!name.empty() && name.back() == '\0') {
+        name.pop_back();
+      }
+      for (unsigned int i = 0; i < rpmdbIndexIteratorNumPkgs(names); i++) {
+        offsets[rpmdbIndexIteratorPkgOffset(names, i)] = name;
+      }
+    }
+    rpmdbIndexIteratorFree(names);
   }
 
-  rpmdbFreeIterator(matches);
-  rpmtsFree(ts);
-  rpmFreeCrypto();
-  rpmFreeRpmrc();
+  auto generation = getPackageDBGeneration(kRpmDBGenerationPaths);
+  if (generation != inventory->generation) {
+    if (inventory->files) {
+      for (const auto& package : inventory->packages) {
+        removePackageFiles("rpm", package.first);
+      }
+    }
+    inventory = std::make_shared<PackageInventory>();
+  }
 
-  return results;
+  auto updated = std::make_shared<PackageInventory>();
+  updated->stamp = stamp;
+  updated->generation = generation;
+  updated->files = files || inventory->files;
+  for (const auto& entry : offsets) {
+    auto offset = entry.first;
+    auto key = std::to_string(offset);
+    auto cached = inventory->packages.find(key);
+    auto has_row = (cached != inventory->packages.end());
+    if (has_row) {
+      auto name = cached->second.find("name");
+      has_row = name != cached->second.end() && name->second == entry.second;
+    }
+    if (has_row && (inventory->files || !updated->files)) {
+      updated->packages.emplace(key, cached->second);
+      continue;
+    }
+
+    auto match =
+        rpmtsInitIterator(ts, RPMDBI_PACKAGES, &offset, sizeof(offset));
+    auto const match_manager =
+        scope_guard::create([&match]() { rpmdbFreeIterator(match); });
+    Header header = rpmdbNextIterator(match);
+    if (header == nullptr) {
+      continue;
+    }
+
+    auto r = has_row ? cached->second : genRpmPackage(header);
+    if (updated->files) {
+      auto s = setPackageFiles("rpm", key, genRpmFiles(ts, header, r["name"]));
+      if (!s.ok()) {
+        VLOG(1) << "Cannot store RPM package files: " << s.getMessage();
+      }
+    }
+    updated->packages.emplace(key, std::move(r));
+  }
+
+  // Drop the file index of removed packages.
+  if (inventory->files) {
+    for (const auto& package : inventory->packages) {
+      if (updated->packages.count(package.first) == 0) {
+        removePackageFiles("rpm", package.first);
+      }
+    }
+  }
+
+  auto s = setPackageInventory("rpm", updated);
+  if (!s.ok()) {
+    VLOG(1) << "Cannot store the RPM inventory: " << s.getMessage();
+  }
+  return updated;
 }
 
-void genRpmPackageFiles(RowYield& yield, QueryContext& context) {
+/**
+ * @brief Check a package name against the EQUALS constraints of a column.
+ *
+ * Each EQUALS constraint, including each member of an IN list, selects the
+ * packages with that name. Without one, every package is selected.
+ */
+static bool isRpmPackageSelected(const std::set<std::string>& names,
+                                 const Row& package) {
+  if (names.empty()) {
+    return true;
+  }
+
+  auto name = package.find("name");
+  return name != package.end() && names.count(name->second) > 0;
+}
+
+void genRpmPackages(RowYield& yield, QueryContext& context) {
   auto dropper = DropPrivileges::get();
   if (!dropper->dropTo("nobody") && isUserAdmin()) {
-    LOG(WARNING) << "Cannot drop privileges for rpm_package_files";
+    LOG(WARNING) << "Cannot drop privileges for rpm_packages";
     return;
   }
 
-  // Isolate RPM/package inspection to the canonical: /usr/lib/rpm.
-  RpmEnvironmentManager env_manager;
-
-  if (rpmReadConfigFiles(nullptr, nullptr) != 0) {
-    TLOG << "Cannot read RPM configuration files";
+  auto inventory = updateRpmInventory(false);
+  if (inventory == nullptr) {
     return;
   }
 
-  rpmts ts = rpmtsCreate();
-  rpmdbMatchIterator matches;
-  if (context.constraints["package"].exists(EQUALS)) {
-    auto name = (*context.constraints["package"].getAll(EQUALS).begin());
-    matches = rpmtsInitIterator(ts, RPMTAG_NAME, name.c_str(), name.size());
-  } else {
-    matches = rpmtsInitIterator(ts, RPMTAG_NAME, nullptr, 0);
+  auto names = context.constraints["name"].getAll(EQUALS);
+  for (const auto& package : inventory->packages) {
+    if (isRpmPackageSelected(names, package.second)) {
+      yield(TableRowHolder(new DynamicTableRow(Row(package.second))));
+    }
   }
+}
 
-  Header header;
-  while ((header = rpmdbNextIterator(matches)) != nullptr) {
-    rpmtd td = rpmtdNew();
-    rpmfi fi = rpmfiNew(ts, header, RPMTAG_BASENAMES, RPMFI_NOHEADER);
-    std::string package_name = getRpmAttribute(header, RPMTAG_NAME, td);
+/**
+ * @brief Yield the files of packages read through the rpmdb name index.
+ *
+ * Only the headers of the named packages are read, the inventory and its
+ * file index are left as they are.
+ */
+static void genRpmNamedPackageFiles(RowYield& yield,
+                                    const std::set<std::string>& names) {
+  RpmDatabase db;
+  auto ts = db.get();
+  if (ts == nullptr) {
+    return;
+  }
 
-    auto file_count = rpmfiFC(fi);
-    if (file_count <= 0) {
-      VLOG(1) << "RPM package " << package_name << " contains 0 files";
-      rpmfiFree(fi);
-      continue;
-    } else if (file_count > MAX_RPM_FILES) {
-      VLOG(1) << "RPM package " << package_name << " contains over "
-              << MAX_RPM_FILES << " files";
-      rpmfiFree(fi);
-      continue;
+  for (const auto& name : names) {
+    auto matches =
+        rpmtsInitIterator(ts, RPMTAG_NAME, name.c_str(), name.size());
+    // The generator may be unwound at any yield if the query stops early.
+    auto const matches_manager =
+        scope_guard::create([&matches]() { rpmdbFreeIterator(matches); });
+
+    Header header;
+    while ((header = rpmdbNextIterator(matches)) != nullptr) {
+      for (auto& r : genRpmFiles(ts, header, name)) {
+        yield(TableRowHolder(new DynamicTableRow(std::move(r))));
+      }
     }
+  }
+}
 
-    // Iterate over every file in this package.
-    for (size_t i = 0; rpmfiNext(fi) >= 0 && i < file_count; i++) {
-      auto r = make_table_row();
-      auto path = rpmfiFN(fi);
-      r["package"] = package_name;
-      r["path"] = (path != nullptr) ? path : "";
-      auto username = rpmfiFUser(fi);
-      r["username"] = (username != nullptr) ? username : "";
-      auto groupname = rpmfiFGroup(fi);
-      r["groupname"] = (groupname != nullptr) ? groupname : "";
-      r["mode"] = lsperms(rpmfiFMode(fi));
-      r["size"] = BIGINT(rpmfiFSize(fi));
-
-      int digest_algo;
-      auto digest = rpmfiFDigestHex(fi, &digest_algo);
-      if (digest_algo == PGPHASHALGO_SHA256) {
-        r["sha256"] = (digest != nullptr) ? digest : "";
-      }
+void genRpmPackageFiles(RowYield& yield, QueryContext& context) {
+  auto dropper = DropPrivileges::get();
+  if (!dropper->dropTo("nobody") && isUserAdmin()) {
+    LOG(WARNING) << "Cannot drop privileges for rpm_package_files";
+    return;
+  }
 
-      yield(std::move(r));
+  // Selected packages are read directly unless the file index is current,
+  // building the index for every package is left to unconstrained scans.
+  auto packages = context.constraints["package"].getAll(EQUALS);
+  PackageInventoryRef inventory;
+  if (!packages.empty()) {
+    inventory = getPackageInventory("rpm");
+    auto stamp = getPackageDBStamp(kRpmDBPaths);
+    if (!inventory->files || stamp.empty() || stamp != inventory->stamp) {
+      genRpmNamedPackageFiles(yield, packages);
+      return;
+    }
+  } else {
+    // Files are served from the index, headers are only read for new
+    // packages.
+    inventory = updateRpmInventory(true);
+    if (inventory == nullptr) {
+      return;
     }
-
-    rpmfiFree(fi);
-    rpmtdFree(td);
   }
 
-  rpmdbFreeIterator(matches);
-  rpmtsFree(ts);
-  rpmFreeRpmrc();
+  for (const auto& package : inventory->packages) {
+    if (!isRpmPackageSelected(packages, package.second)) {
+      continue;
+    }
+
+    QueryData files;
+    if (!getPackageFiles("rpm", package.first, files).ok()) {
+      continue;
+    }
+    for (auto& r : files) {
+      yield(TableRowHolder(new DynamicTableRow(std::move(r))));
+    }
+  }
 }
 }
 }
@@ -0,0 +1,142 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <osquery/database.h>
+#include <osquery/flags.h>
+#include <osquery/registry_interface.h>
+#include <osquery/system.h>
+#include <osquery/tables/system/linux/package_cache.h>
+
+namespace osquery {
+DECLARE_bool(disable_database);
+namespace tables {
+
+bool parseDebStatusStanza(const std::string& stanza, Row& r);
+std::shared_ptr<PackageInventory> genDebInventory(
+    const std::string& status, const PackageInventory& previous);
+
+const std::string kDebTestStanza{
+    "Package: libc6\n"
+    "Status: install ok installed\n"
+    "Priority: optional\n"
+    "Installed-Size: 12000\n"
+    "Architecture: amd64\n"
+    "Multi-Arch: same\n"
+    "Source: glibc\n"
+    "Version: 2.28-10+deb10u1\n"
+    "Description: GNU C Library: Shared libraries\n"
+    " Contains the standard libraries: Version: 1\n"};
+
+const std::string kDebTestRemovedStanza{
+    "Package: removed\n"
+    "Status: purge ok not-installed\n"
+    "Architecture: amd64\n"};
+
+class DebPackagesTests : public testing::Test {
+ protected:
+  void SetUp() override {
+    Initializer::platformSetup();
+    registryAndPluginInit();
+
+    // Force registry to use ephemeral database plugin
+    FLAGS_disable_database = true;
+    DatabasePlugin::setAllowOpen(true);
+    DatabasePlugin::initPlugin();
+  }
+};
+
+TEST_F(DebPackagesTests, test_parse_status_stanza) {
+  Row r;
+  ASSERT_TRUE(parseDebStatusStanza(kDebTestStanza, r));
+  EXPECT_EQ("libc6", r["name"]);
+  EXPECT_EQ("2.28-10+deb10u1", r["version"]);
+  EXPECT_EQ("10+deb10u1", r["revision"]);
+  EXPECT_EQ("12000", r["size"]);
+  EXPECT_EQ("amd64", r["arch"]);
+  EXPECT_EQ("glibc", r["source"]);
+  EXPECT_EQ(6U, r.size());
+
+  // A version without a hyphen has an empty revision.
+  Row native;
+  ASSERT_TRUE(parseDebStatusStanza(
+      "Package: native\nStatus: install ok installed\nVersion: 1:2.0\n",
+      native));
+  EXPECT_EQ("1:2.0", native["version"]);
+  EXPECT_EQ("", native["revision"]);
+  EXPECT_EQ(0U, native.count("source"));
+
+  Row removed;
+  EXPECT_FALSE(parseDebStatusStanza(kDebTestRemovedStanza, removed));
+  Row unknown;
+  EXPECT_FALSE(parseDebStatusStanza("Package: unknown\n", unknown));
+}
+
+TEST_F(DebPackagesTests, test_incremental_inventory) {
+  auto status = kDebTestStanza + "\n" + kDebTestRemovedStanza + "\n\n" +
+                "Package: zlib1g\nStatus: install ok installed\n"
+                "Version: 1:1.2.11.dfsg-1\n";
+  auto first = genDebInventory(status, PackageInventory());
+  ASSERT_EQ(2U, first->packages.size());
+
+  // Mark the cached rows to see which stanzas are parsed again.
+  auto previous = *first;
+  for (auto& package : previous.packages) {
+    package.second["source"] = "cached";
+  }
+
+  auto changed = kDebTestStanza + "\n" + kDebTestRemovedStanza + "\n\n" +
+                 "Package: zlib1g\nStatus: install ok installed\n"
+                 "Version: 1:1.2.11.dfsg-2\n";
+  auto second = genDebInventory(changed, previous);
+  ASSERT_EQ(2U, second->packages.size());
+
+  std::map<std::string, Row> rows;
+  for (const auto& package : second->packages) {
+    rows[package.second.at("name")] = package.second;
+  }
+  EXPECT_EQ("cached", rows["libc6"]["source"]);
+  EXPECT_EQ(0U, rows["zlib1g"].count("source"));
+  EXPECT_EQ("2", rows["zlib1g"]["revision"]);
+}
+
+TEST_F(DebPackagesTests, test_stored_inventory) {
+  auto inventory = genDebInventory(kDebTestStanza, PackageInventory());
+  inventory->stamp = "stamp";
+  inventory->generation = "generation";
+  ASSERT_TRUE(setPackageInventory("deb_test", inventory).ok());
+
+  auto stored = getPackageInventory("deb_test");
+  EXPECT_EQ("stamp", stored->stamp);
+  EXPECT_EQ("generation", stored->generation);
+  EXPECT_FALSE(stored->files);
+  EXPECT_EQ(inventory->packages, stored->packages);
+
+  QueryData files = {{{"package", "libc6"}, {"path", "/lib/libc.so.6"}}};
+  ASSERT_TRUE(setPackageFiles("deb_test", "libc6", files).ok());
+  QueryData stored_files;
+  ASSERT_TRUE(getPackageFiles("deb_test", "libc6", stored_files).ok());
+  EXPECT_EQ(files, stored_files);
+
+  ASSERT_TRUE(removePackageFiles("deb_test", "libc6").ok());
+  EXPECT_FALSE(getPackageFiles("deb_test", "libc6", stored_files).ok());
+}
+
+TEST_F(DebPackagesTests, test_package_db_stamp) {
+  EXPECT_EQ("", getPackageDBStamp({"/does/not/exist"}));
+  EXPECT_FALSE(getPackageDBStamp({"/", "/does/not/exist"}).empty());
+
+  EXPECT_EQ("", getPackageDBGeneration({"/does/not/exist"}));
+  auto generation = getPackageDBGeneration({"/", "/does/not/exist"});
+  EXPECT_FALSE(generation.empty());
+  EXPECT_EQ(generation, getPackageDBGeneration({"/"}));
+}
+
+} // namespace tables
+} // namespace osquery
@@ -427,9 +427,7 @@ void genProcRssInfo(HANDLE& proc, DynamicTableRowHolder& r) {
   r["total_size"] = ret == TRUE ? BIGINT(mem_ctr.PrivateUsage) : BIGINT(-1);
 }
 
-TableRows genProcesses(QueryContext& context) {
-  TableRows results;
-
+void genProcesses(RowYield& yield, QueryContext& context) {
   // Check for pid filtering in constraints.
   // We use a list here, but sqlite3 will usually call this with
   // a single pid for each item in JOIN or IN() list.
@@ -448,7 +446,7 @@ TableRows genProcesses(QueryContext& context) {
   if (proc_snap == INVALID_HANDLE_VALUE) {
     LOG(ERROR) << "Failed to create snapshot of processes with "
                << std::to_string(GetLastError());
-    return {};
+    return;
   }
 
   PROCESSENTRY32 proc;
@@ -458,7 +456,7 @@ TableRows genProcesses(QueryContext& context) {
   if (ret == FALSE) {
     LOG(ERROR) << "Failed to acquire first process information with "
                << std::to_string(GetLastError());
-    return {};
+    return;
   }
 
   while (ret != FALSE) {
@@ -515,7 +513,7 @@ TableRows genProcesses(QueryContext& context) {
     if (proc_handle == NULL) {
       VLOG(1) << "Failed to open handle to process " << proc.th32ProcessID
               << " with " << GetLastError();
-      results.push_back(r);
+      yield(std::move(r));
       ret = Process32Next(proc_snap, &proc);
       continue;
     }
@@ -593,11 +591,9 @@ TableRows genProcesses(QueryContext& context) {
       r["state"] = exit_code == STILL_ACTIVE ? "STILL_ACTIVE" : "EXITED";
     }
 
-    results.push_back(r);
+    yield(std::move(r));
     ret = Process32Next(proc_snap, &proc);
   }
-
-  return results;
 }
 
 QueryData genProcessMemoryMap(QueryContext& context) {
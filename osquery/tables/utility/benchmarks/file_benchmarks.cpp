@@ -0,0 +1,76 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <chrono>
+
+#include <sys/resource.h>
+
+#include <benchmark/benchmark.h>
+
+#include <sqlite3.h>
+
+#include <osquery/registry.h>
+#include <osquery/sql.h>
+#include <osquery/sql/table_snapshot_cache.h>
+#include <osquery/tables.h>
+
+#include "osquery/sql/virtual_table.h"
+
+namespace osquery {
+
+const std::string kFileLimitQuery{
+    "SELECT * FROM file WHERE directory LIKE '/usr/%%' LIMIT 10"};
+
+/**
+ * Time the first row and the whole of a LIMIT query on the file table.
+ *
+ * With range(0) set the connection behaves like a scheduled query, which
+ * materializes every row into the step's snapshot before returning any.
+ * Run each case with --benchmark_filter, as the peak RSS is process-wide.
+ */
+static void TABLES_file_limit(benchmark::State& state) {
+  PluginResponse res;
+  Registry::call("table", "file", {{"action", "columns"}}, res);
+
+  auto dbc = SQLiteDBManager::getUnique();
+  attachTableInternal("file", columnDefinition(res, false, false), dbc, false);
+  dbc->useCache(state.range(0) != 0);
+
+  size_t rows = 0;
+  std::chrono::microseconds first_row{0};
+  while (state.KeepRunning()) {
+    TableSnapshotCache::get().clear();
+
+    sqlite3_stmt* stmt = nullptr;
+    sqlite3_prepare_v2(dbc->db(), kFileLimitQuery.c_str(), -1, &stmt, nullptr);
+    auto start = std::chrono::steady_clock::now();
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      first_row += std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start);
+      rows++;
+      while (sqlite3_step(stmt) == SQLITE_ROW) {
+        rows++;
+      }
+    }
+    sqlite3_finalize(stmt);
+    dbc->clearAffectedTables();
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  auto iterations = std::max<size_t>(state.iterations(), 1);
+  state.counters["first_row_us"] =
+      static_cast<double>(first_row.count()) / iterations;
+  state.counters["rows"] = static_cast<double>(rows) / iterations;
+  state.counters["peak_rss_kb"] = static_cast<double>(usage.ru_maxrss);
+  TableSnapshotCache::get().clear();
+}
+
+BENCHMARK(TABLES_file_limit)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+} // namespace osquery
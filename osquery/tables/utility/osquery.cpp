@@ -17,6 +17,7 @@
 #include <osquery/process/process.h>
 #include <osquery/registry.h>
 #include <osquery/sql.h>
+#include <osquery/sql/table_stats.h>
 #include <osquery/system.h>
 #include <osquery/tables.h>
 #include <osquery/utils/info/platform_type.h>
@@ -245,6 +246,8 @@ QueryData genOsquerySchedule(QueryContext& context) {
         r["system_time"] = "0";
         r["average_memory"] = "0";
         r["last_executed"] = "0";
+        r["placement"] = "0";
+        r["deferrals"] = "0";
 
         // Report optional performance information.
         Config::get().getPerformanceStats(
@@ -255,6 +258,8 @@ QueryData genOsquerySchedule(QueryContext& context) {
               r["user_time"] = BIGINT(perf.user_time);
               r["system_time"] = BIGINT(perf.system_time);
               r["average_memory"] = BIGINT(perf.average_memory);
+              r["placement"] = INTEGER(perf.placement);
+              r["deferrals"] = BIGINT(perf.deferrals);
             });
 
         results.push_back(r);
@@ -262,5 +267,24 @@ QueryData genOsquerySchedule(QueryContext& context) {
       true);
   return results;
 }
+
+QueryData genOsqueryTableStats(QueryContext& context) {
+  QueryData results;
+  for (const auto& table : TableStats::get().snapshot()) {
+    const auto& stats = table.second;
+    Row r;
+    r["name"] = table.first.first;
+    r["constraints"] = table.first.second;
+    r["scans"] = BIGINT(stats.scans);
+    r["cache_hits"] = BIGINT(stats.cache_hits);
+    r["wall_time"] = BIGINT(stats.wall_time);
+    r["cpu_time"] = BIGINT(stats.cpu_time);
+    r["rows_generated"] = BIGINT(stats.rows_generated);
+    r["rows_consumed"] = BIGINT(stats.rows_consumed);
+    r["allocated_bytes"] = BIGINT(stats.allocated_bytes);
+    results.push_back(std::move(r));
+  }
+  return results;
+}
 } // namespace tables
 } // namespace osquery
@@ -9,18 +9,26 @@
 #include <gtest/gtest.h>
 
 #include <osquery/filesystem/filesystem.h>
+#include <osquery/flags.h>
+#include <osquery/tables/yara/yara_scanner.h>
 #include <osquery/tables/yara/yara_utils.h>
 
 #include <boost/filesystem.hpp>
 
 #include <fstream>
+#include <map>
+#include <mutex>
 
 namespace fs = boost::filesystem;
 
 namespace osquery {
 
+DECLARE_uint64(yara_max_file_size);
+
 const std::string alwaysTrue = "rule always_true { condition: true }";
 const std::string alwaysFalse = "rule always_false { condition: false }";
+const std::string hasTest = "rule has_test { strings: $a = \"test\" "
+                            "condition: $a }";
 
 class YARATest : public testing::Test {
  protected:
@@ -67,6 +75,24 @@ class YARATest : public testing::Test {
     fs::remove_all(file_to_scan);
     return r;
   }
+
+  YARARulesRef compileRules(const std::string& ruleContent) {
+    EXPECT_EQ(ERROR_SUCCESS, yr_initialize());
+
+    const auto rule_file = fs::temp_directory_path() /
+                           fs::unique_path("osquery.tests.yara.%%%%.%%%%.sig");
+    writeTextFile(rule_file.string(), ruleContent);
+
+    YR_RULES* rules = nullptr;
+    auto status = compileSingleFile(rule_file.string(), &rules);
+    EXPECT_TRUE(status.ok()) << status.what();
+    fs::remove_all(rule_file);
+    return YARARulesRef(rules, yr_rules_destroy);
+  }
+
+  Row defaultRow() {
+    return {{"count", "0"}, {"matches", ""}, {"strings", ""}, {"tags", ""}};
+  }
 };
 
 TEST_F(YARATest, test_match_true) {
@@ -80,4 +106,117 @@ TEST_F(YARATest, test_match_false) {
   // Should have 0 count
   EXPECT_TRUE(r["count"] == "0");
 }
+
+TEST_F(YARATest, test_scanner_cache) {
+  auto rules = compileRules(hasTest);
+  const auto path = fs::temp_directory_path() /
+                    fs::unique_path("osquery.tests.yara.%%%%.%%%%.bin");
+  writeTextFile(path.string(), "test\n");
+
+  YARAScanner scanner;
+  YARAGroups groups = {{"group", rules}};
+  auto r = defaultRow();
+  ASSERT_TRUE(scanner.scanFile(path.string(), groups, r).ok());
+  EXPECT_EQ("1", r["count"]);
+  EXPECT_EQ("has_test", r["matches"]);
+  EXPECT_EQ(1U, scanner.cacheSize());
+
+  // The unchanged file is served from the cache.
+  r = defaultRow();
+  ASSERT_TRUE(scanner.scanFile(path.string(), groups, r).ok());
+  EXPECT_EQ("1", r["count"]);
+  EXPECT_EQ(1U, scanner.cacheSize());
+
+  // Changing the file invalidates the cached result.
+  fs::remove(path);
+  writeTextFile(path.string(), "nothing to see\n");
+  r = defaultRow();
+  ASSERT_TRUE(scanner.scanFile(path.string(), groups, r).ok());
+  EXPECT_EQ("0", r["count"]);
+  EXPECT_EQ(2U, scanner.cacheSize());
+
+  // Recompiled rules do not reuse results of the previous rules.
+  YARAGroups always = {{"group", compileRules(alwaysTrue)}};
+  r = defaultRow();
+  ASSERT_TRUE(scanner.scanFile(path.string(), always, r).ok());
+  EXPECT_EQ("1", r["count"]);
+  EXPECT_EQ("always_true", r["matches"]);
+
+  // Results of several groups are merged into the row.
+  groups.emplace_back("always", always[0].second);
+  fs::remove(path);
+  writeTextFile(path.string(), "test\n");
+  r = defaultRow();
+  ASSERT_TRUE(scanner.scanFile(path.string(), groups, r).ok());
+  EXPECT_EQ("2", r["count"]);
+  EXPECT_EQ("has_test,always_true", r["matches"]);
+
+  fs::remove_all(path);
+}
+
+TEST_F(YARATest, test_scanner_max_file_size) {
+  auto rules = compileRules(alwaysTrue);
+  const auto path = fs::temp_directory_path() /
+                    fs::unique_path("osquery.tests.yara.%%%%.%%%%.bin");
+  writeTextFile(path.string(), "test\n");
+
+  auto max_file_size = FLAGS_yara_max_file_size;
+  FLAGS_yara_max_file_size = 4;
+
+  YARAScanner scanner;
+  auto r = defaultRow();
+  EXPECT_FALSE(scanner.scanFile(path.string(), {{"group", rules}}, r).ok());
+  EXPECT_EQ("0", r["count"]);
+
+  FLAGS_yara_max_file_size = max_file_size;
+  fs::remove_all(path);
+}
+
+TEST_F(YARATest, test_scanner_scan_all) {
+  auto rules = compileRules(hasTest);
+  const auto root = fs::temp_directory_path() /
+                    fs::unique_path("osquery.tests.yara.%%%%.%%%%");
+  fs::create_directories(root);
+
+  std::mutex mutex;
+  std::map<std::string, std::string> counts;
+  std::vector<YARAScanJob> jobs;
+  for (size_t i = 0; i < 32; i++) {
+    auto path = (root / ("file" + std::to_string(i))).string();
+    writeTextFile(path, (i % 2 == 0) ? "test\n" : "none\n");
+
+    YARAScanJob job;
+    job.path = path;
+    job.groups = {{"group", rules}};
+    job.row = defaultRow();
+    job.done = [&mutex, &counts, path](const Status& status, Row& row) {
+      EXPECT_TRUE(status.ok());
+      std::lock_guard<std::mutex> lock(mutex);
+      counts[path] = row["count"];
+    };
+    jobs.push_back(std::move(job));
+  }
+
+  // A missing file completes with a failed status.
+  YARAScanJob missing;
+  missing.path = (root / "missing").string();
+  missing.groups = {{"group", rules}};
+  missing.row = defaultRow();
+  bool missing_failed = false;
+  missing.done = [&missing_failed](const Status& status, Row&) {
+    missing_failed = !status.ok();
+  };
+  jobs.push_back(std::move(missing));
+
+  YARAScanner scanner;
+  scanner.scanAll(jobs);
+  EXPECT_TRUE(missing_failed);
+  ASSERT_EQ(32U, counts.size());
+  for (size_t i = 0; i < 32; i++) {
+    auto path = (root / ("file" + std::to_string(i))).string();
+    EXPECT_EQ((i % 2 == 0) ? "1" : "0", counts[path]);
+  }
+
+  fs::remove_all(root);
+}
 } // namespace osquery
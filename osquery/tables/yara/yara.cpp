@@ -6,6 +6,8 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <mutex>
+
 #include <boost/filesystem.hpp>
 
 #include <osquery/filesystem/filesystem.h>
@@ -13,6 +15,7 @@
 #include <osquery/tables.h>
 #include <osquery/utils/status/status.h>
 
+#include "osquery/tables/yara/yara_scanner.h"
 #include "osquery/tables/yara/yara_utils.h"
 
 #ifdef CONCAT
@@ -23,14 +26,11 @@
 namespace osquery {
 namespace tables {
 
-void doYARAScan(YR_RULES* rules,
-                const std::string& path,
-                QueryData& results,
-                const std::string& group,
-                const std::string& sigfile) {
+/// Default values, updated with the matches of each signature group.
+static Row makeYARARow(const std::string& path,
+                       const std::string& group,
+                       const std::string& sigfile) {
   Row r;
-
-  // These are default values, to be updated in YARACallback.
   r["count"] = INTEGER(0);
   r["matches"] = std::string("");
   r["strings"] = std::string("");
@@ -38,15 +38,9 @@ void doYARAScan(YR_RULES* rules,
 
   // This could use target_path instead to be consistent with yara_events.
   r["path"] = path;
-  r["sig_group"] = std::string(group);
-  r["sigfile"] = std::string(sigfile);
-
-  // Perform the scan, using the static YARA subscriber callback.
-  int result = yr_rules_scan_file(
-      rules, path.c_str(), SCAN_FLAGS_FAST_MODE, YARACallback, (void*)&r, 0);
-  if (result == ERROR_SUCCESS) {
-    results.push_back(std::move(r));
-  }
+  r["sig_group"] = group;
+  r["sigfile"] = sigfile;
+  return r;
 }
 
 QueryData genYara(QueryContext& context) {
@@ -77,7 +71,6 @@ QueryData genYara(QueryContext& context) {
     LOG(ERROR) << "YARA config parser plugin has no pointer";
     return results;
   }
-  auto& rules = yaraParser->rules();
 
   // Collect all paths specified too.
   auto paths = context.constraints["path"].getAll(EQUALS);
@@ -103,7 +96,7 @@ QueryData genYara(QueryContext& context) {
   // Compile all sigfiles into a map.
   for (const auto& file : sigfiles) {
     // Check if this "ad-hoc" signature file has not been used/compiled.
-    if (rules.count(file) == 0) {
+    if (yaraParser->getRules(file) == nullptr) {
       // If this is a relative path append the default yara search path.
       auto path = (file[0] != '/') ? kYARAHome : "";
       path += file;
@@ -117,21 +110,36 @@ QueryData genYara(QueryContext& context) {
       // Cache the compiled rules by setting the unique signature file path
       // as the lookup name. Additional signature file uses will skip the
       // compile step and be added as rule groups.
-      rules[file] = tmp_rules;
+      yaraParser->setRules(file, tmp_rules);
     }
     // Assemble an "ad-hoc" group using the signature file path as the name.
     groups.insert(file);
   }
 
-  // Scan every path pair.
-  for (const auto& path : paths) {
-    // Scan using the signature groups.
-    for (const auto& group : groups) {
-      if (rules.count(group) > 0) {
-        doYARAScan(rules[group], path.c_str(), results, group, group);
-      }
+  // Scan every path pair on the scanner threads, sharing the compiled rules.
+  std::mutex results_mutex;
+  std::vector<YARAScanJob> jobs;
+  for (const auto& group : groups) {
+    auto rules = yaraParser->getRules(group);
+    if (rules == nullptr) {
+      continue;
+    }
+
+    for (const auto& path : paths) {
+      YARAScanJob job;
+      job.path = path;
+      job.groups = {{group, rules}};
+      job.row = makeYARARow(path, group, group);
+      job.done = [&results, &results_mutex](const Status& status, Row& r) {
+        if (status.ok()) {
+          std::lock_guard<std::mutex> lock(results_mutex);
+          results.push_back(std::move(r));
+        }
+      };
+      jobs.push_back(std::move(job));
     }
   }
+  YARAScanner::get().scanAll(jobs);
 
   return results;
 }
@@ -10,15 +10,17 @@
 #include <string>
 
 #include <osquery/config/config.h>
+#include <osquery/flags.h>
 #include <osquery/logger.h>
 #include <osquery/registry_factory.h>
+#include <osquery/tables/yara/yara_scanner.h>
 #include <osquery/tables/yara/yara_utils.h>
 
 /// The file change event publishers are slightly different in OS X and Linux.
 #ifdef __APPLE__
 #include <osquery/events/darwin/fsevents.h>
 #elif __linux__
-#include <osquery/events/linux/inotify.h>
+#include <osquery/events/linux/fanotify.h>
 #endif
 
 #ifdef CONCAT
@@ -28,6 +30,12 @@
 
 namespace osquery {
 
+FLAG(bool,
+     yara_events_async,
+     false,
+     "Scan files for yara_events on the YARA scanner threads instead of the "
+     "file event publisher");
+
 /// The file change event publishers are slightly different in OS X and Linux.
 #ifdef __APPLE__
 using FileEventSubscriber = EventSubscriber<FSEventsEventPublisher>;
@@ -37,7 +45,7 @@ using FileSubscriptionContextRef = FSEventsSubscriptionContextRef;
   kFSEventStreamEventFlagItemCreated | kFSEventStreamEventFlagItemModified |   \
       kFSEventStreamEventFlagItemRenamed
 #elif __linux__
-using FileEventSubscriber = EventSubscriber<INotifyEventPublisher>;
+using FileEventSubscriber = FileChangeEventSubscriber;
 using FileEventContextRef = INotifyEventContextRef;
 using FileSubscriptionContextRef = INotifySubscriptionContextRef;
 #define FILE_CHANGE_MASK                                                       \
@@ -160,10 +168,9 @@ Status YARAEventSubscriber::Callback(const FileEventContextRef& ec,
     return Status(1, "Yara parser unknown.");
   }
 
-  auto rules = yaraParser->rules();
-
   // Use the category as a lookup into the yara file_paths. The value will be
   // a list of signature groups to scan with.
+  YARAGroups groups;
   auto category = r.at("category");
   const auto& yara_config = parser->getData().doc();
   const auto& yara_paths = yara_config["file_paths"];
@@ -171,17 +178,33 @@ Status YARAEventSubscriber::Callback(const FileEventContextRef& ec,
   if (group_iter != yara_paths.MemberEnd()) {
     for (const auto& rule : group_iter->value.GetArray()) {
       std::string group = rule.GetString();
-      int result = yr_rules_scan_file(rules[group],
-                                      ec->path.c_str(),
-                                      SCAN_FLAGS_FAST_MODE,
-                                      YARACallback,
-                                      (void*)&r,
-                                      0);
-
-      if (result != ERROR_SUCCESS) {
-        return Status(1, "YARA error: " + std::to_string(result));
+      auto rules = yaraParser->getRules(group);
+      if (rules != nullptr) {
+        groups.emplace_back(group, std::move(rules));
+      }
+    }
+  }
+
+  if (FLAGS_yara_events_async) {
+    // The publisher thread only queues the scan, a full queue drops it.
+    YARAScanJob job;
+    job.path = ec->path;
+    job.groups = std::move(groups);
+    job.row = std::move(r);
+    job.done = [this](const Status& status, Row& row) {
+      if (status.ok() && !row.at("matches").empty()) {
+        add(row);
       }
+    };
+    if (!YARAScanner::get().submit(std::move(job), false)) {
+      return Status(1, "YARA scan queue is full");
     }
+    return Status::success();
+  }
+
+  auto status = YARAScanner::get().scanFile(ec->path, groups, r);
+  if (!status.ok()) {
+    return status;
   }
 
   if (ec->action != "" && !r.at("matches").empty()) {
@@ -0,0 +1,260 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include <algorithm>
+
+#include <sys/stat.h>
+
+#include <osquery/flags.h>
+#include <osquery/logger.h>
+#include <osquery/tables/yara/yara_scanner.h>
+#include <osquery/utils/conversions/tryto.h>
+
+namespace osquery {
+
+FLAG(uint32,
+     yara_scan_threads,
+     4,
+     "Number of threads used to scan files with YARA");
+
+FLAG(uint64,
+     yara_max_file_size,
+     0,
+     "Skip YARA scans of files larger than this many bytes (0 for no limit)");
+
+FLAG(uint32,
+     yara_cache_size,
+     8192,
+     "Number of YARA scan results cached by file inode and mtime (0 to "
+     "disable)");
+
+HIDDEN_FLAG(uint32,
+            yara_scan_queue_size,
+            1024,
+            "Maximum number of files waiting for a YARA scan");
+
+/// YARA limits the number of threads scanning with the same rules.
+const size_t kMaxYARAScanThreads = 16;
+
+/// Append a comma-separated list of values.
+static void appendList(std::string& list, const std::string& values) {
+  if (values.empty()) {
+    return;
+  }
+  if (!list.empty()) {
+    list += ',';
+  }
+  list += values;
+}
+
+/// Add the matches of one signature group to the row.
+static void mergeResult(Row& row, const Row& result) {
+  auto count = tryTo<int>(row["count"]).takeOr(0);
+  row["count"] = INTEGER(count + tryTo<int>(result.at("count")).takeOr(0));
+  appendList(row["matches"], result.at("matches"));
+  appendList(row["strings"], result.at("strings"));
+  appendList(row["tags"], result.at("tags"));
+}
+
+/**
+ * @brief The cache key identifies a version of a file and the signature group.
+ *
+ * The ctime is included because the mtime may be set back by the writer,
+ * but any write or utimes call moves the ctime forward.
+ */
+static std::string cacheKey(const struct stat& st, const std::string& group) {
+#ifdef __APPLE__
+  auto mtime_ns = st.st_mtimespec.tv_nsec;
+  auto ctime_ns = st.st_ctimespec.tv_nsec;
+#else
+  auto mtime_ns = st.st_mtim.tv_nsec;
+  auto ctime_ns = st.st_ctim.tv_nsec;
+#endif
+  return std::to_string(st.st_dev) + ':' + std::to_string(st.st_ino) + ':' +
+         std::to_string(st.st_mtime) + '.' + std::to_string(mtime_ns) + ':' +
+         std::to_string(st.st_ctime) + '.' + std::to_string(ctime_ns) + ':' +
+         std::to_string(st.st_size) + ':' + group;
+}
+
+YARAScanner& YARAScanner::get() {
+  static YARAScanner scanner;
+  return scanner;
+}
+
+YARAScanner::~YARAScanner() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    stopping_ = true;
+    // Jobs still queued are dropped, their callbacks may refer to plugins
+    // that were already torn down.
+    queue_.clear();
+  }
+  queued_.notify_all();
+  dequeued_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+Status YARAScanner::scanFile(const std::string& path,
+                             const YARAGroups& groups,
+                             Row& row) {
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0) {
+    return Status::failure("Cannot stat " + path);
+  }
+
+  if (FLAGS_yara_max_file_size > 0 &&
+      static_cast<uint64_t>(st.st_size) > FLAGS_yara_max_file_size) {
+    return Status::failure("File exceeds yara_max_file_size: " + path);
+  }
+
+  for (const auto& group : groups) {
+    const auto& rules = group.second;
+    auto key = cacheKey(st, group.first);
+    {
+      std::lock_guard<std::mutex> lock(cache_mutex_);
+      if (cache_ == nullptr && FLAGS_yara_cache_size > 0) {
+        cache_ = std::make_unique<caches::LRU<std::string, CachedResult>>(
+            FLAGS_yara_cache_size);
+      }
+
+      auto cached = (cache_ != nullptr) ? cache_->get(key) : nullptr;
+      // The result is stale once the group was recompiled.
+      if (cached != nullptr && !cached->rules.owner_before(rules) &&
+          !rules.owner_before(cached->rules)) {
+        mergeResult(row, cached->result);
+        continue;
+      }
+    }
+
+    Row result;
+    result["count"] = INTEGER(0);
+    result["matches"] = "";
+    result["strings"] = "";
+    result["tags"] = "";
+    int error = yr_rules_scan_file(rules.get(),
+                                   path.c_str(),
+                                   SCAN_FLAGS_FAST_MODE,
+                                   YARACallback,
+                                   static_cast<void*>(&result),
+                                   0);
+    if (error != ERROR_SUCCESS) {
+      return Status::failure("YARA error: " + std::to_string(error));
+    }
+
+    mergeResult(row, result);
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    if (cache_ != nullptr) {
+      cache_->insert(key, CachedResult{rules, std::move(result)});
+    }
+  }
+  return Status::success();
+}
+
+void YARAScanner::start() {
+  if (!threads_.empty()) {
+    return;
+  }
+
+  auto count = std::max<size_t>(
+      1, std::min<size_t>(FLAGS_yara_scan_threads, kMaxYARAScanThreads));
+  for (size_t i = 0; i < count; i++) {
+    threads_.emplace_back(&YARAScanner::work, this);
+  }
+}
+
+bool YARAScanner::submit(YARAScanJob job, bool block) {
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  start();
+
+  auto full = [this]() {
+    return queue_.size() >= std::max<size_t>(1, FLAGS_yara_scan_queue_size);
+  };
+  if (full()) {
+    if (!block) {
+      return false;
+    }
+    dequeued_.wait(lock, [this, &full]() { return stopping_ || !full(); });
+  }
+  if (stopping_) {
+    return false;
+  }
+
+  queue_.push_back(std::move(job));
+  lock.unlock();
+  queued_.notify_one();
+  return true;
+}
+
+void YARAScanner::scanAll(std::vector<YARAScanJob>& jobs) {
+  std::mutex mutex;
+  std::condition_variable finished;
+  size_t remaining = 0;
+
+  for (auto& job : jobs) {
+    auto done = std::move(job.done);
+    job.done = [&mutex, &finished, &remaining, done](const Status& status,
+                                                     Row& row) {
+      if (done != nullptr) {
+        done(status, row);
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--remaining == 0) {
+        finished.notify_one();
+      }
+    };
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      remaining++;
+    }
+    if (!submit(std::move(job), true)) {
+      std::lock_guard<std::mutex> lock(mutex);
+      remaining--;
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [&remaining]() { return remaining == 0; });
+}
+
+size_t YARAScanner::cacheSize() {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  return (cache_ == nullptr) ? 0 : cache_->size();
+}
+
+void YARAScanner::work() {
+  while (true) {
+    YARAScanJob job;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      queued_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      if (stopping_) {
+        break;
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    dequeued_.notify_one();
+
+    auto status = scanFile(job.path, job.groups, job.row);
+    if (!status.ok()) {
+      VLOG(1) << "YARA scan of " << job.path
+              << " failed: " << status.getMessage();
+    }
+    if (job.done != nullptr) {
+      job.done(status, job.row);
+    }
+  }
+
+  // YARA keeps per-thread state for scans.
+  yr_finalize_thread();
+}
+
+} // namespace osquery
@@ -0,0 +1,119 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <osquery/tables.h>
+#include <osquery/tables/yara/yara_utils.h>
+#include <osquery/utils/caches/lru.h>
+
+namespace osquery {
+
+/// Signature groups to scan a file with, as (group name, rules) pairs.
+using YARAGroups = std::vector<std::pair<std::string, YARARulesRef>>;
+
+/// A file to scan with one or more signature groups.
+struct YARAScanJob {
+  /// The file to scan.
+  std::string path;
+
+  /// The signature groups, scanned in order.
+  YARAGroups groups;
+
+  /// Row completed with the count, matches, strings and tags of every group.
+  Row row;
+
+  /// Called on a scanner thread once the job completed or failed.
+  std::function<void(const Status& status, Row& row)> done;
+};
+
+/**
+ * @brief Scan files with YARA on a bounded pool of threads.
+ *
+ * Compiled rules are shared by every thread, YARA allows concurrent scans
+ * with the same YR_RULES. Results are cached per signature group by the
+ * device, inode, size and modification time of the file, so unchanged files
+ * are not scanned again until their rules are recompiled.
+ */
+class YARAScanner : private boost::noncopyable {
+ public:
+  /// The scanner used by the yara and yara_events tables.
+  static YARAScanner& get();
+
+  YARAScanner() = default;
+  ~YARAScanner();
+
+  /**
+   * @brief Scan a file on the calling thread.
+   *
+   * Files larger than --yara_max_file_size are skipped with a failed status.
+   */
+  Status scanFile(const std::string& path, const YARAGroups& groups, Row& row);
+
+  /**
+   * @brief Queue a job for the scanner threads.
+   *
+   * @param job the file and signature groups to scan.
+   * @param block wait for space in the queue when it is full.
+   * @return false if the job was dropped because the queue was full.
+   */
+  bool submit(YARAScanJob job, bool block);
+
+  /// Run the jobs on the scanner threads and wait for all of them.
+  void scanAll(std::vector<YARAScanJob>& jobs);
+
+  /// Number of cached scan results.
+  size_t cacheSize();
+
+ private:
+  /// Start the threads on first use.
+  void start();
+
+  /// Thread loop, runs queued jobs until the scanner is destroyed.
+  void work();
+
+  /// A cached scan result and the rules it was produced with.
+  struct CachedResult {
+    std::weak_ptr<YR_RULES> rules;
+    Row result;
+  };
+
+ private:
+  /// Protects the queue and thread state.
+  std::mutex queue_mutex_;
+
+  /// Signaled when a job is queued or the scanner stops.
+  std::condition_variable queued_;
+
+  /// Signaled when a job leaves the queue.
+  std::condition_variable dequeued_;
+
+  std::deque<YARAScanJob> queue_;
+  std::vector<std::thread> threads_;
+  bool stopping_{false};
+
+  /// Protects the result cache.
+  std::mutex cache_mutex_;
+
+  /// Created on first use, with --yara_cache_size entries.
+  std::unique_ptr<caches::LRU<std::string, CachedResult>> cache_;
+};
+
+} // namespace osquery
@@ -242,6 +242,18 @@ int YARACallback(int message, void* message_data, void* user_data) {
   return CALLBACK_CONTINUE;
 }
 
+YARARulesRef YARAConfigParserPlugin::getRules(const std::string& group) {
+  ReadLock lock(rules_mutex_);
+  auto it = rules_.find(group);
+  return (it != rules_.end()) ? it->second : nullptr;
+}
+
+void YARAConfigParserPlugin::setRules(const std::string& group,
+                                      YR_RULES* rules) {
+  WriteLock lock(rules_mutex_);
+  rules_[group] = YARARulesRef(rules, yr_rules_destroy);
+}
+
 Status YARAConfigParserPlugin::setUp() {
   auto obj = data_.getObject();
   data_.add("yara", obj);
@@ -283,11 +295,15 @@ Status YARAConfigParserPlugin::update(const std::string& source,
           VLOG(1) << "YARA signature group " << category << " must be an array";
         } else {
           VLOG(1) << "Compiling YARA signature group: " << category;
-          auto status = handleRuleFiles(category, element.value, rules_);
+          std::map<std::string, YR_RULES*> compiled;
+          auto status = handleRuleFiles(category, element.value, compiled);
           if (!status.ok()) {
             VLOG(1) << "YARA rule compile error: " << status.getMessage();
             return status;
           }
+          if (compiled.count(category) > 0) {
+            setRules(category, compiled[category]);
+          }
         }
       }
     }
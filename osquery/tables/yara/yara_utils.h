@@ -7,11 +7,14 @@
 
 #pragma once
 
+#include <memory>
+
 #include <boost/property_tree/ptree.hpp>
 
 #include <osquery/config/config.h>
 #include <osquery/tables.h>
 #include <osquery/utils/config/default_paths.h>
+#include <osquery/utils/mutex.h>
 
 #ifdef CONCAT
 #undef CONCAT
@@ -24,6 +27,9 @@ namespace osquery {
 
 const std::string kYARAHome{OSQUERY_HOME "yara/"};
 
+/// Compiled rules, destroyed once the last scan using them completes.
+using YARARulesRef = std::shared_ptr<YR_RULES>;
+
 void YARACompilerCallback(int error_level,
                           const char* file_name,
                           int line_number,
@@ -55,16 +61,20 @@ class YARAConfigParserPlugin : public ConfigParserPlugin {
     return {"yara"};
   }
 
-  // Retrieve compiled rules.
-  std::map<std::string, YR_RULES*>& rules() {
-    return rules_;
-  }
+  /// Retrieve the compiled rules of a group, nullptr if it is unknown.
+  YARARulesRef getRules(const std::string& group);
+
+  /// Store compiled rules for a group, replacing the previous rules.
+  void setRules(const std::string& group, YR_RULES* rules);
 
   Status setUp() override;
 
  private:
   // Store compiled rules in a map (group => rules).
-  std::map<std::string, YR_RULES*> rules_;
+  std::map<std::string, YARARulesRef> rules_;
+
+  /// Rules are replaced by config updates while scans run.
+  Mutex rules_mutex_;
 
   /// Store the signatures and file_paths and compile the rules.
   Status update(const std::string& source, const ParserConfig& config) override;
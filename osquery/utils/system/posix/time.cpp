@@ -9,6 +9,7 @@
 #include <osquery/utils/system/time.h>
 
 #include <string.h>
+#include <time.h>
 
 namespace osquery {
 
@@ -22,4 +23,12 @@ std::string platformAsctime(const struct tm* timeptr) {
   return ::asctime_r(timeptr, buffer);
 }
 
+uint64_t getThreadCPUTime() {
+  struct timespec ts;
+  if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 } // namespace osquery
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <ctime>
 #include <string>
 
@@ -32,6 +33,13 @@ size_t toUnixTime(const struct tm* tm_time);
  */
 size_t getUnixTime();
 
+/**
+ * @brief Getter for the CPU time used by the calling thread.
+ *
+ * @return user and system time in microseconds, 0 if it is not available
+ */
+uint64_t getThreadCPUTime();
+
 /**
  * @brief Converts a struct tm into a human-readable format. This expected the
  * struct tm to be already in UTC time/
@@ -13,6 +13,8 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <windows.h>
+
 #define MAX_BUFFER_SIZE 256
 
 namespace osquery {
@@ -31,4 +33,19 @@ std::string platformAsctime(const struct tm* timeptr) {
   return time_str;
 }
 
+uint64_t getThreadCPUTime() {
+  FILETIME creation, exit, kernel, user;
+  if (!::GetThreadTimes(
+          ::GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+    return 0;
+  }
+
+  // Thread times are in units of 100 nanoseconds.
+  ULARGE_INTEGER k, u;
+  k.HighPart = kernel.dwHighDateTime;
+  k.LowPart = kernel.dwLowDateTime;
+  u.HighPart = user.dwHighDateTime;
+  u.LowPart = user.dwLowDateTime;
+  return (k.QuadPart + u.QuadPart) / 10;
+}
 }
@@ -6,6 +6,10 @@
  *  the LICENSE file found in the root directory of this source tree.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <set>
+
 #include <plugins/config/parsers/decorators.h>
 #include <osquery/config/config.h>
 #include <osquery/flags.h>
@@ -23,6 +27,11 @@ FLAG(bool,
      false,
      "Add decorators as top level JSON objects");
 
+FLAG(uint64,
+     decorators_always_ttl,
+     0,
+     "Seconds to reuse 'always' decorator results (0 for each schedule step)");
+
 /// Statically define the parser name to avoid mistakes.
 const std::string kDecorationsName{"decorators"};
 
@@ -35,8 +44,27 @@ const std::map<DecorationPoint, std::string> kDecorationPointKeys = {
 using KeyValueMap = std::map<std::string, std::string>;
 using DecorationStore = std::map<std::string, KeyValueMap>;
 
+/// Tables with content that does not change while osquery runs.
+const std::set<std::string> kStaticDecoratorTables = {
+    "kernel_info",
+    "os_version",
+    "platform_info",
+    "system_info",
+};
+
 namespace {
 
+/// An 'always' decorator query and the schedule step it last ran.
+struct AlwaysDecorator {
+  std::string query;
+
+  /// Only static tables are read, the results are kept for the config.
+  bool is_static{false};
+
+  /// Schedule step of the last run, 0 if it did not run.
+  size_t step{0};
+};
+
 /**
  * @brief A simple ConfigParserPlugin for a "decorators" dictionary key.
  *
@@ -81,7 +109,7 @@ class DecoratorsConfigParserPlugin : public ConfigParserPlugin {
 
  public:
   /// Set of configuration sources to the set of decorator queries.
-  std::map<std::string, std::vector<std::string>> always_;
+  std::map<std::string, std::vector<AlwaysDecorator>> always_;
 
   /// Set of configuration sources to the set of on-load decorator queries.
   std::map<std::string, std::vector<std::string>> load_;
@@ -96,6 +124,9 @@ class DecoratorsConfigParserPlugin : public ConfigParserPlugin {
   /// Protect additions to the decorator set.
   static Mutex kDecorationsMutex;
 
+  /// The merged decorations of all sources, replaced when one changes.
+  static DecorationsRef kDecorationsSnapshot;
+
   /// Protect the configuration controlled content.
   static Mutex kDecorationsConfigMutex;
 };
@@ -103,6 +134,7 @@ class DecoratorsConfigParserPlugin : public ConfigParserPlugin {
 
 DecorationStore DecoratorsConfigParserPlugin::kDecorations;
 Mutex DecoratorsConfigParserPlugin::kDecorationsMutex;
+DecorationsRef DecoratorsConfigParserPlugin::kDecorationsSnapshot;
 Mutex DecoratorsConfigParserPlugin::kDecorationsConfigMutex;
 
 Status DecoratorsConfigParserPlugin::setUp() {
@@ -174,7 +206,10 @@ void DecoratorsConfigParserPlugin::updateDecorations(const std::string& source,
     if (always.IsArray()) {
       for (const auto& item : always.GetArray()) {
         if (item.IsString()) {
-          always_[source].push_back(item.GetString());
+          AlwaysDecorator decorator;
+          decorator.query = item.GetString();
+          decorator.is_static = isStaticDecorator(decorator.query);
+          always_[source].push_back(std::move(decorator));
         }
       }
     }
@@ -209,36 +244,91 @@ void DecoratorsConfigParserPlugin::updateDecorations(const std::string& source,
   }
 }
 
-inline void addDecoration(const std::string& source,
-                          const std::string& name,
-                          const std::string& value) {
+bool isStaticDecorator(const std::string& query) {
+  std::vector<std::string> tables;
+  if (!getQueryTables(query, tables).ok() || tables.empty()) {
+    return false;
+  }
+
+  return std::all_of(
+      tables.begin(), tables.end(), [](const std::string& table) {
+        return kStaticDecoratorTables.count(table) > 0;
+      });
+}
+
+/// Publish the decorations of all sources, kDecorationsMutex must be held.
+static void publishDecorations() {
+  auto decorations = std::make_shared<KeyValueMap>();
+  for (const auto& source : DecoratorsConfigParserPlugin::kDecorations) {
+    for (const auto& decoration : source.second) {
+      (*decorations)[decoration.first] = decoration.second;
+    }
+  }
+
+  DecorationsRef snapshot = std::move(decorations);
+  std::atomic_store(&DecoratorsConfigParserPlugin::kDecorationsSnapshot,
+                    snapshot);
+}
+
+/// Run a decorator query and add the columns of its first row.
+static bool runDecorator(const std::string& source, const std::string& query) {
+  SQL results(query);
+  if (results.rows().size() > 1) {
+    // Multiple rows exhibit undefined behavior.
+    LOG(WARNING) << "Multiple rows returned for decorator query: " << query;
+  }
+  if (results.rows().empty()) {
+    return false;
+  }
+
+  // Notice the warning above about undefined behavior when:
+  // 1: You include decorators that emit the same column name
+  // 2: You include a query that returns more than 1 row.
+  bool changed = false;
   WriteLock lock(DecoratorsConfigParserPlugin::kDecorationsMutex);
-  DecoratorsConfigParserPlugin::kDecorations[source][name] = value;
+  auto& decorations = DecoratorsConfigParserPlugin::kDecorations[source];
+  for (const auto& column : results.rows()[0]) {
+    auto& value = decorations[column.first];
+    if (value != column.second) {
+      value = column.second;
+      changed = true;
+    }
+  }
+  if (changed) {
+    publishDecorations();
+  }
+  return changed;
 }
 
 inline void runDecorators(const std::string& source,
                           const std::vector<std::string>& queries) {
   for (const auto& query : queries) {
-    SQL results(query);
-    if (results.rows().size() > 0) {
-      // Notice the warning above about undefined behavior when:
-      // 1: You include decorators that emit the same column name
-      // 2: You include a query that returns more than 1 row.
-      for (const auto& column : results.rows()[0]) {
-        addDecoration(source, column.first, column.second);
+    runDecorator(source, query);
+  }
+}
+
+/// Run the 'always' decorators that are not fresh for the schedule step.
+static void runAlwaysDecorators(const std::string& source,
+                                std::vector<AlwaysDecorator>& decorators,
+                                size_t step) {
+  auto ttl = std::max<size_t>(1, FLAGS_decorators_always_ttl);
+  for (auto& decorator : decorators) {
+    if (step > 0 && decorator.step > 0) {
+      if (decorator.is_static ||
+          (step >= decorator.step && step - decorator.step < ttl)) {
+        continue;
       }
     }
 
-    if (results.rows().size() > 1) {
-      // Multiple rows exhibit undefined behavior.
-      LOG(WARNING) << "Multiple rows returned for decorator query: " << query;
-    }
+    runDecorator(source, decorator.query);
+    decorator.step = step;
   }
 }
 
 void clearDecorations(const std::string& source) {
   WriteLock lock(DecoratorsConfigParserPlugin::kDecorationsMutex);
   DecoratorsConfigParserPlugin::kDecorations[source].clear();
+  publishDecorations();
 }
 
 void runDecorators(DecorationPoint point,
@@ -254,17 +344,22 @@ void runDecorators(DecorationPoint point,
     return;
   }
 
-  // Abstract the use of the decorator parser API.
-  ReadLock lock(DecoratorsConfigParserPlugin::kDecorationsConfigMutex);
   auto dp = std::dynamic_pointer_cast<DecoratorsConfigParserPlugin>(parser);
-  if (point == DECORATE_LOAD) {
-    for (const auto& target_source : dp->load_) {
+  if (point == DECORATE_ALWAYS) {
+    // The last run of each decorator is updated.
+    WriteLock lock(DecoratorsConfigParserPlugin::kDecorationsConfigMutex);
+    for (auto& target_source : dp->always_) {
       if (source.empty() || target_source.first == source) {
-        runDecorators(target_source.first, target_source.second);
+        runAlwaysDecorators(target_source.first, target_source.second, time);
       }
     }
-  } else if (point == DECORATE_ALWAYS) {
-    for (const auto& target_source : dp->always_) {
+    return;
+  }
+
+  // Abstract the use of the decorator parser API.
+  ReadLock lock(DecoratorsConfigParserPlugin::kDecorationsConfigMutex);
+  if (point == DECORATE_LOAD) {
+    for (const auto& target_source : dp->load_) {
       if (source.empty() || target_source.first == source) {
         runDecorators(target_source.first, target_source.second);
       }
@@ -282,17 +377,22 @@ void runDecorators(DecorationPoint point,
   }
 }
 
+DecorationsRef getDecorationsSnapshot() {
+  return std::atomic_load(&DecoratorsConfigParserPlugin::kDecorationsSnapshot);
+}
+
 void getDecorations(std::map<std::string, std::string>& results) {
   if (FLAGS_disable_decorators) {
     return;
   }
 
-  ReadLock lock(DecoratorsConfigParserPlugin::kDecorationsMutex);
   // Copy the decorations into the log_item.
-  for (const auto& source : DecoratorsConfigParserPlugin::kDecorations) {
-    for (const auto& decoration : source.second) {
-      results[decoration.first] = decoration.second;
-    }
+  auto snapshot = getDecorationsSnapshot();
+  if (snapshot == nullptr) {
+    return;
+  }
+  for (const auto& decoration : *snapshot) {
+    results[decoration.first] = decoration.second;
   }
 }
 
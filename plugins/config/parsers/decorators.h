@@ -10,6 +10,7 @@
 
 #include <map>
 #include <functional>
+#include <memory>
 
 #include <osquery/config/config.h>
 #include <osquery/database.h>
@@ -26,12 +27,21 @@ enum DecorationPoint {
 /// Define a map of decoration points to their expected configuration key.
 extern const std::map<DecorationPoint, std::string> kDecorationPointKeys;
 
+/// An immutable set of decoration column names and values.
+using DecorationsRef =
+    std::shared_ptr<const std::map<std::string, std::string>>;
+
 /**
  * @brief Iterate the discovered decorators for a given point type.
  *
  * The configuration maintains various sources, each may contain a set of
  * decorators. The source tracking is abstracted for the decorator iterator.
  *
+ * For DECORATE_ALWAYS the time is the schedule step. Each decorator then runs
+ * at most once per step, or once per `--decorators_always_ttl` seconds, and
+ * decorators reading only static tables run once per configuration. A time of
+ * 0 runs every decorator.
+ *
  * @param point request execution of decorators for this given point.
  * @param time an optional time for points using intervals.
  * @param source restrict run to a specific config source.
@@ -53,6 +63,16 @@ void runDecorators(DecorationPoint point,
  */
 void getDecorations(std::map<std::string, std::string>& results);
 
+/**
+ * @brief Access the current decorations without locking.
+ *
+ * A new snapshot is published whenever a decoration changes.
+ */
+DecorationsRef getDecorationsSnapshot();
+
+/// Check if a decorator query only reads tables that do not change.
+bool isStaticDecorator(const std::string& query);
+
 /// Clear decorations for a source when it updates.
 void clearDecorations(const std::string& source);
 }
@@ -22,6 +22,7 @@ DECLARE_bool(disable_decorators);
 DECLARE_bool(decorations_top_level);
 DECLARE_bool(disable_database);
 DECLARE_bool(log_numerics_as_numbers);
+DECLARE_uint64(decorators_always_ttl);
 
 class DecoratorsConfigParserPluginTests : public testing::Test {
  public:
@@ -117,6 +118,53 @@ TEST_F(DecoratorsConfigParserPluginTests, test_decorators_run_interval) {
   ASSERT_EQ(second_item.decorations.size(), 2U);
 }
 
+TEST_F(DecoratorsConfigParserPluginTests, test_decorators_run_always) {
+  // Prevent loads from executing.
+  FLAGS_disable_decorators = true;
+  Config::get().update(config_data_);
+
+  // Mimic the schedule's execution, the step is the schedule time.
+  FLAGS_disable_decorators = false;
+  runDecorators(DECORATE_ALWAYS, 100);
+
+  QueryLogItem item;
+  getDecorations(item.decorations);
+  EXPECT_EQ(item.decorations["always_test"], "test");
+
+  // The decorators run at most once within a schedule step.
+  clearDecorations("awesome");
+  runDecorators(DECORATE_ALWAYS, 100);
+  QueryLogItem same_step;
+  getDecorations(same_step.decorations);
+  EXPECT_EQ(same_step.decorations.count("always_test"), 0U);
+
+  runDecorators(DECORATE_ALWAYS, 101);
+  QueryLogItem next_step;
+  getDecorations(next_step.decorations);
+  EXPECT_EQ(next_step.decorations["always_test"], "test");
+
+  // The results may be reused for several steps.
+  FLAGS_decorators_always_ttl = 10;
+  clearDecorations("awesome");
+  runDecorators(DECORATE_ALWAYS, 105);
+  EXPECT_EQ(getDecorationsSnapshot()->count("always_test"), 0U);
+
+  runDecorators(DECORATE_ALWAYS, 111);
+  EXPECT_EQ(getDecorationsSnapshot()->count("always_test"), 1U);
+  FLAGS_decorators_always_ttl = 0;
+
+  // Without a step every decorator runs.
+  clearDecorations("awesome");
+  runDecorators(DECORATE_ALWAYS);
+  EXPECT_EQ(getDecorationsSnapshot()->count("always_test"), 1U);
+}
+
+TEST_F(DecoratorsConfigParserPluginTests, test_decorators_static) {
+  EXPECT_TRUE(isStaticDecorator("select uuid from system_info"));
+  EXPECT_FALSE(isStaticDecorator("select 1 as one from time"));
+  EXPECT_FALSE(isStaticDecorator("select 'test' as always_test"));
+}
+
 TEST_F(DecoratorsConfigParserPluginTests, test_decorators_run_load_top_level) {
   // Re-enable the decorators, then update the config.
   // The 'load' decorator set should run every time the config is updated.
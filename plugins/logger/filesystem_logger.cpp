@@ -9,9 +9,12 @@
 #include "filesystem_logger.h"
 
 #include <exception>
+#include <memory>
 
+#include <osquery/dispatcher.h>
 #include <osquery/flags.h>
 #include <osquery/logger.h>
+#include <osquery/logger/result_spool.h>
 #include <osquery/utils/config/default_paths.h>
 
 namespace fs = boost::filesystem;
@@ -33,8 +36,68 @@ FLAG_ALIAS(std::string, osquery_log_dir, logger_path);
 
 FLAG(int32, logger_mode, 0640, "Decimal mode for log files (default '0640')");
 
+FLAG(bool,
+     logger_spool,
+     false,
+     "Write results to a compressed columnar spool instead of JSON lines");
+
+FLAG(uint64,
+     logger_spool_block_rows,
+     1024,
+     "Rows of a query buffered into each result spool block");
+
+FLAG(uint64,
+     logger_spool_max_size,
+     25 * 1024 * 1024,
+     "Bytes before the result spool is rotated (0 never rotates)");
+
+FLAG(uint64,
+     logger_spool_flush_interval,
+     5,
+     "Seconds before buffered result spool rows are written. Shorter "
+     "intervals write smaller blocks that compress less, longer intervals "
+     "keep more results in memory where a crash loses them (0 waits for "
+     "full blocks)");
+
 const std::string kFilesystemLoggerFilename = "osqueryd.results.log";
 const std::string kFilesystemLoggerSnapshots = "osqueryd.snapshots.log";
+const std::string kFilesystemLoggerSpool = "osqueryd.results.spool";
+
+/// The result spool, shared with its flusher.
+struct FilesystemSpool {
+  Mutex mutex;
+
+  /// Reset when the plugin stops spooling, which also ends the flusher.
+  std::unique_ptr<ResultSpoolWriter> writer;
+};
+
+/// Writes the buffered spool rows of queries that rarely fill a block.
+class FilesystemSpoolFlusher : public InternalRunnable {
+ public:
+  explicit FilesystemSpoolFlusher(std::shared_ptr<FilesystemSpool> spool)
+      : InternalRunnable("FilesystemSpoolFlusher"), spool_(std::move(spool)) {}
+
+ protected:
+  void start() override {
+    std::chrono::seconds interval(FLAGS_logger_spool_flush_interval);
+    while (!interrupted()) {
+      pause(std::chrono::milliseconds(1000));
+
+      WriteLock lock(spool_->mutex);
+      if (spool_->writer == nullptr) {
+        break;
+      }
+      auto status = spool_->writer->flush(interval);
+      if (!status.ok()) {
+        LOG(WARNING) << "Cannot flush the result spool: "
+                     << status.getMessage();
+      }
+    }
+  }
+
+ private:
+  std::shared_ptr<FilesystemSpool> spool_;
+};
 
 Status FilesystemLoggerPlugin::setUp() {
   log_path_ = fs::path(FLAGS_logger_path);
@@ -43,11 +106,52 @@ Status FilesystemLoggerPlugin::setUp() {
   // Glog 0.3.4 does not support a logfile mode.
   // FLAGS_logfile_mode = FLAGS_logger_mode;
 
+  // Finish the spool of a previous setUp, and stop its flusher, before
+  // starting over.
+  if (spool_flusher_ != nullptr) {
+    spool_flusher_->interrupt();
+    spool_flusher_.reset();
+  }
+  // The spool is swapped atomically, logString may be reading it.
+  auto previous =
+      std::atomic_exchange(&spool_, std::shared_ptr<FilesystemSpool>());
+  if (previous != nullptr) {
+    WriteLock lock(previous->mutex);
+    auto status = previous->writer->rotate();
+    if (!status.ok()) {
+      LOG(WARNING) << "Cannot finish the result spool: "
+                   << status.getMessage();
+    }
+    previous->writer.reset();
+  }
+
+  if (FLAGS_logger_spool) {
+    auto spool = std::make_shared<FilesystemSpool>();
+    spool->writer = std::make_unique<ResultSpoolWriter>(
+        (log_path_ / kFilesystemLoggerSpool).string(),
+        FLAGS_logger_spool_block_rows,
+        FLAGS_logger_spool_max_size,
+        FLAGS_logger_mode);
+    std::atomic_store(&spool_, spool);
+    if (FLAGS_logger_spool_flush_interval > 0) {
+      spool_flusher_ = std::make_shared<FilesystemSpoolFlusher>(spool);
+      Dispatcher::addService(spool_flusher_);
+    }
+    return Status::success();
+  }
+
   // Ensure that we create the results log here.
   return logStringToFile("", kFilesystemLoggerFilename, true);
 }
 
 Status FilesystemLoggerPlugin::logString(const std::string& s) {
+  auto spool = std::atomic_load(&spool_);
+  if (spool != nullptr) {
+    WriteLock lock(spool->mutex);
+    if (spool->writer != nullptr) {
+      return spool->writer->add(s);
+    }
+  }
   return logStringToFile(s, kFilesystemLoggerFilename);
 }
 
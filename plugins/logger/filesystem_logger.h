@@ -9,6 +9,7 @@
  */
 
 #include <exception>
+#include <memory>
 
 #include <osquery/filesystem/filesystem.h>
 #include <osquery/registry_factory.h>
@@ -17,11 +18,14 @@
 
 namespace osquery {
 
+class InternalRunnable;
+struct FilesystemSpool;
+
 class FilesystemLoggerPlugin : public LoggerPlugin {
  public:
   Status setUp() override;
 
-  /// Log results (differential) to a distinct path.
+  /// Log results (differential) to a distinct path, or the result spool.
   Status logString(const std::string& s) override;
 
   /// Log snapshot data to a distinct path.
@@ -53,6 +57,17 @@ class FilesystemLoggerPlugin : public LoggerPlugin {
   /// Filesystem writer mutex.
   Mutex mutex_;
 
+  /**
+   * @brief The result spool, if results are spooled instead of logged.
+   *
+   * Only accessed with std::atomic_load and std::atomic_store, setUp may
+   * replace it while results are logged.
+   */
+  std::shared_ptr<FilesystemSpool> spool_;
+
+  /// The service writing partial blocks of the spool.
+  std::shared_ptr<InternalRunnable> spool_flusher_;
+
   /*
  private:
   FRIEND_TEST(FilesystemLoggerTests, test_filesystem_init);
@@ -0,0 +1,19 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#include "null_logger.h"
+
+namespace osquery {
+
+Status NullLoggerPlugin::logString(const std::string& s) {
+  return Status::success();
+}
+
+void NullLoggerPlugin::init(const std::string& name,
+                            const std::vector<StatusLogLine>& log) {}
+} // namespace osquery
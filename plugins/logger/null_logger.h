@@ -0,0 +1,35 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <osquery/plugins/logger.h>
+#include <osquery/registry_factory.h>
+
+namespace osquery {
+
+/**
+ * @brief A logger that discards results.
+ *
+ * Query results are still serialized before they reach a logger, so the null
+ * logger measures the daemon's cost without the cost of a sink. Status logs
+ * are left to Glog.
+ */
+class NullLoggerPlugin : public LoggerPlugin {
+ protected:
+  Status logString(const std::string& s) override;
+
+  void init(const std::string& name,
+            const std::vector<StatusLogLine>& log) override;
+};
+
+REGISTER(NullLoggerPlugin, "logger", "null");
+} // namespace osquery
@@ -9,11 +9,13 @@
 #include <plugins/logger/filesystem_logger.h>
 
 #include <osquery/filesystem/filesystem.h>
+#include <osquery/logger/result_spool.h>
 #include <osquery/utils/conversions/split.h>
 #include <osquery/utils/info/platform_type.h>
 
 #include <osquery/data_logger.h>
 #include <osquery/database.h>
+#include <osquery/dispatcher.h>
 #include <osquery/registry_factory.h>
 #include <osquery/system.h>
 
@@ -21,8 +23,10 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace fs = boost::filesystem;
@@ -33,6 +37,9 @@ DECLARE_bool(disable_database);
 DECLARE_string(logger_path);
 DECLARE_bool(disable_logging);
 DECLARE_bool(log_numerics_as_numbers);
+DECLARE_bool(logger_spool);
+DECLARE_uint64(logger_spool_block_rows);
+DECLARE_uint64(logger_spool_flush_interval);
 
 class FilesystemLoggerTests : public testing::Test {
  public:
@@ -87,6 +94,91 @@ TEST_F(FilesystemLoggerTests, test_log_string) {
   EXPECT_EQ(content, "{\"json\": true}\n");
 }
 
+/// The spools rotated aside in the logger path.
+static std::vector<std::string> getRotatedSpools() {
+  std::vector<std::string> spools;
+  for (const auto& entry : fs::directory_iterator(FLAGS_logger_path)) {
+    auto name = entry.path().filename().string();
+    if (name.find("osqueryd.results.spool.") == 0) {
+      spools.push_back(entry.path().string());
+    }
+  }
+  return spools;
+}
+
+static size_t readSpoolLines(const std::string& path) {
+  size_t lines = 0;
+  auto status = readResultSpool(
+      path, "q", [&lines](const std::string&) { lines++; });
+  EXPECT_TRUE(status.ok()) << status.getMessage();
+  return lines;
+}
+
+TEST_F(FilesystemLoggerTests, test_log_spool) {
+  FLAGS_logger_spool = true;
+  FLAGS_logger_spool_block_rows = 2;
+  FLAGS_logger_spool_flush_interval = 0;
+  auto plugin = Registry::get().plugin("logger", "filesystem");
+  ASSERT_TRUE(plugin->setUp().ok());
+
+  std::string line = "{\"name\":\"q\",\"columns\":{\"a\":\"1\"}}";
+  EXPECT_TRUE(logString(line, "event"));
+  EXPECT_TRUE(logString(line, "event"));
+  EXPECT_TRUE(logString(line, "event"));
+
+  // Setting up again finishes the spool, with the buffered row, and moves
+  // it aside.
+  FLAGS_logger_spool = false;
+  FLAGS_logger_spool_block_rows = 1024;
+  FLAGS_logger_spool_flush_interval = 5;
+  ASSERT_TRUE(plugin->setUp().ok());
+
+  std::string content;
+  EXPECT_TRUE(readFile(results_path_, content));
+  EXPECT_EQ(content, "");
+
+  auto spools = getRotatedSpools();
+  ASSERT_EQ(1U, spools.size());
+  EXPECT_EQ(3U, readSpoolLines(spools[0]));
+}
+
+TEST_F(FilesystemLoggerTests, test_log_spool_flusher) {
+  auto services = Dispatcher::instance().serviceCount();
+  FLAGS_logger_spool = true;
+  FLAGS_logger_spool_flush_interval = 1;
+  auto plugin = Registry::get().plugin("logger", "filesystem");
+  ASSERT_TRUE(plugin->setUp().ok());
+  EXPECT_EQ(services + 1, Dispatcher::instance().serviceCount());
+
+  // The flusher writes the partial block once it is a second old.
+  std::string line = "{\"name\":\"q\",\"columns\":{\"a\":\"1\"}}";
+  EXPECT_TRUE(logString(line, "event"));
+  auto spool_path = fs::path(FLAGS_logger_path) / "osqueryd.results.spool";
+  for (size_t i = 0; i < 50 && !fs::exists(spool_path); i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  ASSERT_TRUE(fs::exists(spool_path));
+  EXPECT_EQ(1U, readSpoolLines(spool_path.string()));
+
+  // Setting up again finishes the spool and replaces its flusher.
+  EXPECT_TRUE(logString(line, "event"));
+  ASSERT_TRUE(plugin->setUp().ok());
+  auto spools = getRotatedSpools();
+  ASSERT_EQ(1U, spools.size());
+  EXPECT_EQ(2U, readSpoolLines(spools[0]));
+
+  FLAGS_logger_spool = false;
+  FLAGS_logger_spool_flush_interval = 5;
+  ASSERT_TRUE(plugin->setUp().ok());
+  for (size_t i = 0; i < 50; i++) {
+    if (Dispatcher::instance().serviceCount() == services) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  EXPECT_EQ(services, Dispatcher::instance().serviceCount());
+}
+
 class FilesystemTestLoggerPlugin : public LoggerPlugin {
  public:
   Status logString(const std::string& s) override {
@@ -21,7 +21,8 @@ FLAG(string,
      numeric_monitoring_filesystem_path,
      OSQUERY_LOG_HOME "numeric_monitoring.log",
      "File to dump numeric monitoring records one per line. "
-     "The format of the line is <PATH><TAB><VALUE><TAB><TIMESTAMP>.");
+     "The format of the line is <PATH><TAB><VALUE><TAB><TIMESTAMP>"
+     "<TAB><SYNC>, histogram records append <TAB><HISTOGRAM>.");
 
 REGISTER(NumericMonitoringFilesystemPlugin,
          monitoring::registryName(),
@@ -56,6 +57,11 @@ Status NumericMonitoringFilesystemPlugin::formTheLine(
     }
     line.append(it->second).push_back(separator_);
   }
+  // histogram points carry their buckets in an optional last field
+  auto histogram = request.find(monitoring::recordKeys().histogram);
+  if (histogram != request.end()) {
+    line.append(histogram->second).push_back(separator_);
+  }
   // remove last separator
   line.pop_back();
   return Status();
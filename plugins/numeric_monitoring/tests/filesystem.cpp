@@ -95,4 +95,36 @@ TEST_F(NumericMonitoringFilesystemPluginTests, simple_workflow) {
   fs::remove(log_path);
 }
 
+TEST_F(NumericMonitoringFilesystemPluginTests, histogram_field) {
+  const auto log_path =
+      fs::temp_directory_path() /
+      fs::unique_path(
+          "osquery.numeric_monitoring_filesystem_plugin_test.%%%%-%%%%%%.log");
+  FLAGS_numeric_monitoring_filesystem_path = log_path.string();
+  {
+    NumericMonitoringFilesystemPlugin plugin{};
+    ASSERT_TRUE(plugin.setUp().ok());
+    const auto request = PluginRequest{
+        {monitoring::recordKeys().path, "query.time.wall.millis"},
+        {monitoring::recordKeys().value, "3"},
+        {monitoring::recordKeys().timestamp, "1051"},
+        {monitoring::recordKeys().sync, "false"},
+        {monitoring::recordKeys().histogram, "19;5;7;5:1,7:2"},
+    };
+    auto response = PluginResponse{};
+    EXPECT_TRUE(plugin.call(request, response).ok());
+
+    auto fin =
+        std::ifstream(log_path.native(), std::ios::in | std::ios::binary);
+    auto line = std::string{};
+    std::getline(fin, line);
+    auto fields = split(line, "\t");
+    ASSERT_EQ(5U, fields.size());
+    EXPECT_EQ("query.time.wall.millis", fields[0]);
+    EXPECT_EQ("3", fields[1]);
+    EXPECT_EQ("19;5;7;5:1,7:2", fields[4]);
+  }
+  fs::remove(log_path);
+}
+
 } // namespace osquery
@@ -43,6 +43,8 @@ TEST_F(osquerySchedule, test_sanity) {
   //      {"user_time", IntType}
   //      {"system_time", IntType}
   //      {"average_memory", IntType}
+  //      {"placement", IntType}
+  //      {"deferrals", IntType}
   //}
   // 4. Perform validation
   // validate_rows(data, row_map);
@@ -0,0 +1,57 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed in accordance with the terms specified in
+ *  the LICENSE file found in the root directory of this source tree.
+ */
+
+// Sanity check integration test for osquery_table_stats
+// Spec file: specs/utility/osquery_table_stats.table
+
+#include <osquery/tests/integration/tables/helper.h>
+
+namespace osquery {
+namespace table_tests {
+
+class osqueryTableStats : public testing::Test {
+ protected:
+  void SetUp() override {
+    setUpEnvironment();
+  }
+};
+
+TEST_F(osqueryTableStats, test_sanity) {
+  // Scan a table once without and once with a constraint.
+  execute_query("select * from time");
+  execute_query("select * from file where path = '/'");
+
+  auto const data = execute_query(
+      "select * from osquery_table_stats where name in ('time', 'file')");
+  ASSERT_GE(data.size(), 2ul);
+
+  ValidationMap row_map = {
+      {"name", NonEmptyString},
+      {"constraints", NormalType},
+      {"scans", NonNegativeInt},
+      {"cache_hits", NonNegativeInt},
+      {"wall_time", NonNegativeInt},
+      {"cpu_time", NonNegativeInt},
+      {"rows_generated", NonNegativeInt},
+      {"rows_consumed", NonNegativeInt},
+      {"allocated_bytes", NonNegativeInt},
+  };
+  validate_rows(data, row_map);
+
+  bool file_path_equals = false;
+  for (const auto& row : data) {
+    if (row.at("name") == "file" && row.at("constraints") == "path =") {
+      file_path_equals = true;
+      EXPECT_EQ(row.at("rows_generated"), "1");
+    }
+  }
+  EXPECT_TRUE(file_path_equals);
+}
+
+} // namespace table_tests
+} // namespace osquery
@@ -237,9 +237,9 @@ class TableState(Singleton):
         if "strongly_typed_rows" in self.attributes:
             self.strongly_typed_rows = True
         if "cacheable" in self.attributes:
-            if self.generator:
+            if "event_subscriber" in self.attributes:
                 print(lightred(
-                    "Table cannot use a generator and be marked cacheable: %s" % (path)))
+                    "Event subscriber table cannot be marked cacheable: %s" % (path)))
                 exit(1)
         if self.table_name == "" or self.function == "":
             print(lightred("Invalid table spec: %s" % (path)))